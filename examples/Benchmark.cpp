@@ -0,0 +1,549 @@
+// -----------------------------------------------------------------------------
+//           OpenMM(tm) benchmark program in C++
+// -----------------------------------------------------------------------------
+// This program measures simulation performance without needing the Python
+// application layer.  It is the C++ counterpart of benchmark.py, and is meant
+// for catching performance regressions between releases.
+//
+// The following workloads are built directly with the API:
+//
+//   argon     Lennard-Jones fluid with a periodic cutoff
+//   rf        TIP3P water box with reaction field
+//   pme       TIP3P water box with PME
+//   softcore  Lennard-Jones fluid computed with a soft core CustomNonbondedForce
+//   gbsa      charged Lennard-Jones cluster with OBC implicit solvent
+//
+// Other workloads (such as DHFR, a GBSA protein, or AMOEBA) can be loaded from
+// serialized XML files.  Create them from Python with XmlSerializer.serialize()
+// on the System, a State containing positions, and optionally the Integrator:
+//
+//   Benchmark --xml dhfr,dhfr_system.xml,dhfr_state.xml[,dhfr_integrator.xml]
+//
+// Every workload is run on each requested Platform.  On Platforms that support
+// a "Threads" property, it is run once for each entry in the thread sweep.
+// Results are written as JSON, reporting ns/day and the distribution of wall
+// clock times for individual steps.  The peak memory use is reported once for
+// the whole run, since the operating system only tracks the high-water mark of
+// the process.  To measure one configuration alone, run it by itself.
+//
+// Options:
+//   --workloads a,b,...   programmatic workloads to run (default: all of them)
+//   --xml name,system.xml,state.xml[,integrator.xml]
+//                         add a workload loaded from XML (may be repeated)
+//   --platforms a,b,...   Platforms to run on (default: Reference,CPU)
+//   --threads n,m,...     thread counts to sweep (default: the Platform default)
+//   --steps n             number of timed steps (default: 100)
+//   --warmup n            number of untimed steps before timing (default: 10)
+//   --output file         write the JSON to a file instead of stdout
+//   --plugins dir         directory to load plugins from
+// -----------------------------------------------------------------------------
+
+#include "OpenMM.h"
+#include "openmm/internal/timer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#ifdef _MSC_VER
+    #include <psapi.h>
+    #pragma comment(lib, "psapi.lib")
+#else
+    #include <sys/resource.h>
+#endif
+
+using namespace OpenMM;
+using namespace std;
+
+static const double PI = 3.14159265358979323846;
+
+/**
+ * This holds everything needed to create a Context for one workload.
+ */
+struct Workload {
+    Workload() : system(NULL), stepSize(0.002), minimize(true) {
+    }
+    string name;
+    System* system;
+    vector<Vec3> positions;
+    vector<Vec3> velocities;
+    Vec3 boxVectors[3];
+    double stepSize;
+    string integratorXml;
+    bool minimize;
+};
+
+/**
+ * The results of running one workload on one Platform with one thread count.
+ */
+struct Result {
+    string workload, platform, error;
+    int threads, numParticles, steps;
+    double stepSize, nsPerDay;
+    vector<double> stepTimes;
+};
+
+static vector<string> splitList(const string& list) {
+    vector<string> items;
+    stringstream stream(list);
+    string item;
+    while (getline(stream, item, ','))
+        if (item.size() > 0)
+            items.push_back(item);
+    return items;
+}
+
+static string readFile(const string& path) {
+    ifstream file(path.c_str());
+    if (!file.is_open())
+        throw OpenMMException("Failed to open file "+path);
+    stringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+}
+
+/**
+ * Get the peak resident memory of the process, in MB.  This is the maximum over the entire
+ * run so far, not just the most recent benchmark.
+ */
+static double getPeakMemoryMB() {
+#ifdef _MSC_VER
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return counters.PeakWorkingSetSize/(1024.0*1024.0);
+    return 0.0;
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss/(1024.0*1024.0); // Reported in bytes
+#else
+    return usage.ru_maxrss/1024.0; // Reported in kilobytes
+#endif
+#endif
+}
+
+/**
+ * A small deterministic random number generator, so every run builds exactly the same System.
+ */
+static double uniformRandom(unsigned int& state) {
+    state = 1664525*state+1013904223;
+    return (state>>8)/16777216.0;
+}
+
+static void setCubicBox(Workload& workload, double size) {
+    workload.boxVectors[0] = Vec3(size, 0, 0);
+    workload.boxVectors[1] = Vec3(0, size, 0);
+    workload.boxVectors[2] = Vec3(0, 0, size);
+    workload.system->setDefaultPeriodicBoxVectors(workload.boxVectors[0], workload.boxVectors[1], workload.boxVectors[2]);
+}
+
+/**
+ * Place particles on a slightly perturbed cubic lattice.
+ */
+static void createLattice(Workload& workload, int gridSize, double spacing, double mass) {
+    unsigned int random = 1;
+    for (int i = 0; i < gridSize; i++)
+        for (int j = 0; j < gridSize; j++)
+            for (int k = 0; k < gridSize; k++) {
+                workload.system->addParticle(mass);
+                Vec3 offset(uniformRandom(random)-0.5, uniformRandom(random)-0.5, uniformRandom(random)-0.5);
+                workload.positions.push_back(Vec3(i+0.5, j+0.5, k+0.5)*spacing + offset*(0.1*spacing));
+            }
+}
+
+static Workload createArgon() {
+    Workload workload;
+    workload.name = "argon";
+    workload.system = new System();
+    workload.stepSize = 0.005;
+    const int gridSize = 16;
+    const double spacing = 0.37;
+    createLattice(workload, gridSize, spacing, 39.95);
+    setCubicBox(workload, gridSize*spacing);
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(NonbondedForce::CutoffPeriodic);
+    nonbonded->setCutoffDistance(1.0);
+    for (int i = 0; i < workload.system->getNumParticles(); i++)
+        nonbonded->addParticle(0.0, 0.3350, 0.996);
+    workload.system->addForce(nonbonded);
+    return workload;
+}
+
+static Workload createSoftcore() {
+    Workload workload;
+    workload.name = "softcore";
+    workload.system = new System();
+    workload.stepSize = 0.005;
+    const int gridSize = 16;
+    const double spacing = 0.37;
+    createLattice(workload, gridSize, spacing, 39.95);
+    setCubicBox(workload, gridSize*spacing);
+    CustomNonbondedForce* nonbonded = new CustomNonbondedForce(
+            "4*epsilon*lambda*(1/s^2-1/s); s=alpha*(1-lambda)+(r/sigma)^6; sigma=0.5*(sigma1+sigma2); epsilon=sqrt(epsilon1*epsilon2)");
+    nonbonded->setNonbondedMethod(CustomNonbondedForce::CutoffPeriodic);
+    nonbonded->setCutoffDistance(1.0);
+    nonbonded->addGlobalParameter("lambda", 0.5);
+    nonbonded->addGlobalParameter("alpha", 0.5);
+    nonbonded->addPerParticleParameter("sigma");
+    nonbonded->addPerParticleParameter("epsilon");
+    vector<double> params(2);
+    for (int i = 0; i < workload.system->getNumParticles(); i++) {
+        params[0] = (i%2 == 0 ? 0.3350 : 0.3);
+        params[1] = (i%2 == 0 ? 0.996 : 0.5);
+        nonbonded->addParticle(params);
+    }
+    workload.system->addForce(nonbonded);
+    return workload;
+}
+
+static Workload createGBSA() {
+    Workload workload;
+    workload.name = "gbsa";
+    workload.system = new System();
+    const int gridSize = 13;
+    const double spacing = 0.4;
+    createLattice(workload, gridSize, spacing, 12.0);
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(NonbondedForce::CutoffNonPeriodic);
+    nonbonded->setCutoffDistance(2.0);
+    GBSAOBCForce* gbsa = new GBSAOBCForce();
+    gbsa->setNonbondedMethod(GBSAOBCForce::CutoffNonPeriodic);
+    gbsa->setCutoffDistance(2.0);
+    for (int i = 0; i < workload.system->getNumParticles(); i++) {
+        double charge = (i%2 == 0 ? 0.2 : -0.2);
+        nonbonded->addParticle(charge, 0.3, 0.5);
+        gbsa->addParticle(charge, 0.15, 0.8);
+    }
+    workload.system->addForce(nonbonded);
+    workload.system->addForce(gbsa);
+    return workload;
+}
+
+static Workload createWaterBox(const string& name, NonbondedForce::NonbondedMethod method, double cutoff) {
+    Workload workload;
+    workload.name = name;
+    workload.system = new System();
+    const int gridSize = 12;
+    const double spacing = 0.3104; // Gives a density of about 1 g/mL
+    const double bondLength = 0.09572;
+    const double angle = 104.52*PI/180.0;
+    const double hhDistance = 2*bondLength*sin(0.5*angle);
+    setCubicBox(workload, gridSize*spacing);
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(method);
+    nonbonded->setCutoffDistance(cutoff);
+    workload.system->addForce(nonbonded);
+    Vec3 hydrogen1(bondLength, 0, 0);
+    Vec3 hydrogen2(bondLength*cos(angle), bondLength*sin(angle), 0);
+    unsigned int random = 1;
+    for (int i = 0; i < gridSize; i++)
+        for (int j = 0; j < gridSize; j++)
+            for (int k = 0; k < gridSize; k++) {
+                int oxygen = workload.system->addParticle(15.999);
+                workload.system->addParticle(1.008);
+                workload.system->addParticle(1.008);
+                nonbonded->addParticle(-0.834, 0.315061, 0.636386);
+                nonbonded->addParticle(0.417, 1.0, 0.0);
+                nonbonded->addParticle(0.417, 1.0, 0.0);
+                nonbonded->addException(oxygen, oxygen+1, 0.0, 1.0, 0.0);
+                nonbonded->addException(oxygen, oxygen+2, 0.0, 1.0, 0.0);
+                nonbonded->addException(oxygen+1, oxygen+2, 0.0, 1.0, 0.0);
+                workload.system->addConstraint(oxygen, oxygen+1, bondLength);
+                workload.system->addConstraint(oxygen, oxygen+2, bondLength);
+                workload.system->addConstraint(oxygen+1, oxygen+2, hhDistance);
+
+                // Give each molecule a random orientation.
+
+                double a = 2*PI*uniformRandom(random), b = 2*PI*uniformRandom(random);
+                Vec3 axis1(cos(a), sin(a), 0);
+                Vec3 axis2 = Vec3(-sin(a), cos(a), 0)*cos(b) + Vec3(0, 0, 1)*sin(b);
+                Vec3 center = Vec3(i+0.5, j+0.5, k+0.5)*spacing;
+                workload.positions.push_back(center);
+                workload.positions.push_back(center + axis1*hydrogen1[0]);
+                workload.positions.push_back(center + axis1*hydrogen2[0] + axis2*hydrogen2[1]);
+            }
+    return workload;
+}
+
+static Workload createProgrammaticWorkload(const string& name) {
+    Workload workload;
+    if (name == "argon")
+        workload = createArgon();
+    else if (name == "rf")
+        workload = createWaterBox(name, NonbondedForce::CutoffPeriodic, 1.0);
+    else if (name == "pme")
+        workload = createWaterBox(name, NonbondedForce::PME, 0.9);
+    else if (name == "softcore")
+        workload = createSoftcore();
+    else if (name == "gbsa")
+        workload = createGBSA();
+    else
+        throw OpenMMException("Unknown workload: "+name);
+    workload.system->getDefaultPeriodicBoxVectors(workload.boxVectors[0], workload.boxVectors[1], workload.boxVectors[2]);
+    return workload;
+}
+
+static Workload loadXmlWorkload(const string& spec) {
+    vector<string> fields = splitList(spec);
+    if (fields.size() < 3 || fields.size() > 4)
+        throw OpenMMException("--xml must be name,system.xml,state.xml[,integrator.xml]");
+    Workload workload;
+    workload.name = fields[0];
+    workload.minimize = false;
+    stringstream systemXml(readFile(fields[1]));
+    workload.system = XmlSerializer::deserialize<System>(systemXml);
+    stringstream stateXml(readFile(fields[2]));
+    State* state = XmlSerializer::deserialize<State>(stateXml);
+    workload.positions = state->getPositions();
+    try {
+        workload.velocities = state->getVelocities();
+    }
+    catch (OpenMMException& ex) {
+        // The State did not include velocities.
+    }
+    state->getPeriodicBoxVectors(workload.boxVectors[0], workload.boxVectors[1], workload.boxVectors[2]);
+    delete state;
+    if (fields.size() == 4) {
+        workload.integratorXml = readFile(fields[3]);
+        stringstream integratorXml(workload.integratorXml);
+        Integrator* integrator = XmlSerializer::deserialize<Integrator>(integratorXml);
+        workload.stepSize = integrator->getStepSize();
+        delete integrator;
+    }
+    return workload;
+}
+
+static Integrator* createIntegrator(const Workload& workload) {
+    Integrator* integrator;
+    if (workload.integratorXml.size() > 0) {
+        stringstream xml(workload.integratorXml);
+        integrator = XmlSerializer::deserialize<Integrator>(xml);
+    }
+    else
+        integrator = new LangevinIntegrator(300.0, 1.0, workload.stepSize);
+    integrator->setConstraintTolerance(1e-5);
+    return integrator;
+}
+
+/**
+ * Relax the initial structure of a programmatically built workload, so it is stable when simulated.
+ */
+static void relaxWorkload(Workload& workload, Platform& platform) {
+    if (!workload.minimize)
+        return;
+    VerletIntegrator integrator(0.001);
+    Context context(*workload.system, integrator, platform);
+    context.setPositions(workload.positions);
+    LocalEnergyMinimizer::minimize(context, 10.0, 50);
+    workload.positions = context.getState(State::Positions).getPositions();
+}
+
+static Result runBenchmark(const Workload& workload, Platform& platform, int threads, int warmupSteps, int timedSteps) {
+    Result result;
+    result.workload = workload.name;
+    result.platform = platform.getName();
+    result.threads = threads;
+    result.numParticles = workload.system->getNumParticles();
+    result.stepSize = workload.stepSize;
+    result.steps = timedSteps;
+    result.nsPerDay = 0.0;
+    map<string, string> properties;
+    if (threads > 0) {
+        stringstream value;
+        value << threads;
+        properties["Threads"] = value.str();
+    }
+    Integrator* integrator = createIntegrator(workload);
+    try {
+        Context context(*workload.system, *integrator, platform, properties);
+        context.setPeriodicBoxVectors(workload.boxVectors[0], workload.boxVectors[1], workload.boxVectors[2]);
+        context.setPositions(workload.positions);
+        if (workload.velocities.size() > 0)
+            context.setVelocities(workload.velocities);
+        else
+            context.setVelocitiesToTemperature(300.0, 1);
+        integrator->step(warmupSteps);
+        context.getState(State::Energy);
+
+        // Time each step separately.
+
+        result.stepTimes.resize(timedSteps);
+        double startTime = getCurrentTime();
+        for (int i = 0; i < timedSteps; i++) {
+            double stepStart = getCurrentTime();
+            integrator->step(1);
+            result.stepTimes[i] = getCurrentTime()-stepStart;
+        }
+        context.getState(State::Energy);
+        double elapsed = getCurrentTime()-startTime;
+        if (elapsed > 0)
+            result.nsPerDay = 1e-3*workload.stepSize*timedSteps*86400.0/elapsed;
+        if (threads == 0)
+            stringstream(platform.getPropertyValue(context, "Threads")) >> result.threads;
+    }
+    catch (exception& ex) {
+        result.error = ex.what();
+    }
+    delete integrator;
+    return result;
+}
+
+static string escapeJson(const string& text) {
+    string result;
+    for (int i = 0; i < (int) text.size(); i++) {
+        char c = text[i];
+        if (c == '"' || c == '\\')
+            result += '\\';
+        if (c == '\n')
+            result += "\\n";
+        else if (c >= 0 && c < 32)
+            result += ' ';
+        else
+            result += c;
+    }
+    return result;
+}
+
+static double percentile(const vector<double>& sortedValues, double fraction) {
+    int index = (int) ceil(fraction*sortedValues.size())-1;
+    return sortedValues[max(0, min((int) sortedValues.size()-1, index))];
+}
+
+static void writeResults(const vector<Result>& results, ostream& out) {
+    out << "{\n";
+    out << "  \"openmmVersion\": \"" << escapeJson(Platform::getOpenMMVersion()) << "\",\n";
+    out << "  \"results\": [";
+    for (int i = 0; i < (int) results.size(); i++) {
+        const Result& r = results[i];
+        out << (i == 0 ? "\n" : ",\n");
+        out << "    {\n";
+        out << "      \"workload\": \"" << escapeJson(r.workload) << "\",\n";
+        out << "      \"platform\": \"" << escapeJson(r.platform) << "\",\n";
+        if (r.threads > 0)
+            out << "      \"threads\": " << r.threads << ",\n";
+        out << "      \"particles\": " << r.numParticles << ",\n";
+        out << "      \"stepSizePs\": " << r.stepSize << ",\n";
+        if (r.error.size() > 0) {
+            out << "      \"error\": \"" << escapeJson(r.error) << "\"\n";
+            out << "    }";
+            continue;
+        }
+        vector<double> times = r.stepTimes;
+        sort(times.begin(), times.end());
+        double sum = 0.0;
+        for (int j = 0; j < (int) times.size(); j++)
+            sum += times[j];
+        out << "      \"steps\": " << r.steps << ",\n";
+        out << "      \"nsPerDay\": " << r.nsPerDay << ",\n";
+        out << "      \"stepTimeMs\": {";
+        if (times.size() > 0) {
+            out << "\"mean\": " << 1000*sum/times.size();
+            out << ", \"min\": " << 1000*times[0];
+            out << ", \"p50\": " << 1000*percentile(times, 0.5);
+            out << ", \"p90\": " << 1000*percentile(times, 0.9);
+            out << ", \"p99\": " << 1000*percentile(times, 0.99);
+            out << ", \"max\": " << 1000*times[times.size()-1];
+        }
+        out << "}\n";
+        out << "    }";
+    }
+    out << "\n  ],\n";
+    out << "  \"peakMemoryMB\": " << getPeakMemoryMB() << "\n";
+    out << "}\n";
+}
+
+int main(int argc, char* argv[]) {
+    vector<string> workloadNames = splitList("argon,rf,pme,softcore,gbsa");
+    vector<string> xmlWorkloads;
+    vector<string> platformNames = splitList("Reference,CPU");
+    vector<int> threadCounts;
+    int timedSteps = 100, warmupSteps = 10;
+    string outputFile;
+    string pluginDir = Platform::getDefaultPluginsDirectory();
+    bool specifiedWorkloads = false;
+    for (int i = 1; i < argc; i++) {
+        string option = argv[i];
+        if (i+1 >= argc) {
+            cerr << "Missing value for option " << option << endl;
+            return 1;
+        }
+        string value = argv[++i];
+        if (option == "--workloads") {
+            workloadNames = splitList(value);
+            specifiedWorkloads = true;
+        }
+        else if (option == "--xml")
+            xmlWorkloads.push_back(value);
+        else if (option == "--platforms")
+            platformNames = splitList(value);
+        else if (option == "--threads") {
+            vector<string> counts = splitList(value);
+            for (int j = 0; j < (int) counts.size(); j++)
+                threadCounts.push_back(atoi(counts[j].c_str()));
+        }
+        else if (option == "--steps")
+            timedSteps = atoi(value.c_str());
+        else if (option == "--warmup")
+            warmupSteps = atoi(value.c_str());
+        else if (option == "--output")
+            outputFile = value;
+        else if (option == "--plugins")
+            pluginDir = value;
+        else {
+            cerr << "Unknown option " << option << endl;
+            return 1;
+        }
+    }
+    if (xmlWorkloads.size() > 0 && !specifiedWorkloads)
+        workloadNames.clear();
+    if (threadCounts.size() == 0)
+        threadCounts.push_back(0);
+    try {
+        Platform::loadPluginsFromDirectory(pluginDir);
+        vector<Platform*> platforms;
+        for (int i = 0; i < (int) platformNames.size(); i++)
+            platforms.push_back(&Platform::getPlatformByName(platformNames[i]));
+        vector<Workload> workloads;
+        for (int i = 0; i < (int) workloadNames.size(); i++)
+            workloads.push_back(createProgrammaticWorkload(workloadNames[i]));
+        for (int i = 0; i < (int) xmlWorkloads.size(); i++)
+            workloads.push_back(loadXmlWorkload(xmlWorkloads[i]));
+        vector<Result> results;
+        for (int i = 0; i < (int) workloads.size(); i++) {
+            Workload& workload = workloads[i];
+            if (platforms.size() > 0)
+                relaxWorkload(workload, *platforms[platforms.size()-1]);
+            for (int j = 0; j < (int) platforms.size(); j++) {
+                const vector<string>& names = platforms[j]->getPropertyNames();
+                bool threaded = (find(names.begin(), names.end(), "Threads") != names.end());
+                for (int k = 0; k < (int) threadCounts.size(); k++) {
+                    if (!threaded && k > 0)
+                        break;
+                    cerr << "Running " << workload.name << " on " << platforms[j]->getName();
+                    if (threaded && threadCounts[k] > 0)
+                        cerr << " with " << threadCounts[k] << " threads";
+                    cerr << endl;
+                    results.push_back(runBenchmark(workload, *platforms[j], threaded ? threadCounts[k] : -1, warmupSteps, timedSteps));
+                }
+            }
+            delete workload.system;
+        }
+        if (outputFile.size() > 0) {
+            ofstream out(outputFile.c_str());
+            writeResults(results, out);
+        }
+        else
+            writeResults(results, cout);
+    }
+    catch (exception& ex) {
+        cerr << "EXCEPTION: " << ex.what() << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -55,6 +55,11 @@ class ParsedExpression;
  * 
  * A CompiledExpression is created by calling createCompiledExpression() on a ParsedExpression.
  * 
+ * A single CompiledExpression can also evaluate several related expressions at once, such as an energy and its
+ * derivatives.  Any subexpression that appears in more than one of them is only computed once.  Create it by
+ * passing a list of ParsedExpressions to the constructor, then call evaluate() and retrieve the value of each
+ * expression with getOutput().
+ * 
  * WARNING: CompiledExpression is NOT thread safe.  You should never access a CompiledExpression from two threads at
  * the same time.
  */
@@ -62,6 +67,12 @@ class ParsedExpression;
 class LEPTON_EXPORT CompiledExpression {
 public:
     CompiledExpression();
+    /**
+     * Create a CompiledExpression that evaluates several expressions at once.
+     *
+     * @param expressions    the expressions to evaluate.  Output i is the value of expressions[i].
+     */
+    CompiledExpression(const std::vector<ParsedExpression>& expressions);
     CompiledExpression(const CompiledExpression& expression);
     ~CompiledExpression();
     CompiledExpression& operator=(const CompiledExpression& expression);
@@ -82,17 +93,32 @@ public:
     void setVariableLocations(std::map<std::string, double*>& variableLocations);
     /**
      * Evaluate the expression.  The values of all variables should have been set before calling this.
+     * If this object contains several expressions, all of them are evaluated and the value of the first
+     * one is returned.
      */
     double evaluate() const;
+    /**
+     * Get the number of expressions that are evaluated by evaluate().
+     */
+    int getNumOutputs() const;
+    /**
+     * Get the value of one of the expressions, as computed by the most recent call to evaluate().
+     *
+     * @param index    the index of the expression to get
+     */
+    double getOutput(int index) const;
 private:
     friend class ParsedExpression;
     CompiledExpression(const ParsedExpression& expression);
+    void compileExpressions(const std::vector<ParsedExpression>& expressions);
     void compileExpression(const ExpressionTreeNode& node, std::vector<std::pair<ExpressionTreeNode, int> >& temps);
     int findTempIndex(const ExpressionTreeNode& node, std::vector<std::pair<ExpressionTreeNode, int> >& temps);
     std::map<std::string, double*> variablePointers;
     std::vector<std::pair<double*, double*> > variablesToCopy;
     std::vector<std::vector<int> > arguments;
     std::vector<int> target;
+    std::vector<int> outputIndex;
+    mutable std::vector<double> outputs;
     std::vector<Operation*> operation;
     std::map<std::string, int> variableIndices;
     std::set<std::string> variableNames;
@@ -103,6 +129,7 @@ private:
 #ifdef LEPTON_USE_JIT
     void generateJitCode();
     void generateSingleArgCall(asmjit::X86Compiler& c, asmjit::X86XmmVar& dest, asmjit::X86XmmVar& arg, double (*function)(double));
+    bool generateUniformSplineCode(asmjit::X86Compiler& c, const Operation& op, asmjit::X86XmmVar& dest, asmjit::X86XmmVar& arg);
     std::vector<double> constants;
     asmjit::JitRuntime runtime;
 #endif
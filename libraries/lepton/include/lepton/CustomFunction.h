@@ -9,7 +9,7 @@
  * Biological Structures at Stanford, funded under the NIH Roadmap for        *
  * Medical Research, grant U54 GM072970. See https://simtk.org.               *
  *                                                                            *
- * Portions copyright (c) 2009 Stanford University and the Authors.           *
+ * Portions copyright (c) 2009-2016 Stanford University and the Authors.      *
  * Authors: Peter Eastman                                                     *
  * Contributors:                                                              *
  *                                                                            *
@@ -33,6 +33,7 @@
  * -------------------------------------------------------------------------- */
 
 #include "windowsIncludes.h"
+#include <vector>
 
 namespace Lepton {
 
@@ -72,6 +73,54 @@ public:
     virtual CustomFunction* clone() const = 0;
 };
 
+/**
+ * This is a CustomFunction of one variable that is a cubic polynomial on each interval of a uniform grid,
+ * and zero outside the grid.  Because the grid is uniform, the interval containing a point can be found
+ * directly without searching.  CompiledExpression recognizes functions of this type and evaluates them
+ * inline in its generated code, rather than through calls to evaluate() and evaluateDerivative().
+ *
+ * Subclasses call setCoefficients() to define the function, and must implement clone().
+ */
+
+class LEPTON_EXPORT UniformSplineFunction : public CustomFunction {
+public:
+    UniformSplineFunction();
+    int getNumArguments() const;
+    double evaluate(const double* arguments) const;
+    /**
+     * Evaluate the first derivative of the function.  Higher derivatives are not supported.
+     */
+    double evaluateDerivative(const double* arguments, const int* derivOrder) const;
+    /**
+     * Get the values {min, max, (number of intervals)/(max-min)} describing the grid.
+     */
+    const double* getGridParameters() const {
+        return gridParameters;
+    }
+    /**
+     * Get the table of coefficients for evaluating the function.  There are eight elements for each
+     * interval.  If u is the position within interval i scaled to go from 0 to 1, the value is
+     * c[8*i]+u*(c[8*i+1]+u*(c[8*i+2]+u*c[8*i+3])) and the derivative is c[8*i+4]+u*(c[8*i+5]+u*c[8*i+6]).
+     * One extra interval is added at the end so that evaluating exactly at max does not need a special case.
+     */
+    const std::vector<double>& getCoefficientTable() const {
+        return table;
+    }
+protected:
+    /**
+     * Define the function.
+     *
+     * @param min           the start of the grid
+     * @param max           the end of the grid
+     * @param coefficients  the polynomial coefficients on each interval.  Element 4*i+k is the coefficient of u^k
+     *                      on interval i, where u goes from 0 at the start of the interval to 1 at the end.
+     */
+    void setCoefficients(double min, double max, const std::vector<double>& coefficients);
+private:
+    double gridParameters[3];
+    std::vector<double> table;
+};
+
 } // namespace Lepton
 
 #endif /*LEPTON_CUSTOM_FUNCTION_H_*/
@@ -44,9 +44,26 @@ CompiledExpression::CompiledExpression() : jitCode(NULL) {
 }
 
 CompiledExpression::CompiledExpression(const ParsedExpression& expression) : jitCode(NULL) {
-    ParsedExpression expr = expression.optimize(); // Just in case it wasn't already optimized.
+    compileExpressions(vector<ParsedExpression>(1, expression));
+}
+
+CompiledExpression::CompiledExpression(const vector<ParsedExpression>& expressions) : jitCode(NULL) {
+    if (expressions.size() == 0)
+        throw Exception("CompiledExpression: No expressions specified");
+    compileExpressions(expressions);
+}
+
+void CompiledExpression::compileExpressions(const vector<ParsedExpression>& expressions) {
+    // All the expressions share a single list of temporaries, so identical subexpressions
+    // are only computed once.
+
     vector<pair<ExpressionTreeNode, int> > temps;
-    compileExpression(expr.getRootNode(), temps);
+    for (int i = 0; i < (int) expressions.size(); i++) {
+        ParsedExpression expr = expressions[i].optimize(); // Just in case it wasn't already optimized.
+        compileExpression(expr.getRootNode(), temps);
+        outputIndex.push_back(temps[findTempIndex(expr.getRootNode(), temps)].second);
+    }
+    outputs.resize(outputIndex.size());
     int maxArguments = 1;
     for (int i = 0; i < (int) operation.size(); i++)
         if (operation[i]->getNumArguments() > maxArguments)
@@ -70,6 +87,8 @@ CompiledExpression::CompiledExpression(const CompiledExpression& expression) : j
 CompiledExpression& CompiledExpression::operator=(const CompiledExpression& expression) {
     arguments = expression.arguments;
     target = expression.target;
+    outputIndex = expression.outputIndex;
+    outputs.resize(expression.outputs.size());
     variableIndices = expression.variableIndices;
     variableNames = expression.variableNames;
     workspace.resize(expression.workspace.size());
@@ -182,10 +201,20 @@ double CompiledExpression::evaluate() const {
             workspace[target[step]] = operation[step]->evaluate(&argValues[0], dummyVariables);
         }
     }
-    return workspace[workspace.size()-1];
+    for (int i = 0; i < (int) outputIndex.size(); i++)
+        outputs[i] = workspace[outputIndex[i]];
+    return outputs[0];
 #endif
 }
 
+int CompiledExpression::getNumOutputs() const {
+    return outputIndex.size();
+}
+
+double CompiledExpression::getOutput(int index) const {
+    return outputs[index];
+}
+
 #ifdef LEPTON_USE_JIT
 static double evaluateOperation(Operation* op, double* args) {
     map<string, double>* dummyVariables = NULL;
@@ -372,6 +401,10 @@ void CompiledExpression::generateJitCode() {
             case Operation::CEIL:
                 generateSingleArgCall(c, workspaceVar[target[step]], workspaceVar[args[0]], ceil);
                 break;
+            case Operation::CUSTOM:
+                if (generateUniformSplineCode(c, op, workspaceVar[target[step]], workspaceVar[args[0]]))
+                    break;
+                // Fall through to the general case.
             default:
                 // Just invoke evaluateOperation().
                 
@@ -385,11 +418,68 @@ void CompiledExpression::generateJitCode() {
                 call->setRet(0, workspaceVar[target[step]]);
         }
     }
-    c.ret(workspaceVar[workspace.size()-1]);
+
+    // Store the outputs.
+
+    X86GpVar outputsPointer(c);
+    c.mov(outputsPointer, imm_ptr(&outputs[0]));
+    for (int i = 0; i < (int) outputIndex.size(); i++)
+        c.movsd(x86::ptr(outputsPointer, 8*i, 0), workspaceVar[outputIndex[i]]);
+    c.ret(workspaceVar[outputIndex[0]]);
     c.endFunc();
     jitCode = c.make();
 }
 
+bool CompiledExpression::generateUniformSplineCode(X86Compiler& c, const Operation& op, X86XmmVar& dest, X86XmmVar& arg) {
+    const Operation::Custom& custom = dynamic_cast<const Operation::Custom&>(op);
+    const UniformSplineFunction* function = dynamic_cast<const UniformSplineFunction*>(&custom.getFunction());
+    if (function == NULL || custom.getDerivOrder()[0] > 1)
+        return false;
+    bool derivative = (custom.getDerivOrder()[0] == 1);
+    X86GpVar gridPointer(c);
+    c.mov(gridPointer, imm_ptr((void*) function->getGridParameters()));
+    
+    // Build a mask that is zero if the argument is outside the grid.
+    
+    X86XmmVar mask(c, kX86VarTypeXmmSd);
+    X86XmmVar upper(c, kX86VarTypeXmmSd);
+    c.movsd(mask, x86::ptr(gridPointer, 0, 0));
+    c.cmpsd(mask, arg, imm(2)); // Comparison mode is _CMP_LE_OS = 2
+    c.movsd(upper, arg);
+    c.cmpsd(upper, x86::ptr(gridPointer, 8, 0), imm(2));
+    c.andpd(mask, upper);
+    
+    // Find the interval containing the argument and the position within it.
+    
+    X86XmmVar t(c, kX86VarTypeXmmSd);
+    X86XmmVar u(c, kX86VarTypeXmmSd);
+    X86GpVar index(c);
+    c.movsd(t, arg);
+    c.maxsd(t, x86::ptr(gridPointer, 0, 0));
+    c.minsd(t, x86::ptr(gridPointer, 8, 0));
+    c.subsd(t, x86::ptr(gridPointer, 0, 0));
+    c.mulsd(t, x86::ptr(gridPointer, 16, 0));
+    c.cvttsd2si(index, t);
+    c.cvtsi2sd(u, index);
+    c.subsd(t, u);
+    c.shl(index, imm(6));
+    X86GpVar tablePointer(c);
+    c.mov(tablePointer, imm_ptr((void*) &function->getCoefficientTable()[0]));
+    c.add(tablePointer, index);
+    
+    // Evaluate the polynomial.
+    
+    int first = (derivative ? 4 : 0);
+    int last = (derivative ? 6 : 3);
+    c.movsd(dest, x86::ptr(tablePointer, 8*last, 0));
+    for (int i = last-1; i >= first; i--) {
+        c.mulsd(dest, t);
+        c.addsd(dest, x86::ptr(tablePointer, 8*i, 0));
+    }
+    c.andpd(dest, mask);
+    return true;
+}
+
 void CompiledExpression::generateSingleArgCall(X86Compiler& c, X86XmmVar& dest, X86XmmVar& arg, double (*function)(double)) {
     X86GpVar fn(c, kVarTypeIntPtr);
     c.mov(fn, imm_ptr((void*) function));
@@ -0,0 +1,95 @@
+/* -------------------------------------------------------------------------- *
+ *                                   Lepton                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the Lepton expression parser originating from              *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2016 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "lepton/CustomFunction.h"
+#include "lepton/Exception.h"
+
+using namespace Lepton;
+using namespace std;
+
+UniformSplineFunction::UniformSplineFunction() {
+    gridParameters[0] = gridParameters[1] = gridParameters[2] = 0.0;
+}
+
+int UniformSplineFunction::getNumArguments() const {
+    return 1;
+}
+
+void UniformSplineFunction::setCoefficients(double min, double max, const vector<double>& coefficients) {
+    int numIntervals = coefficients.size()/4;
+    if (numIntervals < 1 || (int) coefficients.size() != 4*numIntervals)
+        throw Exception("UniformSplineFunction: the number of coefficients must be a positive multiple of 4");
+    if (max <= min)
+        throw Exception("UniformSplineFunction: max must be greater than min");
+    gridParameters[0] = min;
+    gridParameters[1] = max;
+    gridParameters[2] = numIntervals/(max-min);
+    table.resize(8*(numIntervals+1), 0.0);
+    for (int i = 0; i < numIntervals; i++) {
+        const double* c = &coefficients[4*i];
+        double* t = &table[8*i];
+        for (int j = 0; j < 4; j++)
+            t[j] = c[j];
+        t[4] = c[1]*gridParameters[2];
+        t[5] = 2*c[2]*gridParameters[2];
+        t[6] = 3*c[3]*gridParameters[2];
+    }
+
+    // The extra interval holds the value and slope at max.
+
+    double* last = &table[8*(numIntervals-1)];
+    table[8*numIntervals] = last[0]+last[1]+last[2]+last[3];
+    table[8*numIntervals+4] = last[4]+last[5]+last[6];
+}
+
+double UniformSplineFunction::evaluate(const double* arguments) const {
+    double x = arguments[0];
+    if (x < gridParameters[0] || x > gridParameters[1])
+        return 0.0;
+    double t = (x-gridParameters[0])*gridParameters[2];
+    int index = (int) t;
+    double u = t-index;
+    const double* c = &table[8*index];
+    return c[0]+u*(c[1]+u*(c[2]+u*c[3]));
+}
+
+double UniformSplineFunction::evaluateDerivative(const double* arguments, const int* derivOrder) const {
+    if (derivOrder[0] != 1)
+        throw Exception("UniformSplineFunction: Unsupported derivative order");
+    double x = arguments[0];
+    if (x < gridParameters[0] || x > gridParameters[1])
+        return 0.0;
+    double t = (x-gridParameters[0])*gridParameters[2];
+    int index = (int) t;
+    double u = t-index;
+    const double* c = &table[8*index];
+    return c[4]+u*(c[5]+u*c[6]);
+}
@@ -68,6 +68,8 @@
 
 namespace OpenMM {
 
+class Profiler;
+
 /**
  * This kernel is invoked at the beginning and end of force and energy computations.  It gives the
  * Platform a chance to clear buffers and do other initialization at the beginning, and to do any
@@ -143,6 +145,15 @@ public:
      * @param time       the time
      */
     virtual void setTime(ContextImpl& context, double time) = 0;
+    /**
+     * Get the number of integration steps that have been taken.  The default implementation
+     * returns 0.  Platforms that keep track of the step count should override it.
+     *
+     * @param context    the context in which to execute this kernel
+     */
+    virtual int getStepCount(const ContextImpl& context) const {
+        return 0;
+    }
     /**
      * Get the positions of all particles.
      *
@@ -587,6 +598,20 @@ public:
      * @param force      the NonbondedForce to copy the parameters from
      */
     virtual void copyParametersToContext(ContextImpl& context, const NonbondedForce& force) = 0;
+    /**
+     * Copy the parameters of selected particles and exceptions over to a context.  The default
+     * implementation simply copies all parameters.  Platforms can override it to make the cost
+     * proportional to the number of changes.
+     *
+     * @param context    the context to copy parameters to
+     * @param force      the NonbondedForce to copy the parameters from
+     * @param particles  the indices of the particles whose parameters have changed
+     * @param exceptions the indices of the exceptions whose parameters have changed
+     */
+    virtual void copyParameterSubsetToContext(ContextImpl& context, const NonbondedForce& force, const std::vector<int>& particles,
+            const std::vector<int>& exceptions) {
+        copyParametersToContext(context, force);
+    }
     /**
      * Get the parameters being used for PME.
      * 
@@ -636,6 +661,18 @@ public:
      * @param force      the CustomNonbondedForce to copy the parameters from
      */
     virtual void copyParametersToContext(ContextImpl& context, const CustomNonbondedForce& force) = 0;
+    /**
+     * Copy the parameters of selected particles over to a context.  The default implementation
+     * simply copies all parameters.  Platforms can override it to make the cost proportional to
+     * the number of changes.
+     *
+     * @param context    the context to copy parameters to
+     * @param force      the CustomNonbondedForce to copy the parameters from
+     * @param particles  the indices of the particles whose parameters have changed
+     */
+    virtual void copyParameterSubsetToContext(ContextImpl& context, const CustomNonbondedForce& force, const std::vector<int>& particles) {
+        copyParametersToContext(context, force);
+    }
 };
 
 /**
@@ -1277,6 +1314,15 @@ public:
     }
     CalcPmeReciprocalForceKernel(std::string name, const Platform& platform) : KernelImpl(name, platform) {
     }
+    /**
+     * Set the number of threads the kernel should use.  This must be called before initialize().
+     * If it is not called, the kernel chooses for itself.  Implementations that do not use
+     * multiple threads may ignore it.
+     *
+     * @param numThreads   the number of threads to use
+     */
+    virtual void setNumThreads(int numThreads) {
+    }
     /**
      * Initialize the kernel.
      * 
@@ -1332,6 +1378,13 @@ public:
      *                 should be ignored.
      */
     virtual void setForce(float* force) = 0;
+    /**
+     * Get the Profiler in which the kernel should record the times for each phase of the
+     * calculation, or NULL if it should not record them.
+     */
+    virtual Profiler* getProfiler() {
+        return NULL;
+    }
 };
 
 
@@ -44,6 +44,7 @@
 
 namespace OpenMM {
 
+class ContextGroup;
 class ContextImpl;
 class Vec3;
 class Platform;
@@ -66,6 +67,22 @@ class Platform;
 
 class OPENMM_EXPORT Context {
 public:
+    /**
+     * This is an enumeration of options that can be passed to createCheckpointAsync().
+     */
+    enum CheckpointOptions {
+        /**
+         * Compress the checkpoint before writing it.
+         */
+        CompressCheckpoint = 1,
+        /**
+         * Write a compressed checkpoint that records only what has changed since the last full
+         * checkpoint written by createCheckpointAsync().  Loading it requires that full checkpoint
+         * as well.  If there is no earlier full checkpoint, or its size differs from the new one, a full
+         * compressed checkpoint is written instead.  createCheckpointAsync() reports which one was written.
+         */
+        DeltaCheckpoint = 2
+    };
     /**
      * Construct a new Context in which to run a simulation.
      * 
@@ -253,6 +270,38 @@ public:
      * @param stream    an input stream the checkpoint data should be read from
      */
     void loadCheckpoint(std::istream& stream);
+    /**
+     * Create a checkpoint recording the current state of the Context, and write it to a stream
+     * on a background thread.  The state is copied into memory before this method returns, so the
+     * simulation may continue immediately while the data is written.  Checkpoints written without
+     * the DeltaCheckpoint option are full checkpoints that can be loaded with loadCheckpoint(std::istream&).
+     *
+     * The stream must remain valid until the write has finished.  Call waitForCheckpoint() to wait
+     * for that.  Calling this method again also waits for the previous checkpoint to be written.
+     *
+     * When DeltaCheckpoint is requested but there is no earlier full checkpoint, or its size differs
+     * from the new checkpoint (for example because the number of particles changed), a full compressed
+     * checkpoint is written instead.  It then becomes the base for later delta checkpoints, so any
+     * previous full checkpoint can no longer be used to load them.
+     *
+     * @param stream    an output stream the checkpoint data should be written to
+     * @param options   a combination of values from the CheckpointOptions enumeration
+     * @return true if a delta checkpoint is being written, or false if a full checkpoint is being written
+     */
+    bool createCheckpointAsync(std::ostream& stream, int options=0);
+    /**
+     * Wait until the checkpoint most recently started by createCheckpointAsync() has been completely
+     * written.  If an error occurred while writing it, this throws an exception.
+     */
+    void waitForCheckpoint();
+    /**
+     * Load a delta checkpoint that was written by createCheckpointAsync() with the DeltaCheckpoint option.
+     *
+     * @param stream          an input stream the delta checkpoint should be read from
+     * @param fullCheckpoint  an input stream containing the full checkpoint the delta checkpoint was
+     *                        created relative to
+     */
+    void loadCheckpoint(std::istream& stream, std::istream& fullCheckpoint);
     /**
      * Get a description of how the particles in the system are grouped into molecules.  Two particles are in the
      * same molecule if they are connected by constraints or bonds, where every Force object can define bonds
@@ -262,13 +311,50 @@ public:
      * belong to exactly one molecule.
      */
     const std::vector<std::vector<int> >& getMolecules() const;
+    /**
+     * Set whether to record profiling information.  When profiling is enabled, the Context records the
+     * time spent computing each Force and applying constraints, along with any further information the
+     * Platform provides, such as the times for the phases of PME, the number of neighbor list builds, and
+     * how long threads spend waiting for each other.  Profiling is disabled by default, since it adds a
+     * small amount of overhead.
+     *
+     * Times are measured on the host.  They are only meaningful for Platforms that do their computations
+     * synchronously, such as Reference and CPU.
+     */
+    void setProfilingEnabled(bool enabled);
+    /**
+     * Get whether profiling information is being recorded.
+     */
+    bool getProfilingEnabled() const;
+    /**
+     * Get the profiling information recorded since profiling was enabled or resetProfilingData() was last
+     * called.  Each timer maps to the total time it recorded, measured in seconds.  Each counter maps
+     * to the number of events it recorded.
+     */
+    std::map<std::string, double> getProfilingData() const;
+    /**
+     * Get the profiling information as a JSON object.  In addition to what is returned by getProfilingData(),
+     * this includes the number of times each timer was invoked.
+     */
+    std::string getProfilingDataAsJson() const;
+    /**
+     * Discard all profiling information recorded so far.
+     */
+    void resetProfilingData();
 private:
+    friend class ContextGroup;
     friend class Force;
     friend class Platform;
+    friend class TrajectoryWriter;
+    /**
+     * Construct a Context that belongs to a ContextGroup.  This is called by ContextGroup::addContext().
+     */
+    Context(const System& system, Integrator& integrator, ContextGroup& group);
     ContextImpl& getImpl();
     const ContextImpl& getImpl() const;
     ContextImpl* impl;
     std::map<std::string, std::string> properties;
+    ContextGroup* group;
 };
 
 } // namespace OpenMM
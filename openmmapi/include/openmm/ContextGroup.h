@@ -0,0 +1,146 @@
+#ifndef OPENMM_CONTEXTGROUP_H_
+#define OPENMM_CONTEXTGROUP_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2016 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "Context.h"
+#include <map>
+#include <string>
+#include <vector>
+
+namespace OpenMM {
+
+/**
+ * A ContextGroup manages a set of Contexts that all simulate the same System on the same Platform,
+ * such as the replicas in a replica exchange simulation.  The Contexts may share data that depends
+ * only on the System and does not change during a simulation.  Depending on the Platform, this may
+ * include things like exclusion lists, work buffers, and the pool of threads used for computation.
+ * Only per-replica state, such as positions, velocities, and parameters, is stored separately for
+ * each Context.  This can greatly reduce memory use and avoids creating far more threads than there
+ * are processors.
+ *
+ * Call addContext() to create each Context in the group.  The ContextGroup owns them, and deletes
+ * them when it is deleted.  Because the Contexts may share resources, only one of them may be used
+ * at a time.  You must not access two Contexts in the same group from different threads at once.
+ *
+ * step() provides a simple scheduler for advancing all the Contexts together.  It takes turns
+ * between them, integrating each one for a fixed number of steps on every turn.
+ */
+
+class OPENMM_EXPORT ContextGroup {
+public:
+    /**
+     * Create a ContextGroup.
+     *
+     * @param system      the System which will be simulated.  It must not be modified or deleted while
+     *                    the ContextGroup exists.
+     * @param platform    the Platform to use for calculations
+     */
+    ContextGroup(const System& system, Platform& platform);
+    /**
+     * Create a ContextGroup.
+     *
+     * @param system      the System which will be simulated.  It must not be modified or deleted while
+     *                    the ContextGroup exists.
+     * @param platform    the Platform to use for calculations
+     * @param properties  a set of values for platform-specific properties, which are used for every
+     *                    Context in the group.  Keys are the property names.
+     */
+    ContextGroup(const System& system, Platform& platform, const std::map<std::string, std::string>& properties);
+    ~ContextGroup();
+    /**
+     * Get the System being simulated by the Contexts in this group.
+     */
+    const System& getSystem() const {
+        return system;
+    }
+    /**
+     * Get the Platform used by the Contexts in this group.
+     */
+    Platform& getPlatform() {
+        return platform;
+    }
+    /**
+     * Get the platform-specific properties used for every Context in this group.
+     */
+    const std::map<std::string, std::string>& getProperties() const {
+        return properties;
+    }
+    /**
+     * Create a new Context and add it to the group.
+     *
+     * @param integrator  the Integrator which will be used to simulate the Context.  It must not
+     *                    be used by any other Context.
+     * @return the newly created Context
+     */
+    Context& addContext(Integrator& integrator);
+    /**
+     * Get the number of Contexts in the group.
+     */
+    int getNumContexts() const {
+        return contexts.size();
+    }
+    /**
+     * Get a Context in the group.
+     *
+     * @param index    the index of the Context to get
+     */
+    Context& getContext(int index);
+    /**
+     * Get the number of steps step() integrates each Context for on each turn.
+     */
+    int getStepsPerTurn() const {
+        return stepsPerTurn;
+    }
+    /**
+     * Set the number of steps step() integrates each Context for on each turn.  The default value is 10.
+     */
+    void setStepsPerTurn(int steps);
+    /**
+     * Advance every Context in the group by a number of time steps.  The Contexts take turns, each one being
+     * integrated for getStepsPerTurn() steps at a time, until all of them have been advanced by the
+     * requested number of steps.
+     *
+     * @param steps    the number of time steps each Context should be advanced by
+     */
+    void step(int steps);
+private:
+    const System& system;
+    Platform& platform;
+    std::map<std::string, std::string> properties;
+    std::vector<Context*> contexts;
+    int stepsPerTurn;
+};
+
+} // namespace OpenMM
+
+#endif /*OPENMM_CONTEXTGROUP_H_*/
@@ -118,6 +118,9 @@ namespace OpenMM {
  * at the start of the simulation.  Furthermore, that precomputation must be repeated every time a global parameter changes
  * (or when you modify per-particle parameters by calling updateParametersInContext()).  This means that if parameters change
  * frequently, the long range correction can be very slow.  For this reason, it is disabled by default.
+ * If a single global parameter changes frequently (for example, an alchemical coupling parameter), you can
+ * call setLongRangeCorrectionTable() to avoid most of this cost.  The correction is then computed once at
+ * a set of points spanning the range of values the parameter will take, and interpolated between them.
  * 
  * This class also has the ability to compute derivatives of the potential energy with respect to global parameters.
  * Call addEnergyParameterDerivative() to request that the derivative with respect to a particular parameter be
@@ -275,6 +278,31 @@ public:
      * This has no effect if periodic boundary conditions are not used.
      */
     void setUseLongRangeCorrection(bool use);
+    /**
+     * Get the parameters of the table used to interpolate the long range correction.
+     *
+     * @param[out] parameter   the name of the global parameter the correction is tabulated as a function of.  If this
+     *                         is an empty string, the correction is computed directly rather than interpolated.
+     * @param[out] minValue    the smallest value of the parameter in the table
+     * @param[out] maxValue    the largest value of the parameter in the table
+     * @param[out] numPoints   the number of evenly spaced points in the table
+     */
+    void getLongRangeCorrectionTable(std::string& parameter, double& minValue, double& maxValue, int& numPoints) const;
+    /**
+     * Set the long range correction to be interpolated from a table of values computed for different values of
+     * a global parameter.  The correction and its parameter derivatives are computed at numPoints evenly spaced
+     * values of the parameter between minValue and maxValue, along with their derivatives with respect to the
+     * parameter, and cubic interpolation is used between them.  If any other global parameter that affects the
+     * interaction changes, the table is recomputed.  If the parameter takes a value outside the range of the
+     * table, the correction for that value is computed directly.
+     *
+     * @param parameter   the name of the global parameter to tabulate the correction as a function of.  Specify
+     *                    an empty string to compute the correction directly rather than interpolating it.
+     * @param minValue    the smallest value of the parameter in the table
+     * @param maxValue    the largest value of the parameter in the table
+     * @param numPoints   the number of evenly spaced points in the table.  This must be at least 3.
+     */
+    void setLongRangeCorrectionTable(const std::string& parameter, double minValue, double maxValue, int numPoints=21);
     /**
      * Add a new per-particle parameter that the interaction may depend on.
      *
@@ -491,6 +519,16 @@ public:
      * the parameters of existing ones.
      */
     void updateParametersInContext(Context& context);
+    /**
+     * Update the per-particle parameters of selected particles in a Context to match those stored in this Force object.
+     * This is identical to updateParametersInContext(), except that only the listed particles are updated,
+     * and the cost of updating the Context (apart from recomputing the long range correction, if one is used) scales
+     * with the number of changes rather than the size of the System.
+     *
+     * @param context     the Context in which to update the parameters
+     * @param particles   the indices of the particles whose parameters have changed
+     */
+    void updateParameterSubsetInContext(Context& context, const std::vector<int>& particles);
     /**
      * Returns whether or not this force makes use of periodic boundary
      * conditions.
@@ -511,9 +549,10 @@ private:
     class FunctionInfo;
     class InteractionGroupInfo;
     NonbondedMethod nonbondedMethod;
-    double cutoffDistance, switchingDistance;
+    double cutoffDistance, switchingDistance, longRangeTableMin, longRangeTableMax;
     bool useSwitchingFunction, useLongRangeCorrection;
-    std::string energyExpression;
+    int longRangeTablePoints;
+    std::string energyExpression, longRangeTableParameter;
     std::vector<PerParticleParameterInfo> parameters;
     std::vector<GlobalParameterInfo> globalParameters;
     std::vector<ParticleInfo> particles;
@@ -365,6 +365,18 @@ public:
      * to add new particles or exceptions, only to change the parameters of existing ones.
      */
     void updateParametersInContext(Context& context);
+    /**
+     * Update the parameters of selected particles and exceptions in a Context to match those stored in this Force object.
+     * This is identical to updateParametersInContext(), except that only the listed particles and exceptions are
+     * updated, and the cost scales with the number of changes rather than the size of the System.  This is useful when
+     * a small number of parameters change frequently, such as the charges of titratable residues.  The same limitations
+     * apply as for updateParametersInContext().
+     *
+     * @param context     the Context in which to update the parameters
+     * @param particles   the indices of the particles whose parameters have changed
+     * @param exceptions  the indices of the exceptions whose parameters have changed
+     */
+    void updateParameterSubsetInContext(Context& context, const std::vector<int>& particles, const std::vector<int>& exceptions);
     /**
      * Returns whether or not this force makes use of periodic boundary
      * conditions.
@@ -0,0 +1,126 @@
+#ifndef OPENMM_TRAJECTORYWRITER_H_
+#define OPENMM_TRAJECTORYWRITER_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2016 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "Vec3.h"
+#include "internal/windowsExport.h"
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace OpenMM {
+
+class Context;
+class TrajectoryWriterImpl;
+
+/**
+ * A TrajectoryWriter saves a series of frames from a simulation to a trajectory file.  Each call to
+ * writeFrame() copies the current positions and periodic box vectors directly out of the Context into
+ * a ring buffer and then returns, without creating a State.  A background thread converts the buffered
+ * frames to the output format and writes them to disk, so the simulation can continue while the file
+ * is being written.  If every slot in the buffer is still waiting to be written, writeFrame() blocks
+ * until one becomes free.
+ *
+ * Two formats are supported.  DCD files use the CHARMM variant of the format with little-endian byte
+ * order, the same as is written by the DCDFile class in the Python application layer.  Compressed files
+ * are similar in spirit to XTC: each coordinate is rounded to a fixed precision and stored as a variable
+ * length difference from the same coordinate of the previous particle.  Every frame is self contained.
+ * Use readCompressedFrame() to read them.
+ *
+ * All frames written to one TrajectoryWriter must have the same number of particles.  Errors that happen
+ * on the background thread are reported by the next call to writeFrame() or flush().
+ */
+
+class OPENMM_EXPORT TrajectoryWriter {
+public:
+    /**
+     * This is an enumeration of the file formats that can be written.
+     */
+    enum Format {
+        /**
+         * Write a DCD file.
+         */
+        DCD = 0,
+        /**
+         * Write a compressed file, with coordinates stored to a fixed precision.
+         */
+        Compressed = 1
+    };
+    /**
+     * Create a TrajectoryWriter.
+     *
+     * @param filename            the file to write to.  If it already exists, it is overwritten.
+     * @param format              the format of the file to write
+     * @param interval            the number of time steps between frames.  This is recorded in the header of DCD files.
+     * @param enforcePeriodicBox  if true, each molecule is translated so its center lies in the first periodic box,
+     *                            as is done by Context::getState().  This is done on the background thread.
+     * @param bufferSize          the maximum number of frames that may be waiting to be written at once
+     * @param precision           for compressed files, the number of units per nm that coordinates are rounded to
+     */
+    TrajectoryWriter(const std::string& filename, Format format=DCD, int interval=1, bool enforcePeriodicBox=false, int bufferSize=4, double precision=1000.0);
+    ~TrajectoryWriter();
+    /**
+     * Add a frame to the trajectory, containing the current positions and periodic box vectors of a Context.
+     * The data is copied before this returns, and written to the file in the background.
+     *
+     * @param context    the Context to record a frame of
+     */
+    void writeFrame(Context& context);
+    /**
+     * Wait until every frame passed to writeFrame() has been written to the file.  If an error occurred
+     * while writing them, this throws an exception.
+     */
+    void flush();
+    /**
+     * Get the number of frames that have been passed to writeFrame().
+     */
+    int getNumFrames() const;
+    /**
+     * Read the next frame from a file that was written in the Compressed format.
+     *
+     * @param stream      the stream to read from
+     * @param positions   on exit, contains the particle positions (measured in nm)
+     * @param a           on exit, contains the first periodic box vector (measured in nm)
+     * @param b           on exit, contains the second periodic box vector (measured in nm)
+     * @param c           on exit, contains the third periodic box vector (measured in nm)
+     * @param time        on exit, contains the simulation time of the frame (measured in ps)
+     * @return true if a frame was read, or false if the end of the stream was reached
+     */
+    static bool readCompressedFrame(std::istream& stream, std::vector<Vec3>& positions, Vec3& a, Vec3& b, Vec3& c, double& time);
+private:
+    TrajectoryWriterImpl* impl;
+};
+
+} // namespace OpenMM
+
+#endif /*OPENMM_TRAJECTORYWRITER_H_*/
@@ -0,0 +1,134 @@
+#ifndef OPENMM_CHECKPOINTWRITER_H_
+#define OPENMM_CHECKPOINTWRITER_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2016 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "windowsExport.h"
+#include <iosfwd>
+#include <pthread.h>
+#include <string>
+
+namespace OpenMM {
+
+class ContextImpl;
+
+/**
+ * A CheckpointWriter writes checkpoints for a Context on a background thread.  Each ContextImpl
+ * creates one the first time createCheckpointAsync() is called on it.
+ *
+ * write() serializes the Context into an in-memory buffer on the calling thread, then hands the
+ * buffer to the background thread, which optionally compresses it and writes it to the output stream.
+ * The simulation can continue while the data is being written.  Two buffers are used, so the next
+ * checkpoint can be serialized while the previous one is still being written.
+ *
+ * A compressed checkpoint begins with a different header from an ordinary one, followed by the
+ * compressed data.  A delta checkpoint is compressed after taking the bytewise difference between it
+ * and the most recent full checkpoint written by this object.  Anything that has not changed since
+ * then, such as topology information and unused random number state, compresses to almost nothing.
+ * Loading it requires the full checkpoint as well.  Use readCheckpoint() to decode either kind.
+ */
+
+class OPENMM_EXPORT CheckpointWriter {
+public:
+    CheckpointWriter();
+    ~CheckpointWriter();
+    /**
+     * Create a checkpoint of a Context and begin writing it to a stream in the background.  If a
+     * previous checkpoint is still being written, this waits for it to finish first.
+     *
+     * @param context    the context to create a checkpoint of
+     * @param stream     the stream to write it to.  It must remain valid until the write is finished.
+     * @param options    a combination of values from Context::CheckpointOptions
+     * @return true if a delta checkpoint will be written, or false if a full checkpoint will be
+     * written.  A full checkpoint is written in place of a delta checkpoint if there is no earlier full
+     * checkpoint, or if its size differs from this one.  It then becomes the base for later deltas.
+     */
+    bool write(ContextImpl& context, std::ostream& stream, int options);
+    /**
+     * Wait until the most recent checkpoint has been completely written.  If an error occurred
+     * while writing it, this throws an exception.
+     */
+    void waitForCompletion();
+    /**
+     * Read a checkpoint from a stream and return its uncompressed contents, exactly as they were
+     * produced by ContextImpl::createCheckpoint().  The checkpoint may be either an ordinary one or
+     * one produced by this class.
+     *
+     * @param stream    the stream to read the checkpoint from
+     * @param base      the uncompressed contents of the full checkpoint a delta checkpoint was created
+     *                  relative to.  This may be NULL if the checkpoint is not a delta checkpoint.
+     */
+    static std::string readCheckpoint(std::istream& stream, const std::string* base);
+    /**
+     * Get whether a block of data begins with the header that identifies a checkpoint produced by
+     * this class.
+     */
+    static bool isPackedHeader(const char* header, int length);
+    /**
+     * Decode a checkpoint produced by this class, whose header has already been read from the stream.
+     *
+     * @param stream    the stream to read the checkpoint from
+     * @param base      the uncompressed contents of the full checkpoint a delta checkpoint was created
+     *                  relative to.  This may be NULL if the checkpoint is not a delta checkpoint.
+     */
+    static std::string decodeCheckpoint(std::istream& stream, const std::string* base);
+    /**
+     * Encode a checkpoint in compressed form and write it to a stream.
+     *
+     * @param data      the uncompressed checkpoint
+     * @param base      the full checkpoint to create a delta checkpoint relative to, or NULL to
+     *                  write a full checkpoint
+     * @param baseHash  the value of hashData() for base
+     * @param stream    the stream to write the encoded checkpoint to
+     */
+    static void encodeCheckpoint(const std::string& data, const std::string* base, unsigned long long baseHash, std::ostream& stream);
+    /**
+     * Compute a 64 bit hash of a block of data.  This is used to identify the full checkpoint a delta
+     * checkpoint was created relative to.
+     */
+    static unsigned long long hashData(const std::string& data);
+private:
+    static void* threadBody(void* args);
+    void writePending();
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t startCondition, endCondition;
+    bool hasPending, hasBase, isDeleted, pendingDelta;
+    std::ostream* pendingStream;
+    int pendingOptions;
+    std::string snapshot, pending, base, errorMessage;
+    unsigned long long baseHash;
+};
+
+} // namespace OpenMM
+
+#endif /*OPENMM_CHECKPOINTWRITER_H_*/
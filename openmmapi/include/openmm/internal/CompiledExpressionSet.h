@@ -33,7 +33,9 @@
  * -------------------------------------------------------------------------- */
 
 #include "lepton/CompiledExpression.h"
+#include "lepton/ParsedExpression.h"
 #include "windowsExport.h"
+#include <map>
 #include <string>
 #include <vector>
 
@@ -41,14 +43,28 @@ namespace OpenMM {
 
 /**
  * This class simplifies the management of a set of related CompiledExpressions that share variables.
+ * Expressions that are always evaluated together can be added with registerExpressions(), which compiles
+ * them into a single CompiledExpression with one output for each of them.
  */
 class OPENMM_EXPORT CompiledExpressionSet {
 public:
     CompiledExpressionSet();
+    ~CompiledExpressionSet();
     /**
-     * Add a CompiledExpression to the set.
+     * Add a CompiledExpression to the set.  The caller retains ownership of it.
      */
     void registerExpression(Lepton::CompiledExpression& expression);
+    /**
+     * Compile a group of expressions into a single CompiledExpression and add it to the set.  Calling
+     * evaluate() on the result computes all of them, and output i is the value of expressions[i].
+     * Subexpressions that appear in more than one of them are computed only once.  The set owns the
+     * CompiledExpression and deletes it when the set is deleted.
+     *
+     * @param expressions        the expressions to compile
+     * @param variableLocations  the memory locations from which the values of variables should be read
+     * @return the CompiledExpression that was created
+     */
+    Lepton::CompiledExpression& registerExpressions(const std::vector<Lepton::ParsedExpression>& expressions, std::map<std::string, double*>& variableLocations);
     /**
      * Get the index of a particular variable.
      */
@@ -65,7 +81,10 @@ public:
      */
     int getNumVariables() const;
 private:
+    CompiledExpressionSet(const CompiledExpressionSet& set);
+    CompiledExpressionSet& operator=(const CompiledExpressionSet& set);
     std::vector<Lepton::CompiledExpression*> expressions;
+    std::vector<Lepton::CompiledExpression*> ownedExpressions;
     std::vector<std::string> variables;
     std::vector<std::vector<double*> > variableReferences;
 };
@@ -35,12 +35,15 @@
 #include "openmm/Kernel.h"
 #include "openmm/Platform.h"
 #include "openmm/Vec3.h"
+#include "openmm/internal/Profiler.h"
 #include <iosfwd>
 #include <map>
 #include <vector>
 
 namespace OpenMM {
 
+class CheckpointWriter;
+class ContextGroup;
 class ForceImpl;
 class Integrator;
 class Context;
@@ -55,7 +58,8 @@ public:
     /**
      * Create an ContextImpl for a Context;
      */
-    ContextImpl(Context& owner, const System& system, Integrator& integrator, Platform* platform, const std::map<std::string, std::string>& properties);
+    ContextImpl(Context& owner, const System& system, Integrator& integrator, Platform* platform, const std::map<std::string, std::string>& properties,
+            ContextGroup* group=NULL);
     ~ContextImpl();
     /**
      * Get the Context for which this is the implementation.
@@ -63,6 +67,13 @@ public:
     Context& getOwner() {
         return owner;
     }
+    /**
+     * Get the ContextGroup this context belongs to, or NULL if it does not belong to one.  Platforms may
+     * share data between all the contexts in a group.
+     */
+    ContextGroup* getGroup() const {
+        return group;
+    }
     /**
      * Get System being simulated in this context.
      */
@@ -89,6 +100,10 @@ public:
      * Set the current time (in picoseconds).
      */
     void setTime(double t);
+    /**
+     * Get the number of integration steps that have been taken.
+     */
+    int getStepCount() const;
     /**
      * Get the positions of all particles.
      *
@@ -196,9 +211,37 @@ public:
      */
     double calcForcesAndEnergy(bool includeForces, bool includeEnergy, int groups=0xFFFFFFFF);
     /**
-     * Get the set of force group flags that were passed to the most recent call to calcForcesAndEnergy().
+     * Get the set of force group flags that were passed to the most recent call to calcForcesAndEnergy()
+     * that actually evaluated the forces.  When force caching is enabled, a call that is satisfied entirely
+     * from the cache does not change this.
      */
     int getLastForceGroups() const;
+    /**
+     * Get a counter that is incremented every time the positions, periodic box vectors, or parameters of the
+     * Context may have changed.  Cached forces and energies are only reused as long as this value is unchanged.
+     */
+    long long getStateVersion() const;
+    /**
+     * Record that the state of the Context (positions, periodic box vectors, parameters, etc.) may have changed
+     * in a way that affects forces and energies.  ContextImpl calls this automatically from its own methods,
+     * but any code that modifies the state directly while force caching is enabled (such as an integration
+     * kernel) must call it too.
+     */
+    void incrementStateVersion();
+    /**
+     * Set whether calcForcesAndEnergy() may return cached results.  When this is enabled, the energy computed
+     * for each set of force groups is saved, along with the forces for the most recently evaluated set of groups.
+     * A later request that can be satisfied from these is returned without evaluating any forces, as long as
+     * getStateVersion() has not changed in the meantime.
+     *
+     * This is disabled by default, since it requires the caller to call incrementStateVersion() whenever it
+     * modifies the state.  An Integrator typically enables it only for the duration of a step.
+     */
+    void setForceCachingEnabled(bool enabled);
+    /**
+     * Get whether calcForcesAndEnergy() may return cached results.
+     */
+    bool getForceCachingEnabled() const;
     /**
      * Calculate the kinetic energy of the system (in kJ/mol).
      */
@@ -228,6 +271,18 @@ public:
      * Set the platform-specific data stored in this context.
      */
     void setPlatformData(void* data);
+    /**
+     * Get the Profiler that records timing information for this context.
+     */
+    Profiler& getProfiler() {
+        return profiler;
+    }
+    /**
+     * Get the Profiler that records timing information for this context.
+     */
+    const Profiler& getProfiler() const {
+        return profiler;
+    }
     /**
      * Get a list of the particles in each molecules in the system.  Two particles are in the
      * same molecule if they are connected by constraints or bonds.
@@ -245,6 +300,25 @@ public:
      * @param stream    an input stream the checkpoint data should be read from
      */
     void loadCheckpoint(std::istream& stream);
+    /**
+     * Create a checkpoint and write it to a stream on a background thread.
+     * 
+     * @param stream    an output stream the checkpoint data should be written to
+     * @param options   a combination of values from Context::CheckpointOptions
+     * @return true if a delta checkpoint is being written, false if a full one is
+     */
+    bool createCheckpointAsync(std::ostream& stream, int options);
+    /**
+     * Wait until the checkpoint most recently started by createCheckpointAsync() has been written.
+     */
+    void waitForCheckpoint();
+    /**
+     * Load a delta checkpoint that was written by createCheckpointAsync().
+     * 
+     * @param stream          an input stream the delta checkpoint should be read from
+     * @param fullCheckpoint  an input stream containing the full checkpoint it was created relative to
+     */
+    void loadCheckpoint(std::istream& stream, std::istream& fullCheckpoint);
     /**
      * This is invoked by the Integrator when it is deleted.  This is needed to ensure the cleanup process
      * is done correctly, since we don't know whether the Integrator or Context will be deleted first.
@@ -259,6 +333,14 @@ public:
     static std::vector<std::vector<int> > findMolecules(int numParticles, std::vector<std::vector<int> >& particleBonds);
 private:
     friend class Context;
+    /**
+     * Evaluate forces and energy, bypassing the cache, and record the results in it.
+     */
+    double evaluateForcesAndEnergy(bool includeForces, bool includeEnergy, int groups);
+    /**
+     * Evaluate forces and energy while recording the time spent on each Force.
+     */
+    double evaluateForcesAndEnergyWithProfiling(bool includeForces, bool includeEnergy, int groups, bool& valid);
     Context& owner;
     const System& system;
     Integrator& integrator;
@@ -266,10 +348,17 @@ private:
     std::map<std::string, double> parameters;
     mutable std::vector<std::vector<int> > molecules;
     bool hasInitializedForces, hasSetPositions, integratorIsDeleted;
-    int lastForceGroups;
+    bool forceCachingEnabled;
+    int lastForceGroups, lastRequestedGroups;
+    long long stateVersion, cachedForcesVersion;
+    std::map<int, std::pair<long long, double> > cachedEnergies;
     Platform* platform;
     Kernel initializeForcesKernel, updateStateDataKernel, applyConstraintsKernel, virtualSitesKernel;
     void* platformData;
+    Profiler profiler;
+    std::vector<std::string> forceTimerNames;
+    CheckpointWriter* checkpointWriter;
+    ContextGroup* group;
 };
 
 } // namespace OpenMM
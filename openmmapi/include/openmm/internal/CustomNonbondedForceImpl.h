@@ -36,6 +36,8 @@
 #include "openmm/CustomNonbondedForce.h"
 #include "openmm/Kernel.h"
 #include "lepton/CompiledExpression.h"
+#include "lepton/CustomFunction.h"
+#include "lepton/ParsedExpression.h"
 #include <utility>
 #include <map>
 #include <string>
@@ -46,8 +48,11 @@ namespace OpenMM {
  * This is the internal implementation of CustomNonbondedForce.
  */
 
+class ThreadPool;
+
 class OPENMM_EXPORT CustomNonbondedForceImpl : public ForceImpl {
 public:
+    class LongRangeCorrectionData;
     CustomNonbondedForceImpl(const CustomNonbondedForce& owner);
     ~CustomNonbondedForceImpl();
     void initialize(ContextImpl& context);
@@ -61,19 +66,91 @@ public:
     std::map<std::string, double> getDefaultParameters();
     std::vector<std::string> getKernelNames();
     void updateParametersInContext(ContextImpl& context);
+    void updateParameterSubsetInContext(ContextImpl& context, const std::vector<int>& particles);
     /**
      * Compute the coefficient which, when divided by the periodic box volume, gives the
      * long range correction to the energy.  If the Force computes parameter derivatives,
      * also compute the corresponding derivatives of the correction.
+     *
+     * This always integrates the correction directly.  If it needs to be recomputed repeatedly,
+     * a LongRangeCorrectionData is much faster.
      */
     static void calcLongRangeCorrection(const CustomNonbondedForce& force, const Context& context, double& coefficient, std::vector<double>& derivatives);
 private:
     static double integrateInteraction(Lepton::CompiledExpression& expression, const std::vector<double>& params1, const std::vector<double>& params2,
-            const CustomNonbondedForce& force, const Context& context);
+            const CustomNonbondedForce& force, const std::map<std::string, double>& globalParameters);
     const CustomNonbondedForce& owner;
     Kernel kernel;
 };
 
+/**
+ * This class computes the long range correction for a CustomNonbondedForce.  The particle classes and the
+ * number of interactions between each pair of classes are found when it is created, so the correction can
+ * be recomputed quickly when global parameters change.  If a ThreadPool is provided, the integrals for
+ * different pairs of classes are computed in parallel.
+ *
+ * If the force specifies a long range correction table, the correction and its derivatives are tabulated
+ * as a function of that parameter the first time they are needed, along with their derivatives with respect
+ * to the parameter.  Later values are found by cubic Hermite interpolation.  The table is rebuilt if any
+ * other global parameter changes.
+ */
+class OPENMM_EXPORT CustomNonbondedForceImpl::LongRangeCorrectionData {
+public:
+    LongRangeCorrectionData(const CustomNonbondedForce& force);
+    ~LongRangeCorrectionData();
+    /**
+     * Compute the coefficient which, when divided by the periodic box volume, gives the long range correction
+     * to the energy, along with the derivatives of the coefficient with respect to the force's energy
+     * parameter derivatives.
+     *
+     * @param globalParameters  the values of all global parameters defined by the force
+     * @param coefficient       on exit, the coefficient
+     * @param derivatives       on exit, the derivatives of the coefficient
+     * @param threads           if not NULL, this is used to parallelize the calculation
+     */
+    void calcCorrection(const std::map<std::string, double>& globalParameters, double& coefficient, std::vector<double>& derivatives,
+            ThreadPool* threads=NULL);
+    /**
+     * Compute the correction by numerical integration, without using the table.  The arguments are the same
+     * as for calcCorrection().
+     */
+    void integrateCorrection(const std::map<std::string, double>& globalParameters, double& coefficient, std::vector<double>& derivatives,
+            ThreadPool* threads=NULL);
+    /**
+     * Update the particle classes after the parameters of some particles have changed.  The correction
+     * will be integrated again the next time it is needed.
+     *
+     * @param force      the CustomNonbondedForce to copy the parameters from
+     * @param particles  the indices of the particles whose parameters have changed
+     */
+    void updateParticles(const CustomNonbondedForce& force, const std::vector<int>& particles);
+private:
+    class IntegrateTask;
+    void countInteractions();
+    void integrate(const std::vector<std::map<std::string, double> >& points, int numExpressions, std::vector<std::vector<double> >& results,
+            ThreadPool* threads);
+    CustomNonbondedForce force;
+    bool periodic;
+    int numOutputs;
+    double numParticles, numInteractions;
+    std::vector<std::vector<double> > classes;
+    std::map<std::vector<double>, int> classIndex;
+    std::vector<int> atomClass;
+    std::vector<std::pair<int, int> > classPairs;
+    std::vector<long long> classPairCounts;
+    std::map<std::string, Lepton::CustomFunction*> functions;
+    std::vector<Lepton::ParsedExpression> expressions;
+    std::vector<bool> isZero;
+    std::vector<std::vector<Lepton::CompiledExpression> > threadExpressions;
+    std::string tableParameter;
+    double tableMin, tableMax;
+    int tablePoints;
+    bool hasTable;
+    std::map<std::string, double> tableGlobalParameters;
+    std::vector<double> tableX;
+    std::vector<std::vector<double> > tableValues;
+};
+
 } // namespace OpenMM
 
 #endif /*OPENMM_CUSTOMNONBONDEDFORCEIMPL_H_*/
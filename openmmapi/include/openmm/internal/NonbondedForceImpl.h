@@ -35,7 +35,9 @@
 #include "ForceImpl.h"
 #include "openmm/NonbondedForce.h"
 #include "openmm/Kernel.h"
+#include <map>
 #include <utility>
+#include <vector>
 #include <set>
 #include <string>
 
@@ -49,6 +51,7 @@ class System;
 
 class OPENMM_EXPORT NonbondedForceImpl : public ForceImpl {
 public:
+    class DispersionCorrectionData;
     NonbondedForceImpl(const NonbondedForce& owner);
     ~NonbondedForceImpl();
     void initialize(ContextImpl& context);
@@ -64,6 +67,7 @@ public:
     }
     std::vector<std::string> getKernelNames();
     void updateParametersInContext(ContextImpl& context);
+    void updateParameterSubsetInContext(ContextImpl& context, const std::vector<int>& particles, const std::vector<int>& exceptions);
     void getPMEParameters(double& alpha, int& nx, int& ny, int& nz) const;
     /**
      * This is a utility routine that calculates the values to use for alpha and kmax when using
@@ -81,6 +85,7 @@ public:
      */
     static double calcDispersionCorrection(const System& system, const NonbondedForce& force);
 private:
+    friend class DispersionCorrectionData;
     class ErrorFunction;
     class EwaldErrorFunction;
     static int findZero(const ErrorFunction& f, int initialGuess);
@@ -89,6 +94,36 @@ private:
     Kernel kernel;
 };
 
+/**
+ * This class computes the long range dispersion correction for a NonbondedForce, and allows it to be updated
+ * incrementally when the parameters of a few particles change.  It records the particle classes (defined by
+ * sigma and epsilon) and running sums over all pairs of classes.  Changing the class of one particle costs
+ * time proportional to the number of classes, rather than to the number of pairs of classes.
+ */
+class OPENMM_EXPORT NonbondedForceImpl::DispersionCorrectionData {
+public:
+    DispersionCorrectionData(const System& system, const NonbondedForce& force);
+    /**
+     * Get the coefficient which, when divided by the periodic box volume, gives the long range
+     * dispersion correction to the energy.
+     */
+    double getCoefficient() const;
+    /**
+     * Update the correction after the parameters of some particles have changed.
+     *
+     * @param force      the NonbondedForce to copy the parameters from
+     * @param particles  the indices of the particles whose parameters have changed
+     */
+    void updateParticles(const NonbondedForce& force, const std::vector<int>& particles);
+private:
+    void addPairs(const std::pair<double, double>& class1, const std::pair<double, double>& class2, double count);
+    bool periodic, useSwitch;
+    double cutoff, switchDist, numParticles;
+    double sum1, sum2, sum3;
+    std::map<std::pair<double, double>, int> classCounts;
+    std::vector<std::pair<double, double> > particleClass;
+};
+
 } // namespace OpenMM
 
 #endif /*OPENMM_NONBONDEDFORCEIMPL_H_*/
@@ -0,0 +1,114 @@
+#ifndef OPENMM_PROFILER_H_
+#define OPENMM_PROFILER_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2016 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "windowsExport.h"
+#include <map>
+#include <string>
+
+namespace OpenMM {
+
+/**
+ * A Profiler accumulates timing information about a Context: the total time spent in named timers,
+ * the number of times each timer was invoked, and counts of named events.  Each ContextImpl owns one.
+ *
+ * Recording is off by default.  Code that wants to record information should first call isEnabled(),
+ * and skip all timing if it returns false, so profiling costs nothing when it is not being used.
+ *
+ * This class is not thread safe.  Information should only be recorded from the thread that is
+ * calling methods on the Context.
+ */
+
+class OPENMM_EXPORT Profiler {
+public:
+    Profiler();
+    /**
+     * Get whether information is currently being recorded.
+     */
+    bool isEnabled() const {
+        return enabled;
+    }
+    /**
+     * Set whether information should be recorded.
+     */
+    void setEnabled(bool enabled);
+    /**
+     * Add time to a timer, and increment the number of times it has been invoked.
+     *
+     * @param name      the name of the timer
+     * @param seconds   the time to add, measured in seconds
+     */
+    void addTime(const std::string& name, double seconds);
+    /**
+     * Add to the count of an event.
+     *
+     * @param name    the name of the counter
+     * @param count   the number of events to add
+     */
+    void addCount(const std::string& name, int count=1);
+    /**
+     * Discard all recorded information.
+     */
+    void reset();
+    /**
+     * Get the total time recorded by each timer, measured in seconds.
+     */
+    const std::map<std::string, double>& getTimes() const {
+        return times;
+    }
+    /**
+     * Get the number of times each timer has been invoked.
+     */
+    const std::map<std::string, int>& getCalls() const {
+        return calls;
+    }
+    /**
+     * Get the count of each event.
+     */
+    const std::map<std::string, int>& getCounts() const {
+        return counts;
+    }
+    /**
+     * Get all recorded information formatted as a JSON object.
+     */
+    std::string toJson() const;
+private:
+    bool enabled;
+    std::map<std::string, double> times;
+    std::map<std::string, int> calls;
+    std::map<std::string, int> counts;
+};
+
+} // namespace OpenMM
+
+#endif /*OPENMM_PROFILER_H_*/
@@ -83,9 +83,28 @@ public:
      * Instruct the threads to resume running after blocking at a synchronization point.
      */
     void resumeThreads();
+    /**
+     * Set whether to record how much time threads spend waiting for each other.  This is disabled by
+     * default.  It should only be called while no Task is running.
+     */
+    void setTimingEnabled(bool enabled);
+    /**
+     * Get the total time (in seconds) that worker threads have spent at synchronization points waiting for
+     * the slowest thread to arrive, summed over all threads.  This measures load imbalance.
+     */
+    double getIdleTime() const;
+    /**
+     * Get the total time (in seconds) that the master thread has spent blocked in waitForThreads().
+     */
+    double getWaitTime() const;
+    /**
+     * Reset the times returned by getIdleTime() and getWaitTime() to zero.
+     */
+    void resetTiming();
 private:
-    bool isDeleted;
+    bool isDeleted, timingEnabled;
     int numThreads, waitCount;
+    double idleTime, waitTime, arrivalTimeSum;
     std::vector<pthread_t> thread;
     std::vector<ThreadData*> threadData;
     pthread_cond_t startCondition, endCondition;
@@ -0,0 +1,105 @@
+#ifndef OPENMM_TRAJECTORYWRITERIMPL_H_
+#define OPENMM_TRAJECTORYWRITERIMPL_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2016 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "openmm/TrajectoryWriter.h"
+#include "windowsExport.h"
+#include <fstream>
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+namespace OpenMM {
+
+class ContextImpl;
+
+/**
+ * This is the internal implementation of TrajectoryWriter.  It owns a ring buffer of frames and the
+ * background thread that writes them.  A slot in the buffer is filled by the calling thread, then
+ * handed to the background thread, which formats it and writes it to the file before releasing the
+ * slot for reuse.  The arrays in each slot are allocated once and reused, so writing a frame does not
+ * allocate memory.
+ */
+
+class OPENMM_EXPORT TrajectoryWriterImpl {
+public:
+    TrajectoryWriterImpl(const std::string& filename, TrajectoryWriter::Format format, int interval, bool enforcePeriodicBox, int bufferSize, double precision);
+    ~TrajectoryWriterImpl();
+    /**
+     * Copy a frame out of a Context and queue it to be written.
+     */
+    void writeFrame(ContextImpl& context);
+    /**
+     * Wait until every queued frame has been written.  If an error occurred, this throws an exception.
+     */
+    void flush();
+    /**
+     * Get the number of frames that have been queued.
+     */
+    int getNumFrames() const;
+    /**
+     * Read a frame from a file in the Compressed format.
+     */
+    static bool readCompressedFrame(std::istream& stream, std::vector<Vec3>& positions, Vec3& a, Vec3& b, Vec3& c, double& time);
+private:
+    struct Frame {
+        std::vector<Vec3> positions;
+        Vec3 boxVectors[3];
+        double time;
+    };
+    static void* threadBody(void* args);
+    /**
+     * Write one frame to the file.  This is called on the background thread.
+     */
+    void writeToFile(Frame& frame);
+    void applyPeriodicBox(Frame& frame);
+    void writeDCDHeader(const Frame& frame);
+    void writeDCDFrame(const Frame& frame);
+    void writeCompressedFrame(const Frame& frame);
+    std::ofstream file;
+    TrajectoryWriter::Format format;
+    int interval, numParticles, numQueued, numWritten, firstStep;
+    bool enforcePeriodicBox, usesPeriodicBox, isDeleted;
+    double precision, stepSize;
+    std::vector<Frame> frames;
+    int nextFrame, numPending;
+    std::vector<std::vector<int> > molecules;
+    std::string encoded, errorMessage;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t startCondition, endCondition;
+};
+
+} // namespace OpenMM
+
+#endif /*OPENMM_TRAJECTORYWRITERIMPL_H_*/
@@ -92,6 +92,8 @@ static int getNumProcessors() {
  */
 #ifdef WIN32
 #define cpuid __cpuid
+#define cpuidex __cpuidex
+#define xgetbv _xgetbv
 #else
 #if !defined(__ANDROID__) && !defined(__PNACL__)
     static void cpuid(int cpuInfo[4], int infoType){
@@ -118,6 +120,46 @@ static int getNumProcessors() {
         );
     #endif
     }
+
+    /**
+     * This is identical to cpuid(), except that it also specifies a sub-leaf in ECX.  This is
+     * required for some values of infoType, such as 7 (extended features).
+     */
+    static void cpuidex(int cpuInfo[4], int infoType, int subLeaf){
+    #ifdef __LP64__
+        __asm__ __volatile__ (
+            "cpuid":
+            "=a" (cpuInfo[0]),
+            "=b" (cpuInfo[1]),
+            "=c" (cpuInfo[2]),
+            "=d" (cpuInfo[3]) :
+            "a" (infoType), "c" (subLeaf)
+        );
+    #else
+        __asm__ __volatile__ (
+            "pushl %%ebx\n"
+            "cpuid\n"
+            "movl %%ebx, %1\n"
+            "popl %%ebx\n" :
+            "=a" (cpuInfo[0]),
+            "=r" (cpuInfo[1]),
+            "=c" (cpuInfo[2]),
+            "=d" (cpuInfo[3]) :
+            "a" (infoType), "c" (subLeaf)
+        );
+    #endif
+    }
+
+    /**
+     * Read an extended control register.  Register 0 (XCR0) reports which register states the
+     * operating system saves on context switches.  This may only be called if cpuid() reports
+     * that OSXSAVE is enabled.
+     */
+    static unsigned long long xgetbv(int index) {
+        unsigned int eax, edx;
+        __asm__ __volatile__ ("xgetbv" : "=a" (eax), "=d" (edx) : "c" (index));
+        return ((unsigned long long) edx << 32) | eax;
+    }
     #endif
 #endif
 
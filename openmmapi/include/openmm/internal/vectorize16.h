@@ -0,0 +1,338 @@
+#ifndef OPENMM_VECTORIZE16_H_
+#define OPENMM_VECTORIZE16_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2013-2016 Stanford University and the Authors.      *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "vectorize8.h"
+#include <immintrin.h>
+
+// This file defines classes and functions to simplify vectorizing code with AVX-512.  Only
+// instructions from the AVX-512 Foundation subset are used.
+
+class ivec16;
+
+/**
+ * A sixteen element vector of floats.
+ */
+class fvec16 {
+public:
+    __m512 val;
+
+    fvec16() {}
+    fvec16(float v) : val(_mm512_set1_ps(v)) {}
+    fvec16(float v1, float v2, float v3, float v4, float v5, float v6, float v7, float v8,
+           float v9, float v10, float v11, float v12, float v13, float v14, float v15, float v16) :
+            val(_mm512_set_ps(v16, v15, v14, v13, v12, v11, v10, v9, v8, v7, v6, v5, v4, v3, v2, v1)) {}
+    fvec16(__m512 v) : val(v) {}
+    fvec16(const float* v) : val(_mm512_loadu_ps(v)) {}
+    operator __m512() const {
+        return val;
+    }
+    fvec8 lowerVec() const {
+        return _mm512_castps512_ps256(val);
+    }
+    fvec8 upperVec() const {
+        return _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(val), 1));
+    }
+    void store(float* v) const {
+        _mm512_storeu_ps(v, val);
+    }
+    fvec16 operator+(const fvec16& other) const {
+        return _mm512_add_ps(val, other);
+    }
+    fvec16 operator-(const fvec16& other) const {
+        return _mm512_sub_ps(val, other);
+    }
+    fvec16 operator*(const fvec16& other) const {
+        return _mm512_mul_ps(val, other);
+    }
+    fvec16 operator/(const fvec16& other) const {
+        return _mm512_div_ps(val, other);
+    }
+    void operator+=(const fvec16& other) {
+        val = _mm512_add_ps(val, other);
+    }
+    void operator-=(const fvec16& other) {
+        val = _mm512_sub_ps(val, other);
+    }
+    void operator*=(const fvec16& other) {
+        val = _mm512_mul_ps(val, other);
+    }
+    void operator/=(const fvec16& other) {
+        val = _mm512_div_ps(val, other);
+    }
+    fvec16 operator-() const {
+        return _mm512_sub_ps(_mm512_set1_ps(0.0f), val);
+    }
+    fvec16 operator&(const fvec16& other) const {
+        return _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(val), _mm512_castps_si512(other.val)));
+    }
+    fvec16 operator|(const fvec16& other) const {
+        return _mm512_castsi512_ps(_mm512_or_si512(_mm512_castps_si512(val), _mm512_castps_si512(other.val)));
+    }
+    fvec16 operator==(const fvec16& other) const {
+        return fromMask(_mm512_cmp_ps_mask(val, other, _CMP_EQ_OQ));
+    }
+    fvec16 operator!=(const fvec16& other) const {
+        return fromMask(_mm512_cmp_ps_mask(val, other, _CMP_NEQ_OQ));
+    }
+    fvec16 operator>(const fvec16& other) const {
+        return fromMask(_mm512_cmp_ps_mask(val, other, _CMP_GT_OQ));
+    }
+    fvec16 operator<(const fvec16& other) const {
+        return fromMask(_mm512_cmp_ps_mask(val, other, _CMP_LT_OQ));
+    }
+    fvec16 operator>=(const fvec16& other) const {
+        return fromMask(_mm512_cmp_ps_mask(val, other, _CMP_GE_OQ));
+    }
+    fvec16 operator<=(const fvec16& other) const {
+        return fromMask(_mm512_cmp_ps_mask(val, other, _CMP_LE_OQ));
+    }
+    operator ivec16() const;
+private:
+    /**
+     * AVX-512 comparisons produce a bit mask rather than a vector.  Convert it to a vector with all bits
+     * set in the selected elements, so comparisons behave the same as for fvec4 and fvec8.
+     */
+    static __m512 fromMask(__mmask16 mask) {
+        return _mm512_castsi512_ps(_mm512_maskz_set1_epi32(mask, -1));
+    }
+};
+
+/**
+ * A sixteen element vector of ints.
+ */
+class ivec16 {
+public:
+    __m512i val;
+
+    ivec16() {}
+    ivec16(int v) : val(_mm512_set1_epi32(v)) {}
+    ivec16(int v1, int v2, int v3, int v4, int v5, int v6, int v7, int v8,
+           int v9, int v10, int v11, int v12, int v13, int v14, int v15, int v16) :
+            val(_mm512_set_epi32(v16, v15, v14, v13, v12, v11, v10, v9, v8, v7, v6, v5, v4, v3, v2, v1)) {}
+    ivec16(__m512i v) : val(v) {}
+    ivec16(const int* v) : val(_mm512_loadu_si512((const __m512i*) v)) {}
+    operator __m512i() const {
+        return val;
+    }
+    /**
+     * Create a vector whose elements have all bits set if the corresponding bit of a mask is set,
+     * and are zero otherwise.  Bit i of the mask corresponds to element i.
+     */
+    static ivec16 fromBitMask(int mask) {
+        return _mm512_maskz_set1_epi32((__mmask16) mask, -1);
+    }
+    ivec8 lowerVec() const {
+        return _mm512_castsi512_si256(val);
+    }
+    ivec8 upperVec() const {
+        return _mm512_extracti64x4_epi64(val, 1);
+    }
+    void store(int* v) const {
+        _mm512_storeu_si512((__m512i*) v, val);
+    }
+    ivec16 operator+(const ivec16& other) const {
+        return _mm512_add_epi32(val, other);
+    }
+    ivec16 operator&(const ivec16& other) const {
+        return _mm512_and_si512(val, other.val);
+    }
+    ivec16 operator|(const ivec16& other) const {
+        return _mm512_or_si512(val, other.val);
+    }
+    operator fvec16() const;
+};
+
+// Conversion operators.
+
+inline fvec16::operator ivec16() const {
+    return _mm512_cvttps_epi32(val);
+}
+
+inline ivec16::operator fvec16() const {
+    return _mm512_cvtepi32_ps(val);
+}
+
+// Functions that operate on fvec16s.
+
+static inline fvec16 floor(const fvec16& v) {
+    return fvec16(_mm512_roundscale_ps(v.val, _MM_FROUND_TO_NEG_INF));
+}
+
+static inline fvec16 ceil(const fvec16& v) {
+    return fvec16(_mm512_roundscale_ps(v.val, _MM_FROUND_TO_POS_INF));
+}
+
+static inline fvec16 round(const fvec16& v) {
+    return fvec16(_mm512_roundscale_ps(v.val, _MM_FROUND_TO_NEAREST_INT));
+}
+
+static inline fvec16 min(const fvec16& v1, const fvec16& v2) {
+    return fvec16(_mm512_min_ps(v1.val, v2.val));
+}
+
+static inline fvec16 max(const fvec16& v1, const fvec16& v2) {
+    return fvec16(_mm512_max_ps(v1.val, v2.val));
+}
+
+static inline fvec16 abs(const fvec16& v) {
+    return fvec16(_mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(v.val), _mm512_set1_epi32(0x7FFFFFFF))));
+}
+
+static inline fvec16 sqrt(const fvec16& v) {
+    return fvec16(_mm512_sqrt_ps(v.val));
+}
+
+static inline fvec16 rsqrt(const fvec16& v) {
+    // Initial estimate of rsqrt().  This is accurate to 14 bits, compared to 12 for SSE and AVX.
+
+    fvec16 y(_mm512_rsqrt14_ps(v.val));
+
+    // Perform an iteration of Newton refinement.
+
+    fvec16 x2 = v*0.5f;
+    y *= fvec16(1.5f)-x2*y*y;
+    return y;
+}
+
+static inline float dot16(const fvec16& v1, const fvec16& v2) {
+    return _mm512_reduce_add_ps(_mm512_mul_ps(v1.val, v2.val));
+}
+
+/**
+ * Look up sixteen elements of a table.
+ */
+static inline fvec16 gather(const float* table, const ivec16& index) {
+    return fvec16(_mm512_i32gather_ps(index.val, table, 4));
+}
+
+/**
+ * Transpose within each group of four elements of four vectors.  This is the first step of converting
+ * between an array of fvec4s and a set of fvec16s.
+ */
+static inline void transposeLanes(__m512& v1, __m512& v2, __m512& v3, __m512& v4) {
+    __m512 t1 = _mm512_unpacklo_ps(v1, v2);
+    __m512 t2 = _mm512_unpacklo_ps(v3, v4);
+    __m512 t3 = _mm512_unpackhi_ps(v1, v2);
+    __m512 t4 = _mm512_unpackhi_ps(v3, v4);
+    v1 = _mm512_shuffle_ps(t1, t2, _MM_SHUFFLE(1, 0, 1, 0));
+    v2 = _mm512_shuffle_ps(t1, t2, _MM_SHUFFLE(3, 2, 3, 2));
+    v3 = _mm512_shuffle_ps(t3, t4, _MM_SHUFFLE(1, 0, 1, 0));
+    v4 = _mm512_shuffle_ps(t3, t4, _MM_SHUFFLE(3, 2, 3, 2));
+}
+
+/**
+ * Transpose sixteen fvec4s into four fvec16s.  Element j of out[i] is element i of in[j].
+ */
+static inline void transpose(const fvec4 in[16], fvec16& out1, fvec16& out2, fvec16& out3, fvec16& out4) {
+    // Vector i holds inputs i, i+4, i+8, and i+12, so after transposing each group of four elements,
+    // the outputs are in the correct order.
+
+    __m512 v[4];
+    for (int i = 0; i < 4; i++) {
+        v[i] = _mm512_castps128_ps512(in[i]);
+        v[i] = _mm512_insertf32x4(v[i], in[i+4], 1);
+        v[i] = _mm512_insertf32x4(v[i], in[i+8], 2);
+        v[i] = _mm512_insertf32x4(v[i], in[i+12], 3);
+    }
+    transposeLanes(v[0], v[1], v[2], v[3]);
+    out1 = v[0];
+    out2 = v[1];
+    out3 = v[2];
+    out4 = v[3];
+}
+
+/**
+ * Transpose four fvec16s into sixteen fvec4s.  This is the inverse of the function above.
+ */
+static inline void transpose(const fvec16& in1, const fvec16& in2, const fvec16& in3, const fvec16& in4, fvec4 out[16]) {
+    __m512 v1 = in1, v2 = in2, v3 = in3, v4 = in4;
+    transposeLanes(v1, v2, v3, v4);
+    out[0] = _mm512_castps512_ps128(v1);
+    out[1] = _mm512_castps512_ps128(v2);
+    out[2] = _mm512_castps512_ps128(v3);
+    out[3] = _mm512_castps512_ps128(v4);
+    out[4] = _mm512_extractf32x4_ps(v1, 1);
+    out[5] = _mm512_extractf32x4_ps(v2, 1);
+    out[6] = _mm512_extractf32x4_ps(v3, 1);
+    out[7] = _mm512_extractf32x4_ps(v4, 1);
+    out[8] = _mm512_extractf32x4_ps(v1, 2);
+    out[9] = _mm512_extractf32x4_ps(v2, 2);
+    out[10] = _mm512_extractf32x4_ps(v3, 2);
+    out[11] = _mm512_extractf32x4_ps(v4, 2);
+    out[12] = _mm512_extractf32x4_ps(v1, 3);
+    out[13] = _mm512_extractf32x4_ps(v2, 3);
+    out[14] = _mm512_extractf32x4_ps(v3, 3);
+    out[15] = _mm512_extractf32x4_ps(v4, 3);
+}
+
+// Functions that operate on ivec16s.
+
+static inline ivec16 min(const ivec16& v1, const ivec16& v2) {
+    return ivec16(_mm512_min_epi32(v1.val, v2.val));
+}
+
+static inline ivec16 max(const ivec16& v1, const ivec16& v2) {
+    return ivec16(_mm512_max_epi32(v1.val, v2.val));
+}
+
+static inline bool any(const ivec16& v) {
+    return (_mm512_test_epi32_mask(v, v) != 0);
+}
+
+// Mathematical operators involving a scalar and a vector.
+
+static inline fvec16 operator+(float v1, const fvec16& v2) {
+    return fvec16(v1)+v2;
+}
+
+static inline fvec16 operator-(float v1, const fvec16& v2) {
+    return fvec16(v1)-v2;
+}
+
+static inline fvec16 operator*(float v1, const fvec16& v2) {
+    return fvec16(v1)*v2;
+}
+
+static inline fvec16 operator/(float v1, const fvec16& v2) {
+    return fvec16(v1)/v2;
+}
+
+// Operations for blending fvec16s based on an ivec16.  As with fvec4 and fvec8, only the sign bit of
+// each element of the mask is used.
+
+static inline fvec16 blend(const fvec16& v1, const fvec16& v2, const ivec16& mask) {
+    return fvec16(_mm512_mask_blend_ps(_mm512_cmplt_epi32_mask(mask.val, _mm512_setzero_si512()), v1.val, v2.val));
+}
+
+#endif /*OPENMM_VECTORIZE16_H_*/
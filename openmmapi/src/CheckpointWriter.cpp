@@ -0,0 +1,383 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2016 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "openmm/internal/CheckpointWriter.h"
+#include "openmm/internal/ContextImpl.h"
+#include "openmm/Context.h"
+#include "openmm/OpenMMException.h"
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <streambuf>
+#include <vector>
+
+using namespace OpenMM;
+using namespace std;
+
+const static char PACKED_CHECKPOINT_MAGIC_BYTES[] = "OpenMM Packed Checkpoint\n";
+const static int PACKED_CHECKPOINT_VERSION = 1;
+const static int DELTA_FLAG = 1;
+const static int HASH_BITS = 16;
+const static int MIN_MATCH = 4;
+
+/**
+ * A streambuf that appends everything written to it to a string.  This lets a checkpoint be
+ * serialized into a buffer that is reused from one checkpoint to the next.
+ */
+class StringOutputBuffer : public streambuf {
+public:
+    StringOutputBuffer(string& str) : str(str) {
+    }
+protected:
+    int overflow(int c) {
+        if (c != EOF)
+            str.push_back((char) c);
+        return c;
+    }
+    streamsize xsputn(const char* s, streamsize n) {
+        str.append(s, n);
+        return n;
+    }
+private:
+    string& str;
+};
+
+static void throwCorrupted() {
+    throw OpenMMException("loadCheckpoint: Checkpoint data is corrupted");
+}
+
+/**
+ * Transpose the data so byte k of every 8 byte word is stored contiguously.  In a delta checkpoint
+ * most of the changes are in the low order bytes of floating point values, so this groups the
+ * unchanged high order bytes into long runs of zeros.
+ */
+static void shuffleBytes(const char* in, char* out, size_t size) {
+    size_t numWords = size/8;
+    for (size_t i = 0; i < numWords; i++)
+        for (int k = 0; k < 8; k++)
+            out[k*numWords+i] = in[8*i+k];
+    for (size_t i = 8*numWords; i < size; i++)
+        out[i] = in[i];
+}
+
+static void unshuffleBytes(const char* in, char* out, size_t size) {
+    size_t numWords = size/8;
+    for (size_t i = 0; i < numWords; i++)
+        for (int k = 0; k < 8; k++)
+            out[8*i+k] = in[k*numWords+i];
+    for (size_t i = 8*numWords; i < size; i++)
+        out[i] = in[i];
+}
+
+static void writeVarint(string& out, unsigned long long value) {
+    while (value >= 128) {
+        out.push_back((char) ((value&127)|128));
+        value >>= 7;
+    }
+    out.push_back((char) value);
+}
+
+static unsigned long long readVarint(const string& in, size_t& pos) {
+    unsigned long long value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (pos >= in.size())
+            throwCorrupted();
+        unsigned char c = (unsigned char) in[pos++];
+        value |= ((unsigned long long) (c&127))<<shift;
+        if ((c&128) == 0)
+            return value;
+    }
+    throwCorrupted();
+    return 0;
+}
+
+/**
+ * Compress data with a simple LZ77 scheme.  The output is a sequence of tokens, each consisting of
+ * a count of literal bytes, the literal bytes themselves, the length of a match, and the offset
+ * back to the start of the match.  A match length of zero marks the end of the data.  This is much
+ * faster than general purpose compressors, which matters more here than the compression ratio.
+ */
+static void compressData(const char* in, size_t size, string& out) {
+    vector<long long> table(1<<HASH_BITS, -1);
+    size_t pos = 0, anchor = 0;
+    int misses = 0;
+    while (pos+MIN_MATCH <= size) {
+        unsigned int sequence;
+        memcpy(&sequence, &in[pos], MIN_MATCH);
+        int hash = (int) ((sequence*2654435761U)>>(32-HASH_BITS));
+        long long candidate = table[hash];
+        table[hash] = pos;
+        if (candidate < 0 || memcmp(&in[candidate], &in[pos], MIN_MATCH) != 0) {
+            // Skip ahead faster the longer we go without finding a match, so incompressible data
+            // is processed quickly.
+
+            pos += 1+(misses++>>6);
+            continue;
+        }
+        size_t length = MIN_MATCH;
+        while (pos+length < size && in[candidate+length] == in[pos+length])
+            length++;
+        writeVarint(out, pos-anchor);
+        out.append(&in[anchor], pos-anchor);
+        writeVarint(out, length);
+        writeVarint(out, pos-candidate);
+        pos += length;
+        anchor = pos;
+        misses = 0;
+    }
+    writeVarint(out, size-anchor);
+    out.append(&in[anchor], size-anchor);
+    writeVarint(out, 0);
+}
+
+static void decompressData(const string& in, char* out, size_t size) {
+    size_t inPos = 0, outPos = 0;
+    while (true) {
+        unsigned long long literals = readVarint(in, inPos);
+        if (literals > in.size()-inPos || literals > size-outPos)
+            throwCorrupted();
+        memcpy(&out[outPos], &in[inPos], literals);
+        inPos += literals;
+        outPos += literals;
+        unsigned long long length = readVarint(in, inPos);
+        if (length == 0)
+            break;
+        unsigned long long offset = readVarint(in, inPos);
+        if (offset == 0 || offset > outPos || length > size-outPos)
+            throwCorrupted();
+
+        // The match may overlap the bytes being written, so copy one byte at a time.
+
+        const char* source = &out[outPos-offset];
+        for (unsigned long long i = 0; i < length; i++)
+            out[outPos+i] = source[i];
+        outPos += length;
+    }
+    if (outPos != size)
+        throwCorrupted();
+}
+
+CheckpointWriter::CheckpointWriter() : hasPending(false), hasBase(false), isDeleted(false), pendingDelta(false), pendingStream(NULL), pendingOptions(0), baseHash(0) {
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&startCondition, NULL);
+    pthread_cond_init(&endCondition, NULL);
+    pthread_create(&thread, NULL, threadBody, this);
+}
+
+CheckpointWriter::~CheckpointWriter() {
+    pthread_mutex_lock(&lock);
+    while (hasPending)
+        pthread_cond_wait(&endCondition, &lock);
+    isDeleted = true;
+    pthread_cond_signal(&startCondition);
+    pthread_mutex_unlock(&lock);
+    pthread_join(thread, NULL);
+    pthread_mutex_destroy(&lock);
+    pthread_cond_destroy(&startCondition);
+    pthread_cond_destroy(&endCondition);
+}
+
+void* CheckpointWriter::threadBody(void* args) {
+    CheckpointWriter& owner = *reinterpret_cast<CheckpointWriter*>(args);
+    pthread_mutex_lock(&owner.lock);
+    while (true) {
+        while (!owner.hasPending && !owner.isDeleted)
+            pthread_cond_wait(&owner.startCondition, &owner.lock);
+        if (!owner.hasPending)
+            break;
+        pthread_mutex_unlock(&owner.lock);
+        string error;
+        try {
+            owner.writePending();
+        }
+        catch (exception& ex) {
+            error = ex.what();
+        }
+        pthread_mutex_lock(&owner.lock);
+        if (!error.empty())
+            owner.errorMessage = error;
+        owner.hasPending = false;
+        pthread_cond_broadcast(&owner.endCondition);
+    }
+    pthread_mutex_unlock(&owner.lock);
+    return 0;
+}
+
+bool CheckpointWriter::write(ContextImpl& context, ostream& stream, int options) {
+    // Serialize the Context into the free buffer.  This can happen while the previous
+    // checkpoint is still being written.
+
+    snapshot.clear();
+    StringOutputBuffer buffer(snapshot);
+    ostream snapshotStream(&buffer);
+    context.createCheckpoint(snapshotStream);
+
+    // Hand it off to the background thread.  Once the previous checkpoint is finished the base
+    // cannot change, so we can decide here whether this one can be written as a delta.
+
+    waitForCompletion();
+    pthread_mutex_lock(&lock);
+    pending.swap(snapshot);
+    pendingStream = &stream;
+    pendingOptions = options;
+    pendingDelta = ((options&Context::DeltaCheckpoint) != 0 && hasBase && base.size() == pending.size());
+    hasPending = true;
+    bool delta = pendingDelta;
+    pthread_cond_signal(&startCondition);
+    pthread_mutex_unlock(&lock);
+    return delta;
+}
+
+void CheckpointWriter::waitForCompletion() {
+    pthread_mutex_lock(&lock);
+    while (hasPending)
+        pthread_cond_wait(&endCondition, &lock);
+    string error = errorMessage;
+    errorMessage = "";
+    pthread_mutex_unlock(&lock);
+    if (!error.empty())
+        throw OpenMMException(error);
+}
+
+void CheckpointWriter::writePending() {
+    ostream& stream = *pendingStream;
+    bool delta = pendingDelta;
+    if (delta)
+        encodeCheckpoint(pending, &base, baseHash, stream);
+    else if ((pendingOptions&(Context::CompressCheckpoint|Context::DeltaCheckpoint)) != 0)
+        encodeCheckpoint(pending, NULL, 0, stream);
+    else
+        stream.write(&pending[0], pending.size());
+    stream.flush();
+    if (!stream)
+        throw OpenMMException("createCheckpointAsync: Error writing checkpoint");
+
+    // Every full checkpoint becomes the base for later delta checkpoints.  Swapping keeps the
+    // old base's memory around for reuse as a snapshot buffer.
+
+    if (!delta) {
+        base.swap(pending);
+        baseHash = hashData(base);
+        hasBase = true;
+    }
+}
+
+void CheckpointWriter::encodeCheckpoint(const string& data, const string* base, unsigned long long baseHash, ostream& stream) {
+    size_t size = data.size();
+    vector<char> difference, shuffled(size+1);
+    const char* input = data.c_str();
+    if (base != NULL) {
+        if (base->size() != size)
+            throw OpenMMException("createCheckpointAsync: A delta checkpoint must be the same size as the full checkpoint");
+        difference.resize(size+1);
+        for (size_t i = 0; i < size; i++)
+            difference[i] = data[i]^(*base)[i];
+        input = &difference[0];
+    }
+    shuffleBytes(input, &shuffled[0], size);
+    string payload;
+    compressData(&shuffled[0], size, payload);
+    int version = PACKED_CHECKPOINT_VERSION;
+    int flags = (base == NULL ? 0 : DELTA_FLAG);
+    long long rawSize = size;
+    unsigned long long hash = (base == NULL ? 0 : baseHash);
+    long long payloadSize = payload.size();
+    stream.write(PACKED_CHECKPOINT_MAGIC_BYTES, sizeof(PACKED_CHECKPOINT_MAGIC_BYTES));
+    stream.write((char*) &version, sizeof(int));
+    stream.write((char*) &flags, sizeof(int));
+    stream.write((char*) &rawSize, sizeof(long long));
+    stream.write((char*) &hash, sizeof(unsigned long long));
+    stream.write((char*) &payloadSize, sizeof(long long));
+    stream.write(payload.c_str(), payloadSize);
+}
+
+bool CheckpointWriter::isPackedHeader(const char* header, int length) {
+    return (length == sizeof(PACKED_CHECKPOINT_MAGIC_BYTES) && memcmp(header, PACKED_CHECKPOINT_MAGIC_BYTES, length) == 0);
+}
+
+string CheckpointWriter::readCheckpoint(istream& stream, const string* base) {
+    const int magicLength = sizeof(PACKED_CHECKPOINT_MAGIC_BYTES);
+    char magicBytes[magicLength];
+    stream.read(magicBytes, magicLength);
+    if (isPackedHeader(magicBytes, stream.gcount()))
+        return decodeCheckpoint(stream, base);
+
+    // This is an ordinary checkpoint.  Return it unchanged, and leave it to ContextImpl to validate it.
+
+    string data(magicBytes, stream.gcount());
+    data.append(istreambuf_iterator<char>(stream), istreambuf_iterator<char>());
+    return data;
+}
+
+string CheckpointWriter::decodeCheckpoint(istream& stream, const string* base) {
+    int version, flags;
+    long long rawSize, payloadSize;
+    unsigned long long hash;
+    stream.read((char*) &version, sizeof(int));
+    if (!stream || version != PACKED_CHECKPOINT_VERSION)
+        throw OpenMMException("loadCheckpoint: Unsupported checkpoint version");
+    stream.read((char*) &flags, sizeof(int));
+    stream.read((char*) &rawSize, sizeof(long long));
+    stream.read((char*) &hash, sizeof(unsigned long long));
+    stream.read((char*) &payloadSize, sizeof(long long));
+    if (!stream || rawSize < 0 || payloadSize < 0)
+        throwCorrupted();
+    string payload(payloadSize, ' ');
+    if (payloadSize > 0)
+        stream.read(&payload[0], payloadSize);
+    if (stream.gcount() != payloadSize)
+        throwCorrupted();
+    vector<char> shuffled(rawSize+1);
+    decompressData(payload, &shuffled[0], rawSize);
+    string data(rawSize, ' ');
+    if (rawSize > 0)
+        unshuffleBytes(&shuffled[0], &data[0], rawSize);
+    if ((flags&DELTA_FLAG) != 0) {
+        if (base == NULL)
+            throw OpenMMException("loadCheckpoint: This is a delta checkpoint.  It must be loaded along with the full checkpoint it was created from.");
+        if (base->size() != data.size() || hashData(*base) != hash)
+            throw OpenMMException("loadCheckpoint: The delta checkpoint was not created from the specified full checkpoint");
+        for (size_t i = 0; i < data.size(); i++)
+            data[i] ^= (*base)[i];
+    }
+    return data;
+}
+
+unsigned long long CheckpointWriter::hashData(const string& data) {
+    // This is the 64 bit FNV-1a hash.
+
+    unsigned long long hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < data.size(); i++) {
+        hash ^= (unsigned char) data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
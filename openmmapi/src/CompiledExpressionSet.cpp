@@ -30,6 +30,11 @@ using namespace std;
 CompiledExpressionSet::CompiledExpressionSet() {
 }
 
+CompiledExpressionSet::~CompiledExpressionSet() {
+    for (int i = 0; i < (int) ownedExpressions.size(); i++)
+        delete ownedExpressions[i];
+}
+
 void CompiledExpressionSet::registerExpression(Lepton::CompiledExpression& expression) {
     expressions.push_back(&expression);
     for (int i = 0; i < (int) variables.size(); i++)
@@ -37,6 +42,14 @@ void CompiledExpressionSet::registerExpression(Lepton::CompiledExpression& expre
             variableReferences[i].push_back(&expression.getVariableReference(variables[i]));
 }
 
+CompiledExpression& CompiledExpressionSet::registerExpressions(const vector<ParsedExpression>& expressions, map<string, double*>& variableLocations) {
+    CompiledExpression* expression = new CompiledExpression(expressions);
+    ownedExpressions.push_back(expression);
+    expression->setVariableLocations(variableLocations);
+    registerExpression(*expression);
+    return *expression;
+}
+
 int CompiledExpressionSet::getVariableIndex(const std::string& name) {
     for (int i = 0; i < (int) variables.size(); i++)
         if (variables[i] == name)
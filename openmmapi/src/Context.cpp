@@ -30,6 +30,7 @@
  * -------------------------------------------------------------------------- */
 
 #include "openmm/Context.h"
+#include "openmm/ContextGroup.h"
 #include "openmm/internal/ContextImpl.h"
 #include "openmm/OpenMMException.h"
 #include "openmm/internal/ForceImpl.h"
@@ -40,18 +41,22 @@
 using namespace OpenMM;
 using namespace std;
 
-Context::Context(const System& system, Integrator& integrator) : properties(map<string, string>()) {
+Context::Context(const System& system, Integrator& integrator) : properties(map<string, string>()), group(NULL) {
     impl = new ContextImpl(*this, system, integrator, 0, properties);
 }
 
-Context::Context(const System& system, Integrator& integrator, Platform& platform) : properties(map<string, string>()) {
+Context::Context(const System& system, Integrator& integrator, Platform& platform) : properties(map<string, string>()), group(NULL) {
     impl = new ContextImpl(*this, system, integrator, &platform, properties);
 }
 
-Context::Context(const System& system, Integrator& integrator, Platform& platform, const map<string, string>& properties) : properties(properties) {
+Context::Context(const System& system, Integrator& integrator, Platform& platform, const map<string, string>& properties) : properties(properties), group(NULL) {
     impl = new ContextImpl(*this, system, integrator, &platform, properties);
 }
 
+Context::Context(const System& system, Integrator& integrator, ContextGroup& group) : properties(group.getProperties()), group(&group) {
+    impl = new ContextImpl(*this, system, integrator, &group.getPlatform(), properties, &group);
+}
+
 Context::~Context() {
     delete impl;
 }
@@ -239,9 +244,11 @@ void Context::reinitialize() {
     const System& system = impl->getSystem();
     Integrator& integrator = impl->getIntegrator();
     Platform& platform = impl->getPlatform();
+    bool profiling = impl->getProfiler().isEnabled();
     integrator.cleanup();
     delete impl;
-    impl = new ContextImpl(*this, system, integrator, &platform, properties);
+    impl = new ContextImpl(*this, system, integrator, &platform, properties, group);
+    impl->getProfiler().setEnabled(profiling);
 }
 
 void Context::createCheckpoint(ostream& stream) {
@@ -252,6 +259,18 @@ void Context::loadCheckpoint(istream& stream) {
     impl->loadCheckpoint(stream);
 }
 
+bool Context::createCheckpointAsync(ostream& stream, int options) {
+    return impl->createCheckpointAsync(stream, options);
+}
+
+void Context::waitForCheckpoint() {
+    impl->waitForCheckpoint();
+}
+
+void Context::loadCheckpoint(istream& stream, istream& fullCheckpoint) {
+    impl->loadCheckpoint(stream, fullCheckpoint);
+}
+
 ContextImpl& Context::getImpl() {
     return *impl;
 }
@@ -263,3 +282,27 @@ const ContextImpl& Context::getImpl() const {
 const vector<vector<int> >& Context::getMolecules() const {
     return impl->getMolecules();
 }
+
+void Context::setProfilingEnabled(bool enabled) {
+    impl->getProfiler().setEnabled(enabled);
+}
+
+bool Context::getProfilingEnabled() const {
+    return impl->getProfiler().isEnabled();
+}
+
+map<string, double> Context::getProfilingData() const {
+    const Profiler& profiler = impl->getProfiler();
+    map<string, double> data = profiler.getTimes();
+    for (map<string, int>::const_iterator iter = profiler.getCounts().begin(); iter != profiler.getCounts().end(); ++iter)
+        data[iter->first] = iter->second;
+    return data;
+}
+
+string Context::getProfilingDataAsJson() const {
+    return impl->getProfiler().toJson();
+}
+
+void Context::resetProfilingData() {
+    impl->getProfiler().reset();
+}
@@ -0,0 +1,76 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2016 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "openmm/ContextGroup.h"
+#include "openmm/Integrator.h"
+#include "openmm/OpenMMException.h"
+#include <algorithm>
+
+using namespace OpenMM;
+using namespace std;
+
+ContextGroup::ContextGroup(const System& system, Platform& platform) : system(system), platform(platform), stepsPerTurn(10) {
+}
+
+ContextGroup::ContextGroup(const System& system, Platform& platform, const map<string, string>& properties) : system(system), platform(platform),
+        properties(properties), stepsPerTurn(10) {
+}
+
+ContextGroup::~ContextGroup() {
+    for (int i = 0; i < (int) contexts.size(); i++)
+        delete contexts[i];
+}
+
+Context& ContextGroup::addContext(Integrator& integrator) {
+    Context* context = new Context(system, integrator, *this);
+    contexts.push_back(context);
+    return *context;
+}
+
+Context& ContextGroup::getContext(int index) {
+    if (index < 0 || index >= (int) contexts.size())
+        throw OpenMMException("getContext: Illegal index");
+    return *contexts[index];
+}
+
+void ContextGroup::setStepsPerTurn(int steps) {
+    if (steps < 1)
+        throw OpenMMException("setStepsPerTurn: The number of steps must be positive");
+    stepsPerTurn = steps;
+}
+
+void ContextGroup::step(int steps) {
+    for (int completed = 0; completed < steps; completed += stepsPerTurn) {
+        int turnSteps = min(stepsPerTurn, steps-completed);
+        for (int i = 0; i < (int) contexts.size(); i++)
+            contexts[i]->getIntegrator().step(turnSteps);
+    }
+}
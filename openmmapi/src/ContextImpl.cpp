@@ -34,8 +34,10 @@
 #include "openmm/OpenMMException.h"
 #include "openmm/System.h"
 #include "openmm/kernels.h"
+#include "openmm/internal/CheckpointWriter.h"
 #include "openmm/internal/ForceImpl.h"
 #include "openmm/internal/ContextImpl.h"
+#include "openmm/internal/timer.h"
 #include "openmm/State.h"
 #include "openmm/VirtualSite.h"
 #include "openmm/Context.h"
@@ -44,6 +46,7 @@
 #include <cstdlib>
 #include <iostream>
 #include <map>
+#include <sstream>
 #include <utility>
 #include <vector>
 #include <string.h>
@@ -53,9 +56,10 @@ using namespace std;
 const static char CHECKPOINT_MAGIC_BYTES[] = "OpenMM Binary Checkpoint\n";
 
 
-ContextImpl::ContextImpl(Context& owner, const System& system, Integrator& integrator, Platform* platform, const map<string, string>& properties) :
+ContextImpl::ContextImpl(Context& owner, const System& system, Integrator& integrator, Platform* platform, const map<string, string>& properties, ContextGroup* group) :
         owner(owner), system(system), integrator(integrator), hasInitializedForces(false), hasSetPositions(false), integratorIsDeleted(false),
-        lastForceGroups(-1), platform(platform), platformData(NULL) {
+        forceCachingEnabled(false), lastForceGroups(-1), lastRequestedGroups(-1), stateVersion(0), cachedForcesVersion(-1),
+        platform(platform), platformData(NULL), checkpointWriter(NULL), group(group) {
     if (system.getNumParticles() == 0)
         throw OpenMMException("Cannot create a Context for a System with no particles");
     
@@ -174,6 +178,10 @@ ContextImpl::ContextImpl(Context& owner, const System& system, Integrator& integ
 }
 
 ContextImpl::~ContextImpl() {
+    // Deleting the CheckpointWriter waits for any checkpoint that is still being written.
+
+    if (checkpointWriter != NULL)
+        delete checkpointWriter;
     for (int i = 0; i < (int) forceImpls.size(); ++i)
         delete forceImpls[i];
     
@@ -200,6 +208,10 @@ void ContextImpl::setTime(double t) {
     updateStateDataKernel.getAs<UpdateStateDataKernel>().setTime(*this, t);
 }
 
+int ContextImpl::getStepCount() const {
+    return updateStateDataKernel.getAs<const UpdateStateDataKernel>().getStepCount(*this);
+}
+
 void ContextImpl::getPositions(std::vector<Vec3>& positions) {
     updateStateDataKernel.getAs<UpdateStateDataKernel>().getPositions(*this, positions);
 }
@@ -207,6 +219,7 @@ void ContextImpl::getPositions(std::vector<Vec3>& positions) {
 void ContextImpl::setPositions(const std::vector<Vec3>& positions) {
     hasSetPositions = true;
     updateStateDataKernel.getAs<UpdateStateDataKernel>().setPositions(*this, positions);
+    incrementStateVersion();
     integrator.stateChanged(State::Positions);
 }
 
@@ -237,10 +250,17 @@ void ContextImpl::setParameter(std::string name, double value) {
     if (parameters.find(name) == parameters.end())
         throw OpenMMException("Called setParameter() with invalid parameter name: "+name);
     parameters[name] = value;
+    incrementStateVersion();
     integrator.stateChanged(State::Parameters);
 }
 
 void ContextImpl::getEnergyParameterDerivatives(std::map<std::string, double>& derivs) {
+    if (lastRequestedGroups != lastForceGroups) {
+        // The most recent energy was taken from the cache, so the platform does not hold the matching
+        // derivatives.  Evaluate them now.
+
+        evaluateForcesAndEnergy(true, true, lastRequestedGroups);
+    }
     updateStateDataKernel.getAs<UpdateStateDataKernel>().getEnergyParameterDerivatives(*this, derivs);
 }
 
@@ -256,10 +276,12 @@ void ContextImpl::setPeriodicBoxVectors(const Vec3& a, const Vec3& b, const Vec3
     if (a[0] <= 0.0 || b[1] <= 0.0 || c[2] <= 0.0 || a[0] < 2*fabs(b[0]) || a[0] < 2*fabs(c[0]) || b[1] < 2*fabs(c[1]))
         throw OpenMMException("Periodic box vectors must be in reduced form.");
     updateStateDataKernel.getAs<UpdateStateDataKernel>().setPeriodicBoxVectors(*this, a, b, c);
+    incrementStateVersion();
 }
 
 void ContextImpl::applyConstraints(double tol) {
     applyConstraintsKernel.getAs<ApplyConstraintsKernel>().apply(*this, tol);
+    incrementStateVersion();
 }
 
 void ContextImpl::applyVelocityConstraints(double tol) {
@@ -268,36 +290,130 @@ void ContextImpl::applyVelocityConstraints(double tol) {
 
 void ContextImpl::computeVirtualSites() {
     virtualSitesKernel.getAs<VirtualSitesKernel>().computePositions(*this);
+    incrementStateVersion();
 }
 
 double ContextImpl::calcForcesAndEnergy(bool includeForces, bool includeEnergy, int groups) {
     if (!hasSetPositions)
         throw OpenMMException("Particle positions have not been set");
+    if (!forceCachingEnabled) {
+        // The state may have been modified without notifying us, so nothing in the cache can be trusted.
+
+        incrementStateVersion();
+        return evaluateForcesAndEnergy(includeForces, includeEnergy, groups);
+    }
+    if (includeForces || includeEnergy) {
+        // See whether we can satisfy the request from the cache.
+
+        map<int, pair<long long, double> >::const_iterator cached = cachedEnergies.find(groups);
+        bool forcesCached = (!includeForces || (groups == lastForceGroups && cachedForcesVersion == stateVersion));
+        bool energyCached = (!includeEnergy || (cached != cachedEnergies.end() && cached->second.first == stateVersion));
+        if (forcesCached && energyCached) {
+            lastRequestedGroups = groups;
+            return (includeEnergy ? cached->second.second : 0.0);
+        }
+    }
+    return evaluateForcesAndEnergy(includeForces, includeEnergy, groups);
+}
+
+double ContextImpl::evaluateForcesAndEnergy(bool includeForces, bool includeEnergy, int groups) {
     lastForceGroups = groups;
+    lastRequestedGroups = groups;
     CalcForcesAndEnergyKernel& kernel = initializeForcesKernel.getAs<CalcForcesAndEnergyKernel>();
     while (true) {
         double energy = 0.0;
-        kernel.beginComputation(*this, includeForces, includeEnergy, groups);
-        for (int i = 0; i < (int) forceImpls.size(); ++i)
-            energy += forceImpls[i]->calcForcesAndEnergy(*this, includeForces, includeEnergy, groups);
         bool valid = true;
-        energy += kernel.finishComputation(*this, includeForces, includeEnergy, groups, valid);
-        if (valid)
+        if (profiler.isEnabled())
+            energy = evaluateForcesAndEnergyWithProfiling(includeForces, includeEnergy, groups, valid);
+        else {
+            kernel.beginComputation(*this, includeForces, includeEnergy, groups);
+            for (int i = 0; i < (int) forceImpls.size(); ++i)
+                energy += forceImpls[i]->calcForcesAndEnergy(*this, includeForces, includeEnergy, groups);
+            energy += kernel.finishComputation(*this, includeForces, includeEnergy, groups, valid);
+        }
+        if (valid) {
+            cachedForcesVersion = (includeForces ? stateVersion : -1);
+            if (includeEnergy)
+                cachedEnergies[groups] = make_pair(stateVersion, energy);
             return energy;
+        }
+    }
+}
+
+double ContextImpl::evaluateForcesAndEnergyWithProfiling(bool includeForces, bool includeEnergy, int groups, bool& valid) {
+    if (forceTimerNames.size() != forceImpls.size()) {
+        // Name each timer after the kernel that computes the Force.
+
+        forceTimerNames.clear();
+        for (int i = 0; i < (int) forceImpls.size(); i++) {
+            stringstream name;
+            name << "Force " << i;
+            vector<string> kernelNames = forceImpls[i]->getKernelNames();
+            if (kernelNames.size() > 0)
+                name << " (" << kernelNames[0] << ")";
+            forceTimerNames.push_back(name.str());
+        }
+    }
+    CalcForcesAndEnergyKernel& kernel = initializeForcesKernel.getAs<CalcForcesAndEnergyKernel>();
+    double energy = 0.0;
+    double startTime = getCurrentTime();
+    kernel.beginComputation(*this, includeForces, includeEnergy, groups);
+    double endTime = getCurrentTime();
+    profiler.addTime("Begin force computation", endTime-startTime);
+    for (int i = 0; i < (int) forceImpls.size(); ++i) {
+        startTime = endTime;
+        energy += forceImpls[i]->calcForcesAndEnergy(*this, includeForces, includeEnergy, groups);
+        endTime = getCurrentTime();
+        profiler.addTime(forceTimerNames[i], endTime-startTime);
     }
+    startTime = endTime;
+    energy += kernel.finishComputation(*this, includeForces, includeEnergy, groups, valid);
+    profiler.addTime("Finish force computation", getCurrentTime()-startTime);
+    return energy;
 }
 
 int ContextImpl::getLastForceGroups() const {
     return lastForceGroups;
 }
 
+long long ContextImpl::getStateVersion() const {
+    return stateVersion;
+}
+
+void ContextImpl::incrementStateVersion() {
+    stateVersion++;
+}
+
+void ContextImpl::setForceCachingEnabled(bool enabled) {
+    if (enabled && !forceCachingEnabled)
+        incrementStateVersion();
+    forceCachingEnabled = enabled;
+}
+
+bool ContextImpl::getForceCachingEnabled() const {
+    return forceCachingEnabled;
+}
+
 double ContextImpl::calcKineticEnergy() {
     return integrator.computeKineticEnergy();
 }
 
 void ContextImpl::updateContextState() {
-    for (int i = 0; i < (int) forceImpls.size(); ++i)
-        forceImpls[i]->updateContextState(*this);
+    // ForceImpls may modify the state directly (for example, a barostat scaling the coordinates), so
+    // don't let them see cached results.
+
+    bool cachingWasEnabled = forceCachingEnabled;
+    forceCachingEnabled = false;
+    try {
+        for (int i = 0; i < (int) forceImpls.size(); ++i)
+            forceImpls[i]->updateContextState(*this);
+    }
+    catch (...) {
+        forceCachingEnabled = cachingWasEnabled;
+        throw;
+    }
+    forceCachingEnabled = cachingWasEnabled;
+    incrementStateVersion();
 }
 
 const vector<ForceImpl*>& ContextImpl::getForceImpls() const {
@@ -439,6 +555,13 @@ void ContextImpl::loadCheckpoint(istream& stream) {
     static const int magiclength = sizeof(CHECKPOINT_MAGIC_BYTES)/sizeof(CHECKPOINT_MAGIC_BYTES[0]);
     char magicbytes[magiclength];
     stream.read(magicbytes, magiclength);
+    if (CheckpointWriter::isPackedHeader(magicbytes, stream.gcount())) {
+        // This is a compressed checkpoint written by createCheckpointAsync().
+
+        istringstream decoded(CheckpointWriter::decodeCheckpoint(stream, NULL));
+        loadCheckpoint(decoded);
+        return;
+    }
     if (memcmp(magicbytes, CHECKPOINT_MAGIC_BYTES, magiclength) != 0)
         throw OpenMMException("loadCheckpoint: Checkpoint header was not correct");
 
@@ -459,4 +582,22 @@ void ContextImpl::loadCheckpoint(istream& stream) {
     }
     updateStateDataKernel.getAs<UpdateStateDataKernel>().loadCheckpoint(*this, stream);
     hasSetPositions = true;
+    incrementStateVersion();
+}
+
+bool ContextImpl::createCheckpointAsync(ostream& stream, int options) {
+    if (checkpointWriter == NULL)
+        checkpointWriter = new CheckpointWriter();
+    return checkpointWriter->write(*this, stream, options);
+}
+
+void ContextImpl::waitForCheckpoint() {
+    if (checkpointWriter != NULL)
+        checkpointWriter->waitForCompletion();
+}
+
+void ContextImpl::loadCheckpoint(istream& stream, istream& fullCheckpoint) {
+    string base = CheckpointWriter::readCheckpoint(fullCheckpoint, NULL);
+    istringstream decoded(CheckpointWriter::readCheckpoint(stream, &base));
+    loadCheckpoint(decoded);
 }
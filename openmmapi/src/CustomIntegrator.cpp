@@ -97,9 +97,22 @@ void CustomIntegrator::step(int steps) {
     if (context == NULL)
         throw OpenMMException("This Integrator is not bound to a context!");  
     globalsAreCurrent = false;
-    for (int i = 0; i < steps; ++i) {
-        kernel.getAs<IntegrateCustomStepKernel>().execute(*context, *this, forcesAreValid);
+    
+    // The kernel notifies the ContextImpl whenever it modifies the state, so it is safe to let repeated
+    // requests for the same force groups be satisfied from the cache.
+    
+    bool cachingWasEnabled = context->getForceCachingEnabled();
+    context->setForceCachingEnabled(true);
+    try {
+        for (int i = 0; i < steps; ++i) {
+            kernel.getAs<IntegrateCustomStepKernel>().execute(*context, *this, forcesAreValid);
+        }
+    }
+    catch (...) {
+        context->setForceCachingEnabled(cachingWasEnabled);
+        throw;
     }
+    context->setForceCachingEnabled(cachingWasEnabled);
 }
 
 int CustomIntegrator::addGlobalVariable(const string& name, double initialValue) {
@@ -48,7 +48,8 @@ using std::stringstream;
 using std::vector;
 
 CustomNonbondedForce::CustomNonbondedForce(const string& energy) : energyExpression(energy), nonbondedMethod(NoCutoff), cutoffDistance(1.0),
-    switchingDistance(-1.0), useSwitchingFunction(false), useLongRangeCorrection(false) {
+    switchingDistance(-1.0), longRangeTableMin(0.0), longRangeTableMax(1.0), useSwitchingFunction(false), useLongRangeCorrection(false),
+    longRangeTablePoints(21) {
 }
 
 CustomNonbondedForce::CustomNonbondedForce(const CustomNonbondedForce& rhs) {
@@ -59,6 +60,10 @@ CustomNonbondedForce::CustomNonbondedForce(const CustomNonbondedForce& rhs) {
     switchingDistance = rhs.switchingDistance;
     useSwitchingFunction = rhs.useSwitchingFunction;
     useLongRangeCorrection = rhs.useLongRangeCorrection;
+    longRangeTableParameter = rhs.longRangeTableParameter;
+    longRangeTableMin = rhs.longRangeTableMin;
+    longRangeTableMax = rhs.longRangeTableMax;
+    longRangeTablePoints = rhs.longRangeTablePoints;
     parameters = rhs.parameters;
     globalParameters = rhs.globalParameters;
     energyParameterDerivatives = rhs.energyParameterDerivatives;
@@ -122,6 +127,26 @@ void CustomNonbondedForce::setUseLongRangeCorrection(bool use) {
     useLongRangeCorrection = use;
 }
 
+void CustomNonbondedForce::getLongRangeCorrectionTable(string& parameter, double& minValue, double& maxValue, int& numPoints) const {
+    parameter = longRangeTableParameter;
+    minValue = longRangeTableMin;
+    maxValue = longRangeTableMax;
+    numPoints = longRangeTablePoints;
+}
+
+void CustomNonbondedForce::setLongRangeCorrectionTable(const string& parameter, double minValue, double maxValue, int numPoints) {
+    if (!parameter.empty()) {
+        if (minValue >= maxValue)
+            throw OpenMMException("CustomNonbondedForce: The minimum value of a long range correction table must be less than the maximum value");
+        if (numPoints < 3)
+            throw OpenMMException("CustomNonbondedForce: A long range correction table must have at least 3 points");
+    }
+    longRangeTableParameter = parameter;
+    longRangeTableMin = minValue;
+    longRangeTableMax = maxValue;
+    longRangeTablePoints = numPoints;
+}
+
 int CustomNonbondedForce::addPerParticleParameter(const string& name) {
     parameters.push_back(PerParticleParameterInfo(name));
     return parameters.size()-1;
@@ -311,3 +336,9 @@ ForceImpl* CustomNonbondedForce::createImpl() const {
 void CustomNonbondedForce::updateParametersInContext(Context& context) {
     dynamic_cast<CustomNonbondedForceImpl&>(getImplInContext(context)).updateParametersInContext(getContextImpl(context));
 }
+
+void CustomNonbondedForce::updateParameterSubsetInContext(Context& context, const vector<int>& particles) {
+    for (int i = 0; i < (int) particles.size(); i++)
+        ASSERT_VALID_INDEX(particles[i], this->particles);
+    dynamic_cast<CustomNonbondedForceImpl&>(getImplInContext(context)).updateParameterSubsetInContext(getContextImpl(context), particles);
+}
@@ -36,8 +36,10 @@
 #include "openmm/internal/ContextImpl.h"
 #include "openmm/internal/CustomNonbondedForceImpl.h"
 #include "openmm/internal/SplineFitter.h"
+#include "openmm/internal/ThreadPool.h"
 #include "openmm/kernels.h"
 #include "ReferenceTabulatedFunction.h"
+#include "lepton/Operation.h"
 #include "lepton/ParsedExpression.h"
 #include "lepton/Parser.h"
 #include <cmath>
@@ -157,100 +159,21 @@ void CustomNonbondedForceImpl::updateParametersInContext(ContextImpl& context) {
     kernel.getAs<CalcCustomNonbondedForceKernel>().copyParametersToContext(context, owner);
 }
 
+void CustomNonbondedForceImpl::updateParameterSubsetInContext(ContextImpl& context, const vector<int>& particles) {
+    kernel.getAs<CalcCustomNonbondedForceKernel>().copyParameterSubsetToContext(context, owner, particles);
+}
+
 void CustomNonbondedForceImpl::calcLongRangeCorrection(const CustomNonbondedForce& force, const Context& context, double& coefficient, vector<double>& derivatives) {
-    if (force.getNonbondedMethod() == CustomNonbondedForce::NoCutoff || force.getNonbondedMethod() == CustomNonbondedForce::CutoffNonPeriodic) {
-        coefficient = 0.0;
-        return;
-    }
-    
-    // Identify all particle classes (defined by parameters), and record the class of each particle.
-    
-    int numParticles = force.getNumParticles();
-    vector<vector<double> > classes;
-    map<vector<double>, int> classIndex;
-    vector<int> atomClass(numParticles);
-    for (int i = 0; i < numParticles; i++) {
-        vector<double> parameters;
-        force.getParticleParameters(i, parameters);
-        if (classIndex.find(parameters) == classIndex.end()) {
-            classIndex[parameters] = classes.size();
-            classes.push_back(parameters);
-        }
-        atomClass[i] = classIndex[parameters];
-    }
-    int numClasses = classes.size();
-    
-    // Count the total number of particle pairs for each pair of classes.
-    
-    map<pair<int, int>, long long int> interactionCount;
-    if (force.getNumInteractionGroups() == 0) {
-        // Count the particles of each class.
-        
-        vector<long long int> classCounts(numClasses, 0);
-        for (int i = 0; i < numParticles; i++)
-            classCounts[atomClass[i]]++;
-        for (int i = 0; i < numClasses; i++) {
-            interactionCount[make_pair(i, i)] = (classCounts[i]*(classCounts[i]+1))/2;
-            for (int j = i+1; j < numClasses; j++)
-                interactionCount[make_pair(i, j)] = classCounts[i]*classCounts[j];
-        }
-    }
-    else {
-        // Initialize the counts to 0.
-        
-        for (int i = 0; i < numClasses; i++) {
-            for (int j = i; j < numClasses; j++)
-                interactionCount[make_pair(i, j)] = 0;
-        }
-        
-        // Loop over interaction groups and count the interactions in each one.
-        
-        for (int group = 0; group < force.getNumInteractionGroups(); group++) {
-            set<int> set1, set2;
-            force.getInteractionGroupParameters(group, set1, set2);
-            for (set<int>::const_iterator a1 = set1.begin(); a1 != set1.end(); ++a1)
-                for (set<int>::const_iterator a2 = set2.begin(); a2 != set2.end(); ++a2) {
-                    if (*a1 >= *a2 && set1.find(*a2) != set1.end() && set2.find(*a1) != set2.end())
-                        continue;
-                    int class1 = atomClass[*a1];
-                    int class2 = atomClass[*a2];
-                    interactionCount[make_pair(min(class1, class2), max(class1, class2))]++;
-                }
-        }
-    }
-    
-    // Compute the coefficient.
-    
-    map<string, Lepton::CustomFunction*> functions;
-    for (int i = 0; i < force.getNumFunctions(); i++)
-        functions[force.getTabulatedFunctionName(i)] = createReferenceTabulatedFunction(force.getTabulatedFunction(i));
-    double nPart = (double) numParticles;
-    double numInteractions = (nPart*(nPart+1))/2;
-    Lepton::CompiledExpression expression = Lepton::Parser::parse(force.getEnergyFunction(), functions).createCompiledExpression();
-    double sum = 0;
-    for (int i = 0; i < numClasses; i++)
-        for (int j = i; j < numClasses; j++)
-            sum += interactionCount[make_pair(i, j)]*integrateInteraction(expression, classes[i], classes[j], force, context);
-    sum /= numInteractions;
-    coefficient = 2*M_PI*nPart*nPart*sum;
-    
-    // Now do the same for parameter derivatives.
-    
-    int numDerivs = force.getNumEnergyParameterDerivatives();
-    derivatives.resize(numDerivs);
-    for (int k = 0; k < numDerivs; k++) {
-        expression = Lepton::Parser::parse(force.getEnergyFunction(), functions).differentiate(force.getEnergyParameterDerivativeName(k)).createCompiledExpression();
-        sum = 0;
-        for (int i = 0; i < numClasses; i++)
-            for (int j = i; j < numClasses; j++)
-                sum += interactionCount[make_pair(i, j)]*integrateInteraction(expression, classes[i], classes[j], force, context);
-        sum /= numInteractions;
-        derivatives[k] = 2*M_PI*nPart*nPart*sum;
+    map<string, double> globalParameters;
+    for (int i = 0; i < force.getNumGlobalParameters(); i++) {
+        const string& name = force.getGlobalParameterName(i);
+        globalParameters[name] = context.getParameter(name);
     }
+    LongRangeCorrectionData(force).integrateCorrection(globalParameters, coefficient, derivatives);
 }
 
 double CustomNonbondedForceImpl::integrateInteraction(Lepton::CompiledExpression& expression, const vector<double>& params1, const vector<double>& params2,
-        const CustomNonbondedForce& force, const Context& context) {
+        const CustomNonbondedForce& force, const map<string, double>& globalParameters) {
     const set<string>& variables = expression.getVariables();
     for (int i = 0; i < force.getNumPerParticleParameters(); i++) {
         stringstream name1, name2;
@@ -264,7 +187,7 @@ double CustomNonbondedForceImpl::integrateInteraction(Lepton::CompiledExpression
     for (int i = 0; i < force.getNumGlobalParameters(); i++) {
         const string& name = force.getGlobalParameterName(i);
         if (variables.find(name) != variables.end())
-            expression.getVariableReference(name) = context.getParameter(name);
+            expression.getVariableReference(name) = globalParameters.find(name)->second;
     }
     
     // To integrate from r_cutoff to infinity, make the change of variables x=r_cutoff/r and integrate from 0 to 1.
@@ -331,3 +254,274 @@ double CustomNonbondedForceImpl::integrateInteraction(Lepton::CompiledExpression
     }
     return sum/cutoff+sum2;
 }
+
+class CustomNonbondedForceImpl::LongRangeCorrectionData::IntegrateTask : public ThreadPool::Task {
+public:
+    IntegrateTask(LongRangeCorrectionData& owner, const vector<map<string, double> >& points, int numExpressions, vector<double>& integrals) :
+            owner(owner), points(points), numExpressions(numExpressions), integrals(integrals), errors(owner.threadExpressions.size()) {
+    }
+    void execute(ThreadPool& threads, int threadIndex) {
+        integrateItems(threadIndex);
+    }
+    void integrateItems(int threadIndex) {
+        // Each work item is one expression evaluated for one pair of classes at one point.  Each thread
+        // stores its results into separate elements, so the final sums do not depend on the number of threads.
+
+        int numThreads = owner.threadExpressions.size();
+        int numPairs = owner.classPairs.size();
+        int numItems = points.size()*numPairs*numExpressions;
+        try {
+            for (int item = threadIndex; item < numItems; item += numThreads) {
+                int expression = item%numExpressions;
+                int pair = (item/numExpressions)%numPairs;
+                int point = item/(numExpressions*numPairs);
+                if (owner.isZero[expression]) {
+                    integrals[item] = 0.0;
+                    continue;
+                }
+                const vector<double>& params1 = owner.classes[owner.classPairs[pair].first];
+                const vector<double>& params2 = owner.classes[owner.classPairs[pair].second];
+                integrals[item] = integrateInteraction(owner.threadExpressions[threadIndex][expression], params1, params2, owner.force, points[point]);
+            }
+        }
+        catch (exception& ex) {
+            errors[threadIndex] = ex.what();
+        }
+    }
+    LongRangeCorrectionData& owner;
+    const vector<map<string, double> >& points;
+    int numExpressions;
+    vector<double>& integrals;
+    vector<string> errors;
+};
+
+CustomNonbondedForceImpl::LongRangeCorrectionData::LongRangeCorrectionData(const CustomNonbondedForce& force) : force(force), numOutputs(0), hasTable(false) {
+    periodic = (force.getNonbondedMethod() != CustomNonbondedForce::NoCutoff && force.getNonbondedMethod() != CustomNonbondedForce::CutoffNonPeriodic);
+    force.getLongRangeCorrectionTable(tableParameter, tableMin, tableMax, tablePoints);
+    if (!periodic)
+        return;
+    
+    // Identify all particle classes (defined by parameters), and record the class of each particle.
+    
+    int numParticles = force.getNumParticles();
+    atomClass.resize(numParticles);
+    for (int i = 0; i < numParticles; i++) {
+        vector<double> parameters;
+        force.getParticleParameters(i, parameters);
+        if (classIndex.find(parameters) == classIndex.end()) {
+            classIndex[parameters] = classes.size();
+            classes.push_back(parameters);
+        }
+        atomClass[i] = classIndex[parameters];
+    }
+    countInteractions();
+    this->numParticles = numParticles;
+    numInteractions = (this->numParticles*(this->numParticles+1))/2;
+    
+    // Parse the energy expression and its derivatives.
+    
+    for (int i = 0; i < force.getNumFunctions(); i++)
+        functions[force.getTabulatedFunctionName(i)] = createReferenceTabulatedFunction(force.getTabulatedFunction(i));
+    Lepton::ParsedExpression energyExpression = Lepton::Parser::parse(force.getEnergyFunction(), functions);
+    expressions.push_back(energyExpression);
+    for (int i = 0; i < force.getNumEnergyParameterDerivatives(); i++)
+        expressions.push_back(energyExpression.differentiate(force.getEnergyParameterDerivativeName(i)));
+    numOutputs = expressions.size();
+    
+    // When interpolating from a table, we also need the derivative of each one with respect to the tabulated parameter.
+    
+    if (!tableParameter.empty())
+        for (int i = 0; i < numOutputs; i++)
+            expressions.push_back(expressions[i].differentiate(tableParameter).optimize());
+    
+    // An expression that is identically zero (for example, the derivative with respect to a parameter it
+    // does not depend on) does not need to be integrated.
+    
+    for (int i = 0; i < (int) expressions.size(); i++) {
+        const Lepton::Operation& op = expressions[i].getRootNode().getOperation();
+        isZero.push_back(op.getId() == Lepton::Operation::CONSTANT && dynamic_cast<const Lepton::Operation::Constant&>(op).getValue() == 0.0);
+    }
+}
+
+CustomNonbondedForceImpl::LongRangeCorrectionData::~LongRangeCorrectionData() {
+    for (map<string, Lepton::CustomFunction*>::iterator iter = functions.begin(); iter != functions.end(); iter++)
+        delete iter->second;
+}
+
+void CustomNonbondedForceImpl::LongRangeCorrectionData::countInteractions() {
+    // Count the total number of particle pairs for each pair of classes.
+    
+    int numParticles = atomClass.size();
+    int numClasses = classes.size();
+    map<pair<int, int>, long long int> interactionCount;
+    if (force.getNumInteractionGroups() == 0) {
+        // Count the particles of each class.
+        
+        vector<long long int> classCounts(numClasses, 0);
+        for (int i = 0; i < numParticles; i++)
+            classCounts[atomClass[i]]++;
+        for (int i = 0; i < numClasses; i++) {
+            interactionCount[make_pair(i, i)] = (classCounts[i]*(classCounts[i]+1))/2;
+            for (int j = i+1; j < numClasses; j++)
+                interactionCount[make_pair(i, j)] = classCounts[i]*classCounts[j];
+        }
+    }
+    else {
+        // Loop over interaction groups and count the interactions in each one.
+        
+        for (int group = 0; group < force.getNumInteractionGroups(); group++) {
+            set<int> set1, set2;
+            force.getInteractionGroupParameters(group, set1, set2);
+            for (set<int>::const_iterator a1 = set1.begin(); a1 != set1.end(); ++a1)
+                for (set<int>::const_iterator a2 = set2.begin(); a2 != set2.end(); ++a2) {
+                    if (*a1 >= *a2 && set1.find(*a2) != set1.end() && set2.find(*a1) != set2.end())
+                        continue;
+                    int class1 = atomClass[*a1];
+                    int class2 = atomClass[*a2];
+                    interactionCount[make_pair(min(class1, class2), max(class1, class2))]++;
+                }
+        }
+    }
+    
+    // Only pairs of classes that actually interact need to be integrated.
+    
+    classPairs.clear();
+    classPairCounts.clear();
+    for (map<pair<int, int>, long long int>::const_iterator iter = interactionCount.begin(); iter != interactionCount.end(); ++iter)
+        if (iter->second > 0) {
+            classPairs.push_back(iter->first);
+            classPairCounts.push_back(iter->second);
+        }
+}
+
+void CustomNonbondedForceImpl::LongRangeCorrectionData::updateParticles(const CustomNonbondedForce& force, const vector<int>& particles) {
+    if (!periodic)
+        return;
+    bool changed = false;
+    for (int i = 0; i < (int) particles.size(); i++) {
+        vector<double> parameters;
+        force.getParticleParameters(particles[i], parameters);
+        this->force.setParticleParameters(particles[i], parameters);
+        map<vector<double>, int>::const_iterator entry = classIndex.find(parameters);
+        int newClass;
+        if (entry == classIndex.end()) {
+            newClass = classes.size();
+            classIndex[parameters] = newClass;
+            classes.push_back(parameters);
+        }
+        else
+            newClass = entry->second;
+        if (newClass != atomClass[particles[i]]) {
+            atomClass[particles[i]] = newClass;
+            changed = true;
+        }
+    }
+    if (changed) {
+        countInteractions();
+        hasTable = false;
+    }
+}
+
+void CustomNonbondedForceImpl::LongRangeCorrectionData::calcCorrection(const map<string, double>& globalParameters, double& coefficient,
+        vector<double>& derivatives, ThreadPool* threads) {
+    if (!periodic || tableParameter.empty()) {
+        integrateCorrection(globalParameters, coefficient, derivatives, threads);
+        return;
+    }
+    map<string, double>::const_iterator param = globalParameters.find(tableParameter);
+    if (param == globalParameters.end())
+        throw OpenMMException("CustomNonbondedForce: The long range correction table refers to an undefined global parameter: "+tableParameter);
+    double value = param->second;
+    if (value < tableMin || value > tableMax) {
+        integrateCorrection(globalParameters, coefficient, derivatives, threads);
+        return;
+    }
+    
+    // The table depends on the values of all other parameters.  Rebuild it if any of them has changed.
+    
+    map<string, double> otherParameters = globalParameters;
+    otherParameters.erase(tableParameter);
+    if (!hasTable || otherParameters != tableGlobalParameters) {
+        vector<map<string, double> > points(tablePoints, globalParameters);
+        tableX.resize(tablePoints);
+        for (int i = 0; i < tablePoints; i++) {
+            tableX[i] = tableMin+i*(tableMax-tableMin)/(tablePoints-1);
+            points[i][tableParameter] = tableX[i];
+        }
+        integrate(points, expressions.size(), tableValues, threads);
+        tableGlobalParameters = otherParameters;
+        hasTable = true;
+    }
+    
+    // Interpolate with a cubic Hermite spline, using the derivatives with respect to the parameter as the slopes.
+    
+    double spacing = (tableMax-tableMin)/(tablePoints-1);
+    int index = min((int) ((value-tableMin)/spacing), tablePoints-2);
+    double u = (value-tableX[index])/spacing;
+    double u2 = u*u, u3 = u*u2;
+    double h00 = 2*u3-3*u2+1, h10 = u3-2*u2+u, h01 = 3*u2-2*u3, h11 = u3-u2;
+    const vector<double>& lower = tableValues[index];
+    const vector<double>& upper = tableValues[index+1];
+    vector<double> values(numOutputs);
+    for (int i = 0; i < numOutputs; i++)
+        values[i] = h00*lower[i] + h10*spacing*lower[i+numOutputs] + h01*upper[i] + h11*spacing*upper[i+numOutputs];
+    coefficient = values[0];
+    derivatives.assign(values.begin()+1, values.end());
+}
+
+void CustomNonbondedForceImpl::LongRangeCorrectionData::integrateCorrection(const map<string, double>& globalParameters, double& coefficient,
+        vector<double>& derivatives, ThreadPool* threads) {
+    if (!periodic) {
+        coefficient = 0.0;
+        derivatives.assign(force.getNumEnergyParameterDerivatives(), 0.0);
+        return;
+    }
+    vector<map<string, double> > points(1, globalParameters);
+    vector<vector<double> > results;
+    integrate(points, numOutputs, results, threads);
+    coefficient = results[0][0];
+    derivatives.assign(results[0].begin()+1, results[0].end());
+}
+
+void CustomNonbondedForceImpl::LongRangeCorrectionData::integrate(const vector<map<string, double> >& points, int numExpressions, vector<vector<double> >& results,
+        ThreadPool* threads) {
+    // Each thread needs its own copy of the compiled expressions.
+    
+    int numThreads = (threads == NULL ? 1 : threads->getNumThreads());
+    if (threadExpressions.size() != (size_t) numThreads) {
+        threadExpressions.resize(numThreads);
+        for (int i = 0; i < numThreads; i++) {
+            threadExpressions[i].clear();
+            for (int j = 0; j < (int) expressions.size(); j++)
+                threadExpressions[i].push_back(expressions[j].createCompiledExpression());
+        }
+    }
+    
+    // Compute the integrals.
+    
+    int numPairs = classPairs.size();
+    vector<double> integrals(points.size()*numPairs*numExpressions);
+    IntegrateTask task(*this, points, numExpressions, integrals);
+    if (threads == NULL)
+        task.integrateItems(0);
+    else {
+        threads->execute(task);
+        threads->waitForThreads();
+    }
+    for (int i = 0; i < numThreads; i++)
+        if (!task.errors[i].empty())
+            throw OpenMMException(task.errors[i]);
+    
+    // Sum the contributions from all pairs of classes.
+    
+    results.resize(points.size());
+    for (int point = 0; point < (int) points.size(); point++) {
+        results[point].resize(numExpressions);
+        for (int expression = 0; expression < numExpressions; expression++) {
+            double sum = 0;
+            for (int pair = 0; pair < numPairs; pair++)
+                sum += classPairCounts[pair]*integrals[(point*numPairs+pair)*numExpressions+expression];
+            results[point][expression] = 2*M_PI*numParticles*numParticles*sum/numInteractions;
+        }
+    }
+}
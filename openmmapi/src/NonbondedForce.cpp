@@ -247,3 +247,11 @@ void NonbondedForce::setReciprocalSpaceForceGroup(int group) {
 void NonbondedForce::updateParametersInContext(Context& context) {
     dynamic_cast<NonbondedForceImpl&>(getImplInContext(context)).updateParametersInContext(getContextImpl(context));
 }
+
+void NonbondedForce::updateParameterSubsetInContext(Context& context, const vector<int>& particles, const vector<int>& exceptions) {
+    for (int i = 0; i < (int) particles.size(); i++)
+        ASSERT_VALID_INDEX(particles[i], this->particles);
+    for (int i = 0; i < (int) exceptions.size(); i++)
+        ASSERT_VALID_INDEX(exceptions[i], this->exceptions);
+    dynamic_cast<NonbondedForceImpl&>(getImplInContext(context)).updateParameterSubsetInContext(getContextImpl(context), particles, exceptions);
+}
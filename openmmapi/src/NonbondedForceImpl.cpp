@@ -218,17 +218,39 @@ double NonbondedForceImpl::evalIntegral(double r, double rs, double rc, double s
 }
 
 double NonbondedForceImpl::calcDispersionCorrection(const System& system, const NonbondedForce& force) {
-    if (force.getNonbondedMethod() == NonbondedForce::NoCutoff || force.getNonbondedMethod() == NonbondedForce::CutoffNonPeriodic)
-        return 0.0;
+    return DispersionCorrectionData(system, force).getCoefficient();
+}
+
+void NonbondedForceImpl::updateParametersInContext(ContextImpl& context) {
+    kernel.getAs<CalcNonbondedForceKernel>().copyParametersToContext(context, owner);
+}
+
+void NonbondedForceImpl::updateParameterSubsetInContext(ContextImpl& context, const vector<int>& particles, const vector<int>& exceptions) {
+    kernel.getAs<CalcNonbondedForceKernel>().copyParameterSubsetToContext(context, owner, particles, exceptions);
+}
+
+void NonbondedForceImpl::getPMEParameters(double& alpha, int& nx, int& ny, int& nz) const {
+    kernel.getAs<CalcNonbondedForceKernel>().getPMEParameters(alpha, nx, ny, nz);
+}
+
+NonbondedForceImpl::DispersionCorrectionData::DispersionCorrectionData(const System& system, const NonbondedForce& force) : sum1(0), sum2(0), sum3(0) {
+    periodic = (force.getNonbondedMethod() != NonbondedForce::NoCutoff && force.getNonbondedMethod() != NonbondedForce::CutoffNonPeriodic);
+    useSwitch = force.getUseSwitchingFunction();
+    cutoff = force.getCutoffDistance();
+    switchDist = force.getSwitchingDistance();
+    numParticles = (double) system.getNumParticles();
+    if (!periodic)
+        return;
     
     // Identify all particle classes (defined by sigma and epsilon), and count the number of
     // particles in each class.
 
-    map<pair<double, double>, int> classCounts;
+    particleClass.resize(force.getNumParticles());
     for (int i = 0; i < force.getNumParticles(); i++) {
         double charge, sigma, epsilon;
         force.getParticleParameters(i, charge, sigma, epsilon);
         pair<double, double> key = make_pair(sigma, epsilon);
+        particleClass[i] = key;
         map<pair<double, double>, int>::iterator entry = classCounts.find(key);
         if (entry == classCounts.end())
             classCounts[key] = 1;
@@ -236,49 +258,66 @@ double NonbondedForceImpl::calcDispersionCorrection(const System& system, const
             entry->second++;
     }
 
-    // Loop over all pairs of classes to compute the coefficient.
+    // Loop over all pairs of classes to compute the sums.
 
-    double sum1 = 0, sum2 = 0, sum3 = 0;
-    bool useSwitch = force.getUseSwitchingFunction();
-    double cutoff = force.getCutoffDistance();
-    double switchDist = force.getSwitchingDistance();
     for (map<pair<double, double>, int>::const_iterator entry = classCounts.begin(); entry != classCounts.end(); ++entry) {
-        double sigma = entry->first.first;
-        double epsilon = entry->first.second;
         double count = (double) entry->second;
-        count *= (count + 1) / 2;
-        double sigma2 = sigma*sigma;
-        double sigma6 = sigma2*sigma2*sigma2;
-        sum1 += count*epsilon*sigma6*sigma6;
-        sum2 += count*epsilon*sigma6;
-        if (useSwitch)
-            sum3 += count*epsilon*(evalIntegral(cutoff, switchDist, cutoff, sigma)-evalIntegral(switchDist, switchDist, cutoff, sigma));
+        addPairs(entry->first, entry->first, count*(count+1)/2);
     }
     for (map<pair<double, double>, int>::const_iterator class1 = classCounts.begin(); class1 != classCounts.end(); ++class1)
-        for (map<pair<double, double>, int>::const_iterator class2 = classCounts.begin(); class2 != class1; ++class2) {
-            double sigma = 0.5*(class1->first.first+class2->first.first);
-            double epsilon = sqrt(class1->first.second*class2->first.second);
-            double count = (double) class1->second;
-            count *= (double) class2->second;
-            double sigma2 = sigma*sigma;
-            double sigma6 = sigma2*sigma2*sigma2;
-            sum1 += count*epsilon*sigma6*sigma6;
-            sum2 += count*epsilon*sigma6;
-            if (useSwitch)
-                sum3 += count*epsilon*(evalIntegral(cutoff, switchDist, cutoff, sigma)-evalIntegral(switchDist, switchDist, cutoff, sigma));
-        }
-    double numParticles = (double) system.getNumParticles();
+        for (map<pair<double, double>, int>::const_iterator class2 = classCounts.begin(); class2 != class1; ++class2)
+            addPairs(class1->first, class2->first, (double) class1->second*(double) class2->second);
+}
+
+double NonbondedForceImpl::DispersionCorrectionData::getCoefficient() const {
+    if (!periodic)
+        return 0.0;
     double numInteractions = (numParticles*(numParticles+1))/2;
-    sum1 /= numInteractions;
-    sum2 /= numInteractions;
-    sum3 /= numInteractions;
-    return 8*numParticles*numParticles*M_PI*(sum1/(9*pow(cutoff, 9))-sum2/(3*pow(cutoff, 3))+sum3);
+    return 8*numParticles*numParticles*M_PI*((sum1/numInteractions)/(9*pow(cutoff, 9))-(sum2/numInteractions)/(3*pow(cutoff, 3))+sum3/numInteractions);
 }
 
-void NonbondedForceImpl::updateParametersInContext(ContextImpl& context) {
-    kernel.getAs<CalcNonbondedForceKernel>().copyParametersToContext(context, owner);
+void NonbondedForceImpl::DispersionCorrectionData::updateParticles(const NonbondedForce& force, const vector<int>& particles) {
+    if (!periodic)
+        return;
+    for (int i = 0; i < (int) particles.size(); i++) {
+        double charge, sigma, epsilon;
+        force.getParticleParameters(particles[i], charge, sigma, epsilon);
+        pair<double, double> oldClass = particleClass[particles[i]];
+        pair<double, double> newClass = make_pair(sigma, epsilon);
+        if (newClass == oldClass)
+            continue;
+        
+        // Remove the particle's interactions with every other particle and itself, then add them
+        // back with the new parameters.
+        
+        map<pair<double, double>, int>::iterator entry = classCounts.find(oldClass);
+        if (--entry->second == 0)
+            classCounts.erase(entry);
+        for (entry = classCounts.begin(); entry != classCounts.end(); ++entry)
+            addPairs(oldClass, entry->first, -(double) entry->second);
+        addPairs(oldClass, oldClass, -1.0);
+        for (entry = classCounts.begin(); entry != classCounts.end(); ++entry)
+            addPairs(newClass, entry->first, (double) entry->second);
+        addPairs(newClass, newClass, 1.0);
+        classCounts[newClass]++;
+        particleClass[particles[i]] = newClass;
+    }
 }
 
-void NonbondedForceImpl::getPMEParameters(double& alpha, int& nx, int& ny, int& nz) const {
-    kernel.getAs<CalcNonbondedForceKernel>().getPMEParameters(alpha, nx, ny, nz);
+void NonbondedForceImpl::DispersionCorrectionData::addPairs(const pair<double, double>& class1, const pair<double, double>& class2, double count) {
+    double sigma, epsilon;
+    if (class1 == class2) {
+        sigma = class1.first;
+        epsilon = class1.second;
+    }
+    else {
+        sigma = 0.5*(class1.first+class2.first);
+        epsilon = sqrt(class1.second*class2.second);
+    }
+    double sigma2 = sigma*sigma;
+    double sigma6 = sigma2*sigma2*sigma2;
+    sum1 += count*epsilon*sigma6*sigma6;
+    sum2 += count*epsilon*sigma6;
+    if (useSwitch)
+        sum3 += count*epsilon*(evalIntegral(cutoff, switchDist, cutoff, sigma)-evalIntegral(switchDist, switchDist, cutoff, sigma));
 }
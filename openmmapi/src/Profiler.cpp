@@ -0,0 +1,85 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2016 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "openmm/internal/Profiler.h"
+#include <sstream>
+
+using namespace OpenMM;
+using namespace std;
+
+Profiler::Profiler() : enabled(false) {
+}
+
+void Profiler::setEnabled(bool enabled) {
+    this->enabled = enabled;
+}
+
+void Profiler::addTime(const string& name, double seconds) {
+    times[name] += seconds;
+    calls[name]++;
+}
+
+void Profiler::addCount(const string& name, int count) {
+    counts[name] += count;
+}
+
+void Profiler::reset() {
+    times.clear();
+    calls.clear();
+    counts.clear();
+}
+
+static string escapeJson(const string& text) {
+    string result;
+    for (int i = 0; i < (int) text.size(); i++) {
+        if (text[i] == '"' || text[i] == '\\')
+            result += '\\';
+        result += text[i];
+    }
+    return result;
+}
+
+string Profiler::toJson() const {
+    stringstream json;
+    json.precision(9);
+    json << "{\n  \"timers\": {";
+    for (map<string, double>::const_iterator iter = times.begin(); iter != times.end(); ++iter) {
+        json << (iter == times.begin() ? "\n" : ",\n");
+        json << "    \"" << escapeJson(iter->first) << "\": {\"seconds\": " << iter->second << ", \"calls\": " << calls.find(iter->first)->second << "}";
+    }
+    json << "\n  },\n  \"counters\": {";
+    for (map<string, int>::const_iterator iter = counts.begin(); iter != counts.end(); ++iter) {
+        json << (iter == counts.begin() ? "\n" : ",\n");
+        json << "    \"" << escapeJson(iter->first) << "\": " << iter->second;
+    }
+    json << "\n  }\n}\n";
+    return json.str();
+}
@@ -31,6 +31,7 @@
 
 #include "openmm/internal/ThreadPool.h"
 #include "openmm/internal/hardware.h"
+#include "openmm/internal/timer.h"
 
 using namespace std;
 
@@ -60,7 +61,7 @@ static void* threadBody(void* args) {
     return 0;
 }
 
-ThreadPool::ThreadPool(int numThreads) {
+ThreadPool::ThreadPool(int numThreads) : timingEnabled(false), idleTime(0.0), waitTime(0.0), arrivalTimeSum(0.0) {
     if (numThreads <= 0)
         numThreads = getNumProcessors();
     this->numThreads = numThreads;
@@ -107,16 +108,29 @@ void ThreadPool::execute(Task& task) {
 void ThreadPool::syncThreads() {
     pthread_mutex_lock(&lock);
     waitCount++;
+    if (timingEnabled) {
+        // Every thread waits from when it arrives until the last one arrives.
+
+        double time = getCurrentTime();
+        arrivalTimeSum += time;
+        if (waitCount == numThreads) {
+            idleTime += numThreads*time-arrivalTimeSum;
+            arrivalTimeSum = 0.0;
+        }
+    }
     pthread_cond_signal(&endCondition);
     pthread_cond_wait(&startCondition, &lock);
     pthread_mutex_unlock(&lock);
 }
 
 void ThreadPool::waitForThreads() {
+    double startTime = (timingEnabled ? getCurrentTime() : 0.0);
     pthread_mutex_lock(&lock);
     while (waitCount < numThreads)
         pthread_cond_wait(&endCondition, &lock);
     pthread_mutex_unlock(&lock);
+    if (timingEnabled)
+        waitTime += getCurrentTime()-startTime;
 }
 
 void ThreadPool::resumeThreads() {
@@ -126,4 +140,26 @@ void ThreadPool::resumeThreads() {
     pthread_mutex_unlock(&lock);
 }
 
+void ThreadPool::setTimingEnabled(bool enabled) {
+    pthread_mutex_lock(&lock);
+    timingEnabled = enabled;
+    arrivalTimeSum = 0.0;
+    pthread_mutex_unlock(&lock);
+}
+
+double ThreadPool::getIdleTime() const {
+    return idleTime;
+}
+
+double ThreadPool::getWaitTime() const {
+    return waitTime;
+}
+
+void ThreadPool::resetTiming() {
+    pthread_mutex_lock(&lock);
+    idleTime = 0.0;
+    waitTime = 0.0;
+    pthread_mutex_unlock(&lock);
+}
+
 } // namespace OpenMM
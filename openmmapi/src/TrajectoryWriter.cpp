@@ -0,0 +1,61 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2016 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "openmm/TrajectoryWriter.h"
+#include "openmm/Context.h"
+#include "openmm/internal/TrajectoryWriterImpl.h"
+
+using namespace OpenMM;
+using namespace std;
+
+TrajectoryWriter::TrajectoryWriter(const string& filename, Format format, int interval, bool enforcePeriodicBox, int bufferSize, double precision) {
+    impl = new TrajectoryWriterImpl(filename, format, interval, enforcePeriodicBox, bufferSize, precision);
+}
+
+TrajectoryWriter::~TrajectoryWriter() {
+    delete impl;
+}
+
+void TrajectoryWriter::writeFrame(Context& context) {
+    impl->writeFrame(context.getImpl());
+}
+
+void TrajectoryWriter::flush() {
+    impl->flush();
+}
+
+int TrajectoryWriter::getNumFrames() const {
+    return impl->getNumFrames();
+}
+
+bool TrajectoryWriter::readCompressedFrame(istream& stream, vector<Vec3>& positions, Vec3& a, Vec3& b, Vec3& c, double& time) {
+    return TrajectoryWriterImpl::readCompressedFrame(stream, positions, a, b, c, time);
+}
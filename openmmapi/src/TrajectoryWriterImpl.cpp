@@ -0,0 +1,415 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2016 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "openmm/internal/TrajectoryWriterImpl.h"
+#include "openmm/internal/ContextImpl.h"
+#include "openmm/Integrator.h"
+#include "openmm/OpenMMException.h"
+#include "openmm/System.h"
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <istream>
+#include <limits>
+
+using namespace OpenMM;
+using namespace std;
+
+const static char COMPRESSED_FRAME_MAGIC_BYTES[] = "OMMZ";
+
+// All binary data is written in little-endian byte order, regardless of the host.
+
+static void appendInt(string& out, int value) {
+    unsigned int v = (unsigned int) value;
+    for (int i = 0; i < 4; i++)
+        out.push_back((char) ((v>>(8*i))&0xFF));
+}
+
+static void appendFloat(string& out, float value) {
+    unsigned int v;
+    memcpy(&v, &value, sizeof(v));
+    appendInt(out, (int) v);
+}
+
+static void appendDouble(string& out, double value) {
+    unsigned long long v;
+    memcpy(&v, &value, sizeof(v));
+    for (int i = 0; i < 8; i++)
+        out.push_back((char) ((v>>(8*i))&0xFF));
+}
+
+static void throwCorrupted() {
+    throw OpenMMException("readCompressedFrame: Trajectory data is corrupted");
+}
+
+static void readBytes(istream& stream, char* data, int length) {
+    stream.read(data, length);
+    if (stream.gcount() != length)
+        throwCorrupted();
+}
+
+static int readInt(istream& stream) {
+    unsigned char bytes[4];
+    readBytes(stream, (char*) bytes, 4);
+    unsigned int v = 0;
+    for (int i = 0; i < 4; i++)
+        v |= ((unsigned int) bytes[i])<<(8*i);
+    return (int) v;
+}
+
+static double readDouble(istream& stream) {
+    unsigned char bytes[8];
+    readBytes(stream, (char*) bytes, 8);
+    unsigned long long v = 0;
+    for (int i = 0; i < 8; i++)
+        v |= ((unsigned long long) bytes[i])<<(8*i);
+    double value;
+    memcpy(&value, &v, sizeof(value));
+    return value;
+}
+
+TrajectoryWriterImpl::TrajectoryWriterImpl(const string& filename, TrajectoryWriter::Format format, int interval, bool enforcePeriodicBox, int bufferSize, double precision) :
+        format(format), interval(interval), numParticles(0), numQueued(0), numWritten(0), firstStep(0), enforcePeriodicBox(enforcePeriodicBox),
+        usesPeriodicBox(false), isDeleted(false), precision(precision), stepSize(0.0), nextFrame(0), numPending(0) {
+    if (format != TrajectoryWriter::DCD && format != TrajectoryWriter::Compressed)
+        throw OpenMMException("TrajectoryWriter: Illegal value for format");
+    if (interval < 1)
+        throw OpenMMException("TrajectoryWriter: interval must be at least 1");
+    if (bufferSize < 1)
+        throw OpenMMException("TrajectoryWriter: bufferSize must be at least 1");
+    if (!(precision > 0.0))
+        throw OpenMMException("TrajectoryWriter: precision must be positive");
+    file.open(filename.c_str(), ios::out | ios::binary | ios::trunc);
+    if (!file.is_open())
+        throw OpenMMException("TrajectoryWriter: Could not open file "+filename);
+    frames.resize(bufferSize);
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&startCondition, NULL);
+    pthread_cond_init(&endCondition, NULL);
+    pthread_create(&thread, NULL, threadBody, this);
+}
+
+TrajectoryWriterImpl::~TrajectoryWriterImpl() {
+    // The background thread writes any frames that are still pending before it exits.
+
+    pthread_mutex_lock(&lock);
+    isDeleted = true;
+    pthread_cond_signal(&startCondition);
+    pthread_mutex_unlock(&lock);
+    pthread_join(thread, NULL);
+    pthread_mutex_destroy(&lock);
+    pthread_cond_destroy(&startCondition);
+    pthread_cond_destroy(&endCondition);
+    file.close();
+}
+
+void* TrajectoryWriterImpl::threadBody(void* args) {
+    TrajectoryWriterImpl& owner = *reinterpret_cast<TrajectoryWriterImpl*>(args);
+    pthread_mutex_lock(&owner.lock);
+    while (true) {
+        while (owner.numPending == 0 && !owner.isDeleted)
+            pthread_cond_wait(&owner.startCondition, &owner.lock);
+        if (owner.numPending == 0)
+            break;
+        Frame& frame = owner.frames[owner.nextFrame];
+        pthread_mutex_unlock(&owner.lock);
+        string error;
+        try {
+            owner.writeToFile(frame);
+        }
+        catch (exception& ex) {
+            error = ex.what();
+        }
+        pthread_mutex_lock(&owner.lock);
+        if (!error.empty() && owner.errorMessage.empty())
+            owner.errorMessage = error;
+        owner.nextFrame = (owner.nextFrame+1)%owner.frames.size();
+        owner.numPending--;
+        pthread_cond_broadcast(&owner.endCondition);
+    }
+    pthread_mutex_unlock(&owner.lock);
+    return 0;
+}
+
+void TrajectoryWriterImpl::writeFrame(ContextImpl& context) {
+    if (numQueued > 0 && context.getSystem().getNumParticles() != numParticles)
+        throw OpenMMException("TrajectoryWriter: All frames must have the same number of particles");
+
+    // Wait for a free slot in the buffer.
+
+    pthread_mutex_lock(&lock);
+    while (numPending == (int) frames.size())
+        pthread_cond_wait(&endCondition, &lock);
+    string error = errorMessage;
+    errorMessage = "";
+    Frame& frame = frames[(nextFrame+numPending)%frames.size()];
+    pthread_mutex_unlock(&lock);
+    if (!error.empty())
+        throw OpenMMException(error);
+
+    // The first frame determines the information that goes into the file header.
+
+    if (numQueued == 0) {
+        numParticles = context.getSystem().getNumParticles();
+        usesPeriodicBox = context.getSystem().usesPeriodicBoundaryConditions();
+        stepSize = context.getIntegrator().getStepSize();
+        firstStep = context.getStepCount();
+        if (enforcePeriodicBox && usesPeriodicBox)
+            molecules = context.getMolecules();
+    }
+
+    // Copy the data into the slot.  The background thread does not touch it until it is queued.
+
+    context.getPositions(frame.positions);
+    context.getPeriodicBoxVectors(frame.boxVectors[0], frame.boxVectors[1], frame.boxVectors[2]);
+    frame.time = context.getTime();
+    numQueued++;
+    pthread_mutex_lock(&lock);
+    numPending++;
+    pthread_cond_signal(&startCondition);
+    pthread_mutex_unlock(&lock);
+}
+
+void TrajectoryWriterImpl::flush() {
+    pthread_mutex_lock(&lock);
+    while (numPending > 0)
+        pthread_cond_wait(&endCondition, &lock);
+    string error = errorMessage;
+    errorMessage = "";
+    pthread_mutex_unlock(&lock);
+    if (!error.empty())
+        throw OpenMMException(error);
+    file.flush();
+}
+
+int TrajectoryWriterImpl::getNumFrames() const {
+    return numQueued;
+}
+
+void TrajectoryWriterImpl::writeToFile(Frame& frame) {
+    const double infinity = numeric_limits<double>::infinity();
+    for (int i = 0; i < numParticles; i++) {
+        const Vec3& pos = frame.positions[i];
+        if (pos[0] != pos[0] || pos[1] != pos[1] || pos[2] != pos[2])
+            throw OpenMMException("TrajectoryWriter: Particle position is NaN");
+        if (fabs(pos[0]) == infinity || fabs(pos[1]) == infinity || fabs(pos[2]) == infinity)
+            throw OpenMMException("TrajectoryWriter: Particle position is infinite");
+    }
+    if (enforcePeriodicBox && usesPeriodicBox)
+        applyPeriodicBox(frame);
+    if (format == TrajectoryWriter::DCD) {
+        if (numWritten == 0)
+            writeDCDHeader(frame);
+        writeDCDFrame(frame);
+    }
+    else
+        writeCompressedFrame(frame);
+    numWritten++;
+    if (!file)
+        throw OpenMMException("TrajectoryWriter: Error writing to file");
+}
+
+void TrajectoryWriterImpl::applyPeriodicBox(Frame& frame) {
+    // This translates molecules in the same way as Context::getState().
+
+    const Vec3* periodicBoxSize = frame.boxVectors;
+    for (int i = 0; i < (int) molecules.size(); i++) {
+        Vec3 center;
+        for (int j = 0; j < (int) molecules[i].size(); j++)
+            center += frame.positions[molecules[i][j]];
+        center *= 1.0/molecules[i].size();
+        Vec3 diff;
+        diff += periodicBoxSize[2]*floor(center[2]/periodicBoxSize[2][2]);
+        diff += periodicBoxSize[1]*floor((center[1]-diff[1])/periodicBoxSize[1][1]);
+        diff += periodicBoxSize[0]*floor((center[0]-diff[0])/periodicBoxSize[0][0]);
+        for (int j = 0; j < (int) molecules[i].size(); j++)
+            frame.positions[molecules[i][j]] -= diff;
+    }
+}
+
+void TrajectoryWriterImpl::writeDCDHeader(const Frame& frame) {
+    // This matches the header written by the DCDFile class in the Python application layer.
+
+    encoded.clear();
+    appendInt(encoded, 84);
+    encoded.append("CORD", 4);
+    appendInt(encoded, 0);
+    appendInt(encoded, firstStep);
+    appendInt(encoded, interval);
+    for (int i = 0; i < 6; i++)
+        appendInt(encoded, 0);
+    appendFloat(encoded, (float) (stepSize/0.04888821));
+    appendInt(encoded, usesPeriodicBox ? 1 : 0);
+    for (int i = 0; i < 8; i++)
+        appendInt(encoded, 0);
+    appendInt(encoded, 24);
+    appendInt(encoded, 84);
+    appendInt(encoded, 164);
+    appendInt(encoded, 2);
+    string title1 = "Created by OpenMM";
+    time_t now = time(NULL);
+    string title2 = string("Created ")+asctime(localtime(&now));
+    if (!title2.empty() && title2[title2.size()-1] == '\n')
+        title2.erase(title2.size()-1);
+    title1.resize(80, '\0');
+    title2.resize(80, '\0');
+    encoded.append(title1);
+    encoded.append(title2);
+    appendInt(encoded, 164);
+    appendInt(encoded, 4);
+    appendInt(encoded, numParticles);
+    appendInt(encoded, 4);
+    file.write(encoded.c_str(), encoded.size());
+}
+
+void TrajectoryWriterImpl::writeDCDFrame(const Frame& frame) {
+    // Update the number of frames and the last step in the header.  As in DCDFile, the last step is
+    // counted from the step at which the first frame was written.
+
+    string count;
+    appendInt(count, numWritten+1);
+    file.seekp(8, ios::beg);
+    file.write(count.c_str(), 4);
+    count.clear();
+    appendInt(count, firstStep+(numWritten+1)*interval);
+    file.seekp(20, ios::beg);
+    file.write(count.c_str(), 4);
+    file.seekp(0, ios::end);
+
+    // Write the data.  Lengths are in Angstroms, and the box angles are recorded by their cosines.
+
+    encoded.clear();
+    if (usesPeriodicBox) {
+        const Vec3* box = frame.boxVectors;
+        double a = sqrt(box[0].dot(box[0]));
+        double b = sqrt(box[1].dot(box[1]));
+        double c = sqrt(box[2].dot(box[2]));
+        appendInt(encoded, 48);
+        appendDouble(encoded, 10*a);
+        appendDouble(encoded, box[0].dot(box[1])/(a*b));
+        appendDouble(encoded, 10*b);
+        appendDouble(encoded, box[0].dot(box[2])/(a*c));
+        appendDouble(encoded, box[1].dot(box[2])/(b*c));
+        appendDouble(encoded, 10*c);
+        appendInt(encoded, 48);
+    }
+    for (int i = 0; i < 3; i++) {
+        appendInt(encoded, 4*numParticles);
+        for (int j = 0; j < numParticles; j++)
+            appendFloat(encoded, (float) (10*frame.positions[j][i]));
+        appendInt(encoded, 4*numParticles);
+    }
+    file.write(encoded.c_str(), encoded.size());
+}
+
+void TrajectoryWriterImpl::writeCompressedFrame(const Frame& frame) {
+    // Each frame consists of a header followed by the coordinates.  Each coordinate is rounded to an integer
+    // multiple of 1/precision, the difference from the same coordinate of the previous particle is mapped to
+    // an unsigned value (0, -1, 1, -2, 2, ... become 0, 1, 2, 3, 4, ...), and that is stored with seven bits
+    // per byte, the high bit of each byte indicating whether more bytes follow.
+
+    encoded.clear();
+    encoded.append(COMPRESSED_FRAME_MAGIC_BYTES, 4);
+    appendInt(encoded, numParticles);
+    appendDouble(encoded, precision);
+    appendDouble(encoded, frame.time);
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 3; j++)
+            appendDouble(encoded, frame.boxVectors[i][j]);
+    int sizeOffset = encoded.size();
+    appendInt(encoded, 0);
+    long long last[3] = {0, 0, 0};
+    for (int i = 0; i < numParticles; i++)
+        for (int j = 0; j < 3; j++) {
+            double scaled = floor(frame.positions[i][j]*precision+0.5);
+            if (fabs(scaled) > 1e18)
+                throw OpenMMException("TrajectoryWriter: Particle position is too large to store at the requested precision");
+            long long value = (long long) scaled;
+            long long delta = value-last[j];
+            last[j] = value;
+            unsigned long long code = (delta < 0 ? (((unsigned long long) (-(delta+1)))<<1)|1 : ((unsigned long long) delta)<<1);
+            while (code >= 0x80) {
+                encoded.push_back((char) ((code&0x7F)|0x80));
+                code >>= 7;
+            }
+            encoded.push_back((char) code);
+        }
+    string size;
+    appendInt(size, encoded.size()-sizeOffset-4);
+    encoded.replace(sizeOffset, 4, size);
+    file.write(encoded.c_str(), encoded.size());
+}
+
+bool TrajectoryWriterImpl::readCompressedFrame(istream& stream, vector<Vec3>& positions, Vec3& a, Vec3& b, Vec3& c, double& time) {
+    char magic[4];
+    stream.read(magic, 4);
+    if (stream.gcount() == 0)
+        return false;
+    if (stream.gcount() != 4 || memcmp(magic, COMPRESSED_FRAME_MAGIC_BYTES, 4) != 0)
+        throw OpenMMException("readCompressedFrame: The stream does not contain a compressed trajectory frame");
+    int numParticles = readInt(stream);
+    double precision = readDouble(stream);
+    time = readDouble(stream);
+    Vec3* box[3] = {&a, &b, &c};
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 3; j++)
+            (*box[i])[j] = readDouble(stream);
+    int size = readInt(stream);
+    if (numParticles < 0 || size < 0 || !(precision > 0.0))
+        throwCorrupted();
+    vector<char> data(size);
+    if (size > 0)
+        readBytes(stream, &data[0], size);
+    positions.resize(numParticles);
+    double scale = 1.0/precision;
+    long long last[3] = {0, 0, 0};
+    int pos = 0;
+    for (int i = 0; i < numParticles; i++)
+        for (int j = 0; j < 3; j++) {
+            unsigned long long code = 0;
+            int shift = 0;
+            while (true) {
+                if (pos == size || shift > 63)
+                    throwCorrupted();
+                unsigned char byte = (unsigned char) data[pos++];
+                code |= ((unsigned long long) (byte&0x7F))<<shift;
+                shift += 7;
+                if ((byte&0x80) == 0)
+                    break;
+            }
+            long long delta = ((code&1) ? -((long long) (code>>1))-1 : (long long) (code>>1));
+            last[j] += delta;
+            positions[i][j] = last[j]*scale;
+        }
+    if (pos != size)
+        throwCorrupted();
+    return true;
+}
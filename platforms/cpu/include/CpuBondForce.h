@@ -36,7 +36,9 @@
 #include "windowsExportCpu.h"
 #include "openmm/internal/ThreadPool.h"
 #include <list>
+#include <map>
 #include <set>
+#include <string>
 #include <vector>
 
 namespace OpenMM {
@@ -47,11 +49,26 @@ namespace OpenMM {
 class OPENMM_EXPORT_CPU CpuBondForce {
 public:
     class ComputeForceTask;
+    /**
+     * This records which bonds are computed by each thread.  Objects that compute identical sets of
+     * bonds with the same number of threads can share a single Partition.
+     */
+    struct Partition {
+        std::vector<std::vector<int> > threadBonds;
+        std::vector<int> extraBonds;
+    };
     CpuBondForce();
     /**
      * Analyze the set of bonds and decide which to compute with each thread.
+     *
+     * @param sharedPartitions   if this is not NULL, it holds partitions that have already been computed, indexed
+     *                           by a key describing the bonds and the number of threads.  If it contains one for
+     *                           an identical set of bonds, that one is used.  Otherwise the new partition is added
+     *                           to it.  The caller is responsible for deleting the Partitions, and must not do so
+     *                           while this object still exists.
      */
-    void initialize(int numAtoms, int numBonds, int numAtomsPerBond, int** bondAtoms, ThreadPool& threads);
+    void initialize(int numAtoms, int numBonds, int numAtomsPerBond, int** bondAtoms, ThreadPool& threads,
+            std::map<std::string, Partition*>* sharedPartitions=NULL);
     /**
      * Compute the forces from all bonds.
      */
@@ -65,11 +82,14 @@ public:
 private:
     bool canAssignBond(int bond, int thread, std::vector<int>& atomThread);
     void assignBond(int bond, int thread, std::vector<int>& atomThread, std::vector<int>& bondThread, std::vector<std::set<int> >& atomBonds, std::list<int>& candidateBonds);
+    void sharePartition(const std::string& key, std::map<std::string, Partition*>* sharedPartitions);
+    std::string saveAssignments() const;
+    bool loadAssignments(const std::string& data, int numThreads);
     int numBonds, numAtomsPerBond;
     int** bondAtoms;
     ThreadPool* threads;
-    std::vector<std::vector<int> > threadBonds;
-    std::vector<int> extraBonds;
+    Partition ownPartition;
+    const Partition* partition;
 };
 
 } // namespace OpenMM
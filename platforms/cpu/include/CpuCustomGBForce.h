@@ -42,15 +42,15 @@ private:
     class ComputeForceTask;
     class ThreadData;
 
+    const CpuExclusionList exclusions;
     bool cutoff;
     bool periodic;
     const CpuNeighborList* neighborList;
     float periodicBoxSize[3];
     float cutoffDistance, cutoffDistance2;
-    int numValues, numParams;
-    const std::vector<std::set<int> > exclusions;
     std::vector<CustomGBForce::ComputationType> valueTypes;
     std::vector<CustomGBForce::ComputationType> energyTypes;
+    int numValues, numParams;
     ThreadPool& threads;
     std::vector<ThreadData*> threadData;
     std::vector<double> threadEnergy;
@@ -182,20 +182,28 @@ private:
 public:
 
     /**
-     * Construct a new CpuCustomGBForce.
+     * Construct a new CpuCustomGBForce.  Each group of expressions is compiled into a single
+     * CompiledExpression, so subexpressions shared by a group are only computed once.
+     *
+     * @param valueExpressions          for each computed value: the value, then its derivative with respect to each
+     *                                  energy parameter derivative
+     * @param valueDerivExpressions     for each computed value: the derivative with respect to r for the first value,
+     *                                  or with respect to each earlier value for the others
+     * @param valueGradientExpressions  for each computed value after the first: the derivatives with respect to x, y,
+     *                                  and z, then the derivative with respect to each earlier value except the first
+     * @param energyExpressions         for each energy term: the energy, then for a SingleParticle term its derivative
+     *                                  with respect to each value and to x, y, and z, or for a pair term its derivative
+     *                                  with respect to r and to each value of both particles, and finally its
+     *                                  derivative with respect to each energy parameter derivative
      */
 
-     CpuCustomGBForce(int numAtoms, const std::vector<std::set<int> >& exclusions,
-                        const std::vector<Lepton::CompiledExpression>& valueExpressions,
-                        const std::vector<std::vector<Lepton::CompiledExpression> >& valueDerivExpressions,
-                        const std::vector<std::vector<Lepton::CompiledExpression> >& valueGradientExpressions,
-                        const std::vector<std::vector<Lepton::CompiledExpression> >& valueParamDerivExpressions,
+     CpuCustomGBForce(int numAtoms, const CpuExclusionList& exclusions,
+                        const std::vector<std::vector<Lepton::ParsedExpression> >& valueExpressions,
+                        const std::vector<std::vector<Lepton::ParsedExpression> >& valueDerivExpressions,
+                        const std::vector<std::vector<Lepton::ParsedExpression> >& valueGradientExpressions,
                         const std::vector<std::string>& valueNames,
                         const std::vector<CustomGBForce::ComputationType>& valueTypes,
-                        const std::vector<Lepton::CompiledExpression>& energyExpressions,
-                        const std::vector<std::vector<Lepton::CompiledExpression> >& energyDerivExpressions,
-                        const std::vector<std::vector<Lepton::CompiledExpression> >& energyGradientExpressions,
-                        const std::vector<std::vector<Lepton::CompiledExpression> >& energyParamDerivExpressions,
+                        const std::vector<std::vector<Lepton::ParsedExpression> >& energyExpressions,
                         const std::vector<CustomGBForce::ComputationType>& energyTypes,
                         const std::vector<std::string>& parameterNames, ThreadPool& threads);
 
@@ -239,26 +247,20 @@ public:
 class CpuCustomGBForce::ThreadData {
 public:
     ThreadData(int numAtoms, int numThreads, int threadIndex,
-               const std::vector<Lepton::CompiledExpression>& valueExpressions,
-               const std::vector<std::vector<Lepton::CompiledExpression> >& valueDerivExpressions,
-               const std::vector<std::vector<Lepton::CompiledExpression> >& valueGradientExpressions,
-               const std::vector<std::vector<Lepton::CompiledExpression> >& valueParamDerivExpressions,
+               const std::vector<std::vector<Lepton::ParsedExpression> >& valueExpressions,
+               const std::vector<std::vector<Lepton::ParsedExpression> >& valueDerivExpressions,
+               const std::vector<std::vector<Lepton::ParsedExpression> >& valueGradientExpressions,
                const std::vector<std::string>& valueNames,
-               const std::vector<Lepton::CompiledExpression>& energyExpressions,
-               const std::vector<std::vector<Lepton::CompiledExpression> >& energyDerivExpressions,
-               const std::vector<std::vector<Lepton::CompiledExpression> >& energyGradientExpressions,
-               const std::vector<std::vector<Lepton::CompiledExpression> >& energyParamDerivExpressions,
+               const std::vector<std::vector<Lepton::ParsedExpression> >& energyExpressions,
                const std::vector<std::string>& parameterNames);
     CompiledExpressionSet expressionSet;
-    std::vector<Lepton::CompiledExpression> valueExpressions;
-    std::vector<std::vector<Lepton::CompiledExpression> > valueDerivExpressions;
-    std::vector<std::vector<Lepton::CompiledExpression> > valueGradientExpressions;
-    std::vector<std::vector<Lepton::CompiledExpression> > valueParamDerivExpressions;
+    std::vector<Lepton::CompiledExpression*> valueExpressions;
+    std::vector<Lepton::CompiledExpression*> valueDerivExpressions;
+    std::vector<Lepton::CompiledExpression*> valueGradientExpressions;
     std::vector<double> value;
-    std::vector<Lepton::CompiledExpression> energyExpressions;
-    std::vector<std::vector<Lepton::CompiledExpression> > energyDerivExpressions;
-    std::vector<std::vector<Lepton::CompiledExpression> > energyGradientExpressions;
-    std::vector<std::vector<Lepton::CompiledExpression> > energyParamDerivExpressions;
+    std::vector<Lepton::CompiledExpression*> energyExpressions;
+    // The same as energyExpressions but without the energy itself, for steps that do not need it.
+    std::vector<Lepton::CompiledExpression*> forceExpressions;
     std::vector<double> param;
     std::vector<double> particleParam;
     std::vector<double> particleValue;
@@ -51,18 +51,20 @@ private:
     class ComputeForceTask;
     class ThreadData;
     int numParticles, numParticlesPerSet, numPerParticleParameters, numTypes;
-    bool useCutoff, usePeriodic, triclinic, centralParticleMode;
+    bool useCutoff, usePeriodic, triclinic, centralParticleMode, anyExclusions, useTypeFilters;
     RealOpenMM cutoffDistance;
     float recipBoxSize[3];
     RealVec periodicBoxVectors[3];
     AlignedArray<fvec4> periodicBoxVec4;
     CpuNeighborList* neighborList;
     ThreadPool& threads;
-    std::vector<std::set<int> > exclusions;
+    CpuExclusionList exclusions;
     std::vector<int> particleTypes;
     std::vector<int> orderIndex;
     std::vector<std::vector<int> > particleOrder;
     std::vector<std::vector<int> > particleNeighbors;
+    std::vector<std::vector<int> > neighborTypeStart;
+    std::vector<std::vector<bool> > allowedTypePrefix;
     std::vector<ThreadData*> threadData;
     // The following variables are used to make information accessible to the individual threads.
     float* posq;
@@ -77,11 +79,30 @@ private:
      */
     void threadComputeForce(ThreadPool& threads, int threadIndex);
 
+    /**
+     * Build the table of which partial sets of particle types can be completed to form a set that passes the type filters.
+     */
+    void buildAllowedTypePrefixes();
+
+    /**
+     * Prepare the neighbors of one particle to be used as the candidates for its interactions.  This removes any
+     * that are beyond the cutoff distance and, if type filters are in use, sorts them by type and records where
+     * each type begins.
+     */
+    void prepareNeighbors(int particle, ThreadData& data, const fvec4& boxSize, const fvec4& invBoxSize);
+
     /**
      * This is called recursively to loop over all possible combination of a set of particles and evaluate the
      * interaction for each one.
+     *
+     * @param availableParticles  the particles that may be added to the set
+     * @param typeStart           if not NULL, availableParticles is sorted by type, and this contains the index where each type begins
+     * @param particleSet         the particles selected so far
+     * @param loopIndex           the index within the set of the particle to select
+     * @param startIndex          the first element of availableParticles to consider
+     * @param typePrefix          the type index formed from the types of the particles selected so far
      */
-    void loopOverInteractions(std::vector<int>& availableParticles, std::vector<int>& particleSet, int loopIndex, int startIndex,
+    void loopOverInteractions(std::vector<int>& availableParticles, const int* typeStart, std::vector<int>& particleSet, int loopIndex, int startIndex, int typePrefix,
                               RealOpenMM** particleParameters, float* forces, ThreadData& data, const fvec4& boxSize, const fvec4& invBoxSize);
 
     /**---------------------------------------------------------------------------------------
@@ -211,6 +232,7 @@ public:
     std::vector<float> normDelta;
     std::vector<float> norm2Delta;
     AlignedArray<fvec4> f;
+    std::vector<int> sortedNeighbors;
     double energy;
     ThreadData(const CustomManyParticleForce& force, Lepton::ParsedExpression& energyExpr,
             std::map<std::string, std::vector<int> >& distances, std::map<std::string, std::vector<int> >& angles, std::map<std::string, std::vector<int> >& dihedrals);
@@ -44,11 +44,13 @@ class CpuCustomNonbondedForce {
 
          Constructor
 
+         @param pairExpressions   the energy, its derivative with respect to r, and its derivative with
+                                  respect to each energy parameter derivative
+
          --------------------------------------------------------------------------------------- */
 
-       CpuCustomNonbondedForce(const Lepton::CompiledExpression& energyExpression, const Lepton::CompiledExpression& forceExpression,
-                               const std::vector<std::string>& parameterNames, const std::vector<std::set<int> >& exclusions,
-                               const std::vector<Lepton::CompiledExpression> energyParamDerivExpressions, ThreadPool& threads);
+       CpuCustomNonbondedForce(const std::vector<Lepton::ParsedExpression>& pairExpressions, const std::vector<std::string>& parameterNames,
+                               const CpuExclusionList& exclusions, ThreadPool& threads);
 
       /**---------------------------------------------------------------------------------------
 
@@ -135,10 +137,10 @@ private:
     RealVec periodicBoxVectors[3];
     AlignedArray<fvec4> periodicBoxVec4;
     RealOpenMM cutoffDistance, switchingDistance;
-    ThreadPool& threads;
-    const std::vector<std::set<int> > exclusions;
     std::vector<ThreadData*> threadData;
     std::vector<std::string> paramNames;
+    const CpuExclusionList exclusions;
+    ThreadPool& threads;
     std::vector<std::pair<int, int> > groupInteractions;
     std::vector<double> threadEnergy;
     // The following variables are used to make information accessible to the individual threads.
@@ -178,12 +180,12 @@ private:
 
 class CpuCustomNonbondedForce::ThreadData {
 public:
-    ThreadData(const Lepton::CompiledExpression& energyExpression, const Lepton::CompiledExpression& forceExpression, const std::vector<std::string>& parameterNames,
-            const std::vector<Lepton::CompiledExpression> energyParamDerivExpressions);
-    Lepton::CompiledExpression energyExpression;
-    Lepton::CompiledExpression forceExpression;
-    std::vector<Lepton::CompiledExpression> energyParamDerivExpressions;
+    ThreadData(const std::vector<Lepton::ParsedExpression>& pairExpressions, const std::vector<std::string>& parameterNames);
     CompiledExpressionSet expressionSet;
+    // Evaluates every pair expression, including the energy.
+    Lepton::CompiledExpression* energyExpression;
+    // Evaluates every pair expression except the energy, for steps that do not need it.
+    Lepton::CompiledExpression* forceExpression;
     std::vector<double> particleParam;
     double r;
     std::vector<RealOpenMM> energyParamDerivs; 
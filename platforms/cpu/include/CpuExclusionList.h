@@ -0,0 +1,135 @@
+#ifndef OPENMM_CPU_EXCLUSIONLIST_H_
+#define OPENMM_CPU_EXCLUSIONLIST_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2016 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "windowsExportCpu.h"
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace OpenMM {
+
+/**
+ * This class stores the set of atoms excluded from interacting with each atom.  It uses a compressed
+ * sparse row layout: the exclusions of every atom are stored sorted and contiguously in a single
+ * array, with a second array giving the offset at which each atom's exclusions begin.  A hash of the
+ * contents is computed on construction so that exclusion lists can be compared quickly.
+ *
+ * The contents cannot be modified after construction, so copies of a list share the same storage.
+ * This makes copying cheap, and lets Contexts in a ContextGroup share a single copy of each list.
+ * The reference count is not thread safe, so a list should only be copied or destroyed from the
+ * thread that owns the Context.
+ */
+class OPENMM_EXPORT_CPU CpuExclusionList {
+public:
+    /**
+     * Create an empty exclusion list for zero atoms.
+     */
+    CpuExclusionList();
+    /**
+     * Create an exclusion list for a set of atoms, none of which have any exclusions.
+     */
+    explicit CpuExclusionList(int numAtoms);
+    /**
+     * Create an exclusion list from a list of excluded pairs.  Each pair excludes both atoms
+     * from each other.  Duplicate pairs are allowed.
+     */
+    CpuExclusionList(int numAtoms, const std::vector<std::pair<int, int> >& excludedPairs);
+    /**
+     * Create an exclusion list from a set of exclusions for each atom.
+     */
+    CpuExclusionList(const std::vector<std::set<int> >& exclusions);
+    CpuExclusionList(const CpuExclusionList& other);
+    ~CpuExclusionList();
+    CpuExclusionList& operator=(const CpuExclusionList& other);
+    /**
+     * Get the number of atoms.
+     */
+    int getNumAtoms() const {
+        return storage->numAtoms;
+    }
+    /**
+     * Get the total number of entries in the list, summed over all atoms.
+     */
+    int getNumEntries() const {
+        return offset[storage->numAtoms];
+    }
+    /**
+     * Get a pointer to the first (lowest index) atom excluded from an atom.
+     */
+    const int* begin(int atom) const {
+        return indices+offset[atom];
+    }
+    /**
+     * Get a pointer to just past the last atom excluded from an atom.
+     */
+    const int* end(int atom) const {
+        return indices+offset[atom+1];
+    }
+    /**
+     * Get whether two atoms are excluded from each other.
+     */
+    bool isExcluded(int atom1, int atom2) const;
+    /**
+     * Get a hash code for the contents of the list.
+     */
+    unsigned int getHash() const {
+        return storage->hash;
+    }
+    /**
+     * Get whether this list shares its storage with another one.
+     */
+    bool sharesStorageWith(const CpuExclusionList& other) const {
+        return (storage == other.storage);
+    }
+    bool operator==(const CpuExclusionList& other) const;
+    bool operator!=(const CpuExclusionList& other) const {
+        return !(*this == other);
+    }
+private:
+    struct Storage {
+        int numAtoms, refCount;
+        std::vector<int> offset;
+        std::vector<int> indices;
+        unsigned int hash;
+    };
+    void finalize();
+    void release();
+    Storage* storage;
+    const int* offset;
+    const int* indices;
+};
+
+} // namespace OpenMM
+
+#endif // OPENMM_CPU_EXCLUSIONLIST_H_
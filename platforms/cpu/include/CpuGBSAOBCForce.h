@@ -1,5 +1,5 @@
 
-/* Portions copyright (c) 2006-2013 Stanford University and Simbios.
+/* Portions copyright (c) 2006-2016 Stanford University and Simbios.
  * Contributors: Pande Group
  *
  * Permission is hereby granted, free of charge, to any person obtaining
@@ -26,6 +26,7 @@
 #define OPENMM_CPU_GBSAOBC_FORCE_H__
 
 #include "AlignedArray.h"
+#include "CpuNeighborList.h"
 #include "openmm/internal/ThreadPool.h"
 #include "openmm/internal/vectorize.h"
 #include <set>
@@ -38,13 +39,17 @@ class CpuGBSAOBCForce {
 public:
     class ComputeTask;
     CpuGBSAOBCForce();
+    virtual ~CpuGBSAOBCForce();
 
     /**
      * Set the force to use a cutoff.
      * 
      * @param distance    the cutoff distance
+     * @param neighbors   the neighbor list to use
+     * @param exclusions  the exclusions that were used to build the neighbor list.  Excluded pairs are
+     *                    missing from the neighbor list, so they are computed separately.
      */
-    void setUseCutoff(float distance);
+    void setUseCutoff(float distance, const CpuNeighborList& neighbors, const CpuExclusionList& exclusions);
 
     /**
      * 
@@ -97,15 +102,103 @@ public:
      */
     void threadComputeForce(ThreadPool& threads, int threadIndex);
 
-private:
+    /**
+     * This routine contains the code executed by each thread when a neighbor list is used.
+     */
+    void threadComputeNeighborListForce(ThreadPool& threads, int threadIndex);
+
+protected:
+    /**
+     * Add the contributions to the Born radius sums from the interactions between one atom block of the
+     * neighbor list and its neighbors.
+     *
+     * @param blockIndex   the index of the atom block
+     * @param sums         the Born radius sums (contributions are added)
+     */
+    virtual void calculateBlockBornSums(int blockIndex, float* sums, const fvec4& boxSize, const fvec4& invBoxSize);
+
+    /**
+     * Compute the polarization energy between one atom block of the neighbor list and its neighbors, and its
+     * derivatives with respect to positions and Born radii.
+     *
+     * @param blockIndex   the index of the atom block
+     * @param forces       force array (forces added)
+     * @param bornForces   derivatives of the energy with respect to Born radii (values added)
+     * @param energy       the energy is added to this
+     */
+    virtual void calculateBlockPolarization(int blockIndex, float* forces, float* bornForces, double& energy, const fvec4& boxSize, const fvec4& invBoxSize);
+
+    /**
+     * Compute the forces from the dependence of the Born radii on positions for the interactions between one
+     * atom block of the neighbor list and its neighbors.
+     *
+     * @param blockIndex   the index of the atom block
+     * @param forces       force array (forces added)
+     */
+    virtual void calculateBlockChainRuleForces(int blockIndex, float* forces, const fvec4& boxSize, const fvec4& invBoxSize);
+
+    /**
+     * Compute the Born radius sums for a group of four atoms interacting with a list of other atoms.  Each pair
+     * contributes to the sums for both atoms.
+     *
+     * @param atoms        the indices of the four atoms in the group
+     * @param neighbors    the atoms they interact with
+     * @param exclusions   for each neighbor, bits (starting at shift) that are set for atoms of the group it should not interact with
+     * @param shift        the bit in exclusions corresponding to the first atom of the group
+     */
+    void calculateGroupBornSums(const int* atoms, const std::vector<int>& neighbors, const std::vector<short>& exclusions, int shift, float* sums, const fvec4& boxSize, const fvec4& invBoxSize);
+
+    /**
+     * Compute the polarization energy and forces for a group of four atoms interacting with a list of other atoms.
+     * The arguments have the same meaning as for calculateGroupBornSums().
+     */
+    void calculateGroupPolarization(const int* atoms, const std::vector<int>& neighbors, const std::vector<short>& exclusions, int shift, float* forces, float* bornForces, double& energy, const fvec4& boxSize, const fvec4& invBoxSize);
+
+    /**
+     * Compute the chain rule forces for a group of four atoms interacting with a list of other atoms.
+     * The arguments have the same meaning as for calculateGroupBornSums().
+     */
+    void calculateGroupChainRuleForces(const int* atoms, const std::vector<int>& neighbors, const std::vector<short>& exclusions, int shift, float* forces, const fvec4& boxSize, const fvec4& invBoxSize);
+
+    /**
+     * Compute one atom's contribution to the Born radius sum of another atom.
+     *
+     * @param offsetRadius   the offset radius of the atom whose sum is being computed
+     * @param scaledRadius   the scaled radius of the other atom
+     * @param include        a mask of which elements to compute
+     */
+    fvec4 computeBornSumTerm(const fvec4& offsetRadius, const fvec4& scaledRadius, const fvec4& r, const fvec4& rInverse, const ivec4& include);
+
+    /**
+     * Compute the derivative of one atom's Born radius sum with respect to the distance to another atom, divided
+     * by the distance.  The arguments have the same meaning as for computeBornSumTerm().
+     */
+    fvec4 computeChainRuleTerm(const fvec4& offsetRadius, const fvec4& scaledRadius, const fvec4& r, const fvec4& r2Inverse, const ivec4& include);
+
+    /**
+     * Find the excluded atoms with larger indices than an atom.  These interactions are missing from the neighbor
+     * list, so they are computed separately.
+     *
+     * @param atom         the index of the atom
+     * @param partners     on exit, the excluded atoms
+     * @param flags        on exit, exclusion flags for use with the calculateGroup*() methods that restrict
+     *                     the interactions to the first atom of the group
+     * @return true if there are any excluded atoms
+     */
+    bool findExcludedPartners(int atom, std::vector<int>& partners, std::vector<short>& flags) const;
+
     bool cutoff;
     bool periodic;
     float periodicBoxSize[3];
-    float cutoffDistance, soluteDielectric, solventDielectric, surfaceAreaFactor;
+    float cutoffDistance, soluteDielectric, solventDielectric, surfaceAreaFactor, preFactor;
+    const CpuNeighborList* neighborList;
+    const CpuExclusionList* exclusions;
     std::vector<std::pair<float, float> > particleParams;        
     AlignedArray<float> bornRadii;
     std::vector<AlignedArray<float> > threadBornForces;
+    std::vector<AlignedArray<float> > threadBornSums;
     AlignedArray<float> obcChain;
+    AlignedArray<float> chainRuleFactor;
     std::vector<double> threadEnergy;
     std::vector<float> logTable;
     float logDX, logDXInv;
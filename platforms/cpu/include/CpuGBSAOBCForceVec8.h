@@ -0,0 +1,100 @@
+
+/* Portions copyright (c) 2006-2016 Stanford University and Simbios.
+ * Contributors: Pande Group
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef OPENMM_CPU_GBSAOBC_FORCE_VEC8_H__
+#define OPENMM_CPU_GBSAOBC_FORCE_VEC8_H__
+
+#include "CpuGBSAOBCForce.h"
+
+#ifdef __AVX__
+
+#include "openmm/internal/vectorize8.h"
+
+// ---------------------------------------------------------------------------------------
+
+namespace OpenMM {
+
+/**
+ * This is a version of CpuGBSAOBCForce that processes the neighbor list eight atoms at a time
+ * using AVX instructions.  It is only used when a cutoff is in effect.
+ */
+class CpuGBSAOBCForceVec8 : public CpuGBSAOBCForce {
+public:
+    CpuGBSAOBCForceVec8();
+
+protected:
+    /**
+     * Accumulate the Born radius sums for all interactions of one atom block.
+     */
+    void calculateBlockBornSums(int blockIndex, float* sums, const fvec4& boxSize, const fvec4& invBoxSize);
+
+    /**
+     * Compute the polarization energy and its derivatives for all interactions of one atom block.
+     */
+    void calculateBlockPolarization(int blockIndex, float* forces, float* bornForces, double& energy, const fvec4& boxSize, const fvec4& invBoxSize);
+
+    /**
+     * Compute the chain rule forces for all interactions of one atom block.
+     */
+    void calculateBlockChainRuleForces(int blockIndex, float* forces, const fvec4& boxSize, const fvec4& invBoxSize);
+
+    /**
+     * Compute the displacement and squared distance between a collection of points, optionally using
+     * periodic boundary conditions.
+     */
+    void getDeltaR(const fvec4& posI, const fvec8& x, const fvec8& y, const fvec8& z, fvec8& dx, fvec8& dy, fvec8& dz, fvec8& r2, bool periodic, const fvec4& boxSize, const fvec4& invBoxSize) const;
+
+    /**
+     * Load the positions and charges of eight atoms.
+     */
+    void loadGroup(const int* atoms, fvec8& x, fvec8& y, fvec8& z, fvec8& charge) const;
+
+    /**
+     * Build the mask of interactions to include for a neighbor.
+     */
+    ivec8 getIncludeMask(short exclusions, const fvec8& r2) const;
+
+    /**
+     * Compute the contribution of one pair of atoms to the Born radius sum.
+     */
+    fvec8 computeBornSumTerm(const fvec8& offsetRadius, const fvec8& scaledRadius, const fvec8& r, const fvec8& rInverse, const ivec8& include);
+
+    /**
+     * Compute the geometric factor used for the chain rule force between one pair of atoms.
+     */
+    fvec8 computeChainRuleTerm(const fvec8& offsetRadius, const fvec8& scaledRadius, const fvec8& r, const fvec8& r2Inverse, const ivec8& include);
+
+    /**
+     * Evaluate log(x) using a lookup table for speed.
+     */
+    fvec8 fastLog(const fvec8& x);
+};
+
+} // namespace OpenMM
+
+// ---------------------------------------------------------------------------------------
+
+#endif // __AVX__
+
+#endif // OPENMM_CPU_GBSAOBC_FORCE_VEC8_H__
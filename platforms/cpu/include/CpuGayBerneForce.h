@@ -72,15 +72,14 @@ public:
     /**
      * Get the exclusions being used by the force.
      */
-    const std::vector<std::set<int> >& getExclusions() const;
+    const CpuExclusionList& getExclusions() const;
 
 private:
     struct ParticleInfo;
     struct ExceptionInfo;
     std::vector<ParticleInfo> particles;
     std::vector<ExceptionInfo> exceptions;
-    std::set<std::pair<int, int> > exclusions;
-    std::vector<std::set<int> > particleExclusions;
+    CpuExclusionList particleExclusions;
     GayBerneForce::NonbondedMethod nonbondedMethod;
     RealOpenMM cutoffDistance, switchingDistance;
     bool useSwitchingFunction;
@@ -44,6 +44,8 @@
 #include "CpuPlatform.h"
 #include "openmm/kernels.h"
 #include "openmm/System.h"
+#include "openmm/internal/CustomNonbondedForceImpl.h"
+#include "openmm/internal/NonbondedForceImpl.h"
 
 namespace OpenMM {
 
@@ -55,6 +57,7 @@ namespace OpenMM {
 class CpuCalcForcesAndEnergyKernel : public CalcForcesAndEnergyKernel {
 public:
     class InitForceTask;
+    class SortPositionsTask;
     class SumForceTask;
     CpuCalcForcesAndEnergyKernel(std::string name, const Platform& platform, CpuPlatform::PlatformData& data, ContextImpl& context);
     /**
@@ -92,6 +95,30 @@ private:
     CpuPlatform::PlatformData& data;
     Kernel referenceKernel;
     std::vector<RealVec> lastPositions;
+    bool isProfiling;
+};
+
+/**
+ * This kernel recomputes the positions of virtual sites.
+ */
+class CpuVirtualSitesKernel : public VirtualSitesKernel {
+public:
+    CpuVirtualSitesKernel(std::string name, const Platform& platform, CpuPlatform::PlatformData& data) : VirtualSitesKernel(name, platform), data(data) {
+    }
+    /**
+     * Initialize the kernel.
+     *
+     * @param system     the System this kernel will be applied to
+     */
+    void initialize(const System& system);
+    /**
+     * Compute the virtual site locations.
+     *
+     * @param context    the context in which to execute this kernel
+     */
+    void computePositions(ContextImpl& context);
+private:
+    CpuPlatform::PlatformData& data;
 };
 
 /**
@@ -249,6 +276,16 @@ public:
      * @param force      the NonbondedForce to copy the parameters from
      */
     void copyParametersToContext(ContextImpl& context, const NonbondedForce& force);
+    /**
+     * Copy the parameters of selected particles and exceptions over to a context.
+     *
+     * @param context    the context to copy parameters to
+     * @param force      the NonbondedForce to copy the parameters from
+     * @param particles  the indices of the particles whose parameters have changed
+     * @param exceptions the indices of the exceptions whose parameters have changed
+     */
+    void copyParameterSubsetToContext(ContextImpl& context, const NonbondedForce& force, const std::vector<int>& particles,
+            const std::vector<int>& exceptions);
     /**
      * Get the parameters being used for PME.
      * 
@@ -260,15 +297,20 @@ public:
     void getPMEParameters(double& alpha, int& nx, int& ny, int& nz) const;
 private:
     class PmeIO;
+    class ReciprocalTask;
     CpuPlatform::PlatformData& data;
     int numParticles, num14;
     int **bonded14IndexArray;
     double **bonded14ParamArray;
-    double nonbondedCutoff, switchingDistance, rfDielectric, ewaldAlpha, ewaldSelfEnergy, dispersionCoefficient;
+    double nonbondedCutoff, switchingDistance, rfDielectric, ewaldAlpha, ewaldSelfEnergy, dispersionCoefficient, sumSquaredCharges;
     int kmax[3], gridSize[3];
     bool useSwitchingFunction, useOptimizedPme, hasInitializedPme;
-    std::vector<std::set<int> > exclusions;
+    int numPmeThreads;
+    CpuExclusionList exclusions;
     std::vector<std::pair<float, float> > particleParams;
+    std::vector<double> charges;
+    std::vector<int> exceptionIndex;
+    NonbondedForceImpl::DispersionCorrectionData* dispersionCorrection;
     NonbondedMethod nonbondedMethod;
     CpuNonbondedForce* nonbonded;
     Kernel optimizedPme;
@@ -305,15 +347,23 @@ public:
      * @param force      the CustomNonbondedForce to copy the parameters from
      */
     void copyParametersToContext(ContextImpl& context, const CustomNonbondedForce& force);
+    /**
+     * Copy the parameters of selected particles over to a context.
+     *
+     * @param context    the context to copy parameters to
+     * @param force      the CustomNonbondedForce to copy the parameters from
+     * @param particles  the indices of the particles whose parameters have changed
+     */
+    void copyParameterSubsetToContext(ContextImpl& context, const CustomNonbondedForce& force, const std::vector<int>& particles);
 private:
     CpuPlatform::PlatformData& data;
     int numParticles;
     double **particleParamArray;
     double nonbondedCutoff, switchingDistance, periodicBoxSize[3], longRangeCoefficient;
     bool useSwitchingFunction, hasInitializedLongRangeCorrection;
-    CustomNonbondedForce* forceCopy;
+    CustomNonbondedForceImpl::LongRangeCorrectionData* longRangeCorrection;
     std::map<std::string, double> globalParamValues;
-    std::vector<std::set<int> > exclusions;
+    CpuExclusionList exclusions;
     std::vector<std::string> parameterNames, globalParameterNames, energyParamDerivNames;
     std::vector<std::pair<std::set<int>, std::set<int> > > interactionGroups;
     std::vector<double> longRangeCoefficientDerivs;
@@ -327,7 +377,7 @@ private:
 class CpuCalcGBSAOBCForceKernel : public CalcGBSAOBCForceKernel {
 public:
     CpuCalcGBSAOBCForceKernel(std::string name, const Platform& platform, CpuPlatform::PlatformData& data) : CalcGBSAOBCForceKernel(name, platform),
-            data(data) {
+            data(data), obc(NULL) {
     }
     ~CpuCalcGBSAOBCForceKernel();
     /**
@@ -356,7 +406,7 @@ public:
 private:
     CpuPlatform::PlatformData& data;
     std::vector<std::pair<float, float> > particleParams;
-    CpuGBSAOBCForce obc;
+    CpuGBSAOBCForce* obc;
 };
 
 /**
@@ -398,7 +448,7 @@ private:
     RealOpenMM **particleParamArray;
     RealOpenMM nonbondedCutoff;
     CpuCustomGBForce* ixn;
-    std::vector<std::set<int> > exclusions;
+    CpuExclusionList exclusions;
     std::vector<std::string> particleParameterNames, globalParameterNames, energyParamDerivNames, valueNames;
     std::vector<OpenMM::CustomGBForce::ComputationType> valueTypes;
     std::vector<OpenMM::CustomGBForce::ComputationType> energyTypes;
@@ -28,16 +28,20 @@
 
 #include "ReferenceStochasticDynamics.h"
 #include "CpuRandom.h"
+#include "CpuSETTLE.h"
+#include "CpuVirtualSites.h"
+#include "windowsExportCpu.h"
 #include "openmm/internal/ThreadPool.h"
 #include "sfmt/SFMT.h"
 
 namespace OpenMM {
 
-class CpuLangevinDynamics : public ReferenceStochasticDynamics {
+class OPENMM_EXPORT_CPU CpuLangevinDynamics : public ReferenceStochasticDynamics {
 public:
     class Update1Task;
     class Update2Task;
     class Update3Task;
+    class FusedUpdateTask;
     /**
      * Constructor.
      *
@@ -47,14 +51,52 @@ public:
      * @param temperature    temperature
      * @param threads        thread pool for parallelizing computation
      * @param random         random number generator
+     * @param virtualSites   used to compute the positions of virtual sites.  This may be NULL if there are none.
      */
-    CpuLangevinDynamics(int numberOfAtoms, RealOpenMM deltaT, RealOpenMM tau, RealOpenMM temperature, OpenMM::ThreadPool& threads, OpenMM::CpuRandom& random);
+    CpuLangevinDynamics(int numberOfAtoms, RealOpenMM deltaT, RealOpenMM tau, RealOpenMM temperature, OpenMM::ThreadPool& threads, OpenMM::CpuRandom& random,
+            OpenMM::CpuVirtualSites* virtualSites=NULL);
 
     /**
      * Destructor.
      */
     ~CpuLangevinDynamics();
 
+    /**
+     * Generate the random forces for the next step with the counter based generator in CpuRandom.  The
+     * values then depend only on the random number seed, the step index, and the atom index, so they
+     * do not depend on the number of threads and are reproduced after loading a checkpoint.  This must
+     * be called before every step to have an effect.
+     *
+     * @param step     the index of the step about to be taken
+     */
+    void setCounterRandomStep(int step);
+
+    /**
+     * Advance the system by one time step.
+     *
+     * If the only constraints are rigid water molecules handled by SETTLE and every virtual site is
+     * computed from particles in a single molecule, each molecule is integrated, constrained, and has
+     * its virtual sites placed in one pass while its data is in cache.  All molecules are processed in
+     * a single dispatch to the thread pool.  When the CpuSETTLE uses single precision, water molecules
+     * are handled four at a time so they can be constrained with SIMD operations, the same as with
+     * other integrators.  Otherwise this falls back to the separate passes of ReferenceStochasticDynamics.
+     *
+     * @param system              the System to be integrated
+     * @param atomCoordinates     atom coordinates
+     * @param velocities          velocities
+     * @param forces              forces
+     * @param masses              atom masses
+     * @param tolerance           the constraint tolerance
+     */
+    void update(const OpenMM::System& system, std::vector<OpenMM::RealVec>& atomCoordinates,
+                std::vector<OpenMM::RealVec>& velocities, std::vector<OpenMM::RealVec>& forces, std::vector<RealOpenMM>& masses, RealOpenMM tolerance);
+
+    /**
+     * Get whether update() integrates each molecule in a single pass.  This is decided on the first call
+     * to update(), so it always returns false before then.
+     */
+    bool usesFusedUpdate() const;
+
     /**
      * First update step.
      * 
@@ -92,13 +134,36 @@ public:
     void updatePart3(int numberOfAtoms, std::vector<OpenMM::RealVec>& atomCoordinates, std::vector<OpenMM::RealVec>& velocities,
                      std::vector<RealOpenMM>& inverseMasses, std::vector<OpenMM::RealVec>& xPrime);
 
+    /**
+     * Compute the positions of virtual sites.
+     *
+     * @param system              the System being integrated
+     * @param atomCoordinates     atom coordinates
+     */
+    void computeVirtualSites(const OpenMM::System& system, std::vector<OpenMM::RealVec>& atomCoordinates);
+
 private:
     void threadUpdate1(int threadIndex);
     void threadUpdate2(int threadIndex);
     void threadUpdate3(int threadIndex);
+    void initializeFusedUpdate(const OpenMM::System& system);
+    OpenMM::RealVec getRandomNoise(int threadIndex, int atom);
+    void threadFusedUpdate(int threadIndex, std::vector<OpenMM::RealVec>& atomCoordinates, std::vector<OpenMM::RealVec>& velocities, std::vector<OpenMM::RealVec>& forces);
     OpenMM::ThreadPool& threads;
     OpenMM::CpuRandom& random;
+    OpenMM::CpuVirtualSites* virtualSites;
+    bool useCounterRandom;
+    int counterRandomStep;
     std::vector<OpenMM_SFMT::SFMT> threadRandom;
+    // The fused update divides the particles into molecules.  Each one is either a single unconstrained particle
+    // or a set of SETTLE clusters, plus the virtual sites computed from them.  In double precision a molecule
+    // holds one cluster, and moleculeCluster is its index in fusedSettle.  In single precision it holds a group
+    // of four clusters that are constrained together with SIMD operations by simdSettle, and moleculeCluster
+    // is the index of the group.  It is -1 for a molecule with no constraints.
+    bool fusedInitialized, canFuse;
+    ReferenceSETTLEAlgorithm* fusedSettle;
+    OpenMM::CpuSETTLE* simdSettle;
+    std::vector<int> moleculeCluster, moleculeStart, moleculeParticles, moleculeSiteStart, moleculeSites;
     // The following variables are used to make information accessible to the individual threads.
     int numberOfAtoms;
     OpenMM::RealVec* atomCoordinates;
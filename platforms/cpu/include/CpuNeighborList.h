@@ -33,6 +33,7 @@
  * -------------------------------------------------------------------------- */
 
 #include "AlignedArray.h"
+#include "CpuExclusionList.h"
 #include "RealVec.h"
 #include "windowsExportCpu.h"
 #include "openmm/internal/gmx_atomic.h"
@@ -48,13 +49,28 @@ public:
     class ThreadTask;
     class Voxels;
     CpuNeighborList(int blockSize);
-    void computeNeighborList(int numAtoms, const AlignedArray<float>& atomLocations, const std::vector<std::set<int> >& exclusions,
+    void computeNeighborList(int numAtoms, const AlignedArray<float>& atomLocations, const CpuExclusionList& exclusions,
             const RealVec* periodicBoxVectors, bool usePeriodic, float maxDistance, ThreadPool& threads);
     int getNumBlocks() const;
     int getBlockSize() const;
     const std::vector<int>& getSortedAtoms() const;
     const std::vector<int>& getBlockNeighbors(int blockIndex) const;
-    const std::vector<char>& getBlockExclusions(int blockIndex) const;
+    /**
+     * Get the neighbors of a block, identified by their positions in the sorted atom list rather
+     * than by atom index.  This is only available if setStoreSortedNeighbors(true) has been called.
+     */
+    const std::vector<int>& getBlockSortedNeighbors(int blockIndex) const;
+    const std::vector<short>& getBlockExclusions(int blockIndex) const;
+    /**
+     * Set whether to record the neighbors of each block by their positions in the sorted atom list,
+     * in addition to their atom indices.
+     */
+    void setStoreSortedNeighbors(bool store);
+    /**
+     * Get the number of times the neighbor list has been built.  This can be used to detect when the
+     * order of the sorted atoms has changed.
+     */
+    int getBuildCount() const;
     /**
      * This routine contains the code executed by each thread.
      */
@@ -65,17 +81,20 @@ private:
     std::vector<int> sortedAtoms;
     std::vector<float> sortedPositions;
     std::vector<std::vector<int> > blockNeighbors;
-    std::vector<std::vector<char> > blockExclusions;
+    std::vector<std::vector<int> > blockSortedNeighbors;
+    std::vector<std::vector<short> > blockExclusions;
     // The following variables are used to make information accessible to the individual threads.
     float minx, maxx, miny, maxy, minz, maxz;
     std::vector<std::pair<int, int> > atomBins;
     Voxels* voxels;
-    const std::vector<std::set<int> >* exclusions;
+    const CpuExclusionList* exclusions;
     const float* atomLocations;
     RealVec periodicBoxVectors[3];
     int numAtoms;
     bool usePeriodic;
     float maxDistance;
+    bool storeSortedNeighbors;
+    int buildCount;
     gmx_atomic_t atomicCounter;
 };
 
@@ -114,6 +114,63 @@ class CpuNonbondedForce {
       
       void setUsePME(float alpha, int meshSize[3]);
 
+      /**---------------------------------------------------------------------------------------
+      
+         Set the direct space calculation to read particle data in the order of the neighbor
+         list's sorted atoms rather than the order of the System.  This requires that a cutoff
+         has been set, and that the neighbor list stores sorted neighbor indices.  Particle
+         parameters are reordered to match whenever the neighbor list is rebuilt, and forces are
+         accumulated in sorted order and translated back at the end of the calculation.
+      
+         @param sortedPosq   atom coordinates and charges in sorted order, with one entry for
+                             every element of the neighbor list's sorted atom list.  Pass NULL to
+                             use the original order.
+      
+         --------------------------------------------------------------------------------------- */
+      
+      void setSortedPosq(float* sortedPosq);
+
+      /**---------------------------------------------------------------------------------------
+      
+         Indicate that the particle parameters have changed, so any reordered copy of them
+         must be rebuilt.
+      
+         --------------------------------------------------------------------------------------- */
+      
+      void invalidateSortedParameters();
+
+      /**---------------------------------------------------------------------------------------
+      
+         Set the direct space calculation to accumulate forces in 64 bit fixed point, so the
+         results are bitwise identical for any number of threads.  Each unit of work (an atom
+         block, or a row of interactions when there is no cutoff) is computed into a zeroed
+         scratch buffer, then converted to fixed point and added to the calling thread's buffer.
+         Energies are recorded for each unit of work and summed in a fixed order.
+      
+         @param threadFixedForce   one buffer for each thread, holding three values per atom.
+                                   Forces are added to these buffers rather than to threadForce.
+                                   Pass NULL to accumulate forces in floating point.
+      
+         --------------------------------------------------------------------------------------- */
+      
+      void setFixedPointForces(std::vector<std::vector<long long> >* threadFixedForce);
+
+      /**---------------------------------------------------------------------------------------
+      
+         Set the direct space calculation to accumulate forces in double precision.  Each unit of
+         work is computed in single precision into a zeroed scratch buffer, then added to the
+         calling thread's double precision buffer, so rounding error does not build up over the
+         many units of work that contribute to each atom.  This is ignored if fixed point forces
+         have also been requested.
+      
+         @param threadDoubleForce  one buffer for each thread, holding three values per atom.
+                                   Forces are added to these buffers rather than to threadForce.
+                                   Pass NULL to accumulate forces in single precision.
+      
+         --------------------------------------------------------------------------------------- */
+      
+      void setDoubleForces(std::vector<std::vector<double> >* threadDoubleForce);
+
       /**---------------------------------------------------------------------------------------
       
          Calculate Ewald ixn
@@ -123,14 +180,13 @@ class CpuNonbondedForce {
          @param atomCoordinates  atom coordinates (in format needed by PME)
          @param atomParameters   atom parameters (sigma/2, 2*sqrt(epsilon))
          @param exclusions       atom exclusion indices
-                                 exclusions[atomIndex] contains the list of exclusions for that atom
          @param forces           force array (forces added)
          @param totalEnergy      total energy
             
          --------------------------------------------------------------------------------------- */
           
       void calculateReciprocalIxn(int numberOfAtoms, float* posq, const std::vector<RealVec>& atomCoordinates,
-                            const std::vector<std::pair<float, float> >& atomParameters, const std::vector<std::set<int> >& exclusions,
+                            const std::vector<std::pair<float, float> >& atomParameters, const CpuExclusionList& exclusions,
                             std::vector<RealVec>& forces, double* totalEnergy) const;
       
       /**---------------------------------------------------------------------------------------
@@ -142,15 +198,19 @@ class CpuNonbondedForce {
          @param atomCoordinates  atom coordinates (periodic boundary conditions not applied)
          @param atomParameters   atom parameters (sigma/2, 2*sqrt(epsilon))
          @param exclusions       atom exclusion indices
-                                 exclusions[atomIndex] contains the list of exclusions for that atom
          @param forces           force array (forces added)
          @param totalEnergy      total energy
          @param threads          the thread pool to use
+         @param masterTask       if not NULL, this task is executed on the calling thread (with thread index -1)
+                                 while the worker threads compute the direct space interactions
+         @param numActiveThreads if greater than 0, only this many of the worker threads compute interactions,
+                                 so the others' cores are free for other work
       
          --------------------------------------------------------------------------------------- */
           
       void calculateDirectIxn(int numberOfAtoms, float* posq, const std::vector<RealVec>& atomCoordinates, const std::vector<std::pair<float, float> >& atomParameters,
-            const std::vector<std::set<int> >& exclusions, std::vector<AlignedArray<float> >& threadForce, double* totalEnergy, ThreadPool& threads);
+            const CpuExclusionList& exclusions, std::vector<AlignedArray<float> >& threadForce, double* totalEnergy, ThreadPool& threads,
+            ThreadPool::Task* masterTask=NULL, int numActiveThreads=0);
 
     /**
      * This routine contains the code executed by each thread.
@@ -177,12 +237,23 @@ protected:
         std::vector<float> erfcTable, ewaldScaleTable;
         float ewaldDX, ewaldDXInv, erfcDXInv;
         std::vector<double> threadEnergy;
+        float* sortedPosq;
+        std::vector<std::pair<float, float> > sortedParameters;
+        std::vector<int> sortedOrder;
+        std::vector<AlignedArray<float> > threadBlockForce;
+        std::vector<std::vector<int> > threadTouchedAtoms;
+        std::vector<std::vector<char> > threadAtomIsTouched;
+        int sortedParametersBuild;
+        std::vector<std::vector<long long> >* threadFixedForce;
+        std::vector<std::vector<double> >* threadDoubleForce;
+        std::vector<double> unitEnergy, exclusionEnergy;
         // The following variables are used to make information accessible to the individual threads.
-        int numberOfAtoms;
+        int numberOfAtoms, activeThreads;
         float* posq;
+        float* originalPosq;
         RealVec const* atomCoordinates;
         std::pair<float, float> const* atomParameters;        
-        std::set<int> const* exclusions;
+        const CpuExclusionList* exclusions;
         std::vector<AlignedArray<float> >* threadForce;
         bool includeEnergy;
         void* atomicCounter;
@@ -227,6 +298,40 @@ protected:
           
       virtual void calculateBlockEwaldIxn(int blockIndex, float* forces, double* totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize) = 0;
 
+      /**
+       * Get the atoms making up each block, in the order used to index posq and atomParameters.
+       */
+      const std::vector<int>& getBlockAtomOrder() const;
+
+      /**
+       * Get the neighbors of a block, as indices into posq and atomParameters.
+       */
+      const std::vector<int>& getBlockNeighbors(int blockIndex) const;
+
+      /**
+       * Record which entries of a thread's scratch buffer a block may modify: the block's own atoms
+       * and its neighbors.
+       */
+      void recordBlockAtoms(int blockIndex, int threadIndex);
+
+      /**
+       * Add the forces a thread has accumulated in sorted order to a force array in the original order.
+       * Only the entries recorded by recordBlockAtoms() are visited, and each one is reset to zero.
+       */
+      void addSortedForces(int threadIndex, float* sortedForces, float* forces);
+
+      /**
+       * Convert the forces a block has accumulated in a scratch buffer to fixed point, and add them
+       * to a fixed point force array.  The scratch buffer entries are reset to zero.
+       */
+      void addBlockFixedPointForces(int blockIndex, float* blockForces, long long* fixedForces) const;
+
+      /**
+       * Add the forces a block has accumulated in a scratch buffer to a double precision force array.
+       * The scratch buffer entries are reset to zero.
+       */
+      void addBlockDoubleForces(int blockIndex, float* blockForces, double* doubleForces) const;
+
       /**
        * Compute the displacement and squared distance between two points, optionally using
        * periodic boundary conditions.
@@ -33,8 +33,10 @@
  * -------------------------------------------------------------------------- */
 
 #include "AlignedArray.h"
+#include "CpuBondForce.h"
 #include "CpuRandom.h"
 #include "CpuNeighborList.h"
+#include "CpuVirtualSites.h"
 #include "ReferencePlatform.h"
 #include "openmm/internal/ContextImpl.h"
 #include "openmm/internal/ThreadPool.h"
@@ -50,6 +52,7 @@ namespace OpenMM {
 class OPENMM_EXPORT_CPU CpuPlatform : public ReferencePlatform {
 public:
     class PlatformData;
+    class SharedData;
     CpuPlatform();
     const std::string& getName() const {
         static const std::string name = "CPU";
@@ -68,6 +71,61 @@ public:
         static const std::string key = "Threads";
         return key;
     }
+    /**
+     * This is the name of the parameter for selecting what numerical precision to use.  In "mixed" mode,
+     * forces are computed in single precision, but each thread accumulates the NonbondedForce direct
+     * space forces in double precision, and the sum over threads and SETTLE are done in double precision.
+     * In "double" mode, pairwise forces are computed by the Reference kernels, using the number of
+     * threads given by the Threads property unless deterministic forces have been requested.
+     */
+    static const std::string& CpuPrecision() {
+        static const std::string key = "Precision";
+        return key;
+    }
+    /**
+     * This is the name of the parameter for selecting whether to store particle data in the spatially
+     * sorted order of the neighbor list.
+     */
+    static const std::string& CpuReorderParticles() {
+        static const std::string key = "ReorderParticles";
+        return key;
+    }
+    /**
+     * This is the name of the parameter for requesting that force computations be fully deterministic,
+     * giving bitwise identical results for any number of threads.
+     */
+    static const std::string& CpuDeterministicForces() {
+        static const std::string key = "DeterministicForces";
+        return key;
+    }
+    /**
+     * This is the name of the parameter for selecting whether stochastic integrators should use a counter
+     * based random number generator, whose values depend only on the seed, the step, and the atom index.
+     */
+    static const std::string& CpuCounterBasedRandom() {
+        static const std::string key = "CounterBasedRandom";
+        return key;
+    }
+    /**
+     * This is the name of the parameter for selecting whether PME reciprocal space forces should be computed
+     * at the same time as direct space forces, rather than after them.  When the optimized PME plugin is
+     * available, the threads given by the Threads property are divided between the two phases as specified
+     * by OverlapPmeFraction.  Otherwise the reference PME implementation runs on the calling thread while the
+     * worker threads compute direct space.
+     */
+    static const std::string& CpuOverlapPme() {
+        static const std::string key = "OverlapPme";
+        return key;
+    }
+    /**
+     * This is the name of the parameter for selecting what fraction of the threads should compute PME
+     * reciprocal space when OverlapPme is enabled.  The remaining threads compute direct space.  It must
+     * be greater than 0 and less than 1.  At least one thread is always assigned to each phase.
+     */
+    static const std::string& CpuOverlapPmeFraction() {
+        static const std::string key = "OverlapPmeFraction";
+        return key;
+    }
     /**
      * We cannot use the standard mechanism for platform data, because that is already used by the superclass.
      * Instead, we maintain a table of ContextImpls to PlatformDatas.
@@ -76,23 +134,80 @@ public:
     static const PlatformData& getPlatformData(const ContextImpl& context);
 private:
     static std::map<const ContextImpl*, PlatformData*> contextData;
+    static std::map<const ContextGroup*, SharedData*> groupData;
+};
+
+/**
+ * This holds data that can be shared by all the contexts in a ContextGroup.  A context that does
+ * not belong to a group has its own SharedData.
+ */
+class CpuPlatform::SharedData {
+public:
+    SharedData(int numParticles, int numThreads);
+    ~SharedData();
+    /**
+     * Get an exclusion list with the same contents as the specified one.  If another context in
+     * the group has already created an identical list, that one is returned so only one copy of the
+     * data needs to be stored.
+     */
+    const CpuExclusionList& getSharedExclusions(const CpuExclusionList& exclusions);
+    ThreadPool threads;
+    std::vector<AlignedArray<float> > threadForce;
+    /**
+     * Forces in 64 bit fixed point, with one buffer of three values per particle for each thread.
+     * These are only allocated when deterministic forces have been requested.  Integer addition is
+     * associative, so the total does not depend on how work was divided between threads.
+     */
+    std::vector<std::vector<long long> > threadFixedForce;
+    /**
+     * Forces in double precision, with one buffer of three values per particle for each thread.
+     * These are only allocated when mixed precision has been requested, and are used by the kernels
+     * that support accumulating their forces in double precision.
+     */
+    std::vector<std::vector<double> > threadDoubleForce;
+    /**
+     * The scale factor for converting forces to fixed point.
+     */
+    static const double FixedPointScale;
+    std::vector<CpuExclusionList> exclusionLists;
+    /**
+     * The division of bonded interactions between threads, shared by the CpuBondForce objects of every
+     * kernel in the group.  See CpuBondForce::initialize().
+     */
+    std::map<std::string, CpuBondForce::Partition*> bondPartitions;
+    int numContexts;
 };
 
 class CpuPlatform::PlatformData {
 public:
-    PlatformData(int numParticles, int numThreads);
+    PlatformData(SharedData& shared, int numParticles, const std::string& precision, bool reorderParticles, bool deterministicForces, bool counterBasedRandom,
+            bool overlapPme, double overlapPmeFraction);
     ~PlatformData();
-    void requestNeighborList(double cutoffDistance, double padding, bool useExclusions, const std::vector<std::set<int> >& exclusionList);
+    void requestNeighborList(double cutoffDistance, double padding, bool useExclusions, const CpuExclusionList& exclusionList);
+    /**
+     * Get the ThreadPool to use for a calculation whose results would otherwise depend on how work
+     * is divided between threads.  When deterministic forces have been requested, this is a pool
+     * with a single thread.  Otherwise it is the same as threads.
+     */
+    ThreadPool& getDeterministicThreads();
+    SharedData& shared;
     AlignedArray<float> posq;
-    std::vector<AlignedArray<float> > threadForce;
-    ThreadPool threads;
-    bool isPeriodic;
+    AlignedArray<float> sortedPosq;
+    std::vector<AlignedArray<float> >& threadForce;
+    ThreadPool& threads;
+    ThreadPool* serialThreads;
+    bool isPeriodic, useMixedPrecision, useDoublePrecision, reorderParticles, deterministicForces, counterBasedRandom, overlapPme;
+    double overlapPmeFraction;
     CpuRandom random;
     std::map<std::string, std::string> propertyValues;
     CpuNeighborList* neighborList;
+    /**
+     * This is used to compute virtual sites.  It is NULL if the System does not contain any.
+     */
+    CpuVirtualSites* virtualSites;
     double cutoff, paddedCutoff;
     bool anyExclusions;
-    std::vector<std::set<int> > exclusions;
+    CpuExclusionList exclusions;
 };
 
 } // namespace OpenMM
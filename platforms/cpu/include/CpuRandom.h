@@ -34,6 +34,7 @@
 
 #include "sfmt/SFMT.h"
 #include "windowsExportCpu.h"
+#include "openmm/internal/vectorize.h"
 #include <vector>
 
 namespace OpenMM {
@@ -48,9 +49,19 @@ public:
     void initialize(int seed, int numThreads);
     float getGaussianRandom(int threadIndex);
     float getUniformRandom(int threadIndex);
+    /**
+     * Get four Gaussian random numbers from a counter based generator (Philox4x32-10).  Unlike the
+     * other methods, the values depend only on the seed, the step, and the atom index.  They do not
+     * depend on which thread asks for them or on what values were generated before.
+     *
+     * @param step    the index of the time step
+     * @param atom    the index of the atom
+     */
+    fvec4 getCounterGaussianRandom(int step, int atom) const;
 private:
     bool hasInitialized;
     int randomSeed;
+    unsigned int counterKey;
     std::vector<OpenMM_SFMT::SFMT*> threadRandom;
     std::vector<float> nextGaussian;
     std::vector<int> nextGaussianIsValid;
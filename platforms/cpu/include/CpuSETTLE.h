@@ -41,15 +41,45 @@
 namespace OpenMM {
 
 /**
- * This class uses multiple ReferenceSETTLEAlgorithm objects to execute the algorithm in parallel.
+ * This class uses multiple ReferenceSETTLEAlgorithm objects to execute the algorithm in parallel.  When
+ * running in single precision, it instead processes clusters four at a time with SIMD operations.
  */
 class OPENMM_EXPORT_CPU CpuSETTLE : public ReferenceConstraintAlgorithm {
 public:
     class ApplyToPositionsTask;
     class ApplyToVelocitiesTask;
-    CpuSETTLE(const System& system, const ReferenceSETTLEAlgorithm& settle, ThreadPool& threads);
+    /**
+     * Create a CpuSETTLE object.
+     *
+     * @param system              the System being simulated
+     * @param settle              the ReferenceSETTLEAlgorithm defining the clusters to constrain
+     * @param threads             the thread pool to use for parallelization
+     * @param useSinglePrecision  if true, the constraints are solved in single precision with SIMD operations.
+     *                            Otherwise they are solved in double precision.
+     */
+    CpuSETTLE(const System& system, const ReferenceSETTLEAlgorithm& settle, ThreadPool& threads, bool useSinglePrecision=false);
     ~CpuSETTLE();
 
+    /**
+     * Get the number of clusters (ordinarily water molecules) being constrained.
+     */
+    int getNumClusters() const;
+    /**
+     * Get the parameters describing one cluster.
+     * 
+     * @param index       the index of the cluster to get
+     * @param atom1       the index of the first atom in the cluster
+     * @param atom2       the index of the second atom in the cluster
+     * @param atom3       the index of the third atom in the cluster
+     * @param distance1   the distance between atoms 1 and 2
+     * @param distance2   the distance between atoms 2 and 3
+     */
+    void getClusterParameters(int index, int& atom1, int& atom2, int& atom3, RealOpenMM& distance1, RealOpenMM& distance2) const;
+    /**
+     * Get whether the constraints are solved in single precision with SIMD operations.
+     */
+    bool getUseSinglePrecision() const;
+
     /**
      * Apply the constraint algorithm.
      * 
@@ -69,9 +99,32 @@ public:
      * @param tolerance        the constraint tolerance
      */
     void applyToVelocities(std::vector<OpenMM::RealVec>& atomCoordinates, std::vector<OpenMM::RealVec>& velocities, std::vector<RealOpenMM>& inverseMasses, RealOpenMM tolerance);
+
+    /**
+     * Apply the constraints to positions for the group of four clusters starting at the specified index, using
+     * SIMD operations.  This may only be called when single precision is being used.
+     *
+     * @param index            the index of the first cluster in the group.  This must be a multiple of four.
+     * @param atomCoordinates  the original atom coordinates
+     * @param atomCoordinatesP the new atom coordinates
+     */
+    void applyToGroup(int index, std::vector<OpenMM::RealVec>& atomCoordinates, std::vector<OpenMM::RealVec>& atomCoordinatesP);
 private:
+    /**
+     * Apply the constraints to positions for one block of clusters, using SIMD operations.
+     */
+    void applyToBlock(int block, std::vector<OpenMM::RealVec>& atomCoordinates, std::vector<OpenMM::RealVec>& atomCoordinatesP);
+    /**
+     * Apply the constraints to velocities for one block of clusters, using SIMD operations.
+     */
+    void applyToVelocitiesForBlock(int block, std::vector<OpenMM::RealVec>& atomCoordinates, std::vector<OpenMM::RealVec>& velocities,
+            std::vector<RealOpenMM>& inverseMasses);
     std::vector<ReferenceSETTLEAlgorithm*> threadSettle;
     ThreadPool& threads;
+    bool useSinglePrecision;
+    int numClusters;
+    std::vector<int> blockStart, clusterAtom1, clusterAtom2, clusterAtom3;
+    std::vector<float> clusterMass1, clusterMass2, clusterMass3, clusterDistance2, clusterRa, clusterRb, clusterRc;
 };
 
 } // namespace OpenMM
@@ -0,0 +1,119 @@
+#ifndef OPENMM_CPUVIRTUALSITES_H_
+#define OPENMM_CPUVIRTUALSITES_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2016 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "RealVec.h"
+#include "windowsExportCpu.h"
+#include "openmm/System.h"
+#include "openmm/internal/ThreadPool.h"
+#include <vector>
+
+namespace OpenMM {
+
+/**
+ * This class computes the positions of virtual sites and distributes the forces on them to the
+ * particles they depend on, dividing the work between multiple threads.  The sites are grouped by
+ * type when the object is created, so each step is a simple loop over arrays of parameters with no
+ * need to inspect the VirtualSite objects.
+ */
+class OPENMM_EXPORT_CPU CpuVirtualSites {
+public:
+    class ComputePositionsTask;
+    class ComputeContributionsTask;
+    class SumContributionsTask;
+    CpuVirtualSites(const System& system, ThreadPool& threads);
+
+    /**
+     * Compute the positions of all virtual sites.
+     *
+     * @param atomCoordinates  the atom coordinates.  On exit, the positions of virtual sites have been updated.
+     */
+    void computePositions(std::vector<OpenMM::RealVec>& atomCoordinates);
+
+    /**
+     * Compute the position of a single virtual site.  This allows the calculation to be combined with
+     * other work on the same molecule while its particles are still in cache.
+     *
+     * @param site             the index of the virtual site
+     * @param atomCoordinates  the atom coordinates.  On exit, the position of the site has been updated.
+     */
+    void computePosition(int site, std::vector<OpenMM::RealVec>& atomCoordinates) const;
+
+    /**
+     * Distribute the forces on virtual sites to the particles they are computed from.  The result
+     * does not depend on the number of threads.
+     *
+     * @param atomCoordinates  the atom coordinates
+     * @param forces           the forces on all particles.  On exit, the force on each virtual site
+     *                         has been added to the particles it depends on.
+     */
+    void distributeForces(const std::vector<OpenMM::RealVec>& atomCoordinates, std::vector<OpenMM::RealVec>& forces);
+private:
+    enum SiteType {NotVirtualSite, TwoParticleAverage, ThreeParticleAverage, OutOfPlane, LocalCoordinates};
+    void threadComputePositions(int threadIndex);
+    void threadComputeContributions(int threadIndex);
+    void threadSumContributions(int threadIndex);
+    void computeTwoParticleAverage(int index, RealVec* atomCoordinates) const;
+    void computeThreeParticleAverage(int index, RealVec* atomCoordinates) const;
+    void computeOutOfPlane(int index, RealVec* atomCoordinates) const;
+    void computeLocalCoordinates(int index, RealVec* atomCoordinates) const;
+    ThreadPool& threads;
+    // For each particle, the type of virtual site it is and its index within the arrays for that type.
+    std::vector<SiteType> siteType;
+    std::vector<int> siteIndex;
+    // Parameters of TwoParticleAverageSites, ThreeParticleAverageSites, and OutOfPlaneSites.  For
+    // OutOfPlaneSites the weights are weight12, weight13, and weightCross.
+    std::vector<int> twoSite, twoAtom1, twoAtom2;
+    std::vector<RealOpenMM> twoWeight1, twoWeight2;
+    std::vector<int> threeSite, threeAtom1, threeAtom2, threeAtom3;
+    std::vector<RealOpenMM> threeWeight1, threeWeight2, threeWeight3;
+    std::vector<int> outOfPlaneSite, outOfPlaneAtom1, outOfPlaneAtom2, outOfPlaneAtom3;
+    std::vector<RealOpenMM> outOfPlaneWeight12, outOfPlaneWeight13, outOfPlaneWeightCross;
+    // Parameters of LocalCoordinatesSites.
+    std::vector<int> localSite, localAtom1, localAtom2, localAtom3;
+    std::vector<RealVec> localOriginWeights, localXWeights, localYWeights, localPosition;
+    // The force each site applies to each of its particles is first stored in contributions.  Each
+    // particle then adds up its own contributions, listed in contributionIndex between
+    // contributionStart[i] and contributionStart[i+1], so no two threads ever write to the same
+    // particle and the order of summation is fixed.
+    std::vector<RealVec> contributions;
+    std::vector<int> contributionParticle, contributionStart, contributionIndex;
+    int threeOffset, outOfPlaneOffset, localOffset;
+    // The following variables are used to make information accessible to the individual threads.
+    RealVec* atomCoordinates;
+    RealVec* forces;
+};
+
+} // namespace OpenMM
+
+#endif /*OPENMM_CPUVIRTUALSITES_H_*/
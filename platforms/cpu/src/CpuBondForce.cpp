@@ -30,7 +30,10 @@
  * -------------------------------------------------------------------------- */
 
 #include "CpuBondForce.h"
+#include "ReferenceDataCache.h"
 #include "openmm/OpenMMException.h"
+#include <cstring>
+#include <sstream>
 
 using namespace OpenMM;
 using namespace std;
@@ -54,16 +57,46 @@ public:
     ReferenceBondIxn& referenceBondIxn;
 };
 
-CpuBondForce::CpuBondForce() {
+CpuBondForce::CpuBondForce() : partition(&ownPartition) {
 }
 
-void CpuBondForce::initialize(int numAtoms, int numBonds, int numAtomsPerBond, int** bondAtoms, ThreadPool& threads) {
+void CpuBondForce::initialize(int numAtoms, int numBonds, int numAtomsPerBond, int** bondAtoms, ThreadPool& threads,
+        map<string, Partition*>* sharedPartitions) {
     this->numBonds = numBonds;
     this->numAtomsPerBond = numAtomsPerBond;
     this->bondAtoms = bondAtoms;
     this->threads = &threads;
     int numThreads = threads.getNumThreads();
     int targetBondsPerThread = numBonds/numThreads;
+    vector<vector<int> >& threadBonds = ownPartition.threadBonds;
+    vector<int>& extraBonds = ownPartition.extraBonds;
+    threadBonds.clear();
+    extraBonds.clear();
+    partition = &ownPartition;
+    
+    // See whether we have already divided up an identical set of bonds, either in another object
+    // sharing the same partitions or in the on-disk cache.
+    
+    stringstream key;
+    key << numAtoms << ' ' << numBonds << ' ' << numAtomsPerBond << ' ' << numThreads << ' ';
+    if (sharedPartitions != NULL || ReferenceDataCache::isEnabled()) {
+        for (int bond = 0; bond < numBonds; bond++)
+            key.write((const char*) bondAtoms[bond], numAtomsPerBond*sizeof(int));
+    }
+    if (sharedPartitions != NULL) {
+        map<string, Partition*>::const_iterator existing = sharedPartitions->find(key.str());
+        if (existing != sharedPartitions->end()) {
+            partition = existing->second;
+            return;
+        }
+    }
+    if (ReferenceDataCache::isEnabled()) {
+        string cached;
+        if (ReferenceDataCache::load("bonds", key.str(), cached) && loadAssignments(cached, numThreads)) {
+            sharePartition(key.str(), sharedPartitions);
+            return;
+        }
+    }
     
     // Record the bonds that include each atom.
     
@@ -151,6 +184,67 @@ void CpuBondForce::initialize(int numAtoms, int numBonds, int numAtomsPerBond, i
             }
         }
     }
+    if (ReferenceDataCache::isEnabled())
+        ReferenceDataCache::save("bonds", key.str(), saveAssignments());
+    sharePartition(key.str(), sharedPartitions);
+}
+
+void CpuBondForce::sharePartition(const string& key, map<string, Partition*>* sharedPartitions) {
+    if (sharedPartitions == NULL)
+        return;
+    Partition* shared = new Partition();
+    shared->threadBonds.swap(ownPartition.threadBonds);
+    shared->extraBonds.swap(ownPartition.extraBonds);
+    (*sharedPartitions)[key] = shared;
+    partition = shared;
+}
+
+string CpuBondForce::saveAssignments() const {
+    const vector<vector<int> >& threadBonds = ownPartition.threadBonds;
+    const vector<int>& extraBonds = ownPartition.extraBonds;
+    stringstream data;
+    for (int i = 0; i < (int) threadBonds.size(); i++) {
+        int size = threadBonds[i].size();
+        data.write((const char*) &size, sizeof(int));
+        if (size > 0)
+            data.write((const char*) &threadBonds[i][0], size*sizeof(int));
+    }
+    int size = extraBonds.size();
+    data.write((const char*) &size, sizeof(int));
+    if (size > 0)
+        data.write((const char*) &extraBonds[0], size*sizeof(int));
+    return data.str();
+}
+
+bool CpuBondForce::loadAssignments(const string& data, int numThreads) {
+    // The data consists of one list of bonds for each thread, followed by the extra bonds.
+
+    vector<vector<int> > lists(numThreads+1);
+    size_t offset = 0;
+    int totalBonds = 0;
+    for (int i = 0; i < (int) lists.size(); i++) {
+        int size;
+        if (offset+sizeof(int) > data.size())
+            return false;
+        memcpy(&size, &data[offset], sizeof(int));
+        offset += sizeof(int);
+        if (size < 0 || offset+size*sizeof(int) > data.size())
+            return false;
+        lists[i].resize(size);
+        if (size > 0)
+            memcpy(&lists[i][0], &data[offset], size*sizeof(int));
+        offset += size*sizeof(int);
+        for (int j = 0; j < size; j++)
+            if (lists[i][j] < 0 || lists[i][j] >= numBonds)
+                return false;
+        totalBonds += size;
+    }
+    if (offset != data.size() || totalBonds != numBonds)
+        return false;
+    ownPartition.extraBonds.swap(lists[numThreads]);
+    lists.pop_back();
+    ownPartition.threadBonds.swap(lists);
+    return true;
 }
 
 bool CpuBondForce::canAssignBond(int bond, int thread, vector<int>& atomThread) {
@@ -166,7 +260,7 @@ void CpuBondForce::assignBond(int bond, int thread, vector<int>& atomThread, vec
     // Assign the bond to a thread.
     
     bondThread[bond] = thread;
-    threadBonds[thread].push_back(bond);
+    ownPartition.threadBonds[thread].push_back(bond);
     
     // Mark every atom in this bond as also belonging to the thread, and add all of their
     // bonds to the list of candidates.
@@ -194,6 +288,7 @@ void CpuBondForce::calculateForce(vector<RealVec>& atomCoordinates, RealOpenMM**
     
     // Compute any "extra" bonds.
     
+    const vector<int>& extraBonds = partition->extraBonds;
     for (int i = 0; i < extraBonds.size(); i++) {
         int bond = extraBonds[i];
         referenceBondIxn.calculateBondIxn(bondAtoms[bond], atomCoordinates, parameters[bond], forces, totalEnergy, NULL);
@@ -208,7 +303,7 @@ void CpuBondForce::calculateForce(vector<RealVec>& atomCoordinates, RealOpenMM**
 
 void CpuBondForce::threadComputeForce(ThreadPool& threads, int threadIndex, vector<RealVec>& atomCoordinates, RealOpenMM** parameters, vector<RealVec>& forces, 
             RealOpenMM* totalEnergy, ReferenceBondIxn& referenceBondIxn) {
-    vector<int>& bonds = threadBonds[threadIndex];
+    const vector<int>& bonds = partition->threadBonds[threadIndex];
     int numBonds = bonds.size();
     for (int i = 0; i < numBonds; i++) {
         int bond = bonds[i];
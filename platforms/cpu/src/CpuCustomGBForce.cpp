@@ -44,19 +44,12 @@ public:
 };
 
 CpuCustomGBForce::ThreadData::ThreadData(int numAtoms, int numThreads, int threadIndex,
-                      const vector<Lepton::CompiledExpression>& valueExpressions,
-                      const vector<vector<Lepton::CompiledExpression> >& valueDerivExpressions,
-                      const vector<vector<Lepton::CompiledExpression> >& valueGradientExpressions,
-                      const vector<vector<Lepton::CompiledExpression> >& valueParamDerivExpressions,
+                      const vector<vector<Lepton::ParsedExpression> >& valueExpressions,
+                      const vector<vector<Lepton::ParsedExpression> >& valueDerivExpressions,
+                      const vector<vector<Lepton::ParsedExpression> >& valueGradientExpressions,
                       const vector<string>& valueNames,
-                      const vector<Lepton::CompiledExpression>& energyExpressions,
-                      const vector<vector<Lepton::CompiledExpression> >& energyDerivExpressions,
-                      const vector<vector<Lepton::CompiledExpression> >& energyGradientExpressions,
-                      const vector<vector<Lepton::CompiledExpression> >& energyParamDerivExpressions,
-                      const vector<string>& parameterNames) :
-            valueExpressions(valueExpressions), valueDerivExpressions(valueDerivExpressions), valueGradientExpressions(valueGradientExpressions),
-            valueParamDerivExpressions(valueParamDerivExpressions), energyExpressions(energyExpressions), energyDerivExpressions(energyDerivExpressions),
-            energyGradientExpressions(energyGradientExpressions), energyParamDerivExpressions(energyParamDerivExpressions) {
+                      const vector<vector<Lepton::ParsedExpression> >& energyExpressions,
+                      const vector<string>& parameterNames) {
     firstAtom = (threadIndex*(long long) numAtoms)/numThreads;
     lastAtom = ((threadIndex+1)*(long long) numAtoms)/numThreads;
     map<string, double*> variableLocations;
@@ -85,43 +78,18 @@ CpuCustomGBForce::ThreadData::ThreadData(int numAtoms, int numThreads, int threa
         }
     }
     for (int i = 0; i < (int) valueExpressions.size(); i++) {
-        this->valueExpressions[i].setVariableLocations(variableLocations);
-        expressionSet.registerExpression(this->valueExpressions[i]);
+        this->valueExpressions.push_back(&expressionSet.registerExpressions(valueExpressions[i], variableLocations));
+        this->valueDerivExpressions.push_back(&expressionSet.registerExpressions(valueDerivExpressions[i], variableLocations));
+        if (i == 0)
+            this->valueGradientExpressions.push_back(NULL);
+        else
+            this->valueGradientExpressions.push_back(&expressionSet.registerExpressions(valueGradientExpressions[i], variableLocations));
     }
-    for (int i = 0; i < (int) valueDerivExpressions.size(); i++)
-        for (int j = 0; j < (int) valueDerivExpressions[i].size(); j++) {
-            this->valueDerivExpressions[i][j].setVariableLocations(variableLocations);
-            expressionSet.registerExpression(this->valueDerivExpressions[i][j]);
-        }
-    for (int i = 0; i < (int) valueGradientExpressions.size(); i++)
-        for (int j = 0; j < (int) valueGradientExpressions[i].size(); j++) {
-            this->valueGradientExpressions[i][j].setVariableLocations(variableLocations);
-            expressionSet.registerExpression(this->valueGradientExpressions[i][j]);
-        }
-    for (int i = 0; i < (int) valueParamDerivExpressions.size(); i++)
-        for (int j = 0; j < (int) valueParamDerivExpressions[i].size(); j++) {
-            this->valueParamDerivExpressions[i][j].setVariableLocations(variableLocations);
-            expressionSet.registerExpression(this->valueParamDerivExpressions[i][j]);
-        }
     for (int i = 0; i < (int) energyExpressions.size(); i++) {
-        this->energyExpressions[i].setVariableLocations(variableLocations);
-        expressionSet.registerExpression(this->energyExpressions[i]);
+        vector<Lepton::ParsedExpression> forceOnly(energyExpressions[i].begin()+1, energyExpressions[i].end());
+        this->energyExpressions.push_back(&expressionSet.registerExpressions(energyExpressions[i], variableLocations));
+        this->forceExpressions.push_back(&expressionSet.registerExpressions(forceOnly, variableLocations));
     }
-    for (int i = 0; i < (int) energyDerivExpressions.size(); i++)
-        for (int j = 0; j < (int) energyDerivExpressions[i].size(); j++) {
-            this->energyDerivExpressions[i][j].setVariableLocations(variableLocations);
-            expressionSet.registerExpression(this->energyDerivExpressions[i][j]);
-        }
-    for (int i = 0; i < (int) energyGradientExpressions.size(); i++)
-        for (int j = 0; j < (int) energyGradientExpressions[i].size(); j++) {
-            this->energyGradientExpressions[i][j].setVariableLocations(variableLocations);
-            expressionSet.registerExpression(this->energyGradientExpressions[i][j]);
-        }
-    for (int i = 0; i < (int) energyParamDerivExpressions.size(); i++)
-        for (int j = 0; j < (int) energyParamDerivExpressions[i].size(); j++) {
-            this->energyParamDerivExpressions[i][j].setVariableLocations(variableLocations);
-            expressionSet.registerExpression(this->energyParamDerivExpressions[i][j]);
-        }
     value0.resize(numAtoms);
     dEdV.resize(valueNames.size());
     for (int i = 0; i < (int) dEdV.size(); i++)
@@ -131,28 +99,24 @@ CpuCustomGBForce::ThreadData::ThreadData(int numAtoms, int numThreads, int threa
     dVdZ.resize(valueDerivExpressions.size());
     dVdR1.resize(valueDerivExpressions.size());
     dVdR2.resize(valueDerivExpressions.size());
-    dValue0dParam.resize(valueParamDerivExpressions[0].size(), vector<float>(numAtoms));
-    energyParamDerivs.resize(valueParamDerivExpressions[0].size());
+    dValue0dParam.resize(valueExpressions[0].size()-1, vector<float>(numAtoms));
+    energyParamDerivs.resize(valueExpressions[0].size()-1);
 }
 
-CpuCustomGBForce::CpuCustomGBForce(int numAtoms, const std::vector<std::set<int> >& exclusions,
-                     const vector<Lepton::CompiledExpression>& valueExpressions,
-                     const vector<vector<Lepton::CompiledExpression> >& valueDerivExpressions,
-                     const vector<vector<Lepton::CompiledExpression> >& valueGradientExpressions,
-                     const vector<vector<Lepton::CompiledExpression> >& valueParamDerivExpressions,
+CpuCustomGBForce::CpuCustomGBForce(int numAtoms, const CpuExclusionList& exclusions,
+                     const vector<vector<Lepton::ParsedExpression> >& valueExpressions,
+                     const vector<vector<Lepton::ParsedExpression> >& valueDerivExpressions,
+                     const vector<vector<Lepton::ParsedExpression> >& valueGradientExpressions,
                      const vector<string>& valueNames,
                      const vector<CustomGBForce::ComputationType>& valueTypes,
-                     const vector<Lepton::CompiledExpression>& energyExpressions,
-                     const vector<vector<Lepton::CompiledExpression> >& energyDerivExpressions,
-                     const vector<vector<Lepton::CompiledExpression> >& energyGradientExpressions,
-                     const vector<vector<Lepton::CompiledExpression> >& energyParamDerivExpressions,
+                     const vector<vector<Lepton::ParsedExpression> >& energyExpressions,
                      const vector<CustomGBForce::ComputationType>& energyTypes,
                      const vector<string>& parameterNames, ThreadPool& threads) :
             exclusions(exclusions), cutoff(false), periodic(false), valueTypes(valueTypes), energyTypes(energyTypes), numValues(valueNames.size()),
             numParams(parameterNames.size()), threads(threads) {
     for (int i = 0; i < threads.getNumThreads(); i++)
         threadData.push_back(new ThreadData(numAtoms, threads.getNumThreads(), i, valueExpressions, valueDerivExpressions, valueGradientExpressions,
-                valueParamDerivExpressions, valueNames, energyExpressions, energyDerivExpressions, energyGradientExpressions, energyParamDerivExpressions, parameterNames));
+                valueNames, energyExpressions, parameterNames));
     values.resize(numValues);
     dEdV.resize(numValues);
     for (int i = 0; i < (int) values.size(); i++) {
@@ -161,7 +125,7 @@ CpuCustomGBForce::CpuCustomGBForce(int numAtoms, const std::vector<std::set<int>
     }
     dValuedParam.resize(numValues);
     for (int i = 0; i < numValues; i++)
-        dValuedParam[i].resize(valueParamDerivExpressions[0].size(), vector<float>(numAtoms));
+        dValuedParam[i].resize(valueExpressions[0].size()-1, vector<float>(numAtoms));
 }
 
 CpuCustomGBForce::~CpuCustomGBForce() {
@@ -311,16 +275,19 @@ void CpuCustomGBForce::threadComputeForce(ThreadPool& threads, int threadIndex)
             data.param[j] = atomParameters[atom][j];
         for (int i = 1; i < numValues; i++) {
             data.value[i-1] = values[i-1][atom];
-            values[i][atom] = (float) data.valueExpressions[i].evaluate();
+            const Lepton::CompiledExpression& valueExpression = *data.valueExpressions[i];
+            values[i][atom] = (float) valueExpression.evaluate();
 
             // Calculate derivatives with respect to parameters.
 
             if (hasParamDerivs) {
-                for (int j = 0; j < data.valueParamDerivExpressions[i].size(); j++)
-                    dValuedParam[i][j][atom] = data.valueParamDerivExpressions[i][j].evaluate();
+                for (int j = 0; j < (int) dValuedParam[i].size(); j++)
+                    dValuedParam[i][j][atom] = valueExpression.getOutput(j+1);
+                const Lepton::CompiledExpression& derivExpression = *data.valueDerivExpressions[i];
+                derivExpression.evaluate();
                 for (int j = 0; j < i; j++) {
-                    float dVdV = data.valueDerivExpressions[i][j].evaluate();
-                    for (int k = 0; k < data.valueParamDerivExpressions[i].size(); k++)
+                    float dVdV = derivExpression.getOutput(j);
+                    for (int k = 0; k < (int) dValuedParam[i].size(); k++)
                         dValuedParam[i][k][atom] += dVdV*dValuedParam[j][k][atom];
                 }
             }
@@ -377,13 +344,13 @@ void CpuCustomGBForce::calculateParticlePairValue(int index, ThreadData& data, i
             const int blockSize = neighborList->getBlockSize();
             const int* blockAtom = &neighborList->getSortedAtoms()[blockSize*blockIndex];
             const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
-            const vector<char>& blockExclusions = neighborList->getBlockExclusions(blockIndex);
+            const vector<short>& blockExclusions = neighborList->getBlockExclusions(blockIndex);
             for (int i = 0; i < (int) neighbors.size(); i++) {
                 int first = neighbors[i];
                 for (int k = 0; k < blockSize; k++) {
                     if ((blockExclusions[i] & (1<<k)) == 0) {
                         int second = blockAtom[k];
-                        if (useExclusions && exclusions[first].find(second) != exclusions[first].end())
+                        if (useExclusions && exclusions.isExcluded(first, second))
                             continue;
                         calculateOnePairValue(index, first, second, data, posq, atomParameters, valueArray, boxSize, invBoxSize);
                         calculateOnePairValue(index, second, first, data, posq, atomParameters, valueArray, boxSize, invBoxSize);
@@ -400,7 +367,7 @@ void CpuCustomGBForce::calculateParticlePairValue(int index, ThreadData& data, i
             if (i >= numAtoms)
                 break;
             for (int j = i+1; j < numAtoms; j++) {
-                if (useExclusions && exclusions[i].find(j) != exclusions[i].end())
+                if (useExclusions && exclusions.isExcluded(i, j))
                     continue;
                 calculateOnePairValue(index, i, j, data, posq, atomParameters, valueArray, boxSize, invBoxSize);
                 calculateOnePairValue(index, j, i, data, posq, atomParameters, valueArray, boxSize, invBoxSize);
@@ -427,16 +394,22 @@ void CpuCustomGBForce::calculateOnePairValue(int index, int atom1, int atom2, Th
         data.particleValue[i*2] = values[i][atom1];
         data.particleValue[i*2+1] = values[i][atom2];
     }
-    valueArray[atom1] += (float) data.valueExpressions[index].evaluate();
+    const Lepton::CompiledExpression& valueExpression = *data.valueExpressions[index];
+    valueArray[atom1] += (float) valueExpression.evaluate();
     
     // Calculate derivatives with respect to parameters.
     
-    for (int i = 0; i < data.valueParamDerivExpressions[index].size(); i++)
-        data.dValue0dParam[i][atom1] += data.valueParamDerivExpressions[index][i].evaluate();
+    for (int i = 0; i < (int) data.dValue0dParam.size(); i++)
+        data.dValue0dParam[i][atom1] += valueExpression.getOutput(i+1);
 }
 
 void CpuCustomGBForce::calculateSingleParticleEnergyTerm(int index, ThreadData& data, int numAtoms, float* posq,
         RealOpenMM** atomParameters, float* forces, double& totalEnergy) {
+    const Lepton::CompiledExpression& expression = (includeEnergy ? *data.energyExpressions[index] : *data.forceExpressions[index]);
+    int numValues = values.size();
+    int firstDeriv = (includeEnergy ? 1 : 0);
+    int firstGradient = firstDeriv+numValues;
+    int firstParamDeriv = firstGradient+3;
     for (int i = data.firstAtom; i < data.lastAtom; i++) {
         data.x = posq[4*i];
         data.y = posq[4*i+1];
@@ -445,18 +418,19 @@ void CpuCustomGBForce::calculateSingleParticleEnergyTerm(int index, ThreadData&
             data.param[j] = atomParameters[i][j];
         for (int j = 0; j < (int) values.size(); j++)
             data.value[j] = values[j][i];
+        expression.evaluate();
         if (includeEnergy)
-            totalEnergy += (float) data.energyExpressions[index].evaluate();
-        for (int j = 0; j < (int) values.size(); j++)
-            data.dEdV[j][i] += (float) data.energyDerivExpressions[index][j].evaluate();
-        forces[4*i+0] -= (float) data.energyGradientExpressions[index][0].evaluate();
-        forces[4*i+1] -= (float) data.energyGradientExpressions[index][1].evaluate();
-        forces[4*i+2] -= (float) data.energyGradientExpressions[index][2].evaluate();
+            totalEnergy += (float) expression.getOutput(0);
+        for (int j = 0; j < numValues; j++)
+            data.dEdV[j][i] += (float) expression.getOutput(firstDeriv+j);
+        forces[4*i+0] -= (float) expression.getOutput(firstGradient);
+        forces[4*i+1] -= (float) expression.getOutput(firstGradient+1);
+        forces[4*i+2] -= (float) expression.getOutput(firstGradient+2);
         
         // Compute derivatives with respect to parameters.
         
-        for (int k = 0; k < data.energyParamDerivExpressions[index].size(); k++)
-            data.energyParamDerivs[k] += data.energyParamDerivExpressions[index][k].evaluate();
+        for (int k = 0; k < (int) data.energyParamDerivs.size(); k++)
+            data.energyParamDerivs[k] += expression.getOutput(firstParamDeriv+k);
     }
 }
 
@@ -472,13 +446,13 @@ void CpuCustomGBForce::calculateParticlePairEnergyTerm(int index, ThreadData& da
             const int blockSize = neighborList->getBlockSize();
             const int* blockAtom = &neighborList->getSortedAtoms()[blockSize*blockIndex];
             const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
-            const vector<char>& blockExclusions = neighborList->getBlockExclusions(blockIndex);
+            const vector<short>& blockExclusions = neighborList->getBlockExclusions(blockIndex);
             for (int i = 0; i < (int) neighbors.size(); i++) {
                 int first = neighbors[i];
                 for (int k = 0; k < blockSize; k++) {
                     if ((blockExclusions[i] & (1<<k)) == 0) {
                         int second = blockAtom[k];
-                        if (useExclusions && exclusions[first].find(second) != exclusions[first].end())
+                        if (useExclusions && exclusions.isExcluded(first, second))
                             continue;
                         calculateOnePairEnergyTerm(index, first, second, data, posq, atomParameters, forces, totalEnergy, boxSize, invBoxSize);
                     }
@@ -494,7 +468,7 @@ void CpuCustomGBForce::calculateParticlePairEnergyTerm(int index, ThreadData& da
             if (i >= numAtoms)
                 break;
             for (int j = i+1; j < numAtoms; j++) {
-                if (useExclusions && exclusions[i].find(j) != exclusions[i].end())
+                if (useExclusions && exclusions.isExcluded(i, j))
                     continue;
                 calculateOnePairEnergyTerm(index, i, j, data, posq, atomParameters, forces, totalEnergy, boxSize, invBoxSize);
            }
@@ -529,22 +503,26 @@ void CpuCustomGBForce::calculateOnePairEnergyTerm(int index, int atom1, int atom
 
     // Evaluate the energy and its derivatives.
 
+    const Lepton::CompiledExpression& expression = (includeEnergy ? *data.energyExpressions[index] : *data.forceExpressions[index]);
+    int firstDeriv = (includeEnergy ? 1 : 0);
+    expression.evaluate();
     if (includeEnergy)
-        totalEnergy += (float) data.energyExpressions[index].evaluate();
-    float dEdR = (float) data.energyDerivExpressions[index][0].evaluate();
+        totalEnergy += (float) expression.getOutput(0);
+    float dEdR = (float) expression.getOutput(firstDeriv);
     dEdR *= 1/r;
     fvec4 result = deltaR*dEdR;
     (fvec4(forces+4*atom1)-result).store(forces+4*atom1);
     (fvec4(forces+4*atom2)+result).store(forces+4*atom2);
     for (int i = 0; i < (int) values.size(); i++) {
-        data.dEdV[i][atom1] += (float) data.energyDerivExpressions[index][2*i+1].evaluate();
-        data.dEdV[i][atom2] += (float) data.energyDerivExpressions[index][2*i+2].evaluate();
+        data.dEdV[i][atom1] += (float) expression.getOutput(firstDeriv+2*i+1);
+        data.dEdV[i][atom2] += (float) expression.getOutput(firstDeriv+2*i+2);
     }
         
     // Compute derivatives with respect to parameters.
 
-    for (int i = 0; i < data.energyParamDerivExpressions[index].size(); i++)
-        data.energyParamDerivs[i] += data.energyParamDerivExpressions[index][i].evaluate();
+    int firstParamDeriv = firstDeriv+2*values.size()+1;
+    for (int i = 0; i < (int) data.energyParamDerivs.size(); i++)
+        data.energyParamDerivs[i] += expression.getOutput(firstParamDeriv+i);
 }
 
 void CpuCustomGBForce::calculateChainRuleForces(ThreadData& data, int numAtoms, float* posq, RealOpenMM** atomParameters,
@@ -559,13 +537,13 @@ void CpuCustomGBForce::calculateChainRuleForces(ThreadData& data, int numAtoms,
             const int blockSize = neighborList->getBlockSize();
             const int* blockAtom = &neighborList->getSortedAtoms()[blockSize*blockIndex];
             const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
-            const vector<char>& blockExclusions = neighborList->getBlockExclusions(blockIndex);
+            const vector<short>& blockExclusions = neighborList->getBlockExclusions(blockIndex);
             for (int i = 0; i < (int) neighbors.size(); i++) {
                 int first = neighbors[i];
                 for (int k = 0; k < blockSize; k++) {
                     if ((blockExclusions[i] & (1<<k)) == 0) {
                         int second = blockAtom[k];
-                        bool isExcluded = (exclusions[first].find(second) != exclusions[first].end());
+                        bool isExcluded = exclusions.isExcluded(first, second);
                         calculateOnePairChainRule(first, second, data, posq, atomParameters, forces, isExcluded, boxSize, invBoxSize);
                         calculateOnePairChainRule(second, first, data, posq, atomParameters, forces, isExcluded, boxSize, invBoxSize);
                     }
@@ -581,7 +559,7 @@ void CpuCustomGBForce::calculateChainRuleForces(ThreadData& data, int numAtoms,
             if (i >= numAtoms)
                 break;
             for (int j = i+1; j < numAtoms; j++) {
-                bool isExcluded = (exclusions[i].find(j) != exclusions[i].end());
+                bool isExcluded = exclusions.isExcluded(i, j);
                 calculateOnePairChainRule(i, j, data, posq, atomParameters, forces, isExcluded, boxSize, invBoxSize);
                 calculateOnePairChainRule(j, i, data, posq, atomParameters, forces, isExcluded, boxSize, invBoxSize);
            }
@@ -601,15 +579,17 @@ void CpuCustomGBForce::calculateChainRuleForces(ThreadData& data, int numAtoms,
             data.dVdX[j] = 0.0;
             data.dVdY[j] = 0.0;
             data.dVdZ[j] = 0.0;
+            const Lepton::CompiledExpression& gradientExpression = *data.valueGradientExpressions[j];
+            gradientExpression.evaluate();
             for (int k = 1; k < j; k++) {
-                float dVdV = (float) data.valueDerivExpressions[j][k].evaluate();
+                float dVdV = (float) gradientExpression.getOutput(k+2);
                 data.dVdX[j] += dVdV*data.dVdX[k];
                 data.dVdY[j] += dVdV*data.dVdY[k];
                 data.dVdZ[j] += dVdV*data.dVdZ[k];
             }
-            data.dVdX[j] += (float) data.valueGradientExpressions[j][0].evaluate();
-            data.dVdY[j] += (float) data.valueGradientExpressions[j][1].evaluate();
-            data.dVdZ[j] += (float) data.valueGradientExpressions[j][2].evaluate();
+            data.dVdX[j] += (float) gradientExpression.getOutput(0);
+            data.dVdY[j] += (float) gradientExpression.getOutput(1);
+            data.dVdZ[j] += (float) gradientExpression.getOutput(2);
             forces[4*i+0] -= dEdV[j][i]*data.dVdX[j];
             forces[4*i+1] -= dEdV[j][i]*data.dVdY[j];
             forces[4*i+2] -= dEdV[j][i]*data.dVdZ[j];
@@ -658,7 +638,7 @@ void CpuCustomGBForce::calculateOnePairChainRule(int atom1, int atom2, ThreadDat
     deltaR *= rinv;
     fvec4 f1(0.0f), f2(0.0f);
     if (!isExcluded || valueTypes[0] != CustomGBForce::ParticlePair) {
-        data.dVdR1[0] = (float) data.valueDerivExpressions[0][0].evaluate();
+        data.dVdR1[0] = (float) data.valueDerivExpressions[0]->evaluate();
         data.dVdR2[0] = -data.dVdR1[0];
         f1 -= deltaR*(dEdV[0][atom1]*data.dVdR1[0]);
         f2 -= deltaR*(dEdV[0][atom1]*data.dVdR2[0]);
@@ -667,8 +647,10 @@ void CpuCustomGBForce::calculateOnePairChainRule(int atom1, int atom2, ThreadDat
         data.value[i] = values[i][atom1];
         data.dVdR1[i] = 0.0;
         data.dVdR2[i] = 0.0;
+        const Lepton::CompiledExpression& derivExpression = *data.valueDerivExpressions[i];
+        derivExpression.evaluate();
         for (int j = 0; j < i; j++) {
-            float dVdV = (float) data.valueDerivExpressions[i][j].evaluate();
+            float dVdV = (float) derivExpression.getOutput(j);
             data.dVdR1[i] += dVdV*data.dVdR1[j];
             data.dVdR2[i] += dVdV*data.dVdR2[j];
         }
@@ -48,7 +48,7 @@ public:
 };
 
 CpuCustomManyParticleForce::CpuCustomManyParticleForce(const CustomManyParticleForce& force, ThreadPool& threads) :
-            threads(threads), useCutoff(false), usePeriodic(false), neighborList(NULL) {
+            useCutoff(false), usePeriodic(false), neighborList(NULL), threads(threads) {
     numParticles = force.getNumParticles();
     numParticlesPerSet = force.getNumParticlesPerSet();
     numPerParticleParameters = force.getNumPerParticleParameters();
@@ -78,17 +78,18 @@ CpuCustomManyParticleForce::CpuCustomManyParticleForce(const CustomManyParticleF
     
     // Record exclusions.
     
-    exclusions.resize(force.getNumParticles());
-    for (int i = 0; i < (int) force.getNumExclusions(); i++) {
-        int p1, p2;
-        force.getExclusionParticles(i, p1, p2);
-        exclusions[p1].insert(p2);
-        exclusions[p2].insert(p1);
-    }
+    anyExclusions = (force.getNumExclusions() > 0);
+    vector<pair<int, int> > excludedPairs(force.getNumExclusions());
+    for (int i = 0; i < (int) force.getNumExclusions(); i++)
+        force.getExclusionParticles(i, excludedPairs[i].first, excludedPairs[i].second);
+    exclusions = CpuExclusionList(force.getNumParticles(), excludedPairs);
     
     // Record information about type filters.
     
     CustomManyParticleForceImpl::buildFilterArrays(force, numTypes, particleTypes, orderIndex, particleOrder);
+    useTypeFilters = (particleOrder.size() > 1);
+    if (useTypeFilters)
+        buildAllowedTypePrefixes();
 }
 
 CpuCustomManyParticleForce::~CpuCustomManyParticleForce() {
@@ -123,7 +124,7 @@ void CpuCustomManyParticleForce::calculateIxn(AlignedArray<float>& posq, RealOpe
         neighborList->computeNeighborList(numParticles, posq, exclusions, periodicBoxVectors, usePeriodic, cutoffDistance, threads);
         for (int blockIndex = 0; blockIndex < neighborList->getNumBlocks(); blockIndex++) {
             const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
-            const vector<char>& exclusions = neighborList->getBlockExclusions(blockIndex);
+            const vector<short>& exclusions = neighborList->getBlockExclusions(blockIndex);
             int numNeighbors = neighbors.size();
             for (int i = 0; i < 4; i++) {
                 int p1 = neighborList->getSortedAtoms()[4*blockIndex+i];
@@ -137,6 +138,11 @@ void CpuCustomManyParticleForce::calculateIxn(AlignedArray<float>& posq, RealOpe
                 }
             }
         }
+        if (useTypeFilters && (int) neighborTypeStart.size() != numParticles) {
+            neighborTypeStart.resize(numParticles);
+            for (int i = 0; i < numParticles; i++)
+                neighborTypeStart[i].resize(numTypes+1);
+        }
     }
     
     // Signal the threads to start running and wait for them to finish.
@@ -170,8 +176,13 @@ void CpuCustomManyParticleForce::threadComputeForce(ThreadPool& threads, int thr
             int i = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 1);
             if (i >= numParticles)
                 break;
+            int typePrefix = (useTypeFilters ? particleTypes[i] : 0);
+            if (useTypeFilters && !allowedTypePrefix[1][typePrefix])
+                continue;
+            prepareNeighbors(i, data, boxSize, invBoxSize);
+            const int* typeStart = (useTypeFilters ? &neighborTypeStart[i][0] : NULL);
             particleIndices[0] = i;
-            loopOverInteractions(particleNeighbors[i], particleIndices, 1, 0, particleParameters, forces, data, boxSize, invBoxSize);
+            loopOverInteractions(particleNeighbors[i], typeStart, particleIndices, 1, 0, typePrefix, particleParameters, forces, data, boxSize, invBoxSize);
         }
     }
     else {
@@ -184,9 +195,12 @@ void CpuCustomManyParticleForce::threadComputeForce(ThreadPool& threads, int thr
             int i = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 1);
             if (i >= numParticles)
                 break;
+            int typePrefix = (useTypeFilters ? particleTypes[i] : 0);
+            if (useTypeFilters && !allowedTypePrefix[1][typePrefix])
+                continue;
             particleIndices[0] = i;
             int startIndex = (centralParticleMode ? 0 : i+1);
-            loopOverInteractions(particles, particleIndices, 1, startIndex, particleParameters, forces, data, boxSize, invBoxSize);
+            loopOverInteractions(particles, NULL, particleIndices, 1, startIndex, typePrefix, particleParameters, forces, data, boxSize, invBoxSize);
         }
     }
 }
@@ -219,37 +233,157 @@ void CpuCustomManyParticleForce::setPeriodic(RealVec* periodicBoxVectors) {
                  periodicBoxVectors[2][0] != 0.0 || periodicBoxVectors[2][1] != 0.0);
 }
 
-void CpuCustomManyParticleForce::loopOverInteractions(vector<int>& availableParticles, vector<int>& particleSet, int loopIndex, int startIndex,
+void CpuCustomManyParticleForce::buildAllowedTypePrefixes() {
+    // A set of types for the first k particles is allowed if it can be extended to a full set
+    // that passes the filters.
+
+    allowedTypePrefix.resize(numParticlesPerSet+1);
+    allowedTypePrefix[numParticlesPerSet].resize(orderIndex.size());
+    for (int i = 0; i < (int) orderIndex.size(); i++)
+        allowedTypePrefix[numParticlesPerSet][i] = (orderIndex[i] != -1);
+    int stride = orderIndex.size();
+    for (int k = numParticlesPerSet-1; k >= 0; k--) {
+        stride /= numTypes;
+        allowedTypePrefix[k].resize(stride, false);
+        for (int i = 0; i < stride; i++)
+            for (int type = 0; type < numTypes; type++)
+                if (allowedTypePrefix[k+1][i+type*stride])
+                    allowedTypePrefix[k][i] = true;
+    }
+}
+
+void CpuCustomManyParticleForce::prepareNeighbors(int particle, ThreadData& data, const fvec4& boxSize, const fvec4& invBoxSize) {
+    // Remove neighbors that are beyond the cutoff.  This is done four at a time.
+
+    vector<int>& neighbors = particleNeighbors[particle];
+    int numNeighbors = neighbors.size();
+    float cutoff2 = (float) (cutoffDistance*cutoffDistance);
+    fvec4 pos(posq+4*particle);
+    int numKept = 0;
+    int i = 0;
+    for (; i+3 < numNeighbors; i += 4) {
+        fvec4 x(posq+4*neighbors[i]), y(posq+4*neighbors[i+1]), z(posq+4*neighbors[i+2]), q(posq+4*neighbors[i+3]);
+        transpose(x, y, z, q);
+        fvec4 dx = x-pos[0];
+        fvec4 dy = y-pos[1];
+        fvec4 dz = z-pos[2];
+        if (usePeriodic) {
+            if (triclinic) {
+                fvec4 scale3 = floor(dz*recipBoxSize[2]+0.5f);
+                dx -= scale3*(float) periodicBoxVectors[2][0];
+                dy -= scale3*(float) periodicBoxVectors[2][1];
+                dz -= scale3*(float) periodicBoxVectors[2][2];
+                fvec4 scale2 = floor(dy*recipBoxSize[1]+0.5f);
+                dx -= scale2*(float) periodicBoxVectors[1][0];
+                dy -= scale2*(float) periodicBoxVectors[1][1];
+                fvec4 scale1 = floor(dx*recipBoxSize[0]+0.5f);
+                dx -= scale1*(float) periodicBoxVectors[0][0];
+            }
+            else {
+                dx -= round(dx*invBoxSize[0])*boxSize[0];
+                dy -= round(dy*invBoxSize[1])*boxSize[1];
+                dz -= round(dz*invBoxSize[2])*boxSize[2];
+            }
+        }
+        float r2[4];
+        (dx*dx + dy*dy + dz*dz).store(r2);
+        for (int j = 0; j < 4; j++)
+            if (r2[j] < cutoff2)
+                neighbors[numKept++] = neighbors[i+j];
+    }
+    for (; i < numNeighbors; i++) {
+        fvec4 deltaR;
+        float r2;
+        computeDelta(pos, fvec4(posq+4*neighbors[i]), deltaR, r2, boxSize, invBoxSize);
+        if (r2 < cutoff2)
+            neighbors[numKept++] = neighbors[i];
+    }
+    neighbors.resize(numKept);
+    if (!useTypeFilters)
+        return;
+
+    // Sort the neighbors by type, so the loops can skip over types that cannot appear in an interaction.
+
+    vector<int>& typeStart = neighborTypeStart[particle];
+    for (int type = 0; type <= numTypes; type++)
+        typeStart[type] = 0;
+    for (int j = 0; j < numKept; j++)
+        typeStart[particleTypes[neighbors[j]]+1]++;
+    for (int type = 0; type < numTypes; type++)
+        typeStart[type+1] += typeStart[type];
+    vector<int>& sorted = data.sortedNeighbors;
+    sorted.resize(numKept);
+    for (int j = 0; j < numKept; j++) {
+        int type = particleTypes[neighbors[j]];
+        sorted[typeStart[type]++] = neighbors[j];
+    }
+    for (int type = numTypes; type > 0; type--)
+        typeStart[type] = typeStart[type-1];
+    typeStart[0] = 0;
+    neighbors.swap(sorted);
+}
+
+void CpuCustomManyParticleForce::loopOverInteractions(vector<int>& availableParticles, const int* typeStart, vector<int>& particleSet, int loopIndex, int startIndex, int typePrefix,
                                                           RealOpenMM** particleParameters, float* forces, ThreadData& data, const fvec4& boxSize, const fvec4& invBoxSize) {
     int numParticles = availableParticles.size();
     double cutoff2 = cutoffDistance*cutoffDistance;
     int checkRange = (centralParticleMode ? 1 : loopIndex);
-    for (int i = startIndex; i < numParticles; i++) {
-        int particle = availableParticles[i];
-        
-        // Check whether this particle can actually participate in interactions with the others found so far.
-        
-        bool include = true;
-        if (useCutoff) {
-            fvec4 deltaR;
-            fvec4 pos1(posq+4*particle);
-            float r2;
-            for (int j = 0; j < checkRange && include; j++) {
-                fvec4 pos2(posq+4*particleSet[j]);
-                computeDelta(pos1, pos2, deltaR, r2, boxSize, invBoxSize);
-                include &= (r2 < cutoff2);
-            }
-        }
-        for (int j = 0; j < loopIndex && include; j++)
-            include &= (exclusions[particle].find(particleSet[j]) == exclusions[particle].end());
-        if (include) {
-            if (loopIndex > 0 && availableParticles[i] == particleSet[0])
+
+    // When using a cutoff, availableParticles only contains neighbors of the first particle, so
+    // they do not need to be checked against it.
+
+    int firstCheck = (useCutoff ? 1 : 0);
+    int typeStride = 1;
+    for (int j = 0; j < loopIndex; j++)
+        typeStride *= numTypes;
+
+    // If the particles are sorted by type, loop over each type separately and skip the ones that
+    // cannot appear at this position.
+
+    int numRanges = (typeStart == NULL ? 1 : numTypes);
+    for (int range = 0; range < numRanges; range++) {
+        int rangeStart = startIndex;
+        int rangeEnd = numParticles;
+        if (typeStart != NULL) {
+            if (!allowedTypePrefix[loopIndex+1][typePrefix+range*typeStride])
                 continue;
-            particleSet[loopIndex] = availableParticles[i];
-            if (loopIndex == numParticlesPerSet-1)
-                calculateOneIxn(particleSet, particleParameters, forces, data, boxSize, invBoxSize);
-            else
-                loopOverInteractions(availableParticles, particleSet, loopIndex+1, i+1, particleParameters, forces, data, boxSize, invBoxSize);
+            rangeStart = max(startIndex, typeStart[range]);
+            rangeEnd = typeStart[range+1];
+        }
+        for (int i = rangeStart; i < rangeEnd; i++) {
+            int particle = availableParticles[i];
+            int prefix = typePrefix;
+            if (useTypeFilters) {
+                prefix += particleTypes[particle]*typeStride;
+                if (!allowedTypePrefix[loopIndex+1][prefix])
+                    continue;
+            }
+
+            // Check whether this particle can actually participate in interactions with the others found so far.
+
+            bool include = true;
+            if (useCutoff) {
+                fvec4 deltaR;
+                fvec4 pos1(posq+4*particle);
+                float r2;
+                for (int j = firstCheck; j < checkRange && include; j++) {
+                    fvec4 pos2(posq+4*particleSet[j]);
+                    computeDelta(pos1, pos2, deltaR, r2, boxSize, invBoxSize);
+                    include &= (r2 < cutoff2);
+                }
+            }
+            if (anyExclusions)
+                for (int j = firstCheck; j < loopIndex && include; j++)
+                    include &= !exclusions.isExcluded(particle, particleSet[j]);
+            if (include) {
+                if (loopIndex > 0 && particle == particleSet[0])
+                    continue;
+                particleSet[loopIndex] = particle;
+                if (loopIndex == numParticlesPerSet-1)
+                    calculateOneIxn(particleSet, particleParameters, forces, data, boxSize, invBoxSize);
+                else
+                    loopOverInteractions(availableParticles, typeStart, particleSet, loopIndex+1, i+1, prefix, particleParameters, forces, data, boxSize, invBoxSize);
+            }
         }
     }
 }
@@ -43,9 +43,7 @@ public:
     CpuCustomNonbondedForce& owner;
 };
 
-CpuCustomNonbondedForce::ThreadData::ThreadData(const Lepton::CompiledExpression& energyExpression, const Lepton::CompiledExpression& forceExpression,
-            const vector<string>& parameterNames, const std::vector<Lepton::CompiledExpression> energyParamDerivExpressions) :
-            energyExpression(energyExpression), forceExpression(forceExpression), energyParamDerivExpressions(energyParamDerivExpressions) {
+CpuCustomNonbondedForce::ThreadData::ThreadData(const vector<Lepton::ParsedExpression>& pairExpressions, const vector<string>& parameterNames) {
     map<string, double*> variableLocations;
     variableLocations["r"] = &r;
     particleParam.resize(2*parameterNames.size());
@@ -56,23 +54,16 @@ CpuCustomNonbondedForce::ThreadData::ThreadData(const Lepton::CompiledExpression
             variableLocations[name.str()] = &particleParam[i*2+j];
         }
     }
-    energyParamDerivs.resize(energyParamDerivExpressions.size());
-    this->energyExpression.setVariableLocations(variableLocations);
-    this->forceExpression.setVariableLocations(variableLocations);
-    expressionSet.registerExpression(this->energyExpression);
-    expressionSet.registerExpression(this->forceExpression);
-    for (int i = 0; i < this->energyParamDerivExpressions.size(); i++) {
-        this->energyParamDerivExpressions[i].setVariableLocations(variableLocations);
-        expressionSet.registerExpression(this->energyParamDerivExpressions[i]);
-    }
+    energyParamDerivs.resize(pairExpressions.size()-2);
+    energyExpression = &expressionSet.registerExpressions(pairExpressions, variableLocations);
+    forceExpression = &expressionSet.registerExpressions(vector<Lepton::ParsedExpression>(pairExpressions.begin()+1, pairExpressions.end()), variableLocations);
 }
 
-CpuCustomNonbondedForce::CpuCustomNonbondedForce(const Lepton::CompiledExpression& energyExpression,
-            const Lepton::CompiledExpression& forceExpression, const vector<string>& parameterNames, const vector<set<int> >& exclusions,
-            const std::vector<Lepton::CompiledExpression> energyParamDerivExpressions, ThreadPool& threads) :
+CpuCustomNonbondedForce::CpuCustomNonbondedForce(const vector<Lepton::ParsedExpression>& pairExpressions, const vector<string>& parameterNames,
+            const CpuExclusionList& exclusions, ThreadPool& threads) :
             cutoff(false), useSwitch(false), periodic(false), useInteractionGroups(false), paramNames(parameterNames), exclusions(exclusions), threads(threads) {
     for (int i = 0; i < threads.getNumThreads(); i++)
-        threadData.push_back(new ThreadData(energyExpression, forceExpression, parameterNames, energyParamDerivExpressions));
+        threadData.push_back(new ThreadData(pairExpressions, parameterNames));
 }
 
 CpuCustomNonbondedForce::~CpuCustomNonbondedForce() {
@@ -93,7 +84,7 @@ void CpuCustomNonbondedForce::setInteractionGroups(const vector<pair<set<int>, s
         const set<int>& set2 = groups[group].second;
         for (set<int>::const_iterator atom1 = set1.begin(); atom1 != set1.end(); ++atom1) {
             for (set<int>::const_iterator atom2 = set2.begin(); atom2 != set2.end(); ++atom2) {
-                if (*atom1 == *atom2 || exclusions[*atom1].find(*atom2) != exclusions[*atom1].end())
+                if (*atom1 == *atom2 || exclusions.isExcluded(*atom1, *atom2))
                     continue; // This is an excluded interaction.
                 if (*atom1 > *atom2 && set1.find(*atom2) != set1.end() && set2.find(*atom1) != set2.end())
                     continue; // Both atoms are in both sets, so skip duplicate interactions.
@@ -210,7 +201,7 @@ void CpuCustomNonbondedForce::threadComputeForce(ThreadPool& threads, int thread
             const int blockSize = neighborList->getBlockSize();
             const int* blockAtom = &neighborList->getSortedAtoms()[blockSize*blockIndex];
             const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
-            const vector<char>& exclusions = neighborList->getBlockExclusions(blockIndex);
+            const vector<short>& exclusions = neighborList->getBlockExclusions(blockIndex);
             for (int i = 0; i < (int) neighbors.size(); i++) {
                 int first = neighbors[i];
                 for (int j = 0; j < (int) paramNames.size(); j++)
@@ -234,7 +225,7 @@ void CpuCustomNonbondedForce::threadComputeForce(ThreadPool& threads, int thread
             if (ii >= numberOfAtoms)
                 break;
             for (int jj = ii+1; jj < numberOfAtoms; jj++) {
-                if (exclusions[jj].find(ii) == exclusions[jj].end()) {
+                if (!exclusions.isExcluded(jj, ii)) {
                     for (int j = 0; j < (int) paramNames.size(); j++) {
                         data.particleParam[j*2] = atomParameters[ii][j];
                         data.particleParam[j*2+1] = atomParameters[jj][j];
@@ -262,8 +253,15 @@ void CpuCustomNonbondedForce::calculateOneIxn(int ii, int jj, ThreadData& data,
 
     // accumulate forces
 
-    double dEdR = (includeForce ? data.forceExpression.evaluate()/r : 0.0);
-    double energy = (includeEnergy ? data.energyExpression.evaluate() : 0.0);
+    // The force and parameter derivatives are all computed by a single call.  The energy is only
+    // included when it was requested or the switching function needs it.
+
+    bool needEnergy = (includeEnergy || useSwitch);
+    const Lepton::CompiledExpression& expression = (needEnergy ? *data.energyExpression : *data.forceExpression);
+    int firstDeriv = (needEnergy ? 1 : 0);
+    expression.evaluate();
+    double dEdR = (includeForce ? expression.getOutput(firstDeriv)/r : 0.0);
+    double energy = (needEnergy ? expression.getOutput(0) : 0.0);
     double switchValue = 1.0;
     if (useSwitch) {
         if (r > switchingDistance) {
@@ -280,12 +278,13 @@ void CpuCustomNonbondedForce::calculateOneIxn(int ii, int jj, ThreadData& data,
 
     // accumulate energies
 
-    totalEnergy += energy;
+    if (includeEnergy)
+        totalEnergy += energy;
     
     // Accumulate energy derivatives.
 
-    for (int i = 0; i < data.energyParamDerivExpressions.size(); i++)
-        data.energyParamDerivs[i] += switchValue*data.energyParamDerivExpressions[i].evaluate();
+    for (int i = 0; i < data.energyParamDerivs.size(); i++)
+        data.energyParamDerivs[i] += switchValue*expression.getOutput(firstDeriv+i+1);
 }
 
 void CpuCustomNonbondedForce::getDeltaR(const fvec4& posI, const fvec4& posJ, fvec4& deltaR, float& r2, const fvec4& boxSize, const fvec4& invBoxSize) const {
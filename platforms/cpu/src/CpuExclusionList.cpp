@@ -0,0 +1,161 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2016 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "CpuExclusionList.h"
+#include <algorithm>
+
+using namespace std;
+
+namespace OpenMM {
+
+CpuExclusionList::CpuExclusionList() : storage(new Storage()) {
+    storage->numAtoms = 0;
+    storage->offset.resize(1, 0);
+    finalize();
+}
+
+CpuExclusionList::CpuExclusionList(int numAtoms) : storage(new Storage()) {
+    storage->numAtoms = numAtoms;
+    storage->offset.resize(numAtoms+1, 0);
+    finalize();
+}
+
+CpuExclusionList::CpuExclusionList(int numAtoms, const vector<pair<int, int> >& excludedPairs) : storage(new Storage()) {
+    storage->numAtoms = numAtoms;
+    vector<int>& offset = storage->offset;
+    vector<int>& indices = storage->indices;
+    offset.resize(numAtoms+1, 0);
+
+    // Count the entries for each atom and place them with a counting sort.
+
+    int numPairs = excludedPairs.size();
+    for (int i = 0; i < numPairs; i++) {
+        offset[excludedPairs[i].first+1]++;
+        if (excludedPairs[i].second != excludedPairs[i].first)
+            offset[excludedPairs[i].second+1]++;
+    }
+    for (int i = 0; i < numAtoms; i++)
+        offset[i+1] += offset[i];
+    indices.resize(offset[numAtoms]);
+    vector<int> next(offset.begin(), offset.end()-1);
+    for (int i = 0; i < numPairs; i++) {
+        int atom1 = excludedPairs[i].first;
+        int atom2 = excludedPairs[i].second;
+        indices[next[atom1]++] = atom2;
+        if (atom2 != atom1)
+            indices[next[atom2]++] = atom1;
+    }
+
+    // Sort the entries for each atom and remove duplicates.
+
+    int numKept = 0;
+    for (int i = 0; i < numAtoms; i++) {
+        int start = offset[i];
+        int end = offset[i+1];
+        sort(indices.begin()+start, indices.begin()+end);
+        offset[i] = numKept;
+        for (int j = start; j < end; j++)
+            if (j == start || indices[j] != indices[j-1])
+                indices[numKept++] = indices[j];
+    }
+    offset[numAtoms] = numKept;
+    indices.resize(numKept);
+    finalize();
+}
+
+CpuExclusionList::CpuExclusionList(const vector<set<int> >& exclusions) : storage(new Storage()) {
+    int numAtoms = exclusions.size();
+    vector<int>& offset = storage->offset;
+    vector<int>& indices = storage->indices;
+    storage->numAtoms = numAtoms;
+    offset.resize(numAtoms+1, 0);
+    for (int i = 0; i < numAtoms; i++)
+        offset[i+1] = offset[i]+exclusions[i].size();
+    indices.reserve(offset[numAtoms]+1);
+    for (int i = 0; i < numAtoms; i++)
+        indices.insert(indices.end(), exclusions[i].begin(), exclusions[i].end());
+    finalize();
+}
+
+CpuExclusionList::CpuExclusionList(const CpuExclusionList& other) : storage(other.storage), offset(other.offset), indices(other.indices) {
+    storage->refCount++;
+}
+
+CpuExclusionList::~CpuExclusionList() {
+    release();
+}
+
+CpuExclusionList& CpuExclusionList::operator=(const CpuExclusionList& other) {
+    if (storage != other.storage) {
+        other.storage->refCount++;
+        release();
+        storage = other.storage;
+        offset = other.offset;
+        indices = other.indices;
+    }
+    return *this;
+}
+
+void CpuExclusionList::release() {
+    if (--storage->refCount == 0)
+        delete storage;
+}
+
+bool CpuExclusionList::isExcluded(int atom1, int atom2) const {
+    return binary_search(begin(atom1), end(atom1), atom2);
+}
+
+bool CpuExclusionList::operator==(const CpuExclusionList& other) const {
+    if (storage == other.storage)
+        return true;
+    return (storage->hash == other.storage->hash && storage->numAtoms == other.storage->numAtoms &&
+            storage->offset == other.storage->offset && storage->indices == other.storage->indices);
+}
+
+void CpuExclusionList::finalize() {
+    // Add a padding element so begin() and end() are valid even when there are no exclusions.
+
+    storage->indices.push_back(-1);
+    storage->refCount = 1;
+    offset = &storage->offset[0];
+    indices = &storage->indices[0];
+
+    // Compute a hash of the contents with the FNV-1a hash function.
+
+    unsigned int hash = 2166136261u;
+    for (int i = 0; i < (int) storage->offset.size(); i++)
+        hash = (hash^(unsigned int) storage->offset[i])*16777619u;
+    for (int i = 0; i < (int) storage->indices.size(); i++)
+        hash = (hash^(unsigned int) storage->indices[i])*16777619u;
+    storage->hash = hash;
+}
+
+} // namespace OpenMM
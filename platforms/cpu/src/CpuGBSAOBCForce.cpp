@@ -1,5 +1,5 @@
 
-/* Portions copyright (c) 2006-2013 Stanford University and Simbios.
+/* Portions copyright (c) 2006-2016 Stanford University and Simbios.
  * Contributors: Pande Group
  *
  * Permission is hereby granted, free of charge, to any person obtaining
@@ -47,7 +47,7 @@ public:
     CpuGBSAOBCForce& owner;
 };
 
-CpuGBSAOBCForce::CpuGBSAOBCForce() : cutoff(false), periodic(false) {
+CpuGBSAOBCForce::CpuGBSAOBCForce() : cutoff(false), periodic(false), neighborList(NULL), exclusions(NULL) {
     logDX = (TABLE_MAX-TABLE_MIN)/NUM_TABLE_POINTS;
     logDXInv = 1.0f/logDX;
     logTable.resize(NUM_TABLE_POINTS+4);
@@ -57,9 +57,14 @@ CpuGBSAOBCForce::CpuGBSAOBCForce() : cutoff(false), periodic(false) {
     }
 }
 
-void CpuGBSAOBCForce::setUseCutoff(float distance) {
+CpuGBSAOBCForce::~CpuGBSAOBCForce() {
+}
+
+void CpuGBSAOBCForce::setUseCutoff(float distance, const CpuNeighborList& neighbors, const CpuExclusionList& exclusions) {
     cutoff = true;
     cutoffDistance = distance;
+    neighborList = &neighbors;
+    this->exclusions = &exclusions;
 }
 
 void CpuGBSAOBCForce::setPeriodic(float* periodicBoxSize) {
@@ -89,6 +94,7 @@ void CpuGBSAOBCForce::setParticleParameters(const std::vector<std::pair<float, f
     particleParams = params;
     bornRadii.resize(params.size()+3);
     obcChain.resize(params.size()+3);
+    chainRuleFactor.resize(params.size()+3);
 }
 
 void CpuGBSAOBCForce::computeForce(const AlignedArray<float>& posq, vector<AlignedArray<float> >& threadForce, double* totalEnergy, ThreadPool& threads) {
@@ -97,11 +103,20 @@ void CpuGBSAOBCForce::computeForce(const AlignedArray<float>& posq, vector<Align
     this->posq = &posq[0];
     this->threadForce = &threadForce;
     includeEnergy = (totalEnergy != NULL);
+    if (soluteDielectric != 0.0f && solventDielectric != 0.0f)
+        preFactor = ONE_4PI_EPS0*((1.0f/solventDielectric) - (1.0f/soluteDielectric));
+    else
+        preFactor = 0.0f;
     int numThreads = threads.getNumThreads();
     threadEnergy.resize(numThreads);
     threadBornForces.resize(numThreads);
     for (int i = 0; i < numThreads; i++)
         threadBornForces[i].resize(particleParams.size()+3);
+    if (cutoff) {
+        threadBornSums.resize(numThreads);
+        for (int i = 0; i < numThreads; i++)
+            threadBornSums[i].resize(particleParams.size()+3);
+    }
     gmx_atomic_t counter;
     this->atomicCounter = &counter;
     
@@ -117,6 +132,11 @@ void CpuGBSAOBCForce::computeForce(const AlignedArray<float>& posq, vector<Align
     gmx_atomic_set(&counter, 0);
     threads.resumeThreads();
     threads.waitForThreads(); // First loop
+    if (cutoff) {
+        gmx_atomic_set(&counter, 0);
+        threads.resumeThreads();
+        threads.waitForThreads(); // Sum Born forces
+    }
     gmx_atomic_set(&counter, 0);
     threads.resumeThreads();
     threads.waitForThreads(); // Second loop
@@ -132,6 +152,10 @@ void CpuGBSAOBCForce::computeForce(const AlignedArray<float>& posq, vector<Align
 }
 
 void CpuGBSAOBCForce::threadComputeForce(ThreadPool& threads, int threadIndex) {
+    if (cutoff) {
+        threadComputeNeighborListForce(threads, threadIndex);
+        return;
+    }
     int numParticles = particleParams.size();
     int numThreads = threads.getNumThreads();
     const float dielectricOffset = 0.009;
@@ -239,11 +263,6 @@ void CpuGBSAOBCForce::threadComputeForce(ThreadPool& threads, int threadIndex) {
     // First loop of Born energy computation.
 
     float* forces = &(*threadForce)[threadIndex][0];
-    float preFactor;
-    if (soluteDielectric != 0.0f && solventDielectric != 0.0f)
-        preFactor = ONE_4PI_EPS0*((1.0f/solventDielectric) - (1.0f/soluteDielectric));
-    else
-        preFactor = 0.0f;
     while (true) {
         int blockStart = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 4);
         if (blockStart >= numParticles)
@@ -397,6 +416,307 @@ void CpuGBSAOBCForce::threadComputeForce(ThreadPool& threads, int threadIndex) {
     threadEnergy[threadIndex] = energy;
 }
 
+void CpuGBSAOBCForce::threadComputeNeighborListForce(ThreadPool& threads, int threadIndex) {
+    int numParticles = particleParams.size();
+    int numThreads = threads.getNumThreads();
+    int numBlocks = neighborList->getNumBlocks();
+    gmx_atomic_t* counter = reinterpret_cast<gmx_atomic_t*>(atomicCounter);
+    const float dielectricOffset = 0.009;
+    const float alphaObc = 1.0f;
+    const float betaObc = 0.8f;
+    const float gammaObc = 4.85f;
+    fvec4 boxSize(periodicBoxSize[0], periodicBoxSize[1], periodicBoxSize[2], 0);
+    fvec4 invBoxSize((1/periodicBoxSize[0]), (1/periodicBoxSize[1]), (1/periodicBoxSize[2]), 0);
+    vector<int> partners;
+    vector<short> partnerFlags;
+
+    // Accumulate the sums for the Born radii.  Each pair appears only once in the neighbor list,
+    // so it contributes to the sums for both atoms.
+
+    float* sums = &threadBornSums[threadIndex][0];
+    for (int i = 0; i < numParticles; i++)
+        sums[i] = 0.0f;
+    while (true) {
+        int blockIndex = gmx_atomic_fetch_add(counter, 1);
+        if (blockIndex >= numBlocks)
+            break;
+        calculateBlockBornSums(blockIndex, sums, boxSize, invBoxSize);
+    }
+    for (int i = threadIndex; i < numParticles; i += numThreads) {
+        if (findExcludedPartners(i, partners, partnerFlags)) {
+            int group[4] = {i, i, i, i};
+            calculateGroupBornSums(group, partners, partnerFlags, 0, sums, boxSize, invBoxSize);
+        }
+    }
+    threads.syncThreads();
+
+    // Compute the Born radii, the ACE surface area term, and the interaction of each atom with itself.
+
+    const float probeRadius = 0.14f;
+    double energy = 0.0;
+    float* bornForces = &threadBornForces[threadIndex][0];
+    for (int i = 0; i < numParticles; i++)
+        bornForces[i] = 0.0f;
+    while (true) {
+        int atomI = gmx_atomic_fetch_add(counter, 1);
+        if (atomI >= numParticles)
+            break;
+        float sum = 0.0f;
+        for (int i = 0; i < numThreads; i++)
+            sum += threadBornSums[i][atomI];
+        float offsetRadiusI = particleParams[atomI].first;
+        sum *= 0.5f*offsetRadiusI;
+        float sum2 = sum*sum;
+        float sum3 = sum*sum2;
+        float tanhSum = tanh(alphaObc*sum - betaObc*sum2 + gammaObc*sum3);
+        float radiusI = offsetRadiusI + dielectricOffset;
+        bornRadii[atomI] = 1.0f/(1.0f/offsetRadiusI - tanhSum/radiusI);
+        obcChain[atomI] = offsetRadiusI*(alphaObc - 2.0f*betaObc*sum + 3.0f*gammaObc*sum2);
+        obcChain[atomI] = (1.0f - tanhSum*tanhSum)*obcChain[atomI]/radiusI;
+        if (bornRadii[atomI] > 0) {
+            float r = radiusI + probeRadius;
+            float ratio6 = powf(radiusI/bornRadii[atomI], 6.0f);
+            float saTerm = surfaceAreaFactor*r*r*ratio6;
+            energy += saTerm;
+            bornForces[atomI] = -6.0f*saTerm/bornRadii[atomI]; 
+        }
+        float chargeI = posq[4*atomI+3];
+        float selfGpol = preFactor*chargeI*chargeI/bornRadii[atomI];
+        energy += 0.5f*selfGpol;
+        bornForces[atomI] -= 0.5f*selfGpol/bornRadii[atomI];
+    }
+    threads.syncThreads();
+
+    // First loop of Born energy computation.
+
+    float* forces = &(*threadForce)[threadIndex][0];
+    while (true) {
+        int blockIndex = gmx_atomic_fetch_add(counter, 1);
+        if (blockIndex >= numBlocks)
+            break;
+        calculateBlockPolarization(blockIndex, forces, bornForces, energy, boxSize, invBoxSize);
+    }
+    for (int i = threadIndex; i < numParticles; i += numThreads) {
+        if (findExcludedPartners(i, partners, partnerFlags)) {
+            int group[4] = {i, i, i, i};
+            calculateGroupPolarization(group, partners, partnerFlags, 0, forces, bornForces, energy, boxSize, invBoxSize);
+        }
+    }
+    threads.syncThreads();
+
+    // Sum the Born forces from all threads.
+
+    while (true) {
+        int atomI = gmx_atomic_fetch_add(counter, 1);
+        if (atomI >= numParticles)
+            break;
+        float bornForce = 0.0f;
+        for (int i = 0; i < numThreads; i++)
+            bornForce += threadBornForces[i][atomI];
+        chainRuleFactor[atomI] = bornForce*bornRadii[atomI]*bornRadii[atomI]*obcChain[atomI];
+    }
+    threads.syncThreads();
+
+    // Second loop of Born energy computation.
+
+    while (true) {
+        int blockIndex = gmx_atomic_fetch_add(counter, 1);
+        if (blockIndex >= numBlocks)
+            break;
+        calculateBlockChainRuleForces(blockIndex, forces, boxSize, invBoxSize);
+    }
+    for (int i = threadIndex; i < numParticles; i += numThreads) {
+        if (findExcludedPartners(i, partners, partnerFlags)) {
+            int group[4] = {i, i, i, i};
+            calculateGroupChainRuleForces(group, partners, partnerFlags, 0, forces, boxSize, invBoxSize);
+        }
+    }
+    threadEnergy[threadIndex] = energy;
+}
+
+bool CpuGBSAOBCForce::findExcludedPartners(int atom, vector<int>& partners, vector<short>& flags) const {
+    partners.clear();
+    flags.clear();
+    for (const int* iter = upper_bound(exclusions->begin(atom), exclusions->end(atom), atom); iter != exclusions->end(atom); ++iter) {
+        partners.push_back(*iter);
+        flags.push_back(0xE);
+    }
+    return (partners.size() > 0);
+}
+
+void CpuGBSAOBCForce::calculateBlockBornSums(int blockIndex, float* sums, const fvec4& boxSize, const fvec4& invBoxSize) {
+    const int blockSize = neighborList->getBlockSize();
+    const int* blockAtom = &neighborList->getSortedAtoms()[blockSize*blockIndex];
+    const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
+    const vector<short>& blockExclusions = neighborList->getBlockExclusions(blockIndex);
+    for (int i = 0; i < blockSize; i += 4)
+        calculateGroupBornSums(&blockAtom[i], neighbors, blockExclusions, i, sums, boxSize, invBoxSize);
+}
+
+void CpuGBSAOBCForce::calculateBlockPolarization(int blockIndex, float* forces, float* bornForces, double& energy, const fvec4& boxSize, const fvec4& invBoxSize) {
+    const int blockSize = neighborList->getBlockSize();
+    const int* blockAtom = &neighborList->getSortedAtoms()[blockSize*blockIndex];
+    const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
+    const vector<short>& blockExclusions = neighborList->getBlockExclusions(blockIndex);
+    for (int i = 0; i < blockSize; i += 4)
+        calculateGroupPolarization(&blockAtom[i], neighbors, blockExclusions, i, forces, bornForces, energy, boxSize, invBoxSize);
+}
+
+void CpuGBSAOBCForce::calculateBlockChainRuleForces(int blockIndex, float* forces, const fvec4& boxSize, const fvec4& invBoxSize) {
+    const int blockSize = neighborList->getBlockSize();
+    const int* blockAtom = &neighborList->getSortedAtoms()[blockSize*blockIndex];
+    const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
+    const vector<short>& blockExclusions = neighborList->getBlockExclusions(blockIndex);
+    for (int i = 0; i < blockSize; i += 4)
+        calculateGroupChainRuleForces(&blockAtom[i], neighbors, blockExclusions, i, forces, boxSize, invBoxSize);
+}
+
+void CpuGBSAOBCForce::calculateGroupBornSums(const int* atoms, const vector<int>& neighbors, const vector<short>& exclusions, int shift, float* sums, const fvec4& boxSize, const fvec4& invBoxSize) {
+    fvec4 x(posq+4*atoms[0]), y(posq+4*atoms[1]), z(posq+4*atoms[2]), charge(posq+4*atoms[3]);
+    transpose(x, y, z, charge);
+    fvec4 offsetRadiusI(particleParams[atoms[0]].first, particleParams[atoms[1]].first, particleParams[atoms[2]].first, particleParams[atoms[3]].first);
+    fvec4 scaledRadiusI(particleParams[atoms[0]].second, particleParams[atoms[1]].second, particleParams[atoms[2]].second, particleParams[atoms[3]].second);
+    fvec4 sumI(0.0f);
+    fvec4 one(1.0f);
+    for (int i = 0; i < (int) neighbors.size(); i++) {
+        int excl = (exclusions[i]>>shift) & 0xF;
+        if (excl == 0xF)
+            continue;
+        int atomJ = neighbors[i];
+        fvec4 posJ(posq+4*atomJ);
+        fvec4 dx, dy, dz, r2;
+        getDeltaR(posJ, x, y, z, dx, dy, dz, r2, periodic, boxSize, invBoxSize);
+        ivec4 include = ivec4(excl&1 ? 0 : -1, excl&2 ? 0 : -1, excl&4 ? 0 : -1, excl&8 ? 0 : -1) & (r2 < cutoffDistance*cutoffDistance);
+        if (!any(include))
+            continue;
+        fvec4 r = sqrt(r2);
+        fvec4 rInverse = 1.0f/r;
+        sumI += computeBornSumTerm(offsetRadiusI, particleParams[atomJ].second, r, rInverse, include);
+        sums[atomJ] += dot4(computeBornSumTerm(particleParams[atomJ].first, scaledRadiusI, r, rInverse, include), one);
+    }
+    for (int j = 0; j < 4; j++)
+        sums[atoms[j]] += sumI[j];
+}
+
+void CpuGBSAOBCForce::calculateGroupPolarization(const int* atoms, const vector<int>& neighbors, const vector<short>& exclusions, int shift, float* forces, float* bornForces, double& energy, const fvec4& boxSize, const fvec4& invBoxSize) {
+    fvec4 x(posq+4*atoms[0]), y(posq+4*atoms[1]), z(posq+4*atoms[2]), charge(posq+4*atoms[3]);
+    transpose(x, y, z, charge);
+    fvec4 partialChargeI = charge*preFactor;
+    fvec4 radii(bornRadii[atoms[0]], bornRadii[atoms[1]], bornRadii[atoms[2]], bornRadii[atoms[3]]);
+    fvec4 blockAtomForceX(0.0f), blockAtomForceY(0.0f), blockAtomForceZ(0.0f), blockAtomBornForce(0.0f);
+    fvec4 one(1.0f);
+    for (int i = 0; i < (int) neighbors.size(); i++) {
+        int excl = (exclusions[i]>>shift) & 0xF;
+        if (excl == 0xF)
+            continue;
+        int atomJ = neighbors[i];
+        fvec4 posJ(posq+4*atomJ);
+        fvec4 dx, dy, dz, r2;
+        getDeltaR(posJ, x, y, z, dx, dy, dz, r2, periodic, boxSize, invBoxSize);
+        ivec4 include = ivec4(excl&1 ? 0 : -1, excl&2 ? 0 : -1, excl&4 ? 0 : -1, excl&8 ? 0 : -1) & (r2 < cutoffDistance*cutoffDistance);
+        if (!any(include))
+            continue;
+        float radiusJ = bornRadii[atomJ];
+        fvec4 alpha2_ij = radii*radiusJ;
+        fvec4 D_ij = r2/(4.0f*alpha2_ij);
+        fvec4 expTerm = exp(-D_ij);
+        fvec4 denominator2 = r2 + alpha2_ij*expTerm;
+        fvec4 denominator = sqrt(denominator2);
+        fvec4 chargeProd = partialChargeI*posJ[3];
+        fvec4 Gpol = chargeProd/denominator;
+        fvec4 dGpol_dr = -Gpol*(1.0f - 0.25f*expTerm)/denominator2;
+        fvec4 dGpol_dalpha2_ij = -0.5f*Gpol*expTerm*(1.0f + D_ij)/denominator2;
+        dGpol_dr = blend(0.0f, dGpol_dr, include);
+        dGpol_dalpha2_ij = blend(0.0f, dGpol_dalpha2_ij, include);
+        fvec4 fx = dx*dGpol_dr;
+        fvec4 fy = dy*dGpol_dr;
+        fvec4 fz = dz*dGpol_dr;
+        blockAtomForceX -= fx;
+        blockAtomForceY -= fy;
+        blockAtomForceZ -= fz;
+        float* atomForce = forces+4*atomJ;
+        atomForce[0] += dot4(fx, one);
+        atomForce[1] += dot4(fy, one);
+        atomForce[2] += dot4(fz, one);
+        blockAtomBornForce += dGpol_dalpha2_ij*radiusJ;
+        bornForces[atomJ] += dot4(dGpol_dalpha2_ij, radii);
+        energy += dot4(blend(0.0f, Gpol-chargeProd/cutoffDistance, include), one);
+    }
+    fvec4 f[4] = {blockAtomForceX, blockAtomForceY, blockAtomForceZ, 0.0f};
+    transpose(f[0], f[1], f[2], f[3]);
+    for (int j = 0; j < 4; j++) {
+        (fvec4(forces+4*atoms[j])+f[j]).store(forces+4*atoms[j]);
+        bornForces[atoms[j]] += blockAtomBornForce[j];
+    }
+}
+
+void CpuGBSAOBCForce::calculateGroupChainRuleForces(const int* atoms, const vector<int>& neighbors, const vector<short>& exclusions, int shift, float* forces, const fvec4& boxSize, const fvec4& invBoxSize) {
+    fvec4 x(posq+4*atoms[0]), y(posq+4*atoms[1]), z(posq+4*atoms[2]), charge(posq+4*atoms[3]);
+    transpose(x, y, z, charge);
+    fvec4 offsetRadiusI(particleParams[atoms[0]].first, particleParams[atoms[1]].first, particleParams[atoms[2]].first, particleParams[atoms[3]].first);
+    fvec4 scaledRadiusI(particleParams[atoms[0]].second, particleParams[atoms[1]].second, particleParams[atoms[2]].second, particleParams[atoms[3]].second);
+    fvec4 chainI(chainRuleFactor[atoms[0]], chainRuleFactor[atoms[1]], chainRuleFactor[atoms[2]], chainRuleFactor[atoms[3]]);
+    fvec4 blockAtomForceX(0.0f), blockAtomForceY(0.0f), blockAtomForceZ(0.0f);
+    fvec4 one(1.0f);
+    for (int i = 0; i < (int) neighbors.size(); i++) {
+        int excl = (exclusions[i]>>shift) & 0xF;
+        if (excl == 0xF)
+            continue;
+        int atomJ = neighbors[i];
+        fvec4 posJ(posq+4*atomJ);
+        fvec4 dx, dy, dz, r2;
+        getDeltaR(posJ, x, y, z, dx, dy, dz, r2, periodic, boxSize, invBoxSize);
+        ivec4 include = ivec4(excl&1 ? 0 : -1, excl&2 ? 0 : -1, excl&4 ? 0 : -1, excl&8 ? 0 : -1) & (r2 < cutoffDistance*cutoffDistance);
+        if (!any(include))
+            continue;
+        fvec4 r = sqrt(r2);
+        fvec4 rInverse = 1.0f/r;
+        fvec4 r2Inverse = rInverse*rInverse;
+        fvec4 de = chainI*computeChainRuleTerm(offsetRadiusI, particleParams[atomJ].second, r, r2Inverse, include) +
+                   chainRuleFactor[atomJ]*computeChainRuleTerm(particleParams[atomJ].first, scaledRadiusI, r, r2Inverse, include);
+        de = blend(0.0f, de*rInverse, include);
+        fvec4 fx = dx*de;
+        fvec4 fy = dy*de;
+        fvec4 fz = dz*de;
+        blockAtomForceX += fx;
+        blockAtomForceY += fy;
+        blockAtomForceZ += fz;
+        float* atomForce = forces+4*atomJ;
+        atomForce[0] -= dot4(fx, one);
+        atomForce[1] -= dot4(fy, one);
+        atomForce[2] -= dot4(fz, one);
+    }
+    fvec4 f[4] = {blockAtomForceX, blockAtomForceY, blockAtomForceZ, 0.0f};
+    transpose(f[0], f[1], f[2], f[3]);
+    for (int j = 0; j < 4; j++)
+        (fvec4(forces+4*atoms[j])+f[j]).store(forces+4*atoms[j]);
+}
+
+fvec4 CpuGBSAOBCForce::computeBornSumTerm(const fvec4& offsetRadius, const fvec4& scaledRadius, const fvec4& r, const fvec4& rInverse, const ivec4& include) {
+    fvec4 rScaledRadius = r + scaledRadius;
+    ivec4 mask = include & (offsetRadius < rScaledRadius);
+    fvec4 l_ij = 1.0f/max(offsetRadius, abs(r-scaledRadius));
+    fvec4 u_ij = 1.0f/rScaledRadius;
+    fvec4 l_ij2 = l_ij*l_ij;
+    fvec4 u_ij2 = u_ij*u_ij;
+    fvec4 logRatio = fastLog(u_ij/l_ij);
+    fvec4 term = l_ij - u_ij + 0.25f*r*(u_ij2 - l_ij2) + (0.5f*rInverse*logRatio) + (0.25f*scaledRadius*scaledRadius*rInverse)*(l_ij2 - u_ij2);
+    term += blend(0.0f, 2.0f*(1.0f/offsetRadius-l_ij), offsetRadius < scaledRadius-r);
+    return blend(0.0f, term, mask);
+}
+
+fvec4 CpuGBSAOBCForce::computeChainRuleTerm(const fvec4& offsetRadius, const fvec4& scaledRadius, const fvec4& r, const fvec4& r2Inverse, const ivec4& include) {
+    fvec4 rScaledRadius = r + scaledRadius;
+    ivec4 mask = include & (offsetRadius < rScaledRadius);
+    fvec4 l_ij = 1.0f/max(offsetRadius, abs(r-scaledRadius));
+    fvec4 u_ij = 1.0f/rScaledRadius;
+    fvec4 l_ij2 = l_ij*l_ij;
+    fvec4 u_ij2 = u_ij*u_ij;
+    fvec4 logRatio = fastLog(u_ij/l_ij);
+    fvec4 t3 = 0.125f*(1.0f + scaledRadius*scaledRadius*r2Inverse)*(l_ij2 - u_ij2) + 0.25f*logRatio*r2Inverse;
+    return blend(0.0f, t3, mask);
+}
+
 void CpuGBSAOBCForce::getDeltaR(const fvec4& posI, const fvec4& x, const fvec4& y, const fvec4& z, fvec4& dx, fvec4& dy, fvec4& dz, fvec4& r2, bool periodic, const fvec4& boxSize, const fvec4& invBoxSize) const {
     dx = x-posI[0];
     dy = y-posI[1];
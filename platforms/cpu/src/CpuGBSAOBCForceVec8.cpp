@@ -0,0 +1,294 @@
+
+/* Portions copyright (c) 2006-2016 Stanford University and Simbios.
+ * Contributors: Pande Group
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "CpuGBSAOBCForceVec8.h"
+#include "SimTKOpenMMRealType.h"
+#include "openmm/OpenMMException.h"
+#include <cmath>
+
+using namespace std;
+using namespace OpenMM;
+
+#ifdef _MSC_VER
+    // Workaround for a compiler bug in Visual Studio 10. Hopefully we can remove this
+    // once we move to a later version.
+    #undef __AVX__
+#endif
+
+#ifndef __AVX__
+CpuGBSAOBCForce* createCpuGBSAOBCForceVec8() {
+    throw OpenMMException("Internal error: OpenMM was compiled without AVX support");
+}
+#else
+/**
+ * Factory method to create a CpuGBSAOBCForceVec8.
+ */
+CpuGBSAOBCForce* createCpuGBSAOBCForceVec8() {
+    return new CpuGBSAOBCForceVec8();
+}
+
+/**
+ * Combine two four component vectors into an eight component one.
+ */
+static inline fvec8 combine(const fvec4& lower, const fvec4& upper) {
+    return _mm256_insertf128_ps(_mm256_insertf128_ps(_mm256_setzero_ps(), lower, 0), upper, 1);
+}
+
+CpuGBSAOBCForceVec8::CpuGBSAOBCForceVec8() {
+}
+
+void CpuGBSAOBCForceVec8::calculateBlockBornSums(int blockIndex, float* sums, const fvec4& boxSize, const fvec4& invBoxSize) {
+    const int blockSize = neighborList->getBlockSize();
+    if (blockSize%8 != 0) {
+        CpuGBSAOBCForce::calculateBlockBornSums(blockIndex, sums, boxSize, invBoxSize);
+        return;
+    }
+    const int* blockAtom = &neighborList->getSortedAtoms()[blockSize*blockIndex];
+    const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
+    const vector<short>& exclusions = neighborList->getBlockExclusions(blockIndex);
+    for (int group = 0; group < blockSize; group += 8) {
+        const int* atoms = &blockAtom[group];
+        fvec8 x, y, z, charge;
+        loadGroup(atoms, x, y, z, charge);
+        fvec8 offsetRadiusI(particleParams[atoms[0]].first, particleParams[atoms[1]].first, particleParams[atoms[2]].first, particleParams[atoms[3]].first,
+                            particleParams[atoms[4]].first, particleParams[atoms[5]].first, particleParams[atoms[6]].first, particleParams[atoms[7]].first);
+        fvec8 scaledRadiusI(particleParams[atoms[0]].second, particleParams[atoms[1]].second, particleParams[atoms[2]].second, particleParams[atoms[3]].second,
+                            particleParams[atoms[4]].second, particleParams[atoms[5]].second, particleParams[atoms[6]].second, particleParams[atoms[7]].second);
+        fvec8 sumI(0.0f);
+        fvec8 one(1.0f);
+        for (int i = 0; i < (int) neighbors.size(); i++) {
+            short excl = (exclusions[i]>>group) & 0xFF;
+            if (excl == 0xFF)
+                continue;
+            int atomJ = neighbors[i];
+            fvec8 dx, dy, dz, r2;
+            getDeltaR(fvec4(posq+4*atomJ), x, y, z, dx, dy, dz, r2, periodic, boxSize, invBoxSize);
+            ivec8 include = getIncludeMask(excl, r2);
+            if (!any(include))
+                continue;
+            fvec8 r = sqrt(r2);
+            fvec8 rInverse = 1.0f/r;
+            sumI += computeBornSumTerm(offsetRadiusI, particleParams[atomJ].second, r, rInverse, include);
+            sums[atomJ] += dot8(computeBornSumTerm(particleParams[atomJ].first, scaledRadiusI, r, rInverse, include), one);
+        }
+        float s[8];
+        sumI.store(s);
+        for (int j = 0; j < 8; j++)
+            sums[atoms[j]] += s[j];
+    }
+}
+
+void CpuGBSAOBCForceVec8::calculateBlockPolarization(int blockIndex, float* forces, float* bornForces, double& energy, const fvec4& boxSize, const fvec4& invBoxSize) {
+    const int blockSize = neighborList->getBlockSize();
+    if (blockSize%8 != 0) {
+        CpuGBSAOBCForce::calculateBlockPolarization(blockIndex, forces, bornForces, energy, boxSize, invBoxSize);
+        return;
+    }
+    const int* blockAtom = &neighborList->getSortedAtoms()[blockSize*blockIndex];
+    const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
+    const vector<short>& exclusions = neighborList->getBlockExclusions(blockIndex);
+    for (int group = 0; group < blockSize; group += 8) {
+        const int* atoms = &blockAtom[group];
+        fvec8 x, y, z, charge;
+        loadGroup(atoms, x, y, z, charge);
+        fvec8 partialChargeI = charge*preFactor;
+        fvec8 radii(bornRadii[atoms[0]], bornRadii[atoms[1]], bornRadii[atoms[2]], bornRadii[atoms[3]],
+                    bornRadii[atoms[4]], bornRadii[atoms[5]], bornRadii[atoms[6]], bornRadii[atoms[7]]);
+        fvec8 blockAtomForceX(0.0f), blockAtomForceY(0.0f), blockAtomForceZ(0.0f), blockAtomBornForce(0.0f);
+        fvec8 one(1.0f);
+        for (int i = 0; i < (int) neighbors.size(); i++) {
+            short excl = (exclusions[i]>>group) & 0xFF;
+            if (excl == 0xFF)
+                continue;
+            int atomJ = neighbors[i];
+            fvec4 posJ(posq+4*atomJ);
+            fvec8 dx, dy, dz, r2;
+            getDeltaR(posJ, x, y, z, dx, dy, dz, r2, periodic, boxSize, invBoxSize);
+            ivec8 include = getIncludeMask(excl, r2);
+            if (!any(include))
+                continue;
+            float radiusJ = bornRadii[atomJ];
+            fvec8 alpha2_ij = radii*radiusJ;
+            fvec8 D_ij = r2/(4.0f*alpha2_ij);
+            fvec8 expTerm = combine(exp(-D_ij.lowerVec()), exp(-D_ij.upperVec()));
+            fvec8 denominator2 = r2 + alpha2_ij*expTerm;
+            fvec8 denominator = sqrt(denominator2);
+            fvec8 chargeProd = partialChargeI*posJ[3];
+            fvec8 Gpol = chargeProd/denominator;
+            fvec8 dGpol_dr = -Gpol*(1.0f - 0.25f*expTerm)/denominator2;
+            fvec8 dGpol_dalpha2_ij = -0.5f*Gpol*expTerm*(1.0f + D_ij)/denominator2;
+            dGpol_dr = blend(0.0f, dGpol_dr, include);
+            dGpol_dalpha2_ij = blend(0.0f, dGpol_dalpha2_ij, include);
+            fvec8 fx = dx*dGpol_dr;
+            fvec8 fy = dy*dGpol_dr;
+            fvec8 fz = dz*dGpol_dr;
+            blockAtomForceX -= fx;
+            blockAtomForceY -= fy;
+            blockAtomForceZ -= fz;
+            float* atomForce = forces+4*atomJ;
+            atomForce[0] += dot8(fx, one);
+            atomForce[1] += dot8(fy, one);
+            atomForce[2] += dot8(fz, one);
+            blockAtomBornForce += dGpol_dalpha2_ij*radiusJ;
+            bornForces[atomJ] += dot8(dGpol_dalpha2_ij, radii);
+            energy += dot8(blend(0.0f, Gpol-chargeProd/cutoffDistance, include), one);
+        }
+        fvec4 f[8];
+        transpose(blockAtomForceX, blockAtomForceY, blockAtomForceZ, 0.0f, f[0], f[1], f[2], f[3], f[4], f[5], f[6], f[7]);
+        float b[8];
+        blockAtomBornForce.store(b);
+        for (int j = 0; j < 8; j++) {
+            (fvec4(forces+4*atoms[j])+f[j]).store(forces+4*atoms[j]);
+            bornForces[atoms[j]] += b[j];
+        }
+    }
+}
+
+void CpuGBSAOBCForceVec8::calculateBlockChainRuleForces(int blockIndex, float* forces, const fvec4& boxSize, const fvec4& invBoxSize) {
+    const int blockSize = neighborList->getBlockSize();
+    if (blockSize%8 != 0) {
+        CpuGBSAOBCForce::calculateBlockChainRuleForces(blockIndex, forces, boxSize, invBoxSize);
+        return;
+    }
+    const int* blockAtom = &neighborList->getSortedAtoms()[blockSize*blockIndex];
+    const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
+    const vector<short>& exclusions = neighborList->getBlockExclusions(blockIndex);
+    for (int group = 0; group < blockSize; group += 8) {
+        const int* atoms = &blockAtom[group];
+        fvec8 x, y, z, charge;
+        loadGroup(atoms, x, y, z, charge);
+        fvec8 offsetRadiusI(particleParams[atoms[0]].first, particleParams[atoms[1]].first, particleParams[atoms[2]].first, particleParams[atoms[3]].first,
+                            particleParams[atoms[4]].first, particleParams[atoms[5]].first, particleParams[atoms[6]].first, particleParams[atoms[7]].first);
+        fvec8 scaledRadiusI(particleParams[atoms[0]].second, particleParams[atoms[1]].second, particleParams[atoms[2]].second, particleParams[atoms[3]].second,
+                            particleParams[atoms[4]].second, particleParams[atoms[5]].second, particleParams[atoms[6]].second, particleParams[atoms[7]].second);
+        fvec8 chainI(chainRuleFactor[atoms[0]], chainRuleFactor[atoms[1]], chainRuleFactor[atoms[2]], chainRuleFactor[atoms[3]],
+                     chainRuleFactor[atoms[4]], chainRuleFactor[atoms[5]], chainRuleFactor[atoms[6]], chainRuleFactor[atoms[7]]);
+        fvec8 blockAtomForceX(0.0f), blockAtomForceY(0.0f), blockAtomForceZ(0.0f);
+        fvec8 one(1.0f);
+        for (int i = 0; i < (int) neighbors.size(); i++) {
+            short excl = (exclusions[i]>>group) & 0xFF;
+            if (excl == 0xFF)
+                continue;
+            int atomJ = neighbors[i];
+            fvec8 dx, dy, dz, r2;
+            getDeltaR(fvec4(posq+4*atomJ), x, y, z, dx, dy, dz, r2, periodic, boxSize, invBoxSize);
+            ivec8 include = getIncludeMask(excl, r2);
+            if (!any(include))
+                continue;
+            fvec8 r = sqrt(r2);
+            fvec8 rInverse = 1.0f/r;
+            fvec8 r2Inverse = rInverse*rInverse;
+            fvec8 de = chainI*computeChainRuleTerm(offsetRadiusI, particleParams[atomJ].second, r, r2Inverse, include) +
+                       chainRuleFactor[atomJ]*computeChainRuleTerm(particleParams[atomJ].first, scaledRadiusI, r, r2Inverse, include);
+            de = blend(0.0f, de*rInverse, include);
+            fvec8 fx = dx*de;
+            fvec8 fy = dy*de;
+            fvec8 fz = dz*de;
+            blockAtomForceX += fx;
+            blockAtomForceY += fy;
+            blockAtomForceZ += fz;
+            float* atomForce = forces+4*atomJ;
+            atomForce[0] -= dot8(fx, one);
+            atomForce[1] -= dot8(fy, one);
+            atomForce[2] -= dot8(fz, one);
+        }
+        fvec4 f[8];
+        transpose(blockAtomForceX, blockAtomForceY, blockAtomForceZ, 0.0f, f[0], f[1], f[2], f[3], f[4], f[5], f[6], f[7]);
+        for (int j = 0; j < 8; j++)
+            (fvec4(forces+4*atoms[j])+f[j]).store(forces+4*atoms[j]);
+    }
+}
+
+void CpuGBSAOBCForceVec8::loadGroup(const int* atoms, fvec8& x, fvec8& y, fvec8& z, fvec8& charge) const {
+    transpose(fvec4(posq+4*atoms[0]), fvec4(posq+4*atoms[1]), fvec4(posq+4*atoms[2]), fvec4(posq+4*atoms[3]),
+              fvec4(posq+4*atoms[4]), fvec4(posq+4*atoms[5]), fvec4(posq+4*atoms[6]), fvec4(posq+4*atoms[7]), x, y, z, charge);
+}
+
+ivec8 CpuGBSAOBCForceVec8::getIncludeMask(short excl, const fvec8& r2) const {
+    ivec8 include;
+    if (excl == 0)
+        include = -1;
+    else
+        include = ivec8(excl&1 ? 0 : -1, excl&2 ? 0 : -1, excl&4 ? 0 : -1, excl&8 ? 0 : -1, excl&16 ? 0 : -1, excl&32 ? 0 : -1, excl&64 ? 0 : -1, excl&128 ? 0 : -1);
+    return include & (r2 < cutoffDistance*cutoffDistance);
+}
+
+fvec8 CpuGBSAOBCForceVec8::computeBornSumTerm(const fvec8& offsetRadius, const fvec8& scaledRadius, const fvec8& r, const fvec8& rInverse, const ivec8& include) {
+    fvec8 rScaledRadius = r + scaledRadius;
+    ivec8 mask = include & (offsetRadius < rScaledRadius);
+    fvec8 l_ij = 1.0f/max(offsetRadius, abs(r-scaledRadius));
+    fvec8 u_ij = 1.0f/rScaledRadius;
+    fvec8 l_ij2 = l_ij*l_ij;
+    fvec8 u_ij2 = u_ij*u_ij;
+    fvec8 logRatio = fastLog(u_ij/l_ij);
+    fvec8 term = l_ij - u_ij + 0.25f*r*(u_ij2 - l_ij2) + (0.5f*rInverse*logRatio) + (0.25f*scaledRadius*scaledRadius*rInverse)*(l_ij2 - u_ij2);
+    term += blend(0.0f, 2.0f*(1.0f/offsetRadius-l_ij), offsetRadius < scaledRadius-r);
+    return blend(0.0f, term, mask);
+}
+
+fvec8 CpuGBSAOBCForceVec8::computeChainRuleTerm(const fvec8& offsetRadius, const fvec8& scaledRadius, const fvec8& r, const fvec8& r2Inverse, const ivec8& include) {
+    fvec8 rScaledRadius = r + scaledRadius;
+    ivec8 mask = include & (offsetRadius < rScaledRadius);
+    fvec8 l_ij = 1.0f/max(offsetRadius, abs(r-scaledRadius));
+    fvec8 u_ij = 1.0f/rScaledRadius;
+    fvec8 l_ij2 = l_ij*l_ij;
+    fvec8 u_ij2 = u_ij*u_ij;
+    fvec8 logRatio = fastLog(u_ij/l_ij);
+    fvec8 t3 = 0.125f*(1.0f + scaledRadius*scaledRadius*r2Inverse)*(l_ij2 - u_ij2) + 0.25f*logRatio*r2Inverse;
+    return blend(0.0f, t3, mask);
+}
+
+void CpuGBSAOBCForceVec8::getDeltaR(const fvec4& posI, const fvec8& x, const fvec8& y, const fvec8& z, fvec8& dx, fvec8& dy, fvec8& dz, fvec8& r2, bool periodic, const fvec4& boxSize, const fvec4& invBoxSize) const {
+    dx = x-posI[0];
+    dy = y-posI[1];
+    dz = z-posI[2];
+    if (periodic) {
+        dx -= round(dx*invBoxSize[0])*boxSize[0];
+        dy -= round(dy*invBoxSize[1])*boxSize[1];
+        dz -= round(dz*invBoxSize[2])*boxSize[2];
+    }
+    r2 = dx*dx + dy*dy + dz*dz;
+}
+
+fvec8 CpuGBSAOBCForceVec8::fastLog(const fvec8& x) {
+    // Evaluate log(x) using a lookup table for speed.  Masked out lanes may contain
+    // arbitrary values, so fall back to the four component version if anything is
+    // outside the table.
+
+    fvec8 x1 = (x-TABLE_MIN)*logDXInv;
+    fvec8 x1Floor = floor(x1);
+    fvec8 inRange = (x1Floor >= 0.0f) & (x1Floor < (float) NUM_TABLE_POINTS);
+    if (_mm256_movemask_ps(inRange) != 0xFF)
+        return combine(CpuGBSAOBCForce::fastLog(x.lowerVec()), CpuGBSAOBCForce::fastLog(x.upperVec()));
+    int index[8];
+    ivec8(_mm256_cvttps_epi32(x1Floor)).store(index);
+    fvec8 coeff2 = x1-x1Floor;
+    fvec8 coeff1 = 1.0f-coeff2;
+    fvec8 t1, t2, t3, t4;
+    transpose(fvec4(&logTable[index[0]]), fvec4(&logTable[index[1]]), fvec4(&logTable[index[2]]), fvec4(&logTable[index[3]]),
+              fvec4(&logTable[index[4]]), fvec4(&logTable[index[5]]), fvec4(&logTable[index[6]]), fvec4(&logTable[index[7]]), t1, t2, t3, t4);
+    return coeff1*t1 + coeff2*t2;
+}
+
+#endif
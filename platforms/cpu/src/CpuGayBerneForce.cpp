@@ -76,17 +76,16 @@ CpuGayBerneForce::CpuGayBerneForce(const GayBerneForce& force) {
     }
     int numExceptions = force.getNumExceptions();
     exceptions.resize(numExceptions);
-    particleExclusions.resize(numParticles);
+    vector<pair<int, int> > excludedPairs(numExceptions);
     for (int i = 0; i < numExceptions; i++) {
         ExceptionInfo& e = exceptions[i];
         double sigma, epsilon;
         force.getExceptionParameters(i, e.particle1, e.particle2, sigma, epsilon);
         e.sigma = sigma;
         e.epsilon = epsilon;
-        exclusions.insert(make_pair(min(e.particle1, e.particle2), max(e.particle1, e.particle2)));
-        particleExclusions[e.particle1].insert(e.particle2);
-        particleExclusions[e.particle2].insert(e.particle1);
+        excludedPairs[i] = make_pair(e.particle1, e.particle2);
     }
+    particleExclusions = CpuExclusionList(numParticles, excludedPairs);
     nonbondedMethod = force.getNonbondedMethod();
     cutoffDistance = force.getCutoffDistance();
     switchingDistance = force.getSwitchingDistance();
@@ -107,7 +106,7 @@ CpuGayBerneForce::CpuGayBerneForce(const GayBerneForce& force) {
     }
 }
 
-const vector<set<int> >& CpuGayBerneForce::getExclusions() const {
+const CpuExclusionList& CpuGayBerneForce::getExclusions() const {
     return particleExclusions;
 }
 
@@ -124,7 +123,7 @@ RealOpenMM CpuGayBerneForce::calculateForce(const vector<RealVec>& positions, st
 
     // Record the parameters for the threads.
     
-    ThreadPool& threads = data.threads;
+    ThreadPool& threads = data.getDeterministicThreads();
     int numThreads = threads.getNumThreads();
     this->positions = &positions[0];
     this->threadForce = &threadForce;
@@ -182,7 +181,7 @@ void CpuGayBerneForce::threadComputeForce(ThreadPool& threads, int threadIndex,
             for (int j = 0; j < i; j++) {
                 if (particles[j].sqrtEpsilon == 0.0f)
                     continue;
-                if (particleExclusions[i].find(j) != particleExclusions[i].end())
+                if (particleExclusions.isExcluded(i, j))
                     continue; // This interaction will be handled by an exception.
                 RealOpenMM sigma = particles[i].sigmaOver2+particles[j].sigmaOver2;
                 RealOpenMM epsilon = particles[i].sqrtEpsilon*particles[j].sqrtEpsilon;
@@ -198,7 +197,7 @@ void CpuGayBerneForce::threadComputeForce(ThreadPool& threads, int threadIndex,
             const int blockSize = neighborList->getBlockSize();
             const int* blockAtom = &neighborList->getSortedAtoms()[blockSize*blockIndex];
             const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
-            const vector<char>& exclusions = neighborList->getBlockExclusions(blockIndex);
+            const vector<short>& exclusions = neighborList->getBlockExclusions(blockIndex);
             for (int i = 0; i < (int) neighbors.size(); i++) {
                 int first = neighbors[i];
                 if (particles[first].sqrtEpsilon == 0.0f)
@@ -32,6 +32,7 @@
 #include "CpuKernelFactory.h"
 #include "CpuKernels.h"
 #include "CpuPlatform.h"
+#include "ReferenceKernelFactory.h"
 #include "openmm/internal/ContextImpl.h"
 #include "openmm/OpenMMException.h"
 
@@ -39,8 +40,18 @@ using namespace OpenMM;
 
 KernelImpl* CpuKernelFactory::createKernelImpl(std::string name, const Platform& platform, ContextImpl& context) const {
     CpuPlatform::PlatformData& data = CpuPlatform::getPlatformData(context);
+    if (data.useDoublePrecision && name != CalcForcesAndEnergyKernel::Name() && name != CalcHarmonicAngleForceKernel::Name() &&
+            name != CalcPeriodicTorsionForceKernel::Name() && name != CalcRBTorsionForceKernel::Name() && name != IntegrateLangevinStepKernel::Name() &&
+            name != VirtualSitesKernel::Name()) {
+        // The remaining kernels compute forces in single precision, so use the Reference versions instead.
+
+        ReferenceKernelFactory referenceFactory;
+        return referenceFactory.createKernelImpl(name, platform, context);
+    }
     if (name == CalcForcesAndEnergyKernel::Name())
         return new CpuCalcForcesAndEnergyKernel(name, platform, data, context);
+    if (name == VirtualSitesKernel::Name())
+        return new CpuVirtualSitesKernel(name, platform, data);
     if (name == CalcHarmonicAngleForceKernel::Name())
         return new CpuCalcHarmonicAngleForceKernel(name, platform, data);
     if (name == CalcPeriodicTorsionForceKernel::Name())
@@ -44,6 +44,7 @@
 #include "openmm/internal/ContextImpl.h"
 #include "openmm/internal/CustomNonbondedForceImpl.h"
 #include "openmm/internal/NonbondedForceImpl.h"
+#include "openmm/internal/timer.h"
 #include "openmm/internal/vectorize.h"
 #include "RealVec.h"
 #include "lepton/CompiledExpression.h"
@@ -51,6 +52,7 @@
 #include "lepton/Operation.h"
 #include "lepton/Parser.h"
 #include "lepton/ParsedExpression.h"
+#include <algorithm>
 
 using namespace OpenMM;
 using namespace std;
@@ -147,13 +149,37 @@ public:
         int numThreads = threads.getNumThreads();
         int start = threadIndex*numParticles/numThreads;
         int end = (threadIndex+1)*numParticles/numThreads;
-        for (int i = start; i < end; i++) {
-            fvec4 f(0.0f);
-            for (int j = 0; j < numThreads; j++)
-                f += fvec4(&data.threadForce[j][4*i]);
-            forceData[i][0] += f[0];
-            forceData[i][1] += f[1];
-            forceData[i][2] += f[2];
+        if (data.useMixedPrecision) {
+            for (int i = start; i < end; i++)
+                for (int j = 0; j < numThreads; j++) {
+                    float* f = &data.threadForce[j][4*i];
+                    double* d = &data.shared.threadDoubleForce[j][3*i];
+                    forceData[i][0] += f[0]+d[0];
+                    forceData[i][1] += f[1]+d[1];
+                    forceData[i][2] += f[2]+d[2];
+                }
+        }
+        else {
+            for (int i = start; i < end; i++) {
+                fvec4 f(0.0f);
+                for (int j = 0; j < numThreads; j++)
+                    f += fvec4(&data.threadForce[j][4*i]);
+                forceData[i][0] += f[0];
+                forceData[i][1] += f[1];
+                forceData[i][2] += f[2];
+            }
+        }
+        if (data.deterministicForces) {
+            // Add the forces that were accumulated in fixed point.
+
+            const double scale = 1.0/CpuPlatform::SharedData::FixedPointScale;
+            for (int i = start; i < end; i++)
+                for (int k = 0; k < 3; k++) {
+                    long long f = 0;
+                    for (int j = 0; j < numThreads; j++)
+                        f += data.shared.threadFixedForce[j][3*i+k];
+                    forceData[i][k] += f*scale;
+                }
         }
     }
     int numParticles;
@@ -218,6 +244,14 @@ public:
         fvec4 zero(0.0f);
         for (int j = 0; j < numParticles; j++)
             zero.store(&data.threadForce[threadIndex][j*4]);
+        if (data.deterministicForces) {
+            vector<long long>& fixedForce = data.shared.threadFixedForce[threadIndex];
+            fill(fixedForce.begin(), fixedForce.begin()+3*numParticles, 0);
+        }
+        if (data.useMixedPrecision) {
+            vector<double>& doubleForce = data.shared.threadDoubleForce[threadIndex];
+            fill(doubleForce.begin(), doubleForce.begin()+3*numParticles, 0.0);
+        }
     }
     int numParticles;
     bool positionsValid;
@@ -225,8 +259,26 @@ public:
     CpuPlatform::PlatformData& data;
 };
 
+class CpuCalcForcesAndEnergyKernel::SortPositionsTask : public ThreadPool::Task {
+public:
+    SortPositionsTask(CpuPlatform::PlatformData& data) : data(data) {
+    }
+    void execute(ThreadPool& threads, int threadIndex) {
+        // Copy the positions and charges into the order of the neighbor list's sorted atoms.
+
+        const vector<int>& sortedAtoms = data.neighborList->getSortedAtoms();
+        int numSorted = sortedAtoms.size();
+        int numThreads = threads.getNumThreads();
+        int start = threadIndex*numSorted/numThreads;
+        int end = (threadIndex+1)*numSorted/numThreads;
+        for (int i = start; i < end; i++)
+            fvec4(&data.posq[4*sortedAtoms[i]]).store(&data.sortedPosq[4*i]);
+    }
+    CpuPlatform::PlatformData& data;
+};
+
 CpuCalcForcesAndEnergyKernel::CpuCalcForcesAndEnergyKernel(std::string name, const Platform& platform, CpuPlatform::PlatformData& data, ContextImpl& context) :
-        CalcForcesAndEnergyKernel(name, platform), data(data) {
+        CalcForcesAndEnergyKernel(name, platform), data(data), isProfiling(false) {
     // Create a Reference platform version of this kernel.
     
     ReferenceKernelFactory referenceFactory;
@@ -235,11 +287,18 @@ CpuCalcForcesAndEnergyKernel::CpuCalcForcesAndEnergyKernel(std::string name, con
 
 void CpuCalcForcesAndEnergyKernel::initialize(const System& system) {
     referenceKernel.getAs<ReferenceCalcForcesAndEnergyKernel>().initialize(system);
+    referenceKernel.getAs<ReferenceCalcForcesAndEnergyKernel>().setDistributeVirtualSiteForces(data.virtualSites == NULL);
     lastPositions.resize(system.getNumParticles(), Vec3(1e10, 1e10, 1e10));
 }
 
 void CpuCalcForcesAndEnergyKernel::beginComputation(ContextImpl& context, bool includeForce, bool includeEnergy, int groups) {
     referenceKernel.getAs<ReferenceCalcForcesAndEnergyKernel>().beginComputation(context, includeForce, includeEnergy, groups);
+    Profiler& profiler = context.getProfiler();
+    if (profiler.isEnabled() != isProfiling) {
+        isProfiling = profiler.isEnabled();
+        data.threads.setTimingEnabled(isProfiling);
+        data.threads.resetTiming();
+    }
     
     // Convert positions to single precision and clear the forces.
 
@@ -293,8 +352,20 @@ void CpuCalcForcesAndEnergyKernel::beginComputation(ContextImpl& context, bool i
                 }
         }
         if (needRecompute) {
+            double startTime = (isProfiling ? getCurrentTime() : 0.0);
             data.neighborList->computeNeighborList(numParticles, data.posq, data.exclusions, extractBoxVectors(context), data.isPeriodic, data.paddedCutoff, data.threads);
             lastPositions = posData;
+            if (isProfiling) {
+                profiler.addTime("Neighbor list", getCurrentTime()-startTime);
+                profiler.addCount("Neighbor list builds");
+            }
+        }
+        if (data.reorderParticles) {
+            if (data.sortedPosq.size() != 4*(int) data.neighborList->getSortedAtoms().size())
+                data.sortedPosq.resize(4*data.neighborList->getSortedAtoms().size());
+            SortPositionsTask sortTask(data);
+            data.threads.execute(sortTask);
+            data.threads.waitForThreads();
         }
     }
 }
@@ -305,9 +376,27 @@ double CpuCalcForcesAndEnergyKernel::finishComputation(ContextImpl& context, boo
     SumForceTask task(context.getSystem().getNumParticles(), extractForces(context), data);
     data.threads.execute(task);
     data.threads.waitForThreads();
+    if (includeForce && data.virtualSites != NULL)
+        data.virtualSites->distributeForces(extractPositions(context), extractForces(context));
+    if (isProfiling) {
+        // Record how long the thread pool spent waiting during this evaluation.
+
+        Profiler& profiler = context.getProfiler();
+        profiler.addTime("Thread idle", data.threads.getIdleTime());
+        profiler.addTime("Thread wait", data.threads.getWaitTime());
+        data.threads.resetTiming();
+    }
     return referenceKernel.getAs<ReferenceCalcForcesAndEnergyKernel>().finishComputation(context, includeForce, includeEnergy, groups, valid);
 }
 
+void CpuVirtualSitesKernel::initialize(const System& system) {
+}
+
+void CpuVirtualSitesKernel::computePositions(ContextImpl& context) {
+    if (data.virtualSites != NULL)
+        data.virtualSites->computePositions(extractPositions(context));
+}
+
 CpuCalcHarmonicAngleForceKernel::~CpuCalcHarmonicAngleForceKernel() {
     if (angleIndexArray != NULL) {
         for (int i = 0; i < numAngles; i++) {
@@ -337,7 +426,7 @@ void CpuCalcHarmonicAngleForceKernel::initialize(const System& system, const Har
         angleParamArray[i][0] = (RealOpenMM) angle;
         angleParamArray[i][1] = (RealOpenMM) k;
     }
-    bondForce.initialize(system.getNumParticles(), numAngles, 3, angleIndexArray, data.threads);
+    bondForce.initialize(system.getNumParticles(), numAngles, 3, angleIndexArray, data.getDeterministicThreads(), &data.shared.bondPartitions);
     usePeriodic = force.usesPeriodicBoundaryConditions();
 }
 
@@ -400,7 +489,7 @@ void CpuCalcPeriodicTorsionForceKernel::initialize(const System& system, const P
         torsionParamArray[i][1] = (RealOpenMM) phase;
         torsionParamArray[i][2] = (RealOpenMM) periodicity;
     }
-    bondForce.initialize(system.getNumParticles(), numTorsions, 4, torsionIndexArray, data.threads);
+    bondForce.initialize(system.getNumParticles(), numTorsions, 4, torsionIndexArray, data.getDeterministicThreads(), &data.shared.bondPartitions);
     usePeriodic = force.usesPeriodicBoundaryConditions();
 }
 
@@ -467,7 +556,7 @@ void CpuCalcRBTorsionForceKernel::initialize(const System& system, const RBTorsi
         torsionParamArray[i][4] = (RealOpenMM) c4;
         torsionParamArray[i][5] = (RealOpenMM) c5;
     }
-    bondForce.initialize(system.getNumParticles(), numTorsions, 4, torsionIndexArray, data.threads);
+    bondForce.initialize(system.getNumParticles(), numTorsions, 4, torsionIndexArray, data.getDeterministicThreads(), &data.shared.bondPartitions);
     usePeriodic = force.usesPeriodicBoundaryConditions();
 }
 
@@ -505,31 +594,61 @@ void CpuCalcRBTorsionForceKernel::copyParametersToContext(ContextImpl& context,
 
 class CpuCalcNonbondedForceKernel::PmeIO : public CalcPmeReciprocalForceKernel::IO {
 public:
-    PmeIO(float* posq, float* force, int numParticles) : posq(posq), force(force), numParticles(numParticles) {
+    PmeIO(float* posq, float* force, int numParticles, Profiler* profiler, const int* order=NULL) : posq(posq), force(force), numParticles(numParticles),
+            profiler(profiler), order(order) {
     }
     float* getPosq() {
         return posq;
     }
     void setForce(float* f) {
         for (int i = 0; i < numParticles; i++) {
-            force[4*i] += f[4*i];
-            force[4*i+1] += f[4*i+1];
-            force[4*i+2] += f[4*i+2];
+            float* atomForce = force+4*(order == NULL ? i : order[i]);
+            atomForce[0] += f[4*i];
+            atomForce[1] += f[4*i+1];
+            atomForce[2] += f[4*i+2];
         }
     }
+    Profiler* getProfiler() {
+        return profiler;
+    }
 private:
     float* posq;
     float* force;
     int numParticles;
+    Profiler* profiler;
+    const int* order;
+};
+
+class CpuCalcNonbondedForceKernel::ReciprocalTask : public ThreadPool::Task {
+public:
+    ReciprocalTask(CpuNonbondedForce& nonbonded, int numParticles, float* posq, const vector<RealVec>& posData, const vector<pair<float, float> >& particleParams,
+            const CpuExclusionList& exclusions, vector<RealVec>& forceData, double* energy) : nonbonded(nonbonded), numParticles(numParticles), posq(posq),
+            posData(posData), particleParams(particleParams), exclusions(exclusions), forceData(forceData), energy(energy) {
+    }
+    void execute(ThreadPool& threads, int threadIndex) {
+        nonbonded.calculateReciprocalIxn(numParticles, posq, posData, particleParams, exclusions, forceData, energy);
+    }
+    CpuNonbondedForce& nonbonded;
+    int numParticles;
+    float* posq;
+    const vector<RealVec>& posData;
+    const vector<pair<float, float> >& particleParams;
+    const CpuExclusionList& exclusions;
+    vector<RealVec>& forceData;
+    double* energy;
 };
 
 bool isVec8Supported();
+bool isVec16Supported();
 CpuNonbondedForce* createCpuNonbondedForceVec4();
 CpuNonbondedForce* createCpuNonbondedForceVec8();
+CpuNonbondedForce* createCpuNonbondedForceVec16();
 
 CpuCalcNonbondedForceKernel::CpuCalcNonbondedForceKernel(string name, const Platform& platform, CpuPlatform::PlatformData& data) : CalcNonbondedForceKernel(name, platform),
-        data(data), bonded14IndexArray(NULL), bonded14ParamArray(NULL), hasInitializedPme(false), nonbonded(NULL) {
-    if (isVec8Supported())
+        data(data), bonded14IndexArray(NULL), bonded14ParamArray(NULL), hasInitializedPme(false), numPmeThreads(0), dispersionCorrection(NULL), nonbonded(NULL) {
+    if (isVec16Supported())
+        nonbonded = createCpuNonbondedForceVec16();
+    else if (isVec8Supported())
         nonbonded = createCpuNonbondedForceVec8();
     else
         nonbonded = createCpuNonbondedForceVec4();
@@ -546,6 +665,8 @@ CpuCalcNonbondedForceKernel::~CpuCalcNonbondedForceKernel() {
     }
     if (nonbonded != NULL)
         delete nonbonded;
+    if (dispersionCorrection != NULL)
+        delete dispersionCorrection;
 }
 
 void CpuCalcNonbondedForceKernel::initialize(const System& system, const NonbondedForce& force) {
@@ -553,17 +674,21 @@ void CpuCalcNonbondedForceKernel::initialize(const System& system, const Nonbond
     // Identify which exceptions are 1-4 interactions.
 
     numParticles = force.getNumParticles();
-    exclusions.resize(numParticles);
+    vector<pair<int, int> > excludedPairs;
     vector<int> nb14s;
+    exceptionIndex.resize(force.getNumExceptions());
     for (int i = 0; i < force.getNumExceptions(); i++) {
         int particle1, particle2;
         double chargeProd, sigma, epsilon;
         force.getExceptionParameters(i, particle1, particle2, chargeProd, sigma, epsilon);
-        exclusions[particle1].insert(particle2);
-        exclusions[particle2].insert(particle1);
-        if (chargeProd != 0.0 || epsilon != 0.0)
+        excludedPairs.push_back(make_pair(particle1, particle2));
+        exceptionIndex[i] = -1;
+        if (chargeProd != 0.0 || epsilon != 0.0) {
+            exceptionIndex[i] = nb14s.size();
             nb14s.push_back(i);
+        }
     }
+    exclusions = data.shared.getSharedExclusions(CpuExclusionList(numParticles, excludedPairs));
 
     // Record the particle parameters.
 
@@ -575,12 +700,14 @@ void CpuCalcNonbondedForceKernel::initialize(const System& system, const Nonbond
     for (int i = 0; i < num14; i++)
         bonded14ParamArray[i] = new double[3];
     particleParams.resize(numParticles);
-    double sumSquaredCharges = 0.0;
+    charges.resize(numParticles);
+    sumSquaredCharges = 0.0;
     for (int i = 0; i < numParticles; ++i) {
         double charge, radius, depth;
         force.getParticleParameters(i, charge, radius, depth);
         data.posq[4*i+3] = (float) charge;
         particleParams[i] = make_pair((float) (0.5*radius), (float) (2.0*sqrt(depth)));
+        charges[i] = charge;
         sumSquaredCharges += charge*charge;
     }
     
@@ -596,7 +723,7 @@ void CpuCalcNonbondedForceKernel::initialize(const System& system, const Nonbond
         bonded14ParamArray[i][1] = static_cast<RealOpenMM>(4.0*depth);
         bonded14ParamArray[i][2] = static_cast<RealOpenMM>(charge);
     }
-    bondForce.initialize(system.getNumParticles(), num14, 2, bonded14IndexArray, data.threads);
+    bondForce.initialize(system.getNumParticles(), num14, 2, bonded14IndexArray, data.getDeterministicThreads(), &data.shared.bondPartitions);
     
     // Record other parameters.
     
@@ -624,8 +751,10 @@ void CpuCalcNonbondedForceKernel::initialize(const System& system, const Nonbond
     else
         ewaldSelfEnergy = 0.0;
     rfDielectric = force.getReactionFieldDielectric();
-    if (force.getUseDispersionCorrection())
-        dispersionCoefficient = NonbondedForceImpl::calcDispersionCorrection(system, force);
+    if (force.getUseDispersionCorrection()) {
+        dispersionCorrection = new NonbondedForceImpl::DispersionCorrectionData(system, force);
+        dispersionCoefficient = dispersionCorrection->getCoefficient();
+    }
     else
         dispersionCoefficient = 0.0;
     data.isPeriodic = (nonbondedMethod == CutoffPeriodic || nonbondedMethod == Ewald || nonbondedMethod == PME);
@@ -635,14 +764,23 @@ double CpuCalcNonbondedForceKernel::execute(ContextImpl& context, bool includeFo
     if (!hasInitializedPme) {
         hasInitializedPme = true;
         useOptimizedPme = false;
-        if (nonbondedMethod == PME) {
-            // If available, use the optimized PME implementation.
+        if (nonbondedMethod == PME && !data.deterministicForces) {
+            // If available, use the optimized PME implementation.  It is not used when deterministic
+            // forces are requested, since its results depend on the number of threads.
 
             vector<string> kernelNames;
             kernelNames.push_back("CalcPmeReciprocalForce");
             useOptimizedPme = getPlatform().supportsKernels(kernelNames);
             if (useOptimizedPme) {
+                // When reciprocal space overlaps direct space, it gets its share of the threads and direct
+                // space uses the rest.  Otherwise it uses all of them.
+
+                int numThreads = data.threads.getNumThreads();
+                numPmeThreads = numThreads;
+                if (data.overlapPme)
+                    numPmeThreads = min(max(1, (int) floor(data.overlapPmeFraction*numThreads+0.5)), max(1, numThreads-1));
                 optimizedPme = getPlatform().createKernel(CalcPmeReciprocalForceKernel::Name(), context);
+                optimizedPme.getAs<CalcPmeReciprocalForceKernel>().setNumThreads(numPmeThreads);
                 optimizedPme.getAs<CalcPmeReciprocalForceKernel>().initialize(gridSize[0], gridSize[1], gridSize[2], numParticles, ewaldAlpha);
             }
         }
@@ -654,8 +792,11 @@ double CpuCalcNonbondedForceKernel::execute(ContextImpl& context, bool includeFo
     double energy = (includeReciprocal ? ewaldSelfEnergy : 0.0);
     bool ewald  = (nonbondedMethod == Ewald);
     bool pme  = (nonbondedMethod == PME);
+    bool useSortedOrder = (data.reorderParticles && nonbondedMethod != NoCutoff);
     if (nonbondedMethod != NoCutoff)
         nonbonded->setUseCutoff(nonbondedCutoff, *data.neighborList, rfDielectric);
+    if (useSortedOrder)
+        nonbonded->setSortedPosq(&data.sortedPosq[0]);
     if (data.isPeriodic) {
         RealVec* boxVectors = extractBoxVectors(context);
         double minAllowedSize = 1.999999*nonbondedCutoff;
@@ -669,18 +810,63 @@ double CpuCalcNonbondedForceKernel::execute(ContextImpl& context, bool includeFo
         nonbonded->setUsePME(ewaldAlpha, gridSize);
     if (useSwitchingFunction)
         nonbonded->setUseSwitchingFunction(switchingDistance);
+    if (data.deterministicForces)
+        nonbonded->setFixedPointForces(&data.shared.threadFixedForce);
+    else if (data.useMixedPrecision)
+        nonbonded->setDoubleForces(&data.shared.threadDoubleForce);
     double nonbondedEnergy = 0;
-    if (includeDirect)
-        nonbonded->calculateDirectIxn(numParticles, &posq[0], posData, particleParams, exclusions, data.threadForce, includeEnergy ? &nonbondedEnergy : NULL, data.threads);
-    if (includeReciprocal) {
-        if (useOptimizedPme) {
-            PmeIO io(&posq[0], &data.threadForce[0][0], numParticles);
-            Vec3 periodicBoxVectors[3] = {boxVectors[0], boxVectors[1], boxVectors[2]};
+    Profiler& profiler = context.getProfiler();
+    double startTime = (profiler.isEnabled() ? getCurrentTime() : 0.0);
+    if (data.overlapPme && pme && includeDirect && includeReciprocal) {
+        // Start the reciprocal space calculation first so it runs at the same time as the direct space one.
+        // The optimized PME kernel does its work on its own threads, so only the remaining threads compute
+        // direct space.  Otherwise the reference implementation runs on this thread, which would only be
+        // waiting for the worker threads.  Both write to different force arrays than the direct space
+        // calculation, so the result is the same as when they are computed one after the other.
+
+        float* pmePosq = (useSortedOrder ? &data.sortedPosq[0] : &posq[0]);
+        const int* pmeOrder = (useSortedOrder ? &data.neighborList->getSortedAtoms()[0] : NULL);
+        PmeIO io(pmePosq, &data.threadForce[0][0], numParticles, profiler.isEnabled() ? &profiler : NULL, pmeOrder);
+        Vec3 periodicBoxVectors[3] = {boxVectors[0], boxVectors[1], boxVectors[2]};
+        double reciprocalEnergy = 0.0;
+        ReciprocalTask reciprocalTask(*nonbonded, numParticles, &posq[0], posData, particleParams, exclusions, forceData, includeEnergy ? &reciprocalEnergy : NULL);
+        if (useOptimizedPme)
             optimizedPme.getAs<CalcPmeReciprocalForceKernel>().beginComputation(io, periodicBoxVectors, includeEnergy);
-            nonbondedEnergy += optimizedPme.getAs<CalcPmeReciprocalForceKernel>().finishComputation(io);
+        int numDirectThreads = (useOptimizedPme ? max(1, data.threads.getNumThreads()-numPmeThreads) : 0);
+        nonbonded->calculateDirectIxn(numParticles, &posq[0], posData, particleParams, exclusions, data.threadForce, includeEnergy ? &nonbondedEnergy : NULL,
+                data.threads, useOptimizedPme ? NULL : &reciprocalTask, numDirectThreads);
+        double directTime = (profiler.isEnabled() ? getCurrentTime() : 0.0);
+        if (useOptimizedPme)
+            reciprocalEnergy = optimizedPme.getAs<CalcPmeReciprocalForceKernel>().finishComputation(io);
+        nonbondedEnergy += reciprocalEnergy;
+        if (profiler.isEnabled()) {
+            profiler.addTime("NonbondedForce direct space", directTime-startTime);
+            profiler.addTime("NonbondedForce reciprocal space", getCurrentTime()-directTime);
+        }
+    }
+    else {
+        if (includeDirect) {
+            nonbonded->calculateDirectIxn(numParticles, &posq[0], posData, particleParams, exclusions, data.threadForce, includeEnergy ? &nonbondedEnergy : NULL, data.threads);
+            if (profiler.isEnabled()) {
+                double time = getCurrentTime();
+                profiler.addTime("NonbondedForce direct space", time-startTime);
+                startTime = time;
+            }
+        }
+        if (includeReciprocal) {
+            if (useOptimizedPme) {
+                float* pmePosq = (useSortedOrder ? &data.sortedPosq[0] : &posq[0]);
+                const int* pmeOrder = (useSortedOrder ? &data.neighborList->getSortedAtoms()[0] : NULL);
+                PmeIO io(pmePosq, &data.threadForce[0][0], numParticles, profiler.isEnabled() ? &profiler : NULL, pmeOrder);
+                Vec3 periodicBoxVectors[3] = {boxVectors[0], boxVectors[1], boxVectors[2]};
+                optimizedPme.getAs<CalcPmeReciprocalForceKernel>().beginComputation(io, periodicBoxVectors, includeEnergy);
+                nonbondedEnergy += optimizedPme.getAs<CalcPmeReciprocalForceKernel>().finishComputation(io);
+            }
+            else
+                nonbonded->calculateReciprocalIxn(numParticles, &posq[0], posData, particleParams, exclusions, forceData, includeEnergy ? &nonbondedEnergy : NULL);
+            if (profiler.isEnabled())
+                profiler.addTime("NonbondedForce reciprocal space", getCurrentTime()-startTime);
         }
-        else
-            nonbonded->calculateReciprocalIxn(numParticles, &posq[0], posData, particleParams, exclusions, forceData, includeEnergy ? &nonbondedEnergy : NULL);
     }
     energy += nonbondedEnergy;
     if (includeDirect) {
@@ -700,22 +886,27 @@ void CpuCalcNonbondedForceKernel::copyParametersToContext(ContextImpl& context,
         int particle1, particle2;
         double chargeProd, sigma, epsilon;
         force.getExceptionParameters(i, particle1, particle2, chargeProd, sigma, epsilon);
-        if (chargeProd != 0.0 || epsilon != 0.0)
+        exceptionIndex[i] = -1;
+        if (chargeProd != 0.0 || epsilon != 0.0) {
+            exceptionIndex[i] = nb14s.size();
             nb14s.push_back(i);
+        }
     }
     if (nb14s.size() != num14)
         throw OpenMMException("updateParametersInContext: The number of non-excluded exceptions has changed");
 
     // Record the values.
 
-    double sumSquaredCharges = 0.0;
+    sumSquaredCharges = 0.0;
     for (int i = 0; i < numParticles; ++i) {
         double charge, radius, depth;
         force.getParticleParameters(i, charge, radius, depth);
         data.posq[4*i+3] = (float) charge;
         particleParams[i] = make_pair((float) (0.5*radius), (float) (2.0*sqrt(depth)));
+        charges[i] = charge;
         sumSquaredCharges += charge*charge;
     }
+    nonbonded->invalidateSortedParameters();
     if (nonbondedMethod == Ewald || nonbondedMethod == PME)
         ewaldSelfEnergy = -ONE_4PI_EPS0*ewaldAlpha*sumSquaredCharges/sqrt(M_PI);
     else
@@ -733,9 +924,57 @@ void CpuCalcNonbondedForceKernel::copyParametersToContext(ContextImpl& context,
     
     // Recompute the coefficient for the dispersion correction.
 
-    NonbondedForce::NonbondedMethod method = force.getNonbondedMethod();
-    if (force.getUseDispersionCorrection() && (method == NonbondedForce::CutoffPeriodic || method == NonbondedForce::Ewald || method == NonbondedForce::PME))
-        dispersionCoefficient = NonbondedForceImpl::calcDispersionCorrection(context.getSystem(), force);
+    if (dispersionCorrection != NULL) {
+        delete dispersionCorrection;
+        dispersionCorrection = new NonbondedForceImpl::DispersionCorrectionData(context.getSystem(), force);
+        dispersionCoefficient = dispersionCorrection->getCoefficient();
+    }
+}
+
+void CpuCalcNonbondedForceKernel::copyParameterSubsetToContext(ContextImpl& context, const NonbondedForce& force, const vector<int>& particles,
+        const vector<int>& exceptions) {
+    if (numParticles != force.getNumParticles())
+        throw OpenMMException("updateParametersInContext: The number of particles has changed");
+    if ((int) exceptionIndex.size() != force.getNumExceptions())
+        throw OpenMMException("updateParametersInContext: The number of exceptions has changed");
+    
+    // Patch the values of the listed particles and exceptions in place.
+    
+    for (int i = 0; i < (int) particles.size(); i++) {
+        int index = particles[i];
+        double charge, radius, depth;
+        force.getParticleParameters(index, charge, radius, depth);
+        data.posq[4*index+3] = (float) charge;
+        particleParams[index] = make_pair((float) (0.5*radius), (float) (2.0*sqrt(depth)));
+        sumSquaredCharges += charge*charge-charges[index]*charges[index];
+        charges[index] = charge;
+    }
+    if (particles.size() > 0)
+        nonbonded->invalidateSortedParameters();
+    if (nonbondedMethod == Ewald || nonbondedMethod == PME)
+        ewaldSelfEnergy = -ONE_4PI_EPS0*ewaldAlpha*sumSquaredCharges/sqrt(M_PI);
+    for (int i = 0; i < (int) exceptions.size(); i++) {
+        int particle1, particle2;
+        double charge, radius, depth;
+        force.getExceptionParameters(exceptions[i], particle1, particle2, charge, radius, depth);
+        int index = exceptionIndex[exceptions[i]];
+        if ((index == -1) != (charge == 0.0 && depth == 0.0))
+            throw OpenMMException("updateParametersInContext: The set of non-excluded exceptions has changed");
+        if (index == -1)
+            continue;
+        if (bonded14IndexArray[index][0] != particle1 || bonded14IndexArray[index][1] != particle2)
+            throw OpenMMException("updateParametersInContext: The particles involved in an exception have changed");
+        bonded14ParamArray[index][0] = static_cast<RealOpenMM>(radius);
+        bonded14ParamArray[index][1] = static_cast<RealOpenMM>(4.0*depth);
+        bonded14ParamArray[index][2] = static_cast<RealOpenMM>(charge);
+    }
+    
+    // Update the coefficient for the dispersion correction.
+    
+    if (dispersionCorrection != NULL) {
+        dispersionCorrection->updateParticles(force, particles);
+        dispersionCoefficient = dispersionCorrection->getCoefficient();
+    }
 }
 
 void CpuCalcNonbondedForceKernel::getPMEParameters(double& alpha, int& nx, int& ny, int& nz) const {
@@ -752,7 +991,7 @@ void CpuCalcNonbondedForceKernel::getPMEParameters(double& alpha, int& nx, int&
 }
 
 CpuCalcCustomNonbondedForceKernel::CpuCalcCustomNonbondedForceKernel(string name, const Platform& platform, CpuPlatform::PlatformData& data) :
-            CalcCustomNonbondedForceKernel(name, platform), data(data), forceCopy(NULL), nonbonded(NULL) {
+            CalcCustomNonbondedForceKernel(name, platform), data(data), longRangeCorrection(NULL), nonbonded(NULL) {
 }
 
 CpuCalcCustomNonbondedForceKernel::~CpuCalcCustomNonbondedForceKernel() {
@@ -763,8 +1002,8 @@ CpuCalcCustomNonbondedForceKernel::~CpuCalcCustomNonbondedForceKernel() {
     }
     if (nonbonded != NULL)
         delete nonbonded;
-    if (forceCopy != NULL)
-        delete forceCopy;
+    if (longRangeCorrection != NULL)
+        delete longRangeCorrection;
 }
 
 void CpuCalcCustomNonbondedForceKernel::initialize(const System& system, const CustomNonbondedForce& force) {
@@ -772,13 +1011,10 @@ void CpuCalcCustomNonbondedForceKernel::initialize(const System& system, const C
     // Record the exclusions.
 
     numParticles = force.getNumParticles();
-    exclusions.resize(numParticles);
-    for (int i = 0; i < force.getNumExclusions(); i++) {
-        int particle1, particle2;
-        force.getExclusionParticles(i, particle1, particle2);
-        exclusions[particle1].insert(particle2);
-        exclusions[particle2].insert(particle1);
-    }
+    vector<pair<int, int> > excludedPairs(force.getNumExclusions());
+    for (int i = 0; i < force.getNumExclusions(); i++)
+        force.getExclusionParticles(i, excludedPairs[i].first, excludedPairs[i].second);
+    exclusions = data.shared.getSharedExclusions(CpuExclusionList(numParticles, excludedPairs));
 
     // Build the arrays.
 
@@ -811,19 +1047,19 @@ void CpuCalcCustomNonbondedForceKernel::initialize(const System& system, const C
     // Parse the various expressions used to calculate the force.
 
     Lepton::ParsedExpression expression = Lepton::Parser::parse(force.getEnergyFunction(), functions).optimize();
-    Lepton::CompiledExpression energyExpression = expression.createCompiledExpression();
-    Lepton::CompiledExpression forceExpression = expression.differentiate("r").createCompiledExpression();
+    vector<Lepton::ParsedExpression> pairExpressions;
+    pairExpressions.push_back(expression);
+    pairExpressions.push_back(expression.differentiate("r").optimize());
     for (int i = 0; i < numParameters; i++)
         parameterNames.push_back(force.getPerParticleParameterName(i));
     for (int i = 0; i < force.getNumGlobalParameters(); i++) {
         globalParameterNames.push_back(force.getGlobalParameterName(i));
         globalParamValues[force.getGlobalParameterName(i)] = force.getGlobalParameterDefaultValue(i);
     }
-    std::vector<Lepton::CompiledExpression> energyParamDerivExpressions;
     for (int i = 0; i < force.getNumEnergyParameterDerivatives(); i++) {
         string param = force.getEnergyParameterDerivativeName(i);
         energyParamDerivNames.push_back(param);
-        energyParamDerivExpressions.push_back(expression.differentiate(param).createCompiledExpression());
+        pairExpressions.push_back(expression.differentiate(param).optimize());
     }
     set<string> variables;
     variables.insert("r");
@@ -842,7 +1078,7 @@ void CpuCalcCustomNonbondedForceKernel::initialize(const System& system, const C
     // Record information for the long range correction.
     
     if (force.getNonbondedMethod() == CustomNonbondedForce::CutoffPeriodic && force.getUseLongRangeCorrection()) {
-        forceCopy = new CustomNonbondedForce(force);
+        longRangeCorrection = new CustomNonbondedForceImpl::LongRangeCorrectionData(force);
         hasInitializedLongRangeCorrection = false;
     }
     else {
@@ -858,7 +1094,7 @@ void CpuCalcCustomNonbondedForceKernel::initialize(const System& system, const C
         interactionGroups.push_back(make_pair(set1, set2));
     }
     data.isPeriodic = (nonbondedMethod == CutoffPeriodic);
-    nonbonded = new CpuCustomNonbondedForce(energyExpression, forceExpression, parameterNames, exclusions, energyParamDerivExpressions, data.threads);
+    nonbonded = new CpuCustomNonbondedForce(pairExpressions, parameterNames, exclusions, data.getDeterministicThreads());
     if (interactionGroups.size() > 0)
         nonbonded->setInteractionGroups(interactionGroups);
 }
@@ -894,8 +1130,8 @@ double CpuCalcCustomNonbondedForceKernel::execute(ContextImpl& context, bool inc
     
     // Add in the long range correction.
     
-    if (!hasInitializedLongRangeCorrection || (globalParamsChanged && forceCopy != NULL)) {
-        CustomNonbondedForceImpl::calcLongRangeCorrection(*forceCopy, context.getOwner(), longRangeCoefficient, longRangeCoefficientDerivs);
+    if (!hasInitializedLongRangeCorrection || (globalParamsChanged && longRangeCorrection != NULL)) {
+        longRangeCorrection->calcCorrection(globalParamValues, longRangeCoefficient, longRangeCoefficientDerivs, &data.getDeterministicThreads());
         hasInitializedLongRangeCorrection = true;
     }
     double volume = boxVectors[0][0]*boxVectors[1][1]*boxVectors[2][2];
@@ -922,17 +1158,47 @@ void CpuCalcCustomNonbondedForceKernel::copyParametersToContext(ContextImpl& con
     
     // If necessary, recompute the long range correction.
     
-    if (forceCopy != NULL) {
-        CustomNonbondedForceImpl::calcLongRangeCorrection(force, context.getOwner(), longRangeCoefficient, longRangeCoefficientDerivs);
-        hasInitializedLongRangeCorrection = true;
-        *forceCopy = force;
+    if (longRangeCorrection != NULL) {
+        delete longRangeCorrection;
+        longRangeCorrection = new CustomNonbondedForceImpl::LongRangeCorrectionData(force);
+        hasInitializedLongRangeCorrection = false;
+    }
+}
+
+void CpuCalcCustomNonbondedForceKernel::copyParameterSubsetToContext(ContextImpl& context, const CustomNonbondedForce& force, const vector<int>& particles) {
+    if (numParticles != force.getNumParticles())
+        throw OpenMMException("updateParametersInContext: The number of particles has changed");
+
+    // Record the values.
+
+    int numParameters = force.getNumPerParticleParameters();
+    for (int i = 0; i < (int) particles.size(); ++i) {
+        vector<double> parameters;
+        force.getParticleParameters(particles[i], parameters);
+        for (int j = 0; j < numParameters; j++)
+            particleParamArray[particles[i]][j] = parameters[j];
+    }
+    
+    // If necessary, update the long range correction.
+    
+    if (longRangeCorrection != NULL) {
+        longRangeCorrection->updateParticles(force, particles);
+        hasInitializedLongRangeCorrection = false;
     }
 }
 
 CpuCalcGBSAOBCForceKernel::~CpuCalcGBSAOBCForceKernel() {
+    if (obc != NULL)
+        delete obc;
 }
 
+CpuGBSAOBCForce* createCpuGBSAOBCForceVec8();
+
 void CpuCalcGBSAOBCForceKernel::initialize(const System& system, const GBSAOBCForce& force) {
+    if (isVec8Supported())
+        obc = createCpuGBSAOBCForceVec8();
+    else
+        obc = new CpuGBSAOBCForce();
     int numParticles = system.getNumParticles();
     particleParams.resize(numParticles);
     for (int i = 0; i < numParticles; ++i) {
@@ -942,12 +1208,15 @@ void CpuCalcGBSAOBCForceKernel::initialize(const System& system, const GBSAOBCFo
         radius -= 0.009;
         particleParams[i] = make_pair((float) radius, (float) (scalingFactor*radius));
     }
-    obc.setParticleParameters(particleParams);
-    obc.setSolventDielectric((float) force.getSolventDielectric());
-    obc.setSoluteDielectric((float) force.getSoluteDielectric());
-    obc.setSurfaceAreaEnergy((float) force.getSurfaceAreaEnergy());
-    if (force.getNonbondedMethod() != GBSAOBCForce::NoCutoff)
-        obc.setUseCutoff((float) force.getCutoffDistance());
+    obc->setParticleParameters(particleParams);
+    obc->setSolventDielectric((float) force.getSolventDielectric());
+    obc->setSoluteDielectric((float) force.getSoluteDielectric());
+    obc->setSurfaceAreaEnergy((float) force.getSurfaceAreaEnergy());
+    if (force.getNonbondedMethod() != GBSAOBCForce::NoCutoff) {
+        double cutoff = force.getCutoffDistance();
+        data.requestNeighborList(cutoff, 0.25*cutoff, false, CpuExclusionList(numParticles));
+        obc->setUseCutoff((float) cutoff, *data.neighborList, data.exclusions);
+    }
     data.isPeriodic = (force.getNonbondedMethod() == GBSAOBCForce::CutoffPeriodic);
 }
 
@@ -955,16 +1224,16 @@ double CpuCalcGBSAOBCForceKernel::execute(ContextImpl& context, bool includeForc
     if (data.isPeriodic) {
         RealVec& boxSize = extractBoxSize(context);
         float floatBoxSize[3] = {(float) boxSize[0], (float) boxSize[1], (float) boxSize[2]};
-        obc.setPeriodic(floatBoxSize);
+        obc->setPeriodic(floatBoxSize);
     }
     double energy = 0.0;
-    obc.computeForce(data.posq, data.threadForce, includeEnergy ? &energy : NULL, data.threads);
+    obc->computeForce(data.posq, data.threadForce, includeEnergy ? &energy : NULL, data.getDeterministicThreads());
     return energy;
 }
 
 void CpuCalcGBSAOBCForceKernel::copyParametersToContext(ContextImpl& context, const GBSAOBCForce& force) {
     int numParticles = force.getNumParticles();
-    if (numParticles != obc.getParticleParameters().size())
+    if (numParticles != (int) obc->getParticleParameters().size())
         throw OpenMMException("updateParametersInContext: The number of particles has changed");
 
     // Record the values.
@@ -976,7 +1245,7 @@ void CpuCalcGBSAOBCForceKernel::copyParametersToContext(ContextImpl& context, co
         radius -= 0.009;
         particleParams[i] = make_pair((float) radius, (float) (scalingFactor*radius));
     }
-    obc.setParticleParameters(particleParams);
+    obc->setParticleParameters(particleParams);
 }
 
 CpuCalcCustomGBForceKernel::~CpuCalcCustomGBForceKernel() {
@@ -1006,13 +1275,10 @@ void CpuCalcCustomGBForceKernel::initialize(const System& system, const CustomGB
     // Record the exclusions.
 
     numParticles = force.getNumParticles();
-    exclusions.resize(numParticles);
-    for (int i = 0; i < force.getNumExclusions(); i++) {
-        int particle1, particle2;
-        force.getExclusionParticles(i, particle1, particle2);
-        exclusions[particle1].insert(particle2);
-        exclusions[particle2].insert(particle1);
-    }
+    vector<pair<int, int> > excludedPairs(force.getNumExclusions());
+    for (int i = 0; i < force.getNumExclusions(); i++)
+        force.getExclusionParticles(i, excludedPairs[i].first, excludedPairs[i].second);
+    exclusions = data.shared.getSharedExclusions(CpuExclusionList(numParticles, excludedPairs));
 
     // Build the arrays.
 
@@ -1043,11 +1309,10 @@ void CpuCalcCustomGBForceKernel::initialize(const System& system, const CustomGB
 
     // Parse the expressions for computed values.
 
-    vector<vector<Lepton::CompiledExpression> > valueDerivExpressions(force.getNumComputedValues());
-    vector<vector<Lepton::CompiledExpression> > valueGradientExpressions(force.getNumComputedValues());
-    vector<vector<Lepton::CompiledExpression> > valueParamDerivExpressions(force.getNumComputedValues());
-    vector<Lepton::CompiledExpression> valueExpressions;
-    vector<Lepton::CompiledExpression> energyExpressions;
+    vector<vector<Lepton::ParsedExpression> > valueExpressions(force.getNumComputedValues());
+    vector<vector<Lepton::ParsedExpression> > valueDerivExpressions(force.getNumComputedValues());
+    vector<vector<Lepton::ParsedExpression> > valueGradientExpressions(force.getNumComputedValues());
+    vector<vector<Lepton::ParsedExpression> > energyExpressions(force.getNumEnergyTerms());
     set<string> particleVariables, pairVariables;
     pairVariables.insert("r");
     particleVariables.insert("x");
@@ -1065,25 +1330,29 @@ void CpuCalcCustomGBForceKernel::initialize(const System& system, const CustomGB
         CustomGBForce::ComputationType type;
         force.getComputedValueParameters(i, name, expression, type);
         Lepton::ParsedExpression ex = Lepton::Parser::parse(expression, functions).optimize();
-        valueExpressions.push_back(ex.createCompiledExpression());
+        valueExpressions[i].push_back(ex);
         valueTypes.push_back(type);
         valueNames.push_back(name);
         if (i == 0) {
-            valueDerivExpressions[i].push_back(ex.differentiate("r").createCompiledExpression());
+            valueDerivExpressions[i].push_back(ex.differentiate("r").optimize());
             validateVariables(ex.getRootNode(), pairVariables);
         }
         else {
-            valueGradientExpressions[i].push_back(ex.differentiate("x").createCompiledExpression());
-            valueGradientExpressions[i].push_back(ex.differentiate("y").createCompiledExpression());
-            valueGradientExpressions[i].push_back(ex.differentiate("z").createCompiledExpression());
-            for (int j = 0; j < i; j++)
-                valueDerivExpressions[i].push_back(ex.differentiate(valueNames[j]).createCompiledExpression());
+            valueGradientExpressions[i].push_back(ex.differentiate("x").optimize());
+            valueGradientExpressions[i].push_back(ex.differentiate("y").optimize());
+            valueGradientExpressions[i].push_back(ex.differentiate("z").optimize());
+            for (int j = 0; j < i; j++) {
+                Lepton::ParsedExpression deriv = ex.differentiate(valueNames[j]).optimize();
+                valueDerivExpressions[i].push_back(deriv);
+                if (j > 0)
+                    valueGradientExpressions[i].push_back(deriv);
+            }
             validateVariables(ex.getRootNode(), particleVariables);
         }
         for (int j = 0; j < force.getNumEnergyParameterDerivatives(); j++) {
             string param = force.getEnergyParameterDerivativeName(j);
             energyParamDerivNames.push_back(param);
-            valueParamDerivExpressions[i].push_back(ex.differentiate(param).createCompiledExpression());
+            valueExpressions[i].push_back(ex.differentiate(param).optimize());
         }
         particleVariables.insert(name);
         pairVariables.insert(name+"1");
@@ -1092,43 +1361,39 @@ void CpuCalcCustomGBForceKernel::initialize(const System& system, const CustomGB
 
     // Parse the expressions for energy terms.
 
-    vector<vector<Lepton::CompiledExpression> > energyDerivExpressions(force.getNumEnergyTerms());
-    vector<vector<Lepton::CompiledExpression> > energyGradientExpressions(force.getNumEnergyTerms());
-    vector<vector<Lepton::CompiledExpression> > energyParamDerivExpressions(force.getNumEnergyTerms());
     for (int i = 0; i < force.getNumEnergyTerms(); i++) {
         string expression;
         CustomGBForce::ComputationType type;
         force.getEnergyTermParameters(i, expression, type);
         Lepton::ParsedExpression ex = Lepton::Parser::parse(expression, functions).optimize();
-        energyExpressions.push_back(ex.createCompiledExpression());
+        energyExpressions[i].push_back(ex);
         energyTypes.push_back(type);
-        if (type != CustomGBForce::SingleParticle)
-            energyDerivExpressions[i].push_back(ex.differentiate("r").createCompiledExpression());
-        for (int j = 0; j < force.getNumComputedValues(); j++) {
-            if (type == CustomGBForce::SingleParticle) {
-                energyDerivExpressions[i].push_back(ex.differentiate(valueNames[j]).createCompiledExpression());
-                energyGradientExpressions[i].push_back(ex.differentiate("x").createCompiledExpression());
-                energyGradientExpressions[i].push_back(ex.differentiate("y").createCompiledExpression());
-                energyGradientExpressions[i].push_back(ex.differentiate("z").createCompiledExpression());
-                validateVariables(ex.getRootNode(), particleVariables);
-            }
-            else {
-                energyDerivExpressions[i].push_back(ex.differentiate(valueNames[j]+"1").createCompiledExpression());
-                energyDerivExpressions[i].push_back(ex.differentiate(valueNames[j]+"2").createCompiledExpression());
-                validateVariables(ex.getRootNode(), pairVariables);
+        if (type == CustomGBForce::SingleParticle) {
+            for (int j = 0; j < force.getNumComputedValues(); j++)
+                energyExpressions[i].push_back(ex.differentiate(valueNames[j]).optimize());
+            energyExpressions[i].push_back(ex.differentiate("x").optimize());
+            energyExpressions[i].push_back(ex.differentiate("y").optimize());
+            energyExpressions[i].push_back(ex.differentiate("z").optimize());
+            validateVariables(ex.getRootNode(), particleVariables);
+        }
+        else {
+            energyExpressions[i].push_back(ex.differentiate("r").optimize());
+            for (int j = 0; j < force.getNumComputedValues(); j++) {
+                energyExpressions[i].push_back(ex.differentiate(valueNames[j]+"1").optimize());
+                energyExpressions[i].push_back(ex.differentiate(valueNames[j]+"2").optimize());
             }
+            validateVariables(ex.getRootNode(), pairVariables);
         }
         for (int j = 0; j < force.getNumEnergyParameterDerivatives(); j++)
-            energyParamDerivExpressions[i].push_back(ex.differentiate(force.getEnergyParameterDerivativeName(j)).createCompiledExpression());
+            energyExpressions[i].push_back(ex.differentiate(force.getEnergyParameterDerivativeName(j)).optimize());
     }
 
     // Delete the custom functions.
 
     for (map<string, Lepton::CustomFunction*>::iterator iter = functions.begin(); iter != functions.end(); iter++)
         delete iter->second;
-    ixn = new CpuCustomGBForce(numParticles, exclusions, valueExpressions, valueDerivExpressions, valueGradientExpressions, valueParamDerivExpressions,
-        valueNames, valueTypes, energyExpressions, energyDerivExpressions, energyGradientExpressions, energyParamDerivExpressions, energyTypes,
-        particleParameterNames, data.threads);
+    ixn = new CpuCustomGBForce(numParticles, exclusions, valueExpressions, valueDerivExpressions, valueGradientExpressions,
+        valueNames, valueTypes, energyExpressions, energyTypes, particleParameterNames, data.getDeterministicThreads());
     data.isPeriodic = (force.getNonbondedMethod() == CustomGBForce::CutoffPeriodic);
 }
 
@@ -1139,7 +1404,6 @@ double CpuCalcCustomGBForceKernel::execute(ContextImpl& context, bool includeFor
     if (data.isPeriodic)
         ixn->setPeriodic(extractBoxSize(context));
     if (nonbondedMethod != NoCutoff) {
-        vector<set<int> > noExclusions(numParticles);
         ixn->setUseCutoff(nonbondedCutoff, *data.neighborList);
     }
     map<string, double> globalParameters;
@@ -1197,7 +1461,7 @@ void CpuCalcCustomManyParticleForceKernel::initialize(const System& system, cons
     }
     for (int i = 0; i < force.getNumGlobalParameters(); i++)
         globalParameterNames.push_back(force.getGlobalParameterName(i));
-    ixn = new CpuCustomManyParticleForce(force, data.threads);
+    ixn = new CpuCustomManyParticleForce(force, data.getDeterministicThreads());
     nonbondedMethod = CalcCustomManyParticleForceKernel::NonbondedMethod(force.getNonbondedMethod());
     cutoffDistance = force.getCutoffDistance();
     data.isPeriodic = (nonbondedMethod == CutoffPeriodic);
@@ -1286,14 +1550,16 @@ void CpuIntegrateLangevinStepKernel::execute(ContextImpl& context, const Langevi
         if (dynamics)
             delete dynamics;
         RealOpenMM tau = (friction == 0.0 ? 0.0 : 1.0/friction);
-        dynamics = new CpuLangevinDynamics(context.getSystem().getNumParticles(), stepSize, tau, temperature, data.threads, data.random);
+        dynamics = new CpuLangevinDynamics(context.getSystem().getNumParticles(), stepSize, tau, temperature, data.threads, data.random, data.virtualSites);
         dynamics->setReferenceConstraintAlgorithm(&extractConstraints(context));
         prevTemp = temperature;
         prevFriction = friction;
         prevStepSize = stepSize;
     }
-    dynamics->update(context.getSystem(), posData, velData, forceData, masses, integrator.getConstraintTolerance());
     ReferencePlatform::PlatformData* refData = reinterpret_cast<ReferencePlatform::PlatformData*>(context.getPlatformData());
+    if (data.counterBasedRandom)
+        dynamics->setCounterRandomStep(refData->stepCount);
+    dynamics->update(context.getSystem(), posData, velData, forceData, masses, integrator.getConstraintTolerance());
     refData->time += stepSize;
     refData->stepCount++;
 }
@@ -25,6 +25,8 @@
 
 #include "SimTKOpenMMUtilities.h"
 #include "CpuLangevinDynamics.h"
+#include "ReferenceConstraints.h"
+#include "openmm/VirtualSite.h"
 
 using namespace OpenMM;
 using namespace std;
@@ -59,11 +61,158 @@ public:
     CpuLangevinDynamics& owner;
 };
 
-CpuLangevinDynamics::CpuLangevinDynamics(int numberOfAtoms, RealOpenMM deltaT, RealOpenMM tau, RealOpenMM temperature, ThreadPool& threads, CpuRandom& random) : 
-           ReferenceStochasticDynamics(numberOfAtoms, deltaT, tau, temperature), threads(threads), random(random) {
+class CpuLangevinDynamics::FusedUpdateTask : public ThreadPool::Task {
+public:
+    FusedUpdateTask(CpuLangevinDynamics& owner, vector<RealVec>& atomCoordinates, vector<RealVec>& velocities, vector<RealVec>& forces) :
+            owner(owner), atomCoordinates(atomCoordinates), velocities(velocities), forces(forces) {
+    }
+    void execute(ThreadPool& threads, int threadIndex) {
+        owner.threadFusedUpdate(threadIndex, atomCoordinates, velocities, forces);
+    }
+    CpuLangevinDynamics& owner;
+    vector<RealVec>& atomCoordinates;
+    vector<RealVec>& velocities;
+    vector<RealVec>& forces;
+};
+
+CpuLangevinDynamics::CpuLangevinDynamics(int numberOfAtoms, RealOpenMM deltaT, RealOpenMM tau, RealOpenMM temperature, ThreadPool& threads, CpuRandom& random,
+           CpuVirtualSites* virtualSites) : ReferenceStochasticDynamics(numberOfAtoms, deltaT, tau, temperature), threads(threads), random(random), virtualSites(virtualSites),
+           useCounterRandom(false), counterRandomStep(0), fusedInitialized(false), canFuse(false), fusedSettle(NULL), simdSettle(NULL) {
 }
 
 CpuLangevinDynamics::~CpuLangevinDynamics() {
+    if (fusedSettle != NULL)
+        delete fusedSettle;
+}
+
+void CpuLangevinDynamics::setCounterRandomStep(int step) {
+    useCounterRandom = true;
+    counterRandomStep = step;
+}
+
+RealVec CpuLangevinDynamics::getRandomNoise(int threadIndex, int atom) {
+    if (useCounterRandom) {
+        float values[4];
+        random.getCounterGaussianRandom(counterRandomStep, atom).store(values);
+        return RealVec(values[0], values[1], values[2]);
+    }
+    return RealVec(random.getGaussianRandom(threadIndex), random.getGaussianRandom(threadIndex), random.getGaussianRandom(threadIndex));
+}
+
+void CpuLangevinDynamics::update(const System& system, vector<RealVec>& atomCoordinates, vector<RealVec>& velocities,
+                                 vector<RealVec>& forces, vector<RealOpenMM>& masses, RealOpenMM tolerance) {
+    if (!fusedInitialized)
+        initializeFusedUpdate(system);
+    if (!canFuse) {
+        ReferenceStochasticDynamics::update(system, atomCoordinates, velocities, forces, masses, tolerance);
+        return;
+    }
+    if (getTimeStep() == 0) {
+        for (int i = 0; i < system.getNumParticles(); i++)
+            ReferenceStochasticDynamics::inverseMasses[i] = (masses[i] == 0.0 ? 0.0 : 1.0/masses[i]);
+    }
+    FusedUpdateTask task(*this, atomCoordinates, velocities, forces);
+    threads.execute(task);
+    threads.waitForThreads();
+    incrementTimeStep();
+}
+
+bool CpuLangevinDynamics::usesFusedUpdate() const {
+    return canFuse;
+}
+
+void CpuLangevinDynamics::initializeFusedUpdate(const System& system) {
+    fusedInitialized = true;
+    
+    // The fused update can only be used if there are no constraints other than SETTLE clusters.
+    
+    CpuSETTLE* settle = NULL;
+    ReferenceConstraintAlgorithm* constraintAlgorithm = getReferenceConstraintAlgorithm();
+    if (constraintAlgorithm != NULL) {
+        ReferenceConstraints* constraints = dynamic_cast<ReferenceConstraints*>(constraintAlgorithm);
+        if (constraints == NULL || constraints->ccma != NULL)
+            return;
+        if (constraints->settle != NULL) {
+            settle = dynamic_cast<CpuSETTLE*>(constraints->settle);
+            if (settle == NULL)
+                return;
+        }
+    }
+    
+    // In single precision, the CpuSETTLE can constrain any group of four clusters.  Otherwise, create a single
+    // SETTLE object containing all the clusters, so they can be constrained one at a time.  Either way, record
+    // the particles in each cluster or group.
+    
+    int numParticles = system.getNumParticles();
+    vector<int> particleCluster(numParticles, -1);
+    vector<vector<int> > clusterParticles;
+    if (settle != NULL) {
+        int numClusters = settle->getNumClusters();
+        vector<int> atom1(numClusters), atom2(numClusters), atom3(numClusters);
+        vector<RealOpenMM> distance1(numClusters), distance2(numClusters), masses(numParticles);
+        if (settle->getUseSinglePrecision()) {
+            simdSettle = settle;
+            clusterParticles.resize((numClusters+3)/4);
+        }
+        else
+            clusterParticles.resize(numClusters);
+        for (int i = 0; i < numClusters; i++) {
+            settle->getClusterParameters(i, atom1[i], atom2[i], atom3[i], distance1[i], distance2[i]);
+            int cluster = (simdSettle == NULL ? i : i/4);
+            particleCluster[atom1[i]] = particleCluster[atom2[i]] = particleCluster[atom3[i]] = cluster;
+            clusterParticles[cluster].push_back(atom1[i]);
+            clusterParticles[cluster].push_back(atom2[i]);
+            clusterParticles[cluster].push_back(atom3[i]);
+        }
+        if (simdSettle == NULL) {
+            for (int i = 0; i < numParticles; i++)
+                masses[i] = system.getParticleMass(i);
+            fusedSettle = new ReferenceSETTLEAlgorithm(atom1, atom2, atom3, distance1, distance2, masses);
+        }
+    }
+    
+    // Divide the particles into molecules, keeping them in their original order.
+    
+    vector<int> particleMolecule(numParticles, -1);
+    vector<vector<int> > particles;
+    for (int i = 0; i < numParticles; i++) {
+        if (system.isVirtualSite(i) || particleMolecule[i] != -1)
+            continue;
+        int cluster = particleCluster[i];
+        moleculeCluster.push_back(cluster);
+        particles.push_back(vector<int>());
+        if (cluster == -1)
+            particles.back().push_back(i);
+        else
+            particles.back() = clusterParticles[cluster];
+        for (int j = 0; j < (int) particles.back().size(); j++)
+            particleMolecule[particles.back()[j]] = particles.size()-1;
+    }
+    
+    // Assign each virtual site to the molecule containing the particles it is computed from.
+    
+    vector<vector<int> > sites(particles.size());
+    for (int i = 0; i < numParticles; i++) {
+        if (!system.isVirtualSite(i))
+            continue;
+        if (virtualSites == NULL)
+            return;
+        const VirtualSite& site = system.getVirtualSite(i);
+        int molecule = particleMolecule[site.getParticle(0)];
+        for (int j = 1; j < site.getNumParticles(); j++)
+            if (particleMolecule[site.getParticle(j)] != molecule)
+                return;
+        sites[molecule].push_back(i);
+    }
+    for (int i = 0; i < (int) particles.size(); i++) {
+        moleculeStart.push_back(moleculeParticles.size());
+        moleculeParticles.insert(moleculeParticles.end(), particles[i].begin(), particles[i].end());
+        moleculeSiteStart.push_back(moleculeSites.size());
+        moleculeSites.insert(moleculeSites.end(), sites[i].begin(), sites[i].end());
+    }
+    moleculeStart.push_back(moleculeParticles.size());
+    moleculeSiteStart.push_back(moleculeSites.size());
+    canFuse = true;
 }
 
 void CpuLangevinDynamics::updatePart1(int numberOfAtoms, vector<RealVec>& atomCoordinates, vector<RealVec>& velocities,
@@ -119,6 +268,11 @@ void CpuLangevinDynamics::updatePart3(int numberOfAtoms, vector<RealVec>& atomCo
     threads.waitForThreads();
 }
 
+void CpuLangevinDynamics::computeVirtualSites(const System& system, vector<RealVec>& atomCoordinates) {
+    if (virtualSites != NULL)
+        virtualSites->computePositions(atomCoordinates);
+}
+
 void CpuLangevinDynamics::threadUpdate1(int threadIndex) {
     const RealOpenMM tau = getTau();
     const RealOpenMM vscale = EXP(-getDeltaT()/tau);
@@ -131,7 +285,7 @@ void CpuLangevinDynamics::threadUpdate1(int threadIndex) {
     for (int i = start; i < end; i++) {
         if (inverseMasses[i] != 0.0) {
             RealOpenMM sqrtInvMass = SQRT(inverseMasses[i]);
-            RealVec noise(random.getGaussianRandom(threadIndex), random.getGaussianRandom(threadIndex), random.getGaussianRandom(threadIndex));
+            RealVec noise = getRandomNoise(threadIndex, i);
             velocities[i]  = velocities[i]*vscale + forces[i]*(fscale*inverseMasses[i]) + noise*(noisescale*sqrtInvMass);
         }
    }
@@ -162,3 +316,52 @@ void CpuLangevinDynamics::threadUpdate3(int threadIndex) {
        }
 }
 
+void CpuLangevinDynamics::threadFusedUpdate(int threadIndex, vector<RealVec>& atomCoordinates, vector<RealVec>& velocities, vector<RealVec>& forces) {
+    const RealOpenMM dt = getDeltaT();
+    const RealOpenMM invStepSize = 1.0/dt;
+    const RealOpenMM tau = getTau();
+    const RealOpenMM vscale = EXP(-dt/tau);
+    const RealOpenMM fscale = (1-vscale)*tau;
+    const RealOpenMM kT = BOLTZ*getTemperature();
+    const RealOpenMM noisescale = SQRT(2*kT/tau)*SQRT(0.5*(1-vscale*vscale)*tau);
+    vector<RealOpenMM>& invMass = ReferenceStochasticDynamics::inverseMasses;
+    vector<RealVec>& xp = ReferenceStochasticDynamics::xPrime;
+    int numMolecules = moleculeCluster.size();
+    int start = threadIndex*numMolecules/threads.getNumThreads();
+    int end = (threadIndex+1)*numMolecules/threads.getNumThreads();
+
+    for (int molecule = start; molecule < end; molecule++) {
+        // Update the velocities and compute the unconstrained positions.
+
+        for (int j = moleculeStart[molecule]; j < moleculeStart[molecule+1]; j++) {
+            int i = moleculeParticles[j];
+            if (invMass[i] != 0.0) {
+                RealOpenMM sqrtInvMass = SQRT(invMass[i]);
+                RealVec noise = getRandomNoise(threadIndex, i);
+                velocities[i] = velocities[i]*vscale + forces[i]*(fscale*invMass[i]) + noise*(noisescale*sqrtInvMass);
+                xp[i] = atomCoordinates[i]+velocities[i]*dt;
+            }
+        }
+
+        // Apply constraints, then record the new positions and velocities.
+
+        if (moleculeCluster[molecule] != -1) {
+            if (simdSettle != NULL)
+                simdSettle->applyToGroup(4*moleculeCluster[molecule], atomCoordinates, xp);
+            else
+                fusedSettle->applyToCluster(moleculeCluster[molecule], atomCoordinates, xp);
+        }
+        for (int j = moleculeStart[molecule]; j < moleculeStart[molecule+1]; j++) {
+            int i = moleculeParticles[j];
+            if (invMass[i] != 0.0) {
+                velocities[i] = (xp[i]-atomCoordinates[i])*invStepSize;
+                atomCoordinates[i] = xp[i];
+            }
+        }
+
+        // Place the virtual sites.
+
+        for (int j = moleculeSiteStart[molecule]; j < moleculeSiteStart[molecule+1]; j++)
+            virtualSites->computePosition(moleculeSites[j], atomCoordinates);
+    }
+}
@@ -26,6 +26,7 @@
 
 #include "SimTKOpenMMUtilities.h"
 #include "CpuNonbondedForce.h"
+#include "CpuPlatform.h"
 #include "ReferenceForce.h"
 #include "ReferencePME.h"
 #include "openmm/internal/gmx_atomic.h"
@@ -41,6 +42,25 @@ using namespace OpenMM;
 const float CpuNonbondedForce::TWO_OVER_SQRT_PI = (float) (2/sqrt(PI_M));
 const int CpuNonbondedForce::NUM_TABLE_POINTS = 2048;
 
+/**
+ * Convert a force to fixed point and add it to a fixed point force array.
+ */
+static inline void addFixedPointForce(const fvec4& force, long long* fixedForce) {
+    const double scale = CpuPlatform::SharedData::FixedPointScale;
+    fixedForce[0] += (long long) (force[0]*scale);
+    fixedForce[1] += (long long) (force[1]*scale);
+    fixedForce[2] += (long long) (force[2]*scale);
+}
+
+/**
+ * Add a force to a double precision force array.
+ */
+static inline void addDoubleForce(const fvec4& force, double* doubleForce) {
+    doubleForce[0] += force[0];
+    doubleForce[1] += force[1];
+    doubleForce[2] += force[2];
+}
+
 class CpuNonbondedForce::ComputeDirectTask : public ThreadPool::Task {
 public:
     ComputeDirectTask(CpuNonbondedForce& owner) : owner(owner) {
@@ -57,7 +77,8 @@ public:
 
    --------------------------------------------------------------------------------------- */
 
-CpuNonbondedForce::CpuNonbondedForce() : cutoff(false), useSwitch(false), periodic(false), ewald(false), pme(false), tableIsValid(false), cutoffDistance(0.0f), alphaEwald(0.0f) {
+CpuNonbondedForce::CpuNonbondedForce() : cutoff(false), useSwitch(false), periodic(false), ewald(false), pme(false), tableIsValid(false), cutoffDistance(0.0f), alphaEwald(0.0f),
+        sortedPosq(NULL), sortedParametersBuild(-1), threadFixedForce(NULL), threadDoubleForce(NULL) {
 }
 
 CpuNonbondedForce::~CpuNonbondedForce() {
@@ -171,6 +192,105 @@ void CpuNonbondedForce::setUseSwitchingFunction(float distance) {
   }
 
   
+void CpuNonbondedForce::setSortedPosq(float* sortedPosq) {
+    this->sortedPosq = sortedPosq;
+}
+
+void CpuNonbondedForce::invalidateSortedParameters() {
+    sortedParametersBuild = -1;
+}
+
+void CpuNonbondedForce::setFixedPointForces(vector<vector<long long> >* threadFixedForce) {
+    this->threadFixedForce = threadFixedForce;
+}
+
+void CpuNonbondedForce::setDoubleForces(vector<vector<double> >* threadDoubleForce) {
+    this->threadDoubleForce = threadDoubleForce;
+}
+
+const vector<int>& CpuNonbondedForce::getBlockAtomOrder() const {
+    if (sortedPosq != NULL)
+        return sortedOrder;
+    return neighborList->getSortedAtoms();
+}
+
+const vector<int>& CpuNonbondedForce::getBlockNeighbors(int blockIndex) const {
+    if (sortedPosq != NULL)
+        return neighborList->getBlockSortedNeighbors(blockIndex);
+    return neighborList->getBlockNeighbors(blockIndex);
+}
+
+void CpuNonbondedForce::recordBlockAtoms(int blockIndex, int threadIndex) {
+    vector<int>& touched = threadTouchedAtoms[threadIndex];
+    vector<char>& isTouched = threadAtomIsTouched[threadIndex];
+    const int blockSize = neighborList->getBlockSize();
+    const int* blockAtom = &getBlockAtomOrder()[blockSize*blockIndex];
+    const vector<int>& neighbors = getBlockNeighbors(blockIndex);
+    int numNeighbors = neighbors.size();
+    for (int i = -blockSize; i < numNeighbors; i++) {
+        int index = (i < 0 ? blockAtom[blockSize+i] : neighbors[i]);
+        if (!isTouched[index]) {
+            isTouched[index] = 1;
+            touched.push_back(index);
+        }
+    }
+}
+
+void CpuNonbondedForce::addSortedForces(int threadIndex, float* sortedForces, float* forces) {
+    const vector<int>& sortedAtoms = neighborList->getSortedAtoms();
+    vector<int>& touched = threadTouchedAtoms[threadIndex];
+    vector<char>& isTouched = threadAtomIsTouched[threadIndex];
+    const fvec4 zero(0.0f);
+    for (int i = 0; i < (int) touched.size(); i++) {
+        int index = touched[i];
+        float* f = forces+4*sortedAtoms[index];
+        (fvec4(f)+fvec4(sortedForces+4*index)).store(f);
+        zero.store(sortedForces+4*index);
+        isTouched[index] = 0;
+    }
+    touched.clear();
+}
+
+void CpuNonbondedForce::addBlockFixedPointForces(int blockIndex, float* blockForces, long long* fixedForces) const {
+    // The block kernels only modify the forces on the block's own atoms and its neighbors.  Entries
+    // may appear more than once (padding atoms, or block atoms that are also listed as neighbors),
+    // but each one is zeroed after it is converted, so it only gets added once.
+
+    const bool useSortedOrder = (posq != originalPosq);
+    const vector<int>& sortedAtoms = neighborList->getSortedAtoms();
+    const int blockSize = neighborList->getBlockSize();
+    const int* blockAtom = &getBlockAtomOrder()[blockSize*blockIndex];
+    const vector<int>& neighbors = getBlockNeighbors(blockIndex);
+    const fvec4 zero(0.0f);
+    int numNeighbors = neighbors.size();
+    for (int i = -blockSize; i < numNeighbors; i++) {
+        int index = (i < 0 ? blockAtom[blockSize+i] : neighbors[i]);
+        float* f = blockForces+4*index;
+        int atom = (useSortedOrder ? sortedAtoms[index] : index);
+        addFixedPointForce(fvec4(f), fixedForces+3*atom);
+        zero.store(f);
+    }
+}
+
+void CpuNonbondedForce::addBlockDoubleForces(int blockIndex, float* blockForces, double* doubleForces) const {
+    // This visits the same entries as addBlockFixedPointForces().
+
+    const bool useSortedOrder = (posq != originalPosq);
+    const vector<int>& sortedAtoms = neighborList->getSortedAtoms();
+    const int blockSize = neighborList->getBlockSize();
+    const int* blockAtom = &getBlockAtomOrder()[blockSize*blockIndex];
+    const vector<int>& neighbors = getBlockNeighbors(blockIndex);
+    const fvec4 zero(0.0f);
+    int numNeighbors = neighbors.size();
+    for (int i = -blockSize; i < numNeighbors; i++) {
+        int index = (i < 0 ? blockAtom[blockSize+i] : neighbors[i]);
+        float* f = blockForces+4*index;
+        int atom = (useSortedOrder ? sortedAtoms[index] : index);
+        addDoubleForce(fvec4(f), doubleForces+3*atom);
+        zero.store(f);
+    }
+}
+
   void CpuNonbondedForce::tabulateEwaldScaleFactor() {
     if (tableIsValid)
         return;
@@ -189,7 +309,7 @@ void CpuNonbondedForce::setUseSwitchingFunction(float distance) {
 }
   
 void CpuNonbondedForce::calculateReciprocalIxn(int numberOfAtoms, float* posq, const vector<RealVec>& atomCoordinates,
-                                             const vector<pair<float, float> >& atomParameters, const vector<set<int> >& exclusions,
+                                             const vector<pair<float, float> >& atomParameters, const CpuExclusionList& exclusions,
                                              vector<RealVec>& forces, double* totalEnergy) const {
     typedef std::complex<float> d_complex;
 
@@ -301,14 +421,67 @@ void CpuNonbondedForce::calculateReciprocalIxn(int numberOfAtoms, float* posq, c
 
 
 void CpuNonbondedForce::calculateDirectIxn(int numberOfAtoms, float* posq, const vector<RealVec>& atomCoordinates, const vector<pair<float, float> >& atomParameters,
-                const vector<set<int> >& exclusions, vector<AlignedArray<float> >& threadForce, double* totalEnergy, ThreadPool& threads) {
+                const CpuExclusionList& exclusions, vector<AlignedArray<float> >& threadForce, double* totalEnergy, ThreadPool& threads,
+                ThreadPool::Task* masterTask, int numActiveThreads) {
     // Record the parameters for the threads.
     
     this->numberOfAtoms = numberOfAtoms;
+    activeThreads = (numActiveThreads > 0 ? numActiveThreads : threads.getNumThreads());
     this->posq = posq;
+    this->originalPosq = posq;
     this->atomCoordinates = &atomCoordinates[0];
     this->atomParameters = &atomParameters[0];
-    this->exclusions = &exclusions[0];
+    if (sortedPosq != NULL && cutoff) {
+        // The block kernels work on particle data stored in the neighbor list's sorted order.
+        // Reorder the parameters only when the order has changed.
+
+        const vector<int>& sortedAtoms = neighborList->getSortedAtoms();
+        int numSorted = sortedAtoms.size();
+        if (neighborList->getBuildCount() != sortedParametersBuild || (int) sortedParameters.size() != numSorted) {
+            sortedParameters.resize(numSorted);
+            for (int i = 0; i < numSorted; i++)
+                sortedParameters[i] = atomParameters[sortedAtoms[i]];
+            sortedParametersBuild = neighborList->getBuildCount();
+        }
+        if ((int) sortedOrder.size() != numSorted) {
+            sortedOrder.resize(numSorted);
+            for (int i = 0; i < numSorted; i++)
+                sortedOrder[i] = i;
+        }
+        // The scratch buffers are only cleared when they are allocated.  After that, every entry a
+        // thread modifies gets reset to zero when its forces are copied out.
+
+        threadBlockForce.resize(threads.getNumThreads());
+        threadTouchedAtoms.resize(threads.getNumThreads());
+        threadAtomIsTouched.resize(threads.getNumThreads());
+        for (int i = 0; i < (int) threadBlockForce.size(); i++) {
+            if (threadBlockForce[i].size() != 4*numSorted) {
+                threadBlockForce[i].resize(4*numSorted);
+                fill(&threadBlockForce[i][0], &threadBlockForce[i][0]+4*numSorted, 0.0f);
+            }
+            threadAtomIsTouched[i].resize(numSorted, 0);
+        }
+        this->posq = sortedPosq;
+        this->atomParameters = &sortedParameters[0];
+    }
+    else if (threadFixedForce != NULL || threadDoubleForce != NULL) {
+        // Each unit of work is computed into a scratch buffer before adding it to the fixed point
+        // or double precision forces.
+
+        threadBlockForce.resize(threads.getNumThreads());
+        for (int i = 0; i < (int) threadBlockForce.size(); i++)
+            if (threadBlockForce[i].size() != 4*numberOfAtoms) {
+                threadBlockForce[i].resize(4*numberOfAtoms);
+                fill(&threadBlockForce[i][0], &threadBlockForce[i][0]+4*numberOfAtoms, 0.0f);
+            }
+    }
+    if (threadFixedForce != NULL) {
+        unitEnergy.resize(cutoff ? neighborList->getNumBlocks() : numberOfAtoms);
+        exclusionEnergy.resize(numberOfAtoms);
+        fill(unitEnergy.begin(), unitEnergy.end(), 0.0);
+        fill(exclusionEnergy.begin(), exclusionEnergy.end(), 0.0);
+    }
+    this->exclusions = &exclusions;
     this->threadForce = &threadForce;
     includeEnergy = (totalEnergy != NULL);
     threadEnergy.resize(threads.getNumThreads());
@@ -320,6 +493,8 @@ void CpuNonbondedForce::calculateDirectIxn(int numberOfAtoms, float* posq, const
     
     ComputeDirectTask task(*this);
     threads.execute(task);
+    if (masterTask != NULL)
+        masterTask->execute(threads, -1);
     threads.waitForThreads();
     
     // Signal the threads to subtract the exclusions.
@@ -337,65 +512,103 @@ void CpuNonbondedForce::calculateDirectIxn(int numberOfAtoms, float* posq, const
         int numThreads = threads.getNumThreads();
         for (int i = 0; i < numThreads; i++)
             directEnergy += threadEnergy[i];
+        if (threadFixedForce != NULL) {
+            // Sum the energy of each unit of work in a fixed order.
+
+            for (int i = 0; i < (int) unitEnergy.size(); i++)
+                directEnergy += unitEnergy[i];
+            for (int i = 0; i < (int) exclusionEnergy.size(); i++)
+                directEnergy += exclusionEnergy[i];
+        }
         *totalEnergy += directEnergy;
     }
 }
 
 void CpuNonbondedForce::threadComputeDirect(ThreadPool& threads, int threadIndex) {
-    // Compute this thread's subset of interactions.
+    // Compute this thread's subset of interactions.  Inactive threads still take part in the
+    // synchronization, but do not take any work.
 
-    int numThreads = threads.getNumThreads();
+    bool isActive = (threadIndex < activeThreads);
     threadEnergy[threadIndex] = 0;
     double* energyPtr = (includeEnergy ? &threadEnergy[threadIndex] : NULL);
     float* forces = &(*threadForce)[threadIndex][0];
+    float* blockForces = forces;
+    bool useSortedOrder = (posq != originalPosq);
+    bool deterministic = (threadFixedForce != NULL);
+    long long* fixedForces = (deterministic ? &(*threadFixedForce)[threadIndex][0] : NULL);
+    bool useDouble = (!deterministic && threadDoubleForce != NULL);
+    double* doubleForces = (useDouble ? &(*threadDoubleForce)[threadIndex][0] : NULL);
+    if (useSortedOrder || deterministic || useDouble)
+        blockForces = &threadBlockForce[threadIndex][0];
     fvec4 boxSize(periodicBoxVectors[0][0], periodicBoxVectors[1][1], periodicBoxVectors[2][2], 0);
     fvec4 invBoxSize(recipBoxSize[0], recipBoxSize[1], recipBoxSize[2], 0);
     if (ewald || pme) {
         // Compute the interactions from the neighbor list.
 
-        while (true) {
+        while (isActive) {
             int nextBlock = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 1);
             if (nextBlock >= neighborList->getNumBlocks())
                 break;
-            calculateBlockEwaldIxn(nextBlock, forces, energyPtr, boxSize, invBoxSize);
+            if (deterministic) {
+                calculateBlockEwaldIxn(nextBlock, blockForces, includeEnergy ? &unitEnergy[nextBlock] : NULL, boxSize, invBoxSize);
+                addBlockFixedPointForces(nextBlock, blockForces, fixedForces);
+            }
+            else {
+                calculateBlockEwaldIxn(nextBlock, blockForces, energyPtr, boxSize, invBoxSize);
+                if (useDouble)
+                    addBlockDoubleForces(nextBlock, blockForces, doubleForces);
+                else if (useSortedOrder)
+                    recordBlockAtoms(nextBlock, threadIndex);
+            }
         }
+        if (useSortedOrder && !deterministic && !useDouble)
+            addSortedForces(threadIndex, blockForces, forces);
 
         // Now subtract off the exclusions, since they were implicitly included in the reciprocal space sum.
 
         threads.syncThreads();
-        const int groupSize = max(1, numberOfAtoms/(10*numThreads));
-        while (true) {
+        const int groupSize = max(1, numberOfAtoms/(10*activeThreads));
+        while (isActive) {
             int start = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), groupSize);
             if (start >= numberOfAtoms)
                 break;
             int end = min(start+groupSize, numberOfAtoms);
             for (int i = start; i < end; i++) {
                fvec4 posI((float) atomCoordinates[i][0], (float) atomCoordinates[i][1], (float) atomCoordinates[i][2], 0.0f);
-                float scaledChargeI = (float) (ONE_4PI_EPS0*posq[4*i+3]);
-                for (set<int>::const_iterator iter = exclusions[i].begin(); iter != exclusions[i].end(); ++iter) {
-                    if (*iter > i) {
-                        int j = *iter;
-                        fvec4 deltaR;
-                        fvec4 posJ((float) atomCoordinates[j][0], (float) atomCoordinates[j][1], (float) atomCoordinates[j][2], 0.0f);
-                        float r2;
-                        getDeltaR(posJ, posI, deltaR, r2, false, boxSize, invBoxSize);
-                        float r = sqrtf(r2);
-                        float alphaR = alphaEwald*r;
-                        float erfAlphaR = erf(alphaR);
-                        if (erfAlphaR > 1e-6f) {
-                            float inverseR = 1/r;
-                            float chargeProdOverR = scaledChargeI*posq[4*j+3]*inverseR;
-                            float dEdR = chargeProdOverR*inverseR*inverseR;
-                            dEdR = dEdR * (erfAlphaR-TWO_OVER_SQRT_PI*alphaR*(float)exp(-alphaR*alphaR));
-                            fvec4 result = deltaR*dEdR;
+                float scaledChargeI = (float) (ONE_4PI_EPS0*originalPosq[4*i+3]);
+                double& energy = (deterministic ? exclusionEnergy[i] : threadEnergy[threadIndex]);
+                for (const int* iter = upper_bound(exclusions->begin(i), exclusions->end(i), i); iter != exclusions->end(i); ++iter) {
+                    int j = *iter;
+                    fvec4 deltaR;
+                    fvec4 posJ((float) atomCoordinates[j][0], (float) atomCoordinates[j][1], (float) atomCoordinates[j][2], 0.0f);
+                    float r2;
+                    getDeltaR(posJ, posI, deltaR, r2, false, boxSize, invBoxSize);
+                    float r = sqrtf(r2);
+                    float alphaR = alphaEwald*r;
+                    float erfAlphaR = erf(alphaR);
+                    if (erfAlphaR > 1e-6f) {
+                        float inverseR = 1/r;
+                        float chargeProdOverR = scaledChargeI*originalPosq[4*j+3]*inverseR;
+                        float dEdR = chargeProdOverR*inverseR*inverseR;
+                        dEdR = dEdR * (erfAlphaR-TWO_OVER_SQRT_PI*alphaR*(float)exp(-alphaR*alphaR));
+                        fvec4 result = deltaR*dEdR;
+                        if (deterministic) {
+                            addFixedPointForce(-result, fixedForces+3*i);
+                            addFixedPointForce(result, fixedForces+3*j);
+                        }
+                        else if (useDouble) {
+                            addDoubleForce(-result, doubleForces+3*i);
+                            addDoubleForce(result, doubleForces+3*j);
+                        }
+                        else {
                             (fvec4(forces+4*i)-result).store(forces+4*i);
                             (fvec4(forces+4*j)+result).store(forces+4*j);
-                            if (includeEnergy)
-                                threadEnergy[threadIndex] -= chargeProdOverR*erfAlphaR;
                         }
-                        else if (includeEnergy)
-                           threadEnergy[threadIndex] -= alphaEwald*TWO_OVER_SQRT_PI*scaledChargeI*posq[4*j+3];
+                        if (includeEnergy)
+                            energy -= chargeProdOverR*erfAlphaR;
                     }
+                    else if (includeEnergy)
+                       energy -= alphaEwald*TWO_OVER_SQRT_PI*scaledChargeI*originalPosq[4*j+3];
                 }
             }
         }
@@ -403,23 +616,53 @@ void CpuNonbondedForce::threadComputeDirect(ThreadPool& threads, int threadIndex
     else if (cutoff) {
         // Compute the interactions from the neighbor list.
 
-        while (true) {
+        while (isActive) {
             int nextBlock = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 1);
             if (nextBlock >= neighborList->getNumBlocks())
                 break;
-            calculateBlockIxn(nextBlock, forces, energyPtr, boxSize, invBoxSize);
+            if (deterministic) {
+                calculateBlockIxn(nextBlock, blockForces, includeEnergy ? &unitEnergy[nextBlock] : NULL, boxSize, invBoxSize);
+                addBlockFixedPointForces(nextBlock, blockForces, fixedForces);
+            }
+            else {
+                calculateBlockIxn(nextBlock, blockForces, energyPtr, boxSize, invBoxSize);
+                if (useDouble)
+                    addBlockDoubleForces(nextBlock, blockForces, doubleForces);
+                else if (useSortedOrder)
+                    recordBlockAtoms(nextBlock, threadIndex);
+            }
         }
+        if (useSortedOrder && !deterministic && !useDouble)
+            addSortedForces(threadIndex, blockForces, forces);
     }
     else {
         // Loop over all atom pairs
 
-        while (true) {
+        while (isActive) {
             int i = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 1);
             if (i >= numberOfAtoms)
                 break;
-            for (int j = i+1; j < numberOfAtoms; j++)
-                if (exclusions[j].find(i) == exclusions[j].end())
-                    calculateOneIxn(i, j, forces, energyPtr, boxSize, invBoxSize);
+            if (deterministic || useDouble) {
+                // Compute the row into the scratch buffer, then add every atom it touched.
+
+                double* rowEnergy = (deterministic ? (includeEnergy ? &unitEnergy[i] : NULL) : energyPtr);
+                for (int j = i+1; j < numberOfAtoms; j++)
+                    if (!exclusions->isExcluded(j, i))
+                        calculateOneIxn(i, j, blockForces, rowEnergy, boxSize, invBoxSize);
+                const fvec4 zero(0.0f);
+                for (int j = i; j < numberOfAtoms; j++) {
+                    if (deterministic)
+                        addFixedPointForce(fvec4(blockForces+4*j), fixedForces+3*j);
+                    else
+                        addDoubleForce(fvec4(blockForces+4*j), doubleForces+3*j);
+                    zero.store(blockForces+4*j);
+                }
+            }
+            else {
+                for (int j = i+1; j < numberOfAtoms; j++)
+                    if (!exclusions->isExcluded(j, i))
+                        calculateOneIxn(i, j, forces, energyPtr, boxSize, invBoxSize);
+            }
         }
     }
 }
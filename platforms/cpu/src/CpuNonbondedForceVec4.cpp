@@ -57,7 +57,7 @@ void CpuNonbondedForceVec4::calculateBlockIxn(int blockIndex, float* forces, dou
         blockCenter = 0.0f;
     }
     else {
-        const int* blockAtom = &neighborList->getSortedAtoms()[4*blockIndex];
+        const int* blockAtom = &getBlockAtomOrder()[4*blockIndex];
         float minx, maxx, miny, maxy, minz, maxz;
         minx = maxx = posq[4*blockAtom[0]];
         miny = maxy = posq[4*blockAtom[0]+1];
@@ -100,7 +100,7 @@ template <int PERIODIC_TYPE>
 void CpuNonbondedForceVec4::calculateBlockIxnImpl(int blockIndex, float* forces, double* totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize, const fvec4& blockCenter) {
     // Load the positions and parameters of the atoms in the block.
     
-    const int* blockAtom = &neighborList->getSortedAtoms()[4*blockIndex];
+    const int* blockAtom = &getBlockAtomOrder()[4*blockIndex];
     fvec4 blockAtomPosq[4];
     fvec4 blockAtomForceX(0.0f), blockAtomForceY(0.0f), blockAtomForceZ(0.0f);
     for (int i = 0; i < 4; i++) {
@@ -119,8 +119,8 @@ void CpuNonbondedForceVec4::calculateBlockIxnImpl(int blockIndex, float* forces,
     
     // Loop over neighbors for this block.
     
-    const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
-    const vector<char>& exclusions = neighborList->getBlockExclusions(blockIndex);
+    const vector<int>& neighbors = getBlockNeighbors(blockIndex);
+    const vector<short>& exclusions = neighborList->getBlockExclusions(blockIndex);
     for (int i = 0; i < (int) neighbors.size(); i++) {
         // Load the next neighbor.
         
@@ -134,7 +134,7 @@ void CpuNonbondedForceVec4::calculateBlockIxnImpl(int blockIndex, float* forces,
             atomPos -= floor((atomPos-blockCenter)*invBoxSize+0.5f)*boxSize;
         getDeltaR<PERIODIC_TYPE>(atomPos, blockAtomX, blockAtomY, blockAtomZ, dx, dy, dz, r2, needPeriodic, boxSize, invBoxSize);
         ivec4 include;
-        char excl = exclusions[i];
+        short excl = exclusions[i];
         if (excl == 0)
             include = -1;
         else
@@ -221,7 +221,7 @@ void CpuNonbondedForceVec4::calculateBlockEwaldIxn(int blockIndex, float* forces
         blockCenter = 0.0f;
     }
     else {
-        const int* blockAtom = &neighborList->getSortedAtoms()[4*blockIndex];
+        const int* blockAtom = &getBlockAtomOrder()[4*blockIndex];
         float minx, maxx, miny, maxy, minz, maxz;
         minx = maxx = posq[4*blockAtom[0]];
         miny = maxy = posq[4*blockAtom[0]+1];
@@ -264,7 +264,7 @@ template <int PERIODIC_TYPE>
 void CpuNonbondedForceVec4::calculateBlockEwaldIxnImpl(int blockIndex, float* forces, double* totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize, const fvec4& blockCenter) {
     // Load the positions and parameters of the atoms in the block.
     
-    const int* blockAtom = &neighborList->getSortedAtoms()[4*blockIndex];
+    const int* blockAtom = &getBlockAtomOrder()[4*blockIndex];
     fvec4 blockAtomPosq[4];
     fvec4 blockAtomForceX(0.0f), blockAtomForceY(0.0f), blockAtomForceZ(0.0f);
     for (int i = 0; i < 4; i++) {
@@ -283,8 +283,8 @@ void CpuNonbondedForceVec4::calculateBlockEwaldIxnImpl(int blockIndex, float* fo
     
     // Loop over neighbors for this block.
     
-    const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
-    const vector<char>& exclusions = neighborList->getBlockExclusions(blockIndex);
+    const vector<int>& neighbors = getBlockNeighbors(blockIndex);
+    const vector<short>& exclusions = neighborList->getBlockExclusions(blockIndex);
     for (int i = 0; i < (int) neighbors.size(); i++) {
         // Load the next neighbor.
         
@@ -298,7 +298,7 @@ void CpuNonbondedForceVec4::calculateBlockEwaldIxnImpl(int blockIndex, float* fo
             atomPos -= floor((atomPos-blockCenter)*invBoxSize+0.5f)*boxSize;
         getDeltaR<PERIODIC_TYPE>(atomPos, blockAtomX, blockAtomY, blockAtomZ, dx, dy, dz, r2, needPeriodic, boxSize, invBoxSize);
         ivec4 include;
-        char excl = exclusions[i];
+        short excl = exclusions[i];
         if (excl == 0)
             include = -1;
         else
@@ -89,7 +89,7 @@ void CpuNonbondedForceVec8::calculateBlockIxn(int blockIndex, float* forces, dou
         blockCenter = 0.0f;
     }
     else {
-        const int* blockAtom = &neighborList->getSortedAtoms()[8*blockIndex];
+        const int* blockAtom = &getBlockAtomOrder()[8*blockIndex];
         float minx, maxx, miny, maxy, minz, maxz;
         minx = maxx = posq[4*blockAtom[0]];
         miny = maxy = posq[4*blockAtom[0]+1];
@@ -132,7 +132,7 @@ template <int PERIODIC_TYPE>
 void CpuNonbondedForceVec8::calculateBlockIxnImpl(int blockIndex, float* forces, double* totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize, const fvec4& blockCenter) {
     // Load the positions and parameters of the atoms in the block.
     
-    const int* blockAtom = &neighborList->getSortedAtoms()[8*blockIndex];
+    const int* blockAtom = &getBlockAtomOrder()[8*blockIndex];
     fvec4 blockAtomPosq[8];
     fvec8 blockAtomForceX(0.0f), blockAtomForceY(0.0f), blockAtomForceZ(0.0f);
     fvec8 blockAtomX, blockAtomY, blockAtomZ, blockAtomCharge;
@@ -150,8 +150,8 @@ void CpuNonbondedForceVec8::calculateBlockIxnImpl(int blockIndex, float* forces,
     
     // Loop over neighbors for this block.
     
-    const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
-    const vector<char>& exclusions = neighborList->getBlockExclusions(blockIndex);
+    const vector<int>& neighbors = getBlockNeighbors(blockIndex);
+    const vector<short>& exclusions = neighborList->getBlockExclusions(blockIndex);
     for (int i = 0; i < (int) neighbors.size(); i++) {
         // Load the next neighbor.
         
@@ -165,7 +165,7 @@ void CpuNonbondedForceVec8::calculateBlockIxnImpl(int blockIndex, float* forces,
             atomPos -= floor((atomPos-blockCenter)*invBoxSize+0.5f)*boxSize;
         getDeltaR<PERIODIC_TYPE>(atomPos, blockAtomX, blockAtomY, blockAtomZ, dx, dy, dz, r2, needPeriodic, boxSize, invBoxSize);
         ivec8 include;
-        char excl = exclusions[i];
+        short excl = exclusions[i];
         if (excl == 0)
             include = -1;
         else
@@ -252,7 +252,7 @@ void CpuNonbondedForceVec8::calculateBlockEwaldIxn(int blockIndex, float* forces
         blockCenter = 0.0f;
     }
     else {
-        const int* blockAtom = &neighborList->getSortedAtoms()[8*blockIndex];
+        const int* blockAtom = &getBlockAtomOrder()[8*blockIndex];
         float minx, maxx, miny, maxy, minz, maxz;
         minx = maxx = posq[4*blockAtom[0]];
         miny = maxy = posq[4*blockAtom[0]+1];
@@ -295,7 +295,7 @@ template <int PERIODIC_TYPE>
 void CpuNonbondedForceVec8::calculateBlockEwaldIxnImpl(int blockIndex, float* forces, double* totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize, const fvec4& blockCenter) {
     // Load the positions and parameters of the atoms in the block.
     
-    const int* blockAtom = &neighborList->getSortedAtoms()[8*blockIndex];
+    const int* blockAtom = &getBlockAtomOrder()[8*blockIndex];
     fvec4 blockAtomPosq[8];
     fvec8 blockAtomForceX(0.0f), blockAtomForceY(0.0f), blockAtomForceZ(0.0f);
     fvec8 blockAtomX, blockAtomY, blockAtomZ, blockAtomCharge;
@@ -313,8 +313,8 @@ void CpuNonbondedForceVec8::calculateBlockEwaldIxnImpl(int blockIndex, float* fo
     
     // Loop over neighbors for this block.
     
-    const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
-    const vector<char>& exclusions = neighborList->getBlockExclusions(blockIndex);
+    const vector<int>& neighbors = getBlockNeighbors(blockIndex);
+    const vector<short>& exclusions = neighborList->getBlockExclusions(blockIndex);
     for (int i = 0; i < (int) neighbors.size(); i++) {
         // Load the next neighbor.
         
@@ -328,7 +328,7 @@ void CpuNonbondedForceVec8::calculateBlockEwaldIxnImpl(int blockIndex, float* fo
             atomPos -= floor((atomPos-blockCenter)*invBoxSize+0.5f)*boxSize;
         getDeltaR<PERIODIC_TYPE>(atomPos, blockAtomX, blockAtomY, blockAtomZ, dx, dy, dz, r2, needPeriodic, boxSize, invBoxSize);
         ivec8 include;
-        char excl = exclusions[i];
+        short excl = exclusions[i];
         if (excl == 0)
             include = -1;
         else
@@ -37,6 +37,8 @@
 #include "openmm/OpenMMException.h"
 #include "openmm/internal/hardware.h"
 #include "openmm/internal/vectorize.h"
+#include <algorithm>
+#include <cctype>
 #include <sstream>
 #include <stdlib.h>
 
@@ -58,11 +60,14 @@ extern "C" OPENMM_EXPORT_CPU void registerPlatforms() {
 #endif
 
 map<const ContextImpl*, CpuPlatform::PlatformData*> CpuPlatform::contextData;
+map<const ContextGroup*, CpuPlatform::SharedData*> CpuPlatform::groupData;
 
 CpuPlatform::CpuPlatform() {
     deprecatedPropertyReplacements["CpuThreads"] = CpuThreads();
+    deprecatedPropertyReplacements["CpuPrecision"] = CpuPrecision();
     CpuKernelFactory* factory = new CpuKernelFactory();
     registerKernelFactory(CalcForcesAndEnergyKernel::Name(), factory);
+    registerKernelFactory(VirtualSitesKernel::Name(), factory);
     registerKernelFactory(CalcHarmonicAngleForceKernel::Name(), factory);
     registerKernelFactory(CalcPeriodicTorsionForceKernel::Name(), factory);
     registerKernelFactory(CalcRBTorsionForceKernel::Name(), factory);
@@ -73,7 +78,14 @@ CpuPlatform::CpuPlatform() {
     registerKernelFactory(CalcCustomGBForceKernel::Name(), factory);
     registerKernelFactory(CalcGayBerneForceKernel::Name(), factory);
     registerKernelFactory(IntegrateLangevinStepKernel::Name(), factory);
-    platformProperties.push_back(CpuThreads());
+    // The Threads property is already defined by ReferencePlatform.
+
+    platformProperties.push_back(CpuPrecision());
+    platformProperties.push_back(CpuReorderParticles());
+    platformProperties.push_back(CpuDeterministicForces());
+    platformProperties.push_back(CpuCounterBasedRandom());
+    platformProperties.push_back(CpuOverlapPme());
+    platformProperties.push_back(CpuOverlapPmeFraction());
     int threads = getNumProcessors();
     char* threadsEnv = getenv("OPENMM_CPU_THREADS");
     if (threadsEnv != NULL)
@@ -81,6 +93,12 @@ CpuPlatform::CpuPlatform() {
     stringstream defaultThreads;
     defaultThreads << threads;
     setPropertyDefaultValue(CpuThreads(), defaultThreads.str());
+    setPropertyDefaultValue(CpuPrecision(), "single");
+    setPropertyDefaultValue(CpuReorderParticles(), "false");
+    setPropertyDefaultValue(CpuDeterministicForces(), "false");
+    setPropertyDefaultValue(CpuCounterBasedRandom(), "false");
+    setPropertyDefaultValue(CpuOverlapPme(), "false");
+    setPropertyDefaultValue(CpuOverlapPmeFraction(), "0.25");
 }
 
 const string& CpuPlatform::getPropertyValue(const Context& context, const string& property) const {
@@ -100,7 +118,10 @@ double CpuPlatform::getSpeed() const {
 }
 
 bool CpuPlatform::supportsDoublePrecision() const {
-    return false;
+    // Double precision is available by setting the Precision property to "double", so this is true
+    // whatever precision a particular Context uses.
+
+    return true;
 }
 
 bool CpuPlatform::isProcessorSupported() {
@@ -108,25 +129,89 @@ bool CpuPlatform::isProcessorSupported() {
 }
 
 void CpuPlatform::contextCreated(ContextImpl& context, const map<string, string>& properties) const {
-    ReferencePlatform::contextCreated(context, properties);
     const string& threadsPropValue = (properties.find(CpuThreads()) == properties.end() ?
             getPropertyDefaultValue(CpuThreads()) : properties.find(CpuThreads())->second);
+    string precisionPropValue = (properties.find(CpuPrecision()) == properties.end() ?
+            getPropertyDefaultValue(CpuPrecision()) : properties.find(CpuPrecision())->second);
+    transform(precisionPropValue.begin(), precisionPropValue.end(), precisionPropValue.begin(), ::tolower);
+    if (precisionPropValue != "single" && precisionPropValue != "mixed" && precisionPropValue != "double")
+        throw OpenMMException("Illegal value for Precision: "+precisionPropValue);
+    string reorderPropValue = (properties.find(CpuReorderParticles()) == properties.end() ?
+            getPropertyDefaultValue(CpuReorderParticles()) : properties.find(CpuReorderParticles())->second);
+    transform(reorderPropValue.begin(), reorderPropValue.end(), reorderPropValue.begin(), ::tolower);
+    if (reorderPropValue != "true" && reorderPropValue != "false")
+        throw OpenMMException("Illegal value for ReorderParticles: "+reorderPropValue);
+    string deterministicPropValue = (properties.find(CpuDeterministicForces()) == properties.end() ?
+            getPropertyDefaultValue(CpuDeterministicForces()) : properties.find(CpuDeterministicForces())->second);
+    transform(deterministicPropValue.begin(), deterministicPropValue.end(), deterministicPropValue.begin(), ::tolower);
+    if (deterministicPropValue != "true" && deterministicPropValue != "false")
+        throw OpenMMException("Illegal value for DeterministicForces: "+deterministicPropValue);
+    string counterRandomPropValue = (properties.find(CpuCounterBasedRandom()) == properties.end() ?
+            getPropertyDefaultValue(CpuCounterBasedRandom()) : properties.find(CpuCounterBasedRandom())->second);
+    transform(counterRandomPropValue.begin(), counterRandomPropValue.end(), counterRandomPropValue.begin(), ::tolower);
+    if (counterRandomPropValue != "true" && counterRandomPropValue != "false")
+        throw OpenMMException("Illegal value for CounterBasedRandom: "+counterRandomPropValue);
+    string overlapPmePropValue = (properties.find(CpuOverlapPme()) == properties.end() ?
+            getPropertyDefaultValue(CpuOverlapPme()) : properties.find(CpuOverlapPme())->second);
+    transform(overlapPmePropValue.begin(), overlapPmePropValue.end(), overlapPmePropValue.begin(), ::tolower);
+    if (overlapPmePropValue != "true" && overlapPmePropValue != "false")
+        throw OpenMMException("Illegal value for OverlapPme: "+overlapPmePropValue);
+    const string& overlapFractionPropValue = (properties.find(CpuOverlapPmeFraction()) == properties.end() ?
+            getPropertyDefaultValue(CpuOverlapPmeFraction()) : properties.find(CpuOverlapPmeFraction())->second);
+    double overlapFraction = 0.0;
+    stringstream(overlapFractionPropValue) >> overlapFraction;
+    if (!(overlapFraction > 0.0 && overlapFraction < 1.0))
+        throw OpenMMException("Illegal value for OverlapPmeFraction: "+overlapFractionPropValue);
+
+    // In double precision mode the Reference kernels compute the pairwise forces, so they use the same
+    // number of threads as this platform.  Otherwise they only compute inexpensive forces on a single thread.
+    // Their results depend on the number of threads, so they also use a single thread when deterministic
+    // forces have been requested.
+
+    map<string, string> referenceProperties = properties;
+    bool threadedReference = (precisionPropValue == "double" && deterministicPropValue == "false");
+    referenceProperties[ReferenceThreads()] = (threadedReference ? threadsPropValue : "1");
+    ReferencePlatform::contextCreated(context, referenceProperties);
     int numThreads;
     stringstream(threadsPropValue) >> numThreads;
-    PlatformData* data = new PlatformData(context.getSystem().getNumParticles(), numThreads);
+    int numParticles = context.getSystem().getNumParticles();
+    ContextGroup* group = context.getGroup();
+    SharedData* shared;
+    if (group != NULL && groupData.find(group) != groupData.end())
+        shared = groupData[group];
+    else {
+        shared = new SharedData(numParticles, numThreads);
+        if (group != NULL)
+            groupData[group] = shared;
+    }
+    shared->numContexts++;
+    PlatformData* data = new PlatformData(*shared, numParticles, precisionPropValue, reorderPropValue == "true", deterministicPropValue == "true",
+            counterRandomPropValue == "true", overlapPmePropValue == "true", overlapFraction);
     contextData[&context] = data;
     ReferenceConstraints& constraints = *(ReferenceConstraints*) reinterpret_cast<ReferencePlatform::PlatformData*>(context.getPlatformData())->constraints;
     if (constraints.settle != NULL) {
-        CpuSETTLE* parallelSettle = new CpuSETTLE(context.getSystem(), *(ReferenceSETTLEAlgorithm*) constraints.settle, data->threads);
+        CpuSETTLE* parallelSettle = new CpuSETTLE(context.getSystem(), *(ReferenceSETTLEAlgorithm*) constraints.settle, data->threads,
+                !data->useMixedPrecision && !data->useDoublePrecision);
         delete constraints.settle;
         constraints.settle = parallelSettle;
     }
+    for (int i = 0; i < numParticles; i++)
+        if (context.getSystem().isVirtualSite(i)) {
+            data->virtualSites = new CpuVirtualSites(context.getSystem(), data->threads);
+            break;
+        }
 }
 
 void CpuPlatform::contextDestroyed(ContextImpl& context) const {
     PlatformData* data = contextData[&context];
+    SharedData& shared = data->shared;
     delete data;
     contextData.erase(&context);
+    if (--shared.numContexts == 0) {
+        if (context.getGroup() != NULL)
+            groupData.erase(context.getGroup());
+        delete &shared;
+    }
 }
 
 CpuPlatform::PlatformData& CpuPlatform::getPlatformData(ContextImpl& context) {
@@ -137,28 +222,85 @@ const CpuPlatform::PlatformData& CpuPlatform::getPlatformData(const ContextImpl&
     return *contextData[&context];
 }
 
-CpuPlatform::PlatformData::PlatformData(int numParticles, int numThreads) : posq(4*numParticles), threads(numThreads),
-        neighborList(NULL), cutoff(0.0), paddedCutoff(0.0), anyExclusions(false) {
+CpuPlatform::SharedData::SharedData(int numParticles, int numThreads) : threads(numThreads), numContexts(0) {
     numThreads = threads.getNumThreads();
     threadForce.resize(numThreads);
     for (int i = 0; i < numThreads; i++)
         threadForce[i].resize(4*numParticles);
+}
+
+CpuPlatform::SharedData::~SharedData() {
+    for (map<string, CpuBondForce::Partition*>::iterator iter = bondPartitions.begin(); iter != bondPartitions.end(); ++iter)
+        delete iter->second;
+}
+
+const double CpuPlatform::SharedData::FixedPointScale = (double) 0x100000000LL;
+
+const CpuExclusionList& CpuPlatform::SharedData::getSharedExclusions(const CpuExclusionList& exclusions) {
+    for (int i = 0; i < (int) exclusionLists.size(); i++)
+        if (exclusionLists[i] == exclusions)
+            return exclusionLists[i];
+    exclusionLists.push_back(exclusions);
+    return exclusionLists.back();
+}
+
+CpuPlatform::PlatformData::PlatformData(SharedData& shared, int numParticles, const string& precision, bool reorderParticles, bool deterministicForces,
+        bool counterBasedRandom, bool overlapPme, double overlapPmeFraction) : shared(shared),
+        posq(4*numParticles), threadForce(shared.threadForce), threads(shared.threads), serialThreads(NULL), reorderParticles(reorderParticles),
+        deterministicForces(deterministicForces), counterBasedRandom(counterBasedRandom), overlapPme(overlapPme), overlapPmeFraction(overlapPmeFraction), neighborList(NULL), virtualSites(NULL), cutoff(0.0), paddedCutoff(0.0), anyExclusions(false) {
+    int numThreads = threads.getNumThreads();
+    if (deterministicForces) {
+        serialThreads = new ThreadPool(1);
+        if (shared.threadFixedForce.size() == 0) {
+            shared.threadFixedForce.resize(numThreads);
+            for (int i = 0; i < numThreads; i++)
+                shared.threadFixedForce[i].resize(3*numParticles, 0);
+        }
+    }
+    if (precision == "mixed" && shared.threadDoubleForce.size() == 0) {
+        shared.threadDoubleForce.resize(numThreads);
+        for (int i = 0; i < numThreads; i++)
+            shared.threadDoubleForce[i].resize(3*numParticles, 0.0);
+    }
     isPeriodic = false;
+    useMixedPrecision = (precision == "mixed");
+    useDoublePrecision = (precision == "double");
     stringstream threadsProperty;
     threadsProperty << numThreads;
     propertyValues[CpuThreads()] = threadsProperty.str();
+    propertyValues[CpuPrecision()] = precision;
+    propertyValues[CpuReorderParticles()] = (reorderParticles ? "true" : "false");
+    propertyValues[CpuDeterministicForces()] = (deterministicForces ? "true" : "false");
+    propertyValues[CpuCounterBasedRandom()] = (counterBasedRandom ? "true" : "false");
+    propertyValues[CpuOverlapPme()] = (overlapPme ? "true" : "false");
+    stringstream overlapFractionProperty;
+    overlapFractionProperty << overlapPmeFraction;
+    propertyValues[CpuOverlapPmeFraction()] = overlapFractionProperty.str();
 }
 
 CpuPlatform::PlatformData::~PlatformData() {
     if (neighborList != NULL)
         delete neighborList;
+    if (serialThreads != NULL)
+        delete serialThreads;
+    if (virtualSites != NULL)
+        delete virtualSites;
+}
+
+ThreadPool& CpuPlatform::PlatformData::getDeterministicThreads() {
+    if (serialThreads != NULL)
+        return *serialThreads;
+    return threads;
 }
 
 bool isVec8Supported();
+bool isVec16Supported();
 
-void CpuPlatform::PlatformData::requestNeighborList(double cutoffDistance, double padding, bool useExclusions, const vector<set<int> >& exclusionList) {
-    if (neighborList == NULL)
-        neighborList = new CpuNeighborList(isVec8Supported() ? 8 : 4);
+void CpuPlatform::PlatformData::requestNeighborList(double cutoffDistance, double padding, bool useExclusions, const CpuExclusionList& exclusionList) {
+    if (neighborList == NULL) {
+        neighborList = new CpuNeighborList(isVec16Supported() ? 16 : (isVec8Supported() ? 8 : 4));
+        neighborList->setStoreSortedNeighbors(reorderParticles);
+    }
     if (cutoffDistance > cutoff)
         cutoff = cutoffDistance;
     if (cutoffDistance+padding > paddedCutoff)
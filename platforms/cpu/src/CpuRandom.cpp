@@ -57,6 +57,7 @@ void CpuRandom::initialize(int seed, int numThreads) {
     unsigned int r = (unsigned int) seed;
     if (r == 0)
         r = (unsigned int) osrngseed();
+    counterKey = r;
     for (int i = 0; i < numThreads; i++) {
         r = (1664525*r + 1013904223) & 0xFFFFFFFF;
         threadRandom[i] = new OpenMM_SFMT::SFMT();
@@ -87,3 +88,52 @@ float CpuRandom::getGaussianRandom(int threadIndex) {
 float CpuRandom::getUniformRandom(int threadIndex) {
     return genrand_real2(*threadRandom[threadIndex]);
 }
+
+/**
+ * Compute cos(2*pi*t) for values of t in [-1, 1].
+ */
+static fvec4 cos2pi(const fvec4& t) {
+    // cos(2*pi*t) = sin(2*pi*(0.25-|t'|)), where t' is t reduced to [-0.5, 0.5].  That brings the
+    // argument of sin() into [-pi/2, pi/2], where a short Taylor series is accurate to single precision.
+
+    fvec4 x = (0.25f-abs(t-round(t)))*(float) (2*M_PI);
+    fvec4 x2 = x*x;
+    fvec4 poly = 1.0f/6227020800.0f;
+    poly = poly*x2 - 1.0f/39916800.0f;
+    poly = poly*x2 + 1.0f/362880.0f;
+    poly = poly*x2 - 1.0f/5040.0f;
+    poly = poly*x2 + 1.0f/120.0f;
+    poly = poly*x2 - 1.0f/6.0f;
+    poly = poly*x2 + 1.0f;
+    return x*poly;
+}
+
+fvec4 CpuRandom::getCounterGaussianRandom(int step, int atom) const {
+    // Run ten rounds of Philox4x32 with the atom and step as the counter.
+
+    unsigned int c0 = (unsigned int) atom, c1 = (unsigned int) step, c2 = 0, c3 = 0;
+    unsigned int k0 = counterKey, k1 = 0xCAFEF00D;
+    for (int round = 0; round < 10; round++) {
+        unsigned long long p0 = 0xD2511F53ULL*c0;
+        unsigned long long p1 = 0xCD9E8D57ULL*c2;
+        unsigned int hi0 = (unsigned int) (p0>>32), lo0 = (unsigned int) p0;
+        unsigned int hi1 = (unsigned int) (p1>>32), lo1 = (unsigned int) p1;
+        c0 = hi1^c1^k0;
+        c1 = lo1;
+        c2 = hi0^c3^k1;
+        c3 = lo0;
+        k0 += 0x9E3779B9;
+        k1 += 0xBB67AE85;
+    }
+
+    // Convert the four 32 bit values to two pairs of Gaussian random numbers with the Box-Muller
+    // transformation, computing all four at once.
+
+    const double scale = 1.0/4294967296.0;
+    float u0 = (float) ((c0+0.5)*scale);
+    float u2 = (float) ((c2+0.5)*scale);
+    float t1 = (float) (c1*scale);
+    float t3 = (float) (c3*scale);
+    fvec4 radius = sqrt(-2.0f*log(fvec4(u0, u0, u2, u2)));
+    return radius*cos2pi(fvec4(t1, t1-0.25f, t3, t3-0.25f));
+}
@@ -31,65 +31,97 @@
 
 #include "CpuSETTLE.h"
 #include "openmm/internal/gmx_atomic.h"
+#include "openmm/internal/vectorize.h"
+#include <algorithm>
+#include <cmath>
 
 using namespace OpenMM;
 using namespace std;
 
 class CpuSETTLE::ApplyToPositionsTask : public ThreadPool::Task {
 public:
-    ApplyToPositionsTask(vector<OpenMM::RealVec>& atomCoordinates, vector<OpenMM::RealVec>& atomCoordinatesP, vector<RealOpenMM>& inverseMasses,
-            RealOpenMM tolerance, vector<ReferenceSETTLEAlgorithm*>& threadSettle) : atomCoordinates(atomCoordinates), atomCoordinatesP(atomCoordinatesP),
-            inverseMasses(inverseMasses), tolerance(tolerance), threadSettle(threadSettle) {
+    ApplyToPositionsTask(CpuSETTLE& owner, vector<OpenMM::RealVec>& atomCoordinates, vector<OpenMM::RealVec>& atomCoordinatesP, vector<RealOpenMM>& inverseMasses,
+            RealOpenMM tolerance) : owner(owner), atomCoordinates(atomCoordinates), atomCoordinatesP(atomCoordinatesP),
+            inverseMasses(inverseMasses), tolerance(tolerance) {
         gmx_atomic_set(&atomicCounter, 0);
     }
     void execute(ThreadPool& threads, int threadIndex) {
         while (true) {
             int index = gmx_atomic_fetch_add(&atomicCounter, 1);
-            if (index >= threadSettle.size())
+            if (index >= (int) owner.threadSettle.size())
                 break;
-            threadSettle[index]->apply(atomCoordinates, atomCoordinatesP, inverseMasses, tolerance);
+            if (owner.useSinglePrecision)
+                owner.applyToBlock(index, atomCoordinates, atomCoordinatesP);
+            else
+                owner.threadSettle[index]->apply(atomCoordinates, atomCoordinatesP, inverseMasses, tolerance);
         }
     }
+    CpuSETTLE& owner;
     vector<OpenMM::RealVec>& atomCoordinates;
     vector<OpenMM::RealVec>& atomCoordinatesP;
     vector<RealOpenMM>& inverseMasses;
     RealOpenMM tolerance;
-    vector<ReferenceSETTLEAlgorithm*>& threadSettle;
     gmx_atomic_t atomicCounter;
 };
 
 class CpuSETTLE::ApplyToVelocitiesTask : public ThreadPool::Task {
 public:
-    ApplyToVelocitiesTask(vector<OpenMM::RealVec>& atomCoordinates, vector<OpenMM::RealVec>& velocities, vector<RealOpenMM>& inverseMasses,
-            RealOpenMM tolerance, vector<ReferenceSETTLEAlgorithm*>& threadSettle) : atomCoordinates(atomCoordinates), velocities(velocities),
-            inverseMasses(inverseMasses), tolerance(tolerance), threadSettle(threadSettle) {
+    ApplyToVelocitiesTask(CpuSETTLE& owner, vector<OpenMM::RealVec>& atomCoordinates, vector<OpenMM::RealVec>& velocities, vector<RealOpenMM>& inverseMasses,
+            RealOpenMM tolerance) : owner(owner), atomCoordinates(atomCoordinates), velocities(velocities),
+            inverseMasses(inverseMasses), tolerance(tolerance) {
         gmx_atomic_set(&atomicCounter, 0);
     }
     void execute(ThreadPool& threads, int threadIndex) {
         while (true) {
             int index = gmx_atomic_fetch_add(&atomicCounter, 1);
-            if (index >= threadSettle.size())
+            if (index >= (int) owner.threadSettle.size())
                 break;
-            threadSettle[index]->applyToVelocities(atomCoordinates, velocities, inverseMasses, tolerance);
+            if (owner.useSinglePrecision)
+                owner.applyToVelocitiesForBlock(index, atomCoordinates, velocities, inverseMasses);
+            else
+                owner.threadSettle[index]->applyToVelocities(atomCoordinates, velocities, inverseMasses, tolerance);
         }
     }
+    CpuSETTLE& owner;
     vector<OpenMM::RealVec>& atomCoordinates;
     vector<OpenMM::RealVec>& velocities;
     vector<RealOpenMM>& inverseMasses;
     RealOpenMM tolerance;
-    vector<ReferenceSETTLEAlgorithm*>& threadSettle;
     gmx_atomic_t atomicCounter;
 };
 
-CpuSETTLE::CpuSETTLE(const System& system, const ReferenceSETTLEAlgorithm& settle, ThreadPool& threads) : threads(threads) {
+/**
+ * Load the differences between two sets of positions (or velocities) for four clusters, converting
+ * them to single precision.  The subtraction is done in double precision.
+ */
+static void loadDifference(const vector<RealVec>& pos1, const int* atoms1, const vector<RealVec>& pos2, const int* atoms2, fvec4& dx, fvec4& dy, fvec4& dz) {
+    float x[4], y[4], z[4];
+    for (int i = 0; i < 4; i++) {
+        RealVec delta = pos1[atoms1[i]]-pos2[atoms2[i]];
+        x[i] = (float) delta[0];
+        y[i] = (float) delta[1];
+        z[i] = (float) delta[2];
+    }
+    dx = fvec4(x);
+    dy = fvec4(y);
+    dz = fvec4(z);
+}
+
+CpuSETTLE::CpuSETTLE(const System& system, const ReferenceSETTLEAlgorithm& settle, ThreadPool& threads, bool useSinglePrecision) :
+        threads(threads), useSinglePrecision(useSinglePrecision) {
     int numBlocks = 10*threads.getNumThreads();
-    int numClusters = settle.getNumClusters();
+    numClusters = settle.getNumClusters();
     vector<RealOpenMM> mass(system.getNumParticles());
     for (int i = 0; i < system.getNumParticles(); i++)
         mass[i] = system.getParticleMass(i);
+
+    // Divide the clusters into blocks.  Every block except the last one contains a multiple of four clusters
+    // so the SIMD code never needs to process a partial group except at the very end.
+
+    int numGroups = (numClusters+3)/4;
     for (int i = 0; i < numBlocks; i++) {
-        int start = i*numClusters/numBlocks;
-        int end = (i+1)*numClusters/numBlocks;
+        int start = min(4*(i*numGroups/numBlocks), numClusters);
+        int end = min(4*((i+1)*numGroups/numBlocks), numClusters);
         if (start != end) {
             int numThreadClusters = end-start;
             vector<int> atom1(numThreadClusters), atom2(numThreadClusters), atom3(numThreadClusters);
@@ -97,6 +129,33 @@ CpuSETTLE::CpuSETTLE(const System& system, const ReferenceSETTLEAlgorithm& settl
             for (int j = 0; j < numThreadClusters; j++)
                 settle.getClusterParameters(start+j, atom1[j], atom2[j], atom3[j], distance1[j], distance2[j]);
             threadSettle.push_back(new ReferenceSETTLEAlgorithm(atom1, atom2, atom3, distance1, distance2, mass));
+            blockStart.push_back(start);
+        }
+    }
+    blockStart.push_back(numClusters);
+
+    // Record the cluster parameters in the form used by the SIMD code, padding the arrays to a multiple
+    // of four by repeating the last cluster.
+
+    if (useSinglePrecision) {
+        for (int i = 0; i < 4*numGroups; i++) {
+            int atom1, atom2, atom3;
+            RealOpenMM distance1, distance2;
+            settle.getClusterParameters(min(i, numClusters-1), atom1, atom2, atom3, distance1, distance2);
+            RealOpenMM m1 = mass[atom1], m2 = mass[atom2], m3 = mass[atom3];
+            RealOpenMM rc = 0.5*distance2;
+            RealOpenMM rb = sqrt(distance1*distance1-rc*rc);
+            RealOpenMM ra = rb*(m2+m3)/(m1+m2+m3);
+            clusterAtom1.push_back(atom1);
+            clusterAtom2.push_back(atom2);
+            clusterAtom3.push_back(atom3);
+            clusterMass1.push_back((float) m1);
+            clusterMass2.push_back((float) m2);
+            clusterMass3.push_back((float) m3);
+            clusterDistance2.push_back((float) distance2);
+            clusterRa.push_back((float) ra);
+            clusterRb.push_back((float) (rb-ra));
+            clusterRc.push_back((float) rc);
         }
     }
 }
@@ -106,14 +165,239 @@ CpuSETTLE::~CpuSETTLE() {
         delete threadSettle[i];
 }
 
+int CpuSETTLE::getNumClusters() const {
+    return numClusters;
+}
+
+void CpuSETTLE::getClusterParameters(int index, int& atom1, int& atom2, int& atom3, RealOpenMM& distance1, RealOpenMM& distance2) const {
+    for (int i = 0; i < (int) threadSettle.size(); i++) {
+        if (index < threadSettle[i]->getNumClusters()) {
+            threadSettle[i]->getClusterParameters(index, atom1, atom2, atom3, distance1, distance2);
+            return;
+        }
+        index -= threadSettle[i]->getNumClusters();
+    }
+}
+
+bool CpuSETTLE::getUseSinglePrecision() const {
+    return useSinglePrecision;
+}
+
 void CpuSETTLE::apply(vector<OpenMM::RealVec>& atomCoordinates, vector<OpenMM::RealVec>& atomCoordinatesP, vector<RealOpenMM>& inverseMasses, RealOpenMM tolerance) {
-    ApplyToPositionsTask task(atomCoordinates, atomCoordinatesP, inverseMasses, tolerance, threadSettle);
+    ApplyToPositionsTask task(*this, atomCoordinates, atomCoordinatesP, inverseMasses, tolerance);
     threads.execute(task);
     threads.waitForThreads();
 }
 
 void CpuSETTLE::applyToVelocities(vector<OpenMM::RealVec>& atomCoordinates, vector<OpenMM::RealVec>& velocities, vector<RealOpenMM>& inverseMasses, RealOpenMM tolerance) {
-    ApplyToVelocitiesTask task(atomCoordinates, velocities, inverseMasses, tolerance, threadSettle);
+    ApplyToVelocitiesTask task(*this, atomCoordinates, velocities, inverseMasses, tolerance);
     threads.execute(task);
     threads.waitForThreads();
 }
+
+void CpuSETTLE::applyToBlock(int block, vector<OpenMM::RealVec>& atomCoordinates, vector<OpenMM::RealVec>& atomCoordinatesP) {
+    for (int index = blockStart[block]; index < blockStart[block+1]; index += 4)
+        applyToGroup(index, atomCoordinates, atomCoordinatesP);
+}
+
+void CpuSETTLE::applyToGroup(int index, vector<OpenMM::RealVec>& atomCoordinates, vector<OpenMM::RealVec>& atomCoordinatesP) {
+    const int* atom1 = &clusterAtom1[index];
+    const int* atom2 = &clusterAtom2[index];
+    const int* atom3 = &clusterAtom3[index];
+    fvec4 m0(&clusterMass1[index]);
+    fvec4 m1(&clusterMass2[index]);
+    fvec4 m2(&clusterMass3[index]);
+
+    // Load the positions relative to the first atom in each cluster, and the displacements.
+
+    fvec4 xb0, yb0, zb0, xc0, yc0, zc0;
+    loadDifference(atomCoordinates, atom2, atomCoordinates, atom1, xb0, yb0, zb0);
+    loadDifference(atomCoordinates, atom3, atomCoordinates, atom1, xc0, yc0, zc0);
+    fvec4 xp0x, xp0y, xp0z, xp1x, xp1y, xp1z, xp2x, xp2y, xp2z;
+    loadDifference(atomCoordinatesP, atom1, atomCoordinates, atom1, xp0x, xp0y, xp0z);
+    loadDifference(atomCoordinatesP, atom2, atomCoordinates, atom2, xp1x, xp1y, xp1z);
+    loadDifference(atomCoordinatesP, atom3, atomCoordinates, atom3, xp2x, xp2y, xp2z);
+
+    // Apply the SETTLE algorithm.  This follows ReferenceSETTLEAlgorithm::applyToCluster().
+
+    fvec4 invTotalMass = 1.0f/(m0+m1+m2);
+    fvec4 xcom = (xp0x*m0 + (xb0+xp1x)*m1 + (xc0+xp2x)*m2) * invTotalMass;
+    fvec4 ycom = (xp0y*m0 + (yb0+xp1y)*m1 + (yc0+xp2y)*m2) * invTotalMass;
+    fvec4 zcom = (xp0z*m0 + (zb0+xp1z)*m1 + (zc0+xp2z)*m2) * invTotalMass;
+
+    fvec4 xa1 = xp0x - xcom;
+    fvec4 ya1 = xp0y - ycom;
+    fvec4 za1 = xp0z - zcom;
+    fvec4 xb1 = xb0 + xp1x - xcom;
+    fvec4 yb1 = yb0 + xp1y - ycom;
+    fvec4 zb1 = zb0 + xp1z - zcom;
+    fvec4 xc1 = xc0 + xp2x - xcom;
+    fvec4 yc1 = yc0 + xp2y - ycom;
+    fvec4 zc1 = zc0 + xp2z - zcom;
+
+    fvec4 xaksZd = yb0*zc0 - zb0*yc0;
+    fvec4 yaksZd = zb0*xc0 - xb0*zc0;
+    fvec4 zaksZd = xb0*yc0 - yb0*xc0;
+    fvec4 xaksXd = ya1*zaksZd - za1*yaksZd;
+    fvec4 yaksXd = za1*xaksZd - xa1*zaksZd;
+    fvec4 zaksXd = xa1*yaksZd - ya1*xaksZd;
+    fvec4 xaksYd = yaksZd*zaksXd - zaksZd*yaksXd;
+    fvec4 yaksYd = zaksZd*xaksXd - xaksZd*zaksXd;
+    fvec4 zaksYd = xaksZd*yaksXd - yaksZd*xaksXd;
+
+    fvec4 axlngInv = 1.0f/sqrt(xaksXd*xaksXd + yaksXd*yaksXd + zaksXd*zaksXd);
+    fvec4 aylngInv = 1.0f/sqrt(xaksYd*xaksYd + yaksYd*yaksYd + zaksYd*zaksYd);
+    fvec4 azlngInv = 1.0f/sqrt(xaksZd*xaksZd + yaksZd*yaksZd + zaksZd*zaksZd);
+    fvec4 trns11 = xaksXd*axlngInv;
+    fvec4 trns21 = yaksXd*axlngInv;
+    fvec4 trns31 = zaksXd*axlngInv;
+    fvec4 trns12 = xaksYd*aylngInv;
+    fvec4 trns22 = yaksYd*aylngInv;
+    fvec4 trns32 = zaksYd*aylngInv;
+    fvec4 trns13 = xaksZd*azlngInv;
+    fvec4 trns23 = yaksZd*azlngInv;
+    fvec4 trns33 = zaksZd*azlngInv;
+
+    fvec4 xb0d = trns11*xb0 + trns21*yb0 + trns31*zb0;
+    fvec4 yb0d = trns12*xb0 + trns22*yb0 + trns32*zb0;
+    fvec4 xc0d = trns11*xc0 + trns21*yc0 + trns31*zc0;
+    fvec4 yc0d = trns12*xc0 + trns22*yc0 + trns32*zc0;
+    fvec4 za1d = trns13*xa1 + trns23*ya1 + trns33*za1;
+    fvec4 xb1d = trns11*xb1 + trns21*yb1 + trns31*zb1;
+    fvec4 yb1d = trns12*xb1 + trns22*yb1 + trns32*zb1;
+    fvec4 zb1d = trns13*xb1 + trns23*yb1 + trns33*zb1;
+    fvec4 xc1d = trns11*xc1 + trns21*yc1 + trns31*zc1;
+    fvec4 yc1d = trns12*xc1 + trns22*yc1 + trns32*zc1;
+    fvec4 zc1d = trns13*xc1 + trns23*yc1 + trns33*zc1;
+
+    fvec4 ra(&clusterRa[index]);
+    fvec4 rb(&clusterRb[index]);
+    fvec4 rc(&clusterRc[index]);
+    fvec4 distance2(&clusterDistance2[index]);
+    fvec4 sinphi = za1d / ra;
+    fvec4 cosphi = sqrt(1.0f - sinphi*sinphi);
+    fvec4 sinpsi = (zb1d - zc1d) / (2.0f*rc*cosphi);
+    fvec4 cospsi = sqrt(1.0f - sinpsi*sinpsi);
+
+    fvec4 ya2d =   ra*cosphi;
+    fvec4 xb2d = - rc*cospsi;
+    fvec4 yb2d = - rb*cosphi - rc*sinpsi*sinphi;
+    fvec4 yc2d = - rb*cosphi + rc*sinpsi*sinphi;
+    fvec4 xb2d2 = xb2d*xb2d;
+    fvec4 hh2 = 4.0f*xb2d2 + (yb2d-yc2d)*(yb2d-yc2d) + (zb1d-zc1d)*(zb1d-zc1d);
+    fvec4 deltx = 2.0f*xb2d + sqrt(4.0f*xb2d2 - hh2 + distance2*distance2);
+    xb2d -= deltx*0.5f;
+
+    fvec4 alpha = (xb2d*(xb0d-xc0d) + yb0d*yb2d + yc0d*yc2d);
+    fvec4 beta = (xb2d*(yc0d-yb0d) + xb0d*yb2d + xc0d*yc2d);
+    fvec4 gamma = xb0d*yb1d - xb1d*yb0d + xc0d*yc1d - xc1d*yc0d;
+
+    fvec4 al2be2 = alpha*alpha + beta*beta;
+    fvec4 sintheta = (alpha*gamma - beta*sqrt(al2be2 - gamma*gamma)) / al2be2;
+
+    fvec4 costheta = sqrt(1.0f - sintheta*sintheta);
+    fvec4 xa3d = - ya2d*sintheta;
+    fvec4 ya3d =   ya2d*costheta;
+    fvec4 za3d = za1d;
+    fvec4 xb3d =   xb2d*costheta - yb2d*sintheta;
+    fvec4 yb3d =   xb2d*sintheta + yb2d*costheta;
+    fvec4 zb3d = zb1d;
+    fvec4 xc3d = - xb2d*costheta - yc2d*sintheta;
+    fvec4 yc3d = - xb2d*sintheta + yc2d*costheta;
+    fvec4 zc3d = zc1d;
+
+    // Compute the new positions relative to the original position of the first atom.
+
+    float x0[4], y0[4], z0[4], x1[4], y1[4], z1[4], x2[4], y2[4], z2[4];
+    (xcom + trns11*xa3d + trns12*ya3d + trns13*za3d).store(x0);
+    (ycom + trns21*xa3d + trns22*ya3d + trns23*za3d).store(y0);
+    (zcom + trns31*xa3d + trns32*ya3d + trns33*za3d).store(z0);
+    (xcom + trns11*xb3d + trns12*yb3d + trns13*zb3d).store(x1);
+    (ycom + trns21*xb3d + trns22*yb3d + trns23*zb3d).store(y1);
+    (zcom + trns31*xb3d + trns32*yb3d + trns33*zb3d).store(z1);
+    (xcom + trns11*xc3d + trns12*yc3d + trns13*zc3d).store(x2);
+    (ycom + trns21*xc3d + trns22*yc3d + trns23*zc3d).store(y2);
+    (zcom + trns31*xc3d + trns32*yc3d + trns33*zc3d).store(z2);
+
+    // Record the new positions.
+
+    int numInGroup = min(4, numClusters-index);
+    for (int i = 0; i < numInGroup; i++) {
+        RealVec origin = atomCoordinates[atom1[i]];
+        atomCoordinatesP[atom1[i]] = origin+RealVec(x0[i], y0[i], z0[i]);
+        atomCoordinatesP[atom2[i]] = origin+RealVec(x1[i], y1[i], z1[i]);
+        atomCoordinatesP[atom3[i]] = origin+RealVec(x2[i], y2[i], z2[i]);
+    }
+}
+
+void CpuSETTLE::applyToVelocitiesForBlock(int block, vector<OpenMM::RealVec>& atomCoordinates, vector<OpenMM::RealVec>& velocities, vector<RealOpenMM>& inverseMasses) {
+    for (int index = blockStart[block]; index < blockStart[block+1]; index += 4) {
+        const int* atom1 = &clusterAtom1[index];
+        const int* atom2 = &clusterAtom2[index];
+        const int* atom3 = &clusterAtom3[index];
+        fvec4 mA(&clusterMass1[index]);
+        fvec4 mB(&clusterMass2[index]);
+        fvec4 mC(&clusterMass3[index]);
+
+        // Compute intermediate quantities: the bond directions, the relative velocities, and the angle cosines and sines.
+
+        fvec4 eABx, eABy, eABz, eBCx, eBCy, eBCz, eCAx, eCAy, eCAz;
+        loadDifference(atomCoordinates, atom2, atomCoordinates, atom1, eABx, eABy, eABz);
+        loadDifference(atomCoordinates, atom3, atomCoordinates, atom2, eBCx, eBCy, eBCz);
+        loadDifference(atomCoordinates, atom1, atomCoordinates, atom3, eCAx, eCAy, eCAz);
+        fvec4 invLength = 1.0f/sqrt(eABx*eABx + eABy*eABy + eABz*eABz);
+        eABx *= invLength;
+        eABy *= invLength;
+        eABz *= invLength;
+        invLength = 1.0f/sqrt(eBCx*eBCx + eBCy*eBCy + eBCz*eBCz);
+        eBCx *= invLength;
+        eBCy *= invLength;
+        eBCz *= invLength;
+        invLength = 1.0f/sqrt(eCAx*eCAx + eCAy*eCAy + eCAz*eCAz);
+        eCAx *= invLength;
+        eCAy *= invLength;
+        eCAz *= invLength;
+        fvec4 dvx, dvy, dvz;
+        loadDifference(velocities, atom2, velocities, atom1, dvx, dvy, dvz);
+        fvec4 vAB = dvx*eABx + dvy*eABy + dvz*eABz;
+        loadDifference(velocities, atom3, velocities, atom2, dvx, dvy, dvz);
+        fvec4 vBC = dvx*eBCx + dvy*eBCy + dvz*eBCz;
+        loadDifference(velocities, atom1, velocities, atom3, dvx, dvy, dvz);
+        fvec4 vCA = dvx*eCAx + dvy*eCAy + dvz*eCAz;
+        fvec4 cA = -(eABx*eCAx + eABy*eCAy + eABz*eCAz);
+        fvec4 cB = -(eABx*eBCx + eABy*eBCy + eABz*eBCz);
+        fvec4 cC = -(eBCx*eCAx + eBCy*eCAy + eBCz*eCAz);
+        fvec4 s2A = 1.0f-cA*cA;
+        fvec4 s2B = 1.0f-cB*cB;
+        fvec4 s2C = 1.0f-cC*cC;
+
+        // Solve the equations.  See ReferenceSETTLEAlgorithm::applyToVelocities() for details.
+
+        fvec4 mABCinv = 1.0f/(mA*mB*mC);
+        fvec4 mABC = mA+mB+mC;
+        fvec4 denom = (((s2A*mB+s2B*mA)*mC+(s2A*mB*mB+2.0f*(cA*cB*cC+1.0f)*mA*mB+s2B*mA*mA))*mC+s2C*mA*mB*(mA+mB))*mABCinv;
+        fvec4 invDenom = 1.0f/denom;
+        fvec4 tab = ((cB*cC*mA-cA*mB-cA*mC)*vCA + (cA*cC*mB-cB*mC-cB*mA)*vBC + (s2C*mA*mA*mB*mB*mABCinv+mABC)*vAB)*invDenom;
+        fvec4 tbc = ((cA*cB*mC-cC*mB-cC*mA)*vCA + (s2A*mB*mB*mC*mC*mABCinv+mABC)*vBC + (cA*cC*mB-cB*mA-cB*mC)*vAB)*invDenom;
+        fvec4 tca = ((s2B*mA*mA*mC*mC*mABCinv+mABC)*vCA + (cA*cB*mC-cC*mB-cC*mA)*vBC + (cB*cC*mA-cA*mB-cA*mC)*vAB)*invDenom;
+        float dv0x[4], dv0y[4], dv0z[4], dv1x[4], dv1y[4], dv1z[4], dv2x[4], dv2y[4], dv2z[4];
+        (eABx*tab - eCAx*tca).store(dv0x);
+        (eABy*tab - eCAy*tca).store(dv0y);
+        (eABz*tab - eCAz*tca).store(dv0z);
+        (eBCx*tbc - eABx*tab).store(dv1x);
+        (eBCy*tbc - eABy*tab).store(dv1y);
+        (eBCz*tbc - eABz*tab).store(dv1z);
+        (eCAx*tca - eBCx*tbc).store(dv2x);
+        (eCAy*tca - eBCy*tbc).store(dv2y);
+        (eCAz*tca - eBCz*tbc).store(dv2z);
+
+        // Update the velocities.
+
+        int numInGroup = min(4, numClusters-index);
+        for (int i = 0; i < numInGroup; i++) {
+            velocities[atom1[i]] += RealVec(dv0x[i], dv0y[i], dv0z[i])*inverseMasses[atom1[i]];
+            velocities[atom2[i]] += RealVec(dv1x[i], dv1y[i], dv1z[i])*inverseMasses[atom2[i]];
+            velocities[atom3[i]] += RealVec(dv2x[i], dv2y[i], dv2z[i])*inverseMasses[atom3[i]];
+        }
+    }
+}
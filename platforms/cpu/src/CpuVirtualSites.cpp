@@ -0,0 +1,381 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2016 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "CpuVirtualSites.h"
+#include "SimTKOpenMMRealType.h"
+#include "openmm/VirtualSite.h"
+#include <algorithm>
+#include <utility>
+
+using namespace OpenMM;
+using namespace std;
+
+class CpuVirtualSites::ComputePositionsTask : public ThreadPool::Task {
+public:
+    ComputePositionsTask(CpuVirtualSites& owner) : owner(owner) {
+    }
+    void execute(ThreadPool& threads, int threadIndex) {
+        owner.threadComputePositions(threadIndex);
+    }
+    CpuVirtualSites& owner;
+};
+
+class CpuVirtualSites::ComputeContributionsTask : public ThreadPool::Task {
+public:
+    ComputeContributionsTask(CpuVirtualSites& owner) : owner(owner) {
+    }
+    void execute(ThreadPool& threads, int threadIndex) {
+        owner.threadComputeContributions(threadIndex);
+    }
+    CpuVirtualSites& owner;
+};
+
+class CpuVirtualSites::SumContributionsTask : public ThreadPool::Task {
+public:
+    SumContributionsTask(CpuVirtualSites& owner) : owner(owner) {
+    }
+    void execute(ThreadPool& threads, int threadIndex) {
+        owner.threadSumContributions(threadIndex);
+    }
+    CpuVirtualSites& owner;
+};
+
+CpuVirtualSites::CpuVirtualSites(const System& system, ThreadPool& threads) : threads(threads) {
+    // Record the parameters of all the sites, grouped by type.
+
+    siteType.resize(system.getNumParticles(), NotVirtualSite);
+    siteIndex.resize(system.getNumParticles(), -1);
+    for (int i = 0; i < system.getNumParticles(); i++) {
+        if (!system.isVirtualSite(i))
+            continue;
+        const VirtualSite& site = system.getVirtualSite(i);
+        if (dynamic_cast<const TwoParticleAverageSite*>(&site) != NULL) {
+            siteType[i] = TwoParticleAverage;
+            siteIndex[i] = twoSite.size();
+            twoSite.push_back(i);
+            twoAtom1.push_back(site.getParticle(0));
+            twoAtom2.push_back(site.getParticle(1));
+            twoWeight1.push_back(dynamic_cast<const TwoParticleAverageSite&>(site).getWeight(0));
+            twoWeight2.push_back(dynamic_cast<const TwoParticleAverageSite&>(site).getWeight(1));
+        }
+        else if (dynamic_cast<const ThreeParticleAverageSite*>(&site) != NULL) {
+            siteType[i] = ThreeParticleAverage;
+            siteIndex[i] = threeSite.size();
+            threeSite.push_back(i);
+            threeAtom1.push_back(site.getParticle(0));
+            threeAtom2.push_back(site.getParticle(1));
+            threeAtom3.push_back(site.getParticle(2));
+            threeWeight1.push_back(dynamic_cast<const ThreeParticleAverageSite&>(site).getWeight(0));
+            threeWeight2.push_back(dynamic_cast<const ThreeParticleAverageSite&>(site).getWeight(1));
+            threeWeight3.push_back(dynamic_cast<const ThreeParticleAverageSite&>(site).getWeight(2));
+        }
+        else if (dynamic_cast<const OutOfPlaneSite*>(&site) != NULL) {
+            const OutOfPlaneSite& outOfPlane = dynamic_cast<const OutOfPlaneSite&>(site);
+            siteType[i] = OutOfPlane;
+            siteIndex[i] = outOfPlaneSite.size();
+            outOfPlaneSite.push_back(i);
+            outOfPlaneAtom1.push_back(site.getParticle(0));
+            outOfPlaneAtom2.push_back(site.getParticle(1));
+            outOfPlaneAtom3.push_back(site.getParticle(2));
+            outOfPlaneWeight12.push_back(outOfPlane.getWeight12());
+            outOfPlaneWeight13.push_back(outOfPlane.getWeight13());
+            outOfPlaneWeightCross.push_back(outOfPlane.getWeightCross());
+        }
+        else if (dynamic_cast<const LocalCoordinatesSite*>(&site) != NULL) {
+            const LocalCoordinatesSite& local = dynamic_cast<const LocalCoordinatesSite&>(site);
+            siteType[i] = LocalCoordinates;
+            siteIndex[i] = localSite.size();
+            localSite.push_back(i);
+            localAtom1.push_back(site.getParticle(0));
+            localAtom2.push_back(site.getParticle(1));
+            localAtom3.push_back(site.getParticle(2));
+            localOriginWeights.push_back(local.getOriginWeights());
+            localXWeights.push_back(local.getXWeights());
+            localYWeights.push_back(local.getYWeights());
+            localPosition.push_back(local.getLocalPosition());
+        }
+    }
+    threeOffset = 2*twoSite.size();
+    outOfPlaneOffset = threeOffset+3*threeSite.size();
+    localOffset = outOfPlaneOffset+3*outOfPlaneSite.size();
+    contributions.resize(localOffset+3*localSite.size());
+
+    // Build the list of contributions to each particle, sorted by the index of the site they come from.
+
+    vector<pair<pair<int, int>, int> > entries;
+    for (int i = 0; i < (int) twoSite.size(); i++) {
+        entries.push_back(make_pair(make_pair(twoAtom1[i], twoSite[i]), 2*i));
+        entries.push_back(make_pair(make_pair(twoAtom2[i], twoSite[i]), 2*i+1));
+    }
+    for (int i = 0; i < (int) threeSite.size(); i++) {
+        entries.push_back(make_pair(make_pair(threeAtom1[i], threeSite[i]), threeOffset+3*i));
+        entries.push_back(make_pair(make_pair(threeAtom2[i], threeSite[i]), threeOffset+3*i+1));
+        entries.push_back(make_pair(make_pair(threeAtom3[i], threeSite[i]), threeOffset+3*i+2));
+    }
+    for (int i = 0; i < (int) outOfPlaneSite.size(); i++) {
+        entries.push_back(make_pair(make_pair(outOfPlaneAtom1[i], outOfPlaneSite[i]), outOfPlaneOffset+3*i));
+        entries.push_back(make_pair(make_pair(outOfPlaneAtom2[i], outOfPlaneSite[i]), outOfPlaneOffset+3*i+1));
+        entries.push_back(make_pair(make_pair(outOfPlaneAtom3[i], outOfPlaneSite[i]), outOfPlaneOffset+3*i+2));
+    }
+    for (int i = 0; i < (int) localSite.size(); i++) {
+        entries.push_back(make_pair(make_pair(localAtom1[i], localSite[i]), localOffset+3*i));
+        entries.push_back(make_pair(make_pair(localAtom2[i], localSite[i]), localOffset+3*i+1));
+        entries.push_back(make_pair(make_pair(localAtom3[i], localSite[i]), localOffset+3*i+2));
+    }
+    sort(entries.begin(), entries.end());
+    for (int i = 0; i < (int) entries.size(); i++) {
+        if (i == 0 || entries[i].first.first != entries[i-1].first.first) {
+            contributionParticle.push_back(entries[i].first.first);
+            contributionStart.push_back(i);
+        }
+        contributionIndex.push_back(entries[i].second);
+    }
+    contributionStart.push_back(entries.size());
+}
+
+void CpuVirtualSites::computePositions(vector<RealVec>& atomCoordinates) {
+    this->atomCoordinates = &atomCoordinates[0];
+    ComputePositionsTask task(*this);
+    threads.execute(task);
+    threads.waitForThreads();
+}
+
+void CpuVirtualSites::distributeForces(const vector<RealVec>& atomCoordinates, vector<RealVec>& forces) {
+    this->atomCoordinates = const_cast<RealVec*>(&atomCoordinates[0]);
+    this->forces = &forces[0];
+
+    // First compute the force each site applies to each particle, then let each particle add up
+    // the forces applied to it.
+
+    ComputeContributionsTask task1(*this);
+    threads.execute(task1);
+    threads.waitForThreads();
+    SumContributionsTask task2(*this);
+    threads.execute(task2);
+    threads.waitForThreads();
+}
+
+void CpuVirtualSites::computePosition(int site, vector<RealVec>& atomCoordinates) const {
+    int index = siteIndex[site];
+    switch (siteType[site]) {
+        case TwoParticleAverage:
+            computeTwoParticleAverage(index, &atomCoordinates[0]);
+            break;
+        case ThreeParticleAverage:
+            computeThreeParticleAverage(index, &atomCoordinates[0]);
+            break;
+        case OutOfPlane:
+            computeOutOfPlane(index, &atomCoordinates[0]);
+            break;
+        case LocalCoordinates:
+            computeLocalCoordinates(index, &atomCoordinates[0]);
+            break;
+        default:
+            break;
+    }
+}
+
+void CpuVirtualSites::threadComputePositions(int threadIndex) {
+    const int numThreads = threads.getNumThreads();
+    int start = threadIndex*twoSite.size()/numThreads;
+    int end = (threadIndex+1)*twoSite.size()/numThreads;
+    for (int i = start; i < end; i++)
+        computeTwoParticleAverage(i, atomCoordinates);
+    start = threadIndex*threeSite.size()/numThreads;
+    end = (threadIndex+1)*threeSite.size()/numThreads;
+    for (int i = start; i < end; i++)
+        computeThreeParticleAverage(i, atomCoordinates);
+    start = threadIndex*outOfPlaneSite.size()/numThreads;
+    end = (threadIndex+1)*outOfPlaneSite.size()/numThreads;
+    for (int i = start; i < end; i++)
+        computeOutOfPlane(i, atomCoordinates);
+    start = threadIndex*localSite.size()/numThreads;
+    end = (threadIndex+1)*localSite.size()/numThreads;
+    for (int i = start; i < end; i++)
+        computeLocalCoordinates(i, atomCoordinates);
+}
+
+void CpuVirtualSites::computeTwoParticleAverage(int i, RealVec* atomCoordinates) const {
+    atomCoordinates[twoSite[i]] = atomCoordinates[twoAtom1[i]]*twoWeight1[i] + atomCoordinates[twoAtom2[i]]*twoWeight2[i];
+}
+
+void CpuVirtualSites::computeThreeParticleAverage(int i, RealVec* atomCoordinates) const {
+    atomCoordinates[threeSite[i]] = atomCoordinates[threeAtom1[i]]*threeWeight1[i] + atomCoordinates[threeAtom2[i]]*threeWeight2[i] + atomCoordinates[threeAtom3[i]]*threeWeight3[i];
+}
+
+void CpuVirtualSites::computeOutOfPlane(int i, RealVec* atomCoordinates) const {
+    RealVec v12 = atomCoordinates[outOfPlaneAtom2[i]]-atomCoordinates[outOfPlaneAtom1[i]];
+    RealVec v13 = atomCoordinates[outOfPlaneAtom3[i]]-atomCoordinates[outOfPlaneAtom1[i]];
+    RealVec cross = v12.cross(v13);
+    atomCoordinates[outOfPlaneSite[i]] = atomCoordinates[outOfPlaneAtom1[i]] + v12*outOfPlaneWeight12[i] + v13*outOfPlaneWeight13[i] + cross*outOfPlaneWeightCross[i];
+}
+
+void CpuVirtualSites::computeLocalCoordinates(int i, RealVec* atomCoordinates) const {
+    const RealVec& p1 = atomCoordinates[localAtom1[i]];
+    const RealVec& p2 = atomCoordinates[localAtom2[i]];
+    const RealVec& p3 = atomCoordinates[localAtom3[i]];
+    const RealVec& originWeights = localOriginWeights[i];
+    const RealVec& xWeights = localXWeights[i];
+    const RealVec& yWeights = localYWeights[i];
+    RealVec origin = p1*originWeights[0] + p2*originWeights[1] + p3*originWeights[2];
+    RealVec xdir = p1*xWeights[0] + p2*xWeights[1] + p3*xWeights[2];
+    RealVec ydir = p1*yWeights[0] + p2*yWeights[1] + p3*yWeights[2];
+    RealVec zdir = xdir.cross(ydir);
+    xdir /= SQRT(xdir.dot(xdir));
+    zdir /= SQRT(zdir.dot(zdir));
+    ydir = zdir.cross(xdir);
+    atomCoordinates[localSite[i]] = origin + xdir*localPosition[i][0] + ydir*localPosition[i][1] + zdir*localPosition[i][2];
+}
+
+void CpuVirtualSites::threadComputeContributions(int threadIndex) {
+    const int numThreads = threads.getNumThreads();
+    int start = threadIndex*twoSite.size()/numThreads;
+    int end = (threadIndex+1)*twoSite.size()/numThreads;
+    for (int i = start; i < end; i++) {
+        RealVec f = forces[twoSite[i]];
+        contributions[2*i] = f*twoWeight1[i];
+        contributions[2*i+1] = f*twoWeight2[i];
+    }
+    start = threadIndex*threeSite.size()/numThreads;
+    end = (threadIndex+1)*threeSite.size()/numThreads;
+    for (int i = start; i < end; i++) {
+        RealVec f = forces[threeSite[i]];
+        RealVec* c = &contributions[threeOffset+3*i];
+        c[0] = f*threeWeight1[i];
+        c[1] = f*threeWeight2[i];
+        c[2] = f*threeWeight3[i];
+    }
+    start = threadIndex*outOfPlaneSite.size()/numThreads;
+    end = (threadIndex+1)*outOfPlaneSite.size()/numThreads;
+    for (int i = start; i < end; i++) {
+        RealVec f = forces[outOfPlaneSite[i]];
+        RealOpenMM w12 = outOfPlaneWeight12[i], w13 = outOfPlaneWeight13[i], wcross = outOfPlaneWeightCross[i];
+        RealVec v12 = atomCoordinates[outOfPlaneAtom2[i]]-atomCoordinates[outOfPlaneAtom1[i]];
+        RealVec v13 = atomCoordinates[outOfPlaneAtom3[i]]-atomCoordinates[outOfPlaneAtom1[i]];
+        RealVec f2(w12*f[0] - wcross*v13[2]*f[1] + wcross*v13[1]*f[2],
+                   wcross*v13[2]*f[0] + w12*f[1] - wcross*v13[0]*f[2],
+                  -wcross*v13[1]*f[0] + wcross*v13[0]*f[1] + w12*f[2]);
+        RealVec f3(w13*f[0] + wcross*v12[2]*f[1] - wcross*v12[1]*f[2],
+                  -wcross*v12[2]*f[0] + w13*f[1] + wcross*v12[0]*f[2],
+                   wcross*v12[1]*f[0] - wcross*v12[0]*f[1] + w13*f[2]);
+        RealVec* c = &contributions[outOfPlaneOffset+3*i];
+        c[0] = f-f2-f3;
+        c[1] = f2;
+        c[2] = f3;
+    }
+    start = threadIndex*localSite.size()/numThreads;
+    end = (threadIndex+1)*localSite.size()/numThreads;
+    for (int i = start; i < end; i++) {
+        RealVec f = forces[localSite[i]];
+        const RealVec& p1 = atomCoordinates[localAtom1[i]];
+        const RealVec& p2 = atomCoordinates[localAtom2[i]];
+        const RealVec& p3 = atomCoordinates[localAtom3[i]];
+        const RealVec& originWeights = localOriginWeights[i];
+        const RealVec& wx = localXWeights[i];
+        const RealVec& wy = localYWeights[i];
+        RealVec xdir = p1*wx[0] + p2*wx[1] + p3*wx[2];
+        RealVec ydir = p1*wy[0] + p2*wy[1] + p3*wy[2];
+        RealVec zdir = xdir.cross(ydir);
+        RealOpenMM invNormXdir = 1.0/SQRT(xdir.dot(xdir));
+        RealOpenMM invNormZdir = 1.0/SQRT(zdir.dot(zdir));
+        RealVec dx = xdir*invNormXdir;
+        RealVec dz = zdir*invNormZdir;
+        RealVec dy = dz.cross(dx);
+        RealVec c1, c2, c3;
+
+        // The derivatives for this case are very complicated.  They were computed with SymPy then simplified by hand.
+        
+        RealOpenMM t11 = (wx[0]*ydir[0]-wy[0]*xdir[0])*invNormZdir;
+        RealOpenMM t12 = (wx[0]*ydir[1]-wy[0]*xdir[1])*invNormZdir;
+        RealOpenMM t13 = (wx[0]*ydir[2]-wy[0]*xdir[2])*invNormZdir;
+        RealOpenMM t21 = (wx[1]*ydir[0]-wy[1]*xdir[0])*invNormZdir;
+        RealOpenMM t22 = (wx[1]*ydir[1]-wy[1]*xdir[1])*invNormZdir;
+        RealOpenMM t23 = (wx[1]*ydir[2]-wy[1]*xdir[2])*invNormZdir;
+        RealOpenMM t31 = (wx[2]*ydir[0]-wy[2]*xdir[0])*invNormZdir;
+        RealOpenMM t32 = (wx[2]*ydir[1]-wy[2]*xdir[1])*invNormZdir;
+        RealOpenMM t33 = (wx[2]*ydir[2]-wy[2]*xdir[2])*invNormZdir;
+        RealOpenMM sx1 = t13*dz[1]-t12*dz[2];
+        RealOpenMM sy1 = t11*dz[2]-t13*dz[0];
+        RealOpenMM sz1 = t12*dz[0]-t11*dz[1];
+        RealOpenMM sx2 = t23*dz[1]-t22*dz[2];
+        RealOpenMM sy2 = t21*dz[2]-t23*dz[0];
+        RealOpenMM sz2 = t22*dz[0]-t21*dz[1];
+        RealOpenMM sx3 = t33*dz[1]-t32*dz[2];
+        RealOpenMM sy3 = t31*dz[2]-t33*dz[0];
+        RealOpenMM sz3 = t32*dz[0]-t31*dz[1];
+        RealVec wxScaled = wx*invNormXdir;
+        RealVec fp1 = localPosition[i]*f[0];
+        RealVec fp2 = localPosition[i]*f[1];
+        RealVec fp3 = localPosition[i]*f[2];
+        c1[0] += fp1[0]*wxScaled[0]*(1-dx[0]*dx[0]) + fp1[2]*(dz[0]*sx1    ) + fp1[1]*((-dx[0]*dy[0]      )*wxScaled[0] + dy[0]*sx1 - dx[1]*t12 - dx[2]*t13) + f[0]*originWeights[0];
+        c1[1] += fp1[0]*wxScaled[0]*( -dx[0]*dx[1]) + fp1[2]*(dz[0]*sy1+t13) + fp1[1]*((-dx[1]*dy[0]-dz[2])*wxScaled[0] + dy[0]*sy1 + dx[1]*t11);
+        c1[2] += fp1[0]*wxScaled[0]*( -dx[0]*dx[2]) + fp1[2]*(dz[0]*sz1-t12) + fp1[1]*((-dx[2]*dy[0]+dz[1])*wxScaled[0] + dy[0]*sz1 + dx[2]*t11);
+        c2[0] += fp1[0]*wxScaled[1]*(1-dx[0]*dx[0]) + fp1[2]*(dz[0]*sx2    ) + fp1[1]*((-dx[0]*dy[0]      )*wxScaled[1] + dy[0]*sx2 - dx[1]*t22 - dx[2]*t23) + f[0]*originWeights[1];
+        c2[1] += fp1[0]*wxScaled[1]*( -dx[0]*dx[1]) + fp1[2]*(dz[0]*sy2+t23) + fp1[1]*((-dx[1]*dy[0]-dz[2])*wxScaled[1] + dy[0]*sy2 + dx[1]*t21);
+        c2[2] += fp1[0]*wxScaled[1]*( -dx[0]*dx[2]) + fp1[2]*(dz[0]*sz2-t22) + fp1[1]*((-dx[2]*dy[0]+dz[1])*wxScaled[1] + dy[0]*sz2 + dx[2]*t21);
+        c3[0] += fp1[0]*wxScaled[2]*(1-dx[0]*dx[0]) + fp1[2]*(dz[0]*sx3    ) + fp1[1]*((-dx[0]*dy[0]      )*wxScaled[2] + dy[0]*sx3 - dx[1]*t32 - dx[2]*t33) + f[0]*originWeights[2];
+        c3[1] += fp1[0]*wxScaled[2]*( -dx[0]*dx[1]) + fp1[2]*(dz[0]*sy3+t33) + fp1[1]*((-dx[1]*dy[0]-dz[2])*wxScaled[2] + dy[0]*sy3 + dx[1]*t31);
+        c3[2] += fp1[0]*wxScaled[2]*( -dx[0]*dx[2]) + fp1[2]*(dz[0]*sz3-t32) + fp1[1]*((-dx[2]*dy[0]+dz[1])*wxScaled[2] + dy[0]*sz3 + dx[2]*t31);
+        c1[0] += fp2[0]*wxScaled[0]*( -dx[1]*dx[0]) + fp2[2]*(dz[1]*sx1-t13) - fp2[1]*(( dx[0]*dy[1]-dz[2])*wxScaled[0] - dy[1]*sx1 - dx[0]*t12);
+        c1[1] += fp2[0]*wxScaled[0]*(1-dx[1]*dx[1]) + fp2[2]*(dz[1]*sy1    ) - fp2[1]*(( dx[1]*dy[1]      )*wxScaled[0] - dy[1]*sy1 + dx[0]*t11 + dx[2]*t13) + f[1]*originWeights[0];
+        c1[2] += fp2[0]*wxScaled[0]*( -dx[1]*dx[2]) + fp2[2]*(dz[1]*sz1+t11) - fp2[1]*(( dx[2]*dy[1]+dz[0])*wxScaled[0] - dy[1]*sz1 - dx[2]*t12);
+        c2[0] += fp2[0]*wxScaled[1]*( -dx[1]*dx[0]) + fp2[2]*(dz[1]*sx2-t23) - fp2[1]*(( dx[0]*dy[1]-dz[2])*wxScaled[1] - dy[1]*sx2 - dx[0]*t22);
+        c2[1] += fp2[0]*wxScaled[1]*(1-dx[1]*dx[1]) + fp2[2]*(dz[1]*sy2    ) - fp2[1]*(( dx[1]*dy[1]      )*wxScaled[1] - dy[1]*sy2 + dx[0]*t21 + dx[2]*t23) + f[1]*originWeights[1];
+        c2[2] += fp2[0]*wxScaled[1]*( -dx[1]*dx[2]) + fp2[2]*(dz[1]*sz2+t21) - fp2[1]*(( dx[2]*dy[1]+dz[0])*wxScaled[1] - dy[1]*sz2 - dx[2]*t22);
+        c3[0] += fp2[0]*wxScaled[2]*( -dx[1]*dx[0]) + fp2[2]*(dz[1]*sx3-t33) - fp2[1]*(( dx[0]*dy[1]-dz[2])*wxScaled[2] - dy[1]*sx3 - dx[0]*t32);
+        c3[1] += fp2[0]*wxScaled[2]*(1-dx[1]*dx[1]) + fp2[2]*(dz[1]*sy3    ) - fp2[1]*(( dx[1]*dy[1]      )*wxScaled[2] - dy[1]*sy3 + dx[0]*t31 + dx[2]*t33) + f[1]*originWeights[2];
+        c3[2] += fp2[0]*wxScaled[2]*( -dx[1]*dx[2]) + fp2[2]*(dz[1]*sz3+t31) - fp2[1]*(( dx[2]*dy[1]+dz[0])*wxScaled[2] - dy[1]*sz3 - dx[2]*t32);
+        c1[0] += fp3[0]*wxScaled[0]*( -dx[2]*dx[0]) + fp3[2]*(dz[2]*sx1+t12) + fp3[1]*((-dx[0]*dy[2]-dz[1])*wxScaled[0] + dy[2]*sx1 + dx[0]*t13);
+        c1[1] += fp3[0]*wxScaled[0]*( -dx[2]*dx[1]) + fp3[2]*(dz[2]*sy1-t11) + fp3[1]*((-dx[1]*dy[2]+dz[0])*wxScaled[0] + dy[2]*sy1 + dx[1]*t13);
+        c1[2] += fp3[0]*wxScaled[0]*(1-dx[2]*dx[2]) + fp3[2]*(dz[2]*sz1    ) + fp3[1]*((-dx[2]*dy[2]      )*wxScaled[0] + dy[2]*sz1 - dx[0]*t11 - dx[1]*t12) + f[2]*originWeights[0];
+        c2[0] += fp3[0]*wxScaled[1]*( -dx[2]*dx[0]) + fp3[2]*(dz[2]*sx2+t22) + fp3[1]*((-dx[0]*dy[2]-dz[1])*wxScaled[1] + dy[2]*sx2 + dx[0]*t23);
+        c2[1] += fp3[0]*wxScaled[1]*( -dx[2]*dx[1]) + fp3[2]*(dz[2]*sy2-t21) + fp3[1]*((-dx[1]*dy[2]+dz[0])*wxScaled[1] + dy[2]*sy2 + dx[1]*t23);
+        c2[2] += fp3[0]*wxScaled[1]*(1-dx[2]*dx[2]) + fp3[2]*(dz[2]*sz2    ) + fp3[1]*((-dx[2]*dy[2]      )*wxScaled[1] + dy[2]*sz2 - dx[0]*t21 - dx[1]*t22) + f[2]*originWeights[1];
+        c3[0] += fp3[0]*wxScaled[2]*( -dx[2]*dx[0]) + fp3[2]*(dz[2]*sx3+t32) + fp3[1]*((-dx[0]*dy[2]-dz[1])*wxScaled[2] + dy[2]*sx3 + dx[0]*t33);
+        c3[1] += fp3[0]*wxScaled[2]*( -dx[2]*dx[1]) + fp3[2]*(dz[2]*sy3-t31) + fp3[1]*((-dx[1]*dy[2]+dz[0])*wxScaled[2] + dy[2]*sy3 + dx[1]*t33);
+        c3[2] += fp3[0]*wxScaled[2]*(1-dx[2]*dx[2]) + fp3[2]*(dz[2]*sz3    ) + fp3[1]*((-dx[2]*dy[2]      )*wxScaled[2] + dy[2]*sz3 - dx[0]*t31 - dx[1]*t32) + f[2]*originWeights[2];
+        RealVec* c = &contributions[localOffset+3*i];
+        c[0] = c1;
+        c[1] = c2;
+        c[2] = c3;
+    }
+}
+
+void CpuVirtualSites::threadSumContributions(int threadIndex) {
+    const int numThreads = threads.getNumThreads();
+    int start = threadIndex*contributionParticle.size()/numThreads;
+    int end = (threadIndex+1)*contributionParticle.size()/numThreads;
+    for (int i = start; i < end; i++) {
+        RealVec& f = forces[contributionParticle[i]];
+        for (int j = contributionStart[i]; j < contributionStart[i+1]; j++)
+            f += contributions[contributionIndex[j]];
+    }
+}
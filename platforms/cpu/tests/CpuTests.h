@@ -35,6 +35,7 @@
 #include "CpuPlatform.h"
 #include <cstdlib>
 #include <iostream>
+#include <string>
 
 OpenMM::CpuPlatform platform;
 
@@ -43,4 +44,6 @@ void initializeTests(int argc, char* argv[]) {
         std::cout << "CPU is not supported.  Exiting." << std::endl;
         exit(0);
     }
+    if (argc > 1)
+        platform.setPropertyDefaultValue("Precision", std::string(argv[1]));
 }
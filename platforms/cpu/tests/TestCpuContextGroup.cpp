@@ -0,0 +1,118 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2016 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "CpuTests.h"
+#include "TestContextGroup.h"
+#include "openmm/HarmonicAngleForce.h"
+#include "openmm/OpenMMException.h"
+
+/**
+ * Force is the only public class that can retrieve the ContextImpl for a Context, so use a subclass
+ * of it to reach the platform data.
+ */
+class ContextImplAccessor : public Force {
+public:
+    static ContextImpl& getImpl(Context& context) {
+        return ContextImplAccessor().getContextImpl(context);
+    }
+protected:
+    ForceImpl* createImpl() const {
+        throw OpenMMException("ContextImplAccessor cannot be added to a System");
+    }
+};
+
+/**
+ * Verify that Contexts in a group really do share the thread pool, force buffers, exclusions, and
+ * division of bonded interactions between threads, while a separate Context does not.
+ */
+void testSharedData() {
+    const int numParticles = 20;
+    System system;
+    NonbondedForce* nonbonded = new NonbondedForce();
+    system.addForce(nonbonded);
+    nonbonded->setNonbondedMethod(NonbondedForce::CutoffNonPeriodic);
+    nonbonded->setCutoffDistance(1.0);
+    HarmonicAngleForce* angles = new HarmonicAngleForce();
+    system.addForce(angles);
+    vector<Vec3> positions;
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        nonbonded->addParticle(i%2 == 0 ? 0.1 : -0.1, 0.2, 0.2);
+        if (i > 0)
+            nonbonded->addException(i-1, i, 0.005, 0.2, 0.1);
+        if (i > 1)
+            angles->addAngle(i-2, i-1, i, 2.0, 10.0);
+        positions.push_back(Vec3(0.15*i, 0.1*(i%2), 0));
+    }
+    ContextGroup group(system, platform);
+    VerletIntegrator integrator1(0.001), integrator2(0.001), integrator3(0.001);
+    Context& context1 = group.addContext(integrator1);
+    Context& context2 = group.addContext(integrator2);
+    Context context3(system, integrator3, platform);
+    context1.setPositions(positions);
+    context2.setPositions(positions);
+    context3.setPositions(positions);
+    context1.getState(State::Forces);
+    context2.getState(State::Forces);
+    context3.getState(State::Forces);
+    CpuPlatform::PlatformData& data1 = CpuPlatform::getPlatformData(ContextImplAccessor::getImpl(context1));
+    CpuPlatform::PlatformData& data2 = CpuPlatform::getPlatformData(ContextImplAccessor::getImpl(context2));
+    CpuPlatform::PlatformData& data3 = CpuPlatform::getPlatformData(ContextImplAccessor::getImpl(context3));
+    ASSERT(&data1 != &data2);
+    ASSERT(&data1.shared == &data2.shared);
+    ASSERT(&data1.shared != &data3.shared);
+    ASSERT(&data1.threads == &data2.threads);
+    ASSERT(&data1.threads != &data3.threads);
+    ASSERT(&data1.threadForce == &data2.threadForce);
+    ASSERT(&data1.threadForce[0][0] == &data2.threadForce[0][0]);
+    ASSERT(&data1.threadForce != &data3.threadForce);
+    ASSERT(&data1.posq[0] != &data2.posq[0]);
+
+    // In double precision, nonbonded interactions are computed by the Reference platform's code, which
+    // does not use the shared exclusions or divide the exceptions between threads.
+
+    if (!data1.useDoublePrecision) {
+        ASSERT_EQUAL(numParticles-1, data1.exclusions.getNumEntries()/2);
+        ASSERT(data1.exclusions.sharesStorageWith(data2.exclusions));
+        ASSERT(!data1.exclusions.sharesStorageWith(data3.exclusions));
+        ASSERT_EQUAL(1, data1.shared.exclusionLists.size());
+    }
+
+    // The angles and the nonbonded exceptions are each divided between threads once for the whole group.
+
+    int numPartitions = (data1.useDoublePrecision ? 1 : 2);
+    ASSERT_EQUAL(numPartitions, data1.shared.bondPartitions.size());
+    ASSERT_EQUAL(numPartitions, data3.shared.bondPartitions.size());
+}
+
+void runPlatformTests() {
+    testSharedData();
+}
@@ -31,6 +31,68 @@
 
 #include "CpuTests.h"
 #include "TestCustomManyParticleForce.h"
+#include "ReferencePlatform.h"
+#include <set>
+
+void testFiltersAndExclusions(CustomManyParticleForce::PermutationMode mode, CustomManyParticleForce::NonbondedMethod method) {
+    // Build a system large enough to use the neighbor list, with type filters that allow different
+    // types for each particle in a set, and a variety of exclusions.  This exercises the pruning of
+    // candidate sets on the CPU platform, so compare it to the Reference platform.  The energy is
+    // symmetric in the particles, so it does not depend on which ordering each platform selects.
+
+    const int numParticles = 400;
+    const double boxSize = 4.0;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    CustomManyParticleForce* force = new CustomManyParticleForce(3,
+        "k1*k2*k3*(c-distance(p1,p2))^2*(c-distance(p1,p3))^2*(c-distance(p2,p3))^2*(3+cos(angle(p1,p2,p3))+cos(angle(p2,p3,p1))+cos(angle(p3,p1,p2))); c=0.7");
+    force->addPerParticleParameter("k");
+    force->setPermutationMode(mode);
+    force->setNonbondedMethod(method);
+    force->setCutoffDistance(0.7);
+    vector<double> params(1);
+    vector<Vec3> positions;
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        params[0] = 1.0+0.1*(i%7);
+        force->addParticle(params, i%3);
+        positions.push_back(Vec3(boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt)));
+    }
+    for (int i = 0; i < numParticles; i++) {
+        force->addExclusion(i, (i+1)%numParticles);
+        if (i%5 == 0)
+            force->addExclusion(i, (i+17)%numParticles);
+    }
+    set<int> filter;
+    filter.insert(0);
+    force->setTypeFilter(0, filter);
+    filter.insert(1);
+    force->setTypeFilter(1, filter);
+    filter.clear();
+    filter.insert(1);
+    filter.insert(2);
+    force->setTypeFilter(2, filter);
+    system.addForce(force);
+    VerletIntegrator integrator1(0.001);
+    VerletIntegrator integrator2(0.001);
+    ReferencePlatform reference;
+    Context context(system, integrator1, platform);
+    Context refContext(system, integrator2, reference);
+    context.setPositions(positions);
+    refContext.setPositions(positions);
+    State state = context.getState(State::Forces | State::Energy);
+    State refState = refContext.getState(State::Forces | State::Energy);
+    ASSERT(refState.getPotentialEnergy() != 0.0);
+    ASSERT_EQUAL_TOL(refState.getPotentialEnergy(), state.getPotentialEnergy(), 1e-4);
+    for (int i = 0; i < numParticles; i++)
+        ASSERT_EQUAL_VEC(refState.getForces()[i], state.getForces()[i], 1e-4);
+}
 
 void runPlatformTests() {
+    testFiltersAndExclusions(CustomManyParticleForce::SinglePermutation, CustomManyParticleForce::CutoffNonPeriodic);
+    testFiltersAndExclusions(CustomManyParticleForce::SinglePermutation, CustomManyParticleForce::CutoffPeriodic);
+    testFiltersAndExclusions(CustomManyParticleForce::UniqueCentralParticle, CustomManyParticleForce::CutoffNonPeriodic);
+    testFiltersAndExclusions(CustomManyParticleForce::UniqueCentralParticle, CustomManyParticleForce::CutoffPeriodic);
 }
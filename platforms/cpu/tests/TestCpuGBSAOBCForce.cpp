@@ -32,5 +32,67 @@
 #include "CpuTests.h"
 #include "TestGBSAOBCForce.h"
 
+void testExceptions(NonbondedForce::NonbondedMethod method, GBSAOBCForce::NonbondedMethod method2, double nonbondedCutoff, double gbsaCutoff) {
+    // The CPU platform shares one neighbor list between the two forces, which omits pairs that are
+    // excluded from the NonbondedForce.  GBSAOBCForce must still include them.
+
+    const int grid = 7;
+    const int numParticles = 300;
+    const double spacing = 0.6;
+    ReferencePlatform reference;
+    System system;
+    GBSAOBCForce* gbsa = new GBSAOBCForce();
+    NonbondedForce* nonbonded = new NonbondedForce();
+    vector<pair<int, int> > bonds;
+    for (int i = 0; i < numParticles; ++i) {
+        system.addParticle(1.0);
+        double charge = i%2 == 0 ? -1 : 1;
+        gbsa->addParticle(charge, 0.15, 1);
+        nonbonded->addParticle(charge, 0.2, 0.5);
+        if (i > 0)
+            bonds.push_back(make_pair(i-1, i));
+    }
+    nonbonded->createExceptionsFromBonds(bonds, 0.5, 0.5);
+    nonbonded->setNonbondedMethod(method);
+    gbsa->setNonbondedMethod(method2);
+    nonbonded->setCutoffDistance(nonbondedCutoff);
+    gbsa->setCutoffDistance(gbsaCutoff);
+    double boxSize = grid*spacing;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    system.addForce(gbsa);
+    system.addForce(nonbonded);
+    LangevinIntegrator integrator1(0, 0.1, 0.01);
+    LangevinIntegrator integrator2(0, 0.1, 0.01);
+    Context context(system, integrator1, platform);
+    Context refContext(system, integrator2, reference);
+    vector<Vec3> positions(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; ++i) {
+        Vec3 pos((i/(grid*grid))*spacing, ((i/grid)%grid)*spacing, (i%grid)*spacing);
+        positions[i] = pos + Vec3(0.2*genrand_real2(sfmt), 0.2*genrand_real2(sfmt), 0.2*genrand_real2(sfmt));
+    }
+    context.setPositions(positions);
+    refContext.setPositions(positions);
+    State state = context.getState(State::Forces | State::Energy);
+    State refState = refContext.getState(State::Forces | State::Energy);
+    double norm = 0.0;
+    double diff = 0.0;
+    for (int i = 0; i < numParticles; ++i) {
+        Vec3 f = state.getForces()[i];
+        norm += f[0]*f[0] + f[1]*f[1] + f[2]*f[2];
+        Vec3 delta = f-refState.getForces()[i];
+        diff += delta[0]*delta[0] + delta[1]*delta[1] + delta[2]*delta[2];
+    }
+    norm = std::sqrt(norm);
+    diff = std::sqrt(diff);
+    ASSERT_EQUAL_TOL(0.0, diff, 0.001*norm);
+    ASSERT_EQUAL_TOL(state.getPotentialEnergy(), refState.getPotentialEnergy(), 1e-3);
+}
+
 void runPlatformTests() {
+    testExceptions(NonbondedForce::CutoffNonPeriodic, GBSAOBCForce::CutoffNonPeriodic, 1.5, 1.5);
+    testExceptions(NonbondedForce::CutoffNonPeriodic, GBSAOBCForce::CutoffNonPeriodic, 1.2, 1.6);
+    testExceptions(NonbondedForce::CutoffPeriodic, GBSAOBCForce::CutoffPeriodic, 1.5, 1.5);
+    testExceptions(NonbondedForce::CutoffPeriodic, GBSAOBCForce::CutoffPeriodic, 1.6, 1.2);
 }
@@ -31,6 +31,99 @@
 
 #include "CpuTests.h"
 #include "TestLangevinIntegrator.h"
+#include "CpuRandom.h"
+#include <sstream>
+
+/**
+ * Check the distribution of values from the counter based random number generator.
+ */
+void testCounterGaussianDistribution() {
+    CpuRandom random;
+    random.initialize(5, 1);
+    const int numAtoms = 25000;
+    double mean = 0.0, var = 0.0, skew = 0.0, kurtosis = 0.0;
+    for (int step = 0; step < 2; step++)
+        for (int atom = 0; atom < numAtoms; atom++) {
+            float values[4];
+            random.getCounterGaussianRandom(step, atom).store(values);
+            for (int i = 0; i < 4; i++) {
+                double value = values[i];
+                mean += value;
+                var += value*value;
+                skew += value*value*value;
+                kurtosis += value*value*value*value;
+            }
+        }
+    int numValues = 8*numAtoms;
+    mean /= numValues;
+    var /= numValues;
+    skew /= numValues;
+    kurtosis /= numValues;
+    ASSERT_EQUAL_TOL(0.0, mean, 0.01);
+    ASSERT_EQUAL_TOL(1.0, var, 0.01);
+    ASSERT_EQUAL_TOL(0.0, skew, 0.02);
+    ASSERT_EQUAL_TOL(3.0, kurtosis, 0.02);
+
+    // The values should only depend on the step and atom.
+
+    CpuRandom random2;
+    random2.initialize(5, 3);
+    float values1[4], values2[4];
+    random.getCounterGaussianRandom(10, 7).store(values1);
+    random2.getCounterGaussianRandom(10, 7).store(values2);
+    for (int i = 0; i < 4; i++)
+        ASSERT_EQUAL(values1[i], values2[i]);
+    random2.getCounterGaussianRandom(11, 7).store(values2);
+    ASSERT(values1[0] != values2[0]);
+}
+
+/**
+ * With counter based random numbers and deterministic forces, a trajectory should not depend on the
+ * number of threads, and should be reproduced exactly after loading a checkpoint.
+ */
+void testCounterBasedRandom() {
+    System system;
+    NonbondedForce* nonbonded = new NonbondedForce();
+    system.addForce(nonbonded);
+    vector<Vec3> positions;
+    for (int i = 0; i < 64; i++) {
+        system.addParticle(10.0);
+        nonbonded->addParticle(i%2 == 0 ? 0.2 : -0.2, 0.3, 0.5);
+        positions.push_back(Vec3(0.5*(i%4), 0.5*((i/4)%4), 0.5*(i/16)));
+    }
+    vector<Vec3> finalPositions[2];
+    for (int trial = 0; trial < 2; trial++) {
+        map<string, string> properties;
+        properties[CpuPlatform::CpuThreads()] = (trial == 0 ? "1" : "3");
+        properties[CpuPlatform::CpuDeterministicForces()] = "true";
+        properties[CpuPlatform::CpuCounterBasedRandom()] = "true";
+        LangevinIntegrator integrator(300.0, 1.0, 0.002);
+        integrator.setRandomNumberSeed(10);
+        Context context(system, integrator, platform, properties);
+        ASSERT_EQUAL("true", platform.getPropertyValue(context, CpuPlatform::CpuCounterBasedRandom()));
+        context.setPositions(positions);
+        integrator.step(10);
+        stringstream checkpoint;
+        context.createCheckpoint(checkpoint);
+        integrator.step(10);
+        finalPositions[trial] = context.getState(State::Positions).getPositions();
+
+        // Load the checkpoint into a new Context and make sure it follows the same trajectory.
+
+        LangevinIntegrator integrator2(300.0, 1.0, 0.002);
+        integrator2.setRandomNumberSeed(10);
+        Context context2(system, integrator2, platform, properties);
+        context2.loadCheckpoint(checkpoint);
+        integrator2.step(10);
+        vector<Vec3> restartPositions = context2.getState(State::Positions).getPositions();
+        for (int i = 0; i < system.getNumParticles(); i++)
+            ASSERT_EQUAL_VEC(finalPositions[trial][i], restartPositions[i], 0);
+    }
+    for (int i = 0; i < system.getNumParticles(); i++)
+        ASSERT_EQUAL_VEC(finalPositions[0][i], finalPositions[1][i], 0);
+}
 
 void runPlatformTests() {
+    testCounterGaussianDistribution();
+    testCounterBasedRandom();
 }
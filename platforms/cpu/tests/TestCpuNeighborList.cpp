@@ -80,7 +80,7 @@ void testNeighborList(bool periodic, bool triclinic) {
     }
     ThreadPool threads;
     CpuNeighborList neighborList(blockSize);
-    neighborList.computeNeighborList(numParticles, positions, exclusions, boxVectors, periodic, cutoff, threads);
+    neighborList.computeNeighborList(numParticles, positions, CpuExclusionList(exclusions), boxVectors, periodic, cutoff, threads);
     
     // Convert the neighbor list to a set for faster lookup.
     
@@ -119,6 +119,61 @@ void testNeighborList(bool periodic, bool triclinic) {
         }
 }
 
+void testExclusionList() {
+    // Build the same exclusions from pairs and from sets, and make sure they agree.
+
+    const int numParticles = 100;
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    vector<pair<int, int> > pairs;
+    vector<set<int> > exclusions(numParticles);
+    for (int i = 0; i < 300; i++) {
+        int atom1 = (int) (numParticles*genrand_real2(sfmt));
+        int atom2 = (int) (numParticles*genrand_real2(sfmt));
+        pairs.push_back(make_pair(atom1, atom2));
+        if (i%3 == 0)
+            pairs.push_back(make_pair(atom2, atom1)); // Duplicates should be ignored.
+        exclusions[atom1].insert(atom2);
+        exclusions[atom2].insert(atom1);
+    }
+    CpuExclusionList list1(numParticles, pairs);
+    CpuExclusionList list2(exclusions);
+    ASSERT_EQUAL(numParticles, list1.getNumAtoms());
+    ASSERT(list1 == list2);
+    ASSERT_EQUAL(list1.getHash(), list2.getHash());
+    int numEntries = 0;
+    for (int i = 0; i < numParticles; i++) {
+        ASSERT_EQUAL(exclusions[i].size(), list1.end(i)-list1.begin(i));
+        ASSERT(equal(exclusions[i].begin(), exclusions[i].end(), list1.begin(i)));
+        for (int j = 0; j < numParticles; j++)
+            ASSERT_EQUAL(exclusions[i].find(j) != exclusions[i].end(), list1.isExcluded(i, j));
+        numEntries += exclusions[i].size();
+    }
+    ASSERT_EQUAL(numEntries, list1.getNumEntries());
+
+    // Changing a single exclusion should make them compare as different.
+
+    pairs.push_back(make_pair(0, numParticles-1));
+    pairs.push_back(make_pair(1, numParticles-1));
+    CpuExclusionList list3(numParticles, pairs);
+    ASSERT(list1 != list3);
+    ASSERT(CpuExclusionList(numParticles) != CpuExclusionList(numParticles+1));
+    ASSERT(CpuExclusionList(numParticles) == CpuExclusionList(numParticles, vector<pair<int, int> >()));
+
+    // Copies should share storage with the original, and remain valid after it is destroyed.
+
+    CpuExclusionList* original = new CpuExclusionList(numParticles, pairs);
+    CpuExclusionList copy1(*original);
+    CpuExclusionList copy2;
+    copy2 = copy1;
+    ASSERT(copy1.sharesStorageWith(*original));
+    ASSERT(copy2.sharesStorageWith(*original));
+    ASSERT(!list1.sharesStorageWith(list2));
+    delete original;
+    ASSERT(copy2 == list3);
+    ASSERT(copy2.isExcluded(0, numParticles-1));
+}
+
 int main() {
     try {
         if (!CpuPlatform::isProcessorSupported()) {
@@ -128,6 +183,7 @@ int main() {
         testNeighborList(false, false);
         testNeighborList(true, false);
         testNeighborList(true, true);
+        testExclusionList();
     }
     catch(const exception& e) {
         cout << "exception: " << e.what() << endl;
@@ -31,6 +31,321 @@
 
 #include "CpuTests.h"
 #include "TestNonbondedForce.h"
+#include "openmm/HarmonicAngleForce.h"
+#include "openmm/LangevinIntegrator.h"
+#include <sstream>
+
+void testProfiling() {
+    const int numMolecules = 100;
+    const double boxSize = 3.0;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(NonbondedForce::CutoffPeriodic);
+    nonbonded->setCutoffDistance(1.0);
+    system.addForce(nonbonded);
+    vector<Vec3> positions;
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numMolecules; i++) {
+        system.addParticle(10.0);
+        system.addParticle(10.0);
+        nonbonded->addParticle(0.5, 0.2, 0.2);
+        nonbonded->addParticle(-0.5, 0.2, 0.2);
+        nonbonded->addException(2*i, 2*i+1, 0.0, 1.0, 0.0);
+        system.addConstraint(2*i, 2*i+1, 0.1);
+        Vec3 pos(boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt));
+        positions.push_back(pos);
+        positions.push_back(pos+Vec3(0.1, 0, 0));
+    }
+    LangevinIntegrator integrator(300.0, 1.0, 0.001);
+    Context context(system, integrator, platform);
+    context.setPositions(positions);
+    ASSERT(!context.getProfilingEnabled());
+    integrator.step(2);
+    ASSERT(context.getProfilingData().size() == 0);
+
+    // Enable profiling and make sure the expected information is recorded.
+
+    context.setProfilingEnabled(true);
+    ASSERT(context.getProfilingEnabled());
+    integrator.step(5);
+    map<string, double> data = context.getProfilingData();
+    ASSERT(data.find("Force 0 (CalcNonbondedForce)") != data.end());
+    ASSERT(data["Force 0 (CalcNonbondedForce)"] > 0.0);
+    bool usesCpuKernels = (platform.getPropertyValue(context, "Precision") != "double");
+    if (usesCpuKernels)
+        ASSERT(data.find("NonbondedForce direct space") != data.end());
+    ASSERT(data.find("Constraints") != data.end());
+    ASSERT(data.find("Thread wait") != data.end());
+    ASSERT(data.find("Thread idle") != data.end());
+    ASSERT(data["Thread idle"] >= 0.0);
+    string json = context.getProfilingDataAsJson();
+    ASSERT(json.find("\"Force 0 (CalcNonbondedForce)\": {\"seconds\": ") != string::npos);
+    ASSERT(json.find("\"calls\": ") != string::npos);
+
+    // Moving the particles should trigger a neighbor list build.
+
+    for (int i = 0; i < (int) positions.size(); i++)
+        positions[i][0] += 0.5;
+    context.setPositions(positions);
+    context.getState(State::Energy);
+    data = context.getProfilingData();
+    if (usesCpuKernels)
+        ASSERT(data["Neighbor list builds"] >= 1);
+
+    // Resetting or disabling it should discard the information.
+
+    context.resetProfilingData();
+    ASSERT(context.getProfilingData().size() == 0);
+    context.setProfilingEnabled(false);
+    integrator.step(2);
+    ASSERT(context.getProfilingData().size() == 0);
+}
+
+void testReorderParticles(NonbondedForce::NonbondedMethod method) {
+    // Storing particles in sorted order should give the same results as the original order.
+
+    const int numMolecules = 300;
+    const double boxSize = 3.0;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(method);
+    nonbonded->setCutoffDistance(1.0);
+    system.addForce(nonbonded);
+    vector<Vec3> positions;
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numMolecules; i++) {
+        system.addParticle(10.0);
+        system.addParticle(10.0);
+        nonbonded->addParticle(0.5, 0.2, 0.2);
+        nonbonded->addParticle(-0.5, 0.1+0.1*genrand_real2(sfmt), 0.1);
+        nonbonded->addException(2*i, 2*i+1, 0.0, 1.0, 0.0);
+        Vec3 pos(boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt));
+        positions.push_back(pos);
+        positions.push_back(pos+Vec3(0.1, 0, 0));
+    }
+    VerletIntegrator integrator1(0.001), integrator2(0.001);
+    map<string, string> properties;
+    properties["ReorderParticles"] = "true";
+    Context context1(system, integrator1, platform);
+    Context context2(system, integrator2, platform, properties);
+    ASSERT_EQUAL("true", platform.getPropertyValue(context2, "ReorderParticles"));
+    for (int iteration = 0; iteration < 3; iteration++) {
+        if (iteration == 1) {
+            // Move the particles far enough to rebuild the neighbor list.
+
+            for (int i = 0; i < (int) positions.size(); i++)
+                positions[i] += Vec3(0.3*genrand_real2(sfmt), 0.3*genrand_real2(sfmt), 0.3*genrand_real2(sfmt));
+        }
+        if (iteration == 2) {
+            // Change the parameters without rebuilding the neighbor list.
+
+            for (int i = 0; i < numMolecules; i++) {
+                nonbonded->setParticleParameters(2*i, 0.4, 0.25, 0.3);
+                nonbonded->setParticleParameters(2*i+1, -0.4, 0.15, 0.2);
+            }
+            nonbonded->updateParametersInContext(context1);
+            nonbonded->updateParametersInContext(context2);
+        }
+        context1.setPositions(positions);
+        context2.setPositions(positions);
+        State state1 = context1.getState(State::Forces | State::Energy);
+        State state2 = context2.getState(State::Forces | State::Energy);
+        ASSERT_EQUAL_TOL(state1.getPotentialEnergy(), state2.getPotentialEnergy(), 1e-4);
+        for (int i = 0; i < system.getNumParticles(); i++)
+            ASSERT_EQUAL_VEC(state1.getForces()[i], state2.getForces()[i], 1e-4);
+    }
+}
+
+void testDeterministicForces(NonbondedForce::NonbondedMethod method) {
+    // With deterministic forces, the results should be bitwise identical for any number of threads.
+
+    const int numMolecules = 300;
+    const double boxSize = 3.0;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(method);
+    nonbonded->setCutoffDistance(1.0);
+    system.addForce(nonbonded);
+    HarmonicAngleForce* angles = new HarmonicAngleForce();
+    system.addForce(angles);
+    vector<Vec3> positions;
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numMolecules; i++) {
+        system.addParticle(10.0);
+        system.addParticle(10.0);
+        system.addParticle(10.0);
+        nonbonded->addParticle(0.5, 0.2, 0.2);
+        nonbonded->addParticle(-0.3, 0.1+0.1*genrand_real2(sfmt), 0.1);
+        nonbonded->addParticle(-0.2, 0.15, 0.1);
+        nonbonded->addException(3*i, 3*i+1, 0.0, 1.0, 0.0);
+        nonbonded->addException(3*i+1, 3*i+2, 0.0, 1.0, 0.0);
+        nonbonded->addException(3*i, 3*i+2, -0.05, 0.15, 0.1);
+        angles->addAngle(3*i, 3*i+1, 3*i+2, 2.0, 100.0);
+        Vec3 pos = Vec3(i%7, (i/7)%7, i/49)*(boxSize/7)+Vec3(0.05*genrand_real2(sfmt), 0.05*genrand_real2(sfmt), 0.05*genrand_real2(sfmt));
+        positions.push_back(pos);
+        positions.push_back(pos+Vec3(0.1, 0, 0));
+        positions.push_back(pos+Vec3(0.1, 0.1, 0));
+    }
+    VerletIntegrator reference(0.001);
+    Context referenceContext(system, reference, platform);
+    referenceContext.setPositions(positions);
+    State referenceState = referenceContext.getState(State::Forces | State::Energy);
+    vector<State> states;
+    for (int numThreads = 1; numThreads <= 3; numThreads++) {
+        map<string, string> properties;
+        stringstream threads;
+        threads << numThreads;
+        properties[CpuPlatform::CpuThreads()] = threads.str();
+        properties[CpuPlatform::CpuDeterministicForces()] = "true";
+        if (numThreads == 3)
+            properties[CpuPlatform::CpuReorderParticles()] = "true";
+        VerletIntegrator integrator(0.001);
+        Context context(system, integrator, platform, properties);
+        ASSERT_EQUAL("true", platform.getPropertyValue(context, CpuPlatform::CpuDeterministicForces()));
+        context.setPositions(positions);
+        states.push_back(context.getState(State::Forces | State::Energy));
+        states.push_back(context.getState(State::Forces | State::Energy));
+    }
+    ASSERT_EQUAL_TOL(referenceState.getPotentialEnergy(), states[0].getPotentialEnergy(), 1e-5);
+    for (int i = 0; i < system.getNumParticles(); i++)
+        ASSERT_EQUAL_VEC(referenceState.getForces()[i], states[0].getForces()[i], 1e-4);
+    for (int j = 1; j < (int) states.size(); j++) {
+        ASSERT(states[0].getPotentialEnergy() == states[j].getPotentialEnergy());
+        for (int i = 0; i < system.getNumParticles(); i++)
+            ASSERT(states[0].getForces()[i] == states[j].getForces()[i]);
+    }
+}
+
+void testOverlapPme() {
+    // Computing reciprocal space at the same time as direct space should give the same results as computing
+    // them one after the other.
+
+    const int numMolecules = 300;
+    const double boxSize = 3.0;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(NonbondedForce::PME);
+    nonbonded->setCutoffDistance(1.0);
+    system.addForce(nonbonded);
+    vector<Vec3> positions;
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numMolecules; i++) {
+        system.addParticle(10.0);
+        system.addParticle(10.0);
+        nonbonded->addParticle(0.5, 0.2, 0.2);
+        nonbonded->addParticle(-0.5, 0.1+0.1*genrand_real2(sfmt), 0.1);
+        nonbonded->addException(2*i, 2*i+1, 0.0, 1.0, 0.0);
+        Vec3 pos = Vec3(i%7, (i/7)%7, i/49)*(boxSize/7)+Vec3(0.05*genrand_real2(sfmt), 0.05*genrand_real2(sfmt), 0.05*genrand_real2(sfmt));
+        positions.push_back(pos);
+        positions.push_back(pos+Vec3(0.1, 0, 0));
+    }
+    for (int deterministic = 0; deterministic < 2; deterministic++) {
+        vector<State> states;
+        for (int overlap = 0; overlap < 2; overlap++) {
+            map<string, string> properties;
+            properties[CpuPlatform::CpuThreads()] = "3";
+            properties[CpuPlatform::CpuReorderParticles()] = "true";
+            properties[CpuPlatform::CpuDeterministicForces()] = (deterministic ? "true" : "false");
+            properties[CpuPlatform::CpuOverlapPme()] = (overlap ? "true" : "false");
+            properties[CpuPlatform::CpuOverlapPmeFraction()] = "0.5";
+            VerletIntegrator integrator(0.001);
+            Context context(system, integrator, platform, properties);
+            ASSERT_EQUAL(overlap ? "true" : "false", platform.getPropertyValue(context, CpuPlatform::CpuOverlapPme()));
+            ASSERT_EQUAL("0.5", platform.getPropertyValue(context, CpuPlatform::CpuOverlapPmeFraction()));
+            context.setPositions(positions);
+            states.push_back(context.getState(State::Forces | State::Energy));
+        }
+        ASSERT_EQUAL_TOL(states[0].getPotentialEnergy(), states[1].getPotentialEnergy(), 1e-5);
+        for (int i = 0; i < system.getNumParticles(); i++) {
+            ASSERT_EQUAL_VEC(states[0].getForces()[i], states[1].getForces()[i], 1e-5);
+            if (deterministic)
+                ASSERT(states[0].getForces()[i] == states[1].getForces()[i]);
+        }
+    }
+
+    // The fraction of threads used for reciprocal space must leave some for direct space.
+
+    map<string, string> properties;
+    properties[CpuPlatform::CpuOverlapPme()] = "true";
+    properties[CpuPlatform::CpuOverlapPmeFraction()] = "1";
+    VerletIntegrator integrator(0.001);
+    bool failed = false;
+    try {
+        // This should throw an exception.
+
+        Context context(system, integrator, platform, properties);
+    }
+    catch (exception& ex) {
+        failed = true;
+    }
+    ASSERT(failed);
+}
+
+void testMixedPrecision(NonbondedForce::NonbondedMethod method) {
+    // Mixed precision accumulates the forces of each thread in double precision.  Compare it to double
+    // precision, with and without sorting the particles, and make sure double precision can use multiple
+    // threads.
+
+    const int numMolecules = 300;
+    const double boxSize = 3.0;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(method);
+    nonbonded->setCutoffDistance(1.0);
+    system.addForce(nonbonded);
+    vector<Vec3> positions;
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numMolecules; i++) {
+        system.addParticle(10.0);
+        system.addParticle(10.0);
+        nonbonded->addParticle(0.5, 0.2, 0.2);
+        nonbonded->addParticle(-0.5, 0.1+0.1*genrand_real2(sfmt), 0.1);
+        nonbonded->addException(2*i, 2*i+1, 0.0, 1.0, 0.0);
+        Vec3 pos = Vec3(i%7, (i/7)%7, i/49)*(boxSize/7)+Vec3(0.05*genrand_real2(sfmt), 0.05*genrand_real2(sfmt), 0.05*genrand_real2(sfmt));
+        positions.push_back(pos);
+        positions.push_back(pos+Vec3(0.1, 0, 0));
+    }
+    map<string, string> properties;
+    properties[CpuPlatform::CpuThreads()] = "3";
+    properties[CpuPlatform::CpuPrecision()] = "double";
+    VerletIntegrator integrator(0.001);
+    Context context(system, integrator, platform, properties);
+    ASSERT_EQUAL("3", platform.getPropertyValue(context, CpuPlatform::CpuThreads()));
+    context.setPositions(positions);
+    State doubleState = context.getState(State::Forces | State::Energy);
+    for (int reorder = 0; reorder < 2; reorder++) {
+        properties[CpuPlatform::CpuPrecision()] = "mixed";
+        properties[CpuPlatform::CpuReorderParticles()] = (reorder ? "true" : "false");
+        VerletIntegrator integrator2(0.001);
+        Context context2(system, integrator2, platform, properties);
+        ASSERT_EQUAL("mixed", platform.getPropertyValue(context2, CpuPlatform::CpuPrecision()));
+        context2.setPositions(positions);
+        State state = context2.getState(State::Forces | State::Energy);
+        ASSERT_EQUAL_TOL(doubleState.getPotentialEnergy(), state.getPotentialEnergy(), 1e-4);
+        for (int i = 0; i < system.getNumParticles(); i++)
+            ASSERT_EQUAL_VEC(doubleState.getForces()[i], state.getForces()[i], 1e-4);
+    }
+}
 
 void runPlatformTests() {
+    testProfiling();
+    testReorderParticles(NonbondedForce::CutoffPeriodic);
+    testReorderParticles(NonbondedForce::PME);
+    testDeterministicForces(NonbondedForce::NoCutoff);
+    testDeterministicForces(NonbondedForce::CutoffPeriodic);
+    testDeterministicForces(NonbondedForce::PME);
+    testOverlapPme();
+    testMixedPrecision(NonbondedForce::NoCutoff);
+    testMixedPrecision(NonbondedForce::CutoffPeriodic);
+    testMixedPrecision(NonbondedForce::PME);
 }
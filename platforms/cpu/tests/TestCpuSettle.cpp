@@ -31,6 +31,223 @@
 
 #include "CpuTests.h"
 #include "TestSettle.h"
+#include "CpuLangevinDynamics.h"
+#include "CpuSETTLE.h"
+#include "ReferenceConstraints.h"
+#include "openmm/VerletIntegrator.h"
+#include "openmm/VirtualSite.h"
+#include <sstream>
+
+/**
+ * Build a box of four site water molecules and ions.
+ */
+System* createWaterBox(vector<Vec3>& positions) {
+    System* system = new System();
+    NonbondedForce* nonbonded = new NonbondedForce();
+    system->addForce(nonbonded);
+    positions.clear();
+    for (int i = 0; i < 27; i++) {
+        Vec3 pos(0.4*(i%3), 0.4*((i/3)%3), 0.4*(i/9));
+        int first = system->getNumParticles();
+        system->addParticle(16.0);
+        system->addParticle(1.0);
+        system->addParticle(1.0);
+        system->addParticle(0.0);
+        system->setVirtualSite(first+3, new ThreeParticleAverageSite(first, first+1, first+2, 0.786646558, 0.106676721, 0.106676721));
+        system->addConstraint(first, first+1, 0.09572);
+        system->addConstraint(first, first+2, 0.09572);
+        system->addConstraint(first+1, first+2, 0.15139);
+        nonbonded->addParticle(0.0, 0.315, 0.65);
+        nonbonded->addParticle(0.52, 1.0, 0.0);
+        nonbonded->addParticle(0.52, 1.0, 0.0);
+        nonbonded->addParticle(-1.04, 1.0, 0.0);
+        for (int j = 0; j < 4; j++)
+            for (int k = j+1; k < 4; k++)
+                nonbonded->addException(first+j, first+k, 0, 1, 0);
+        positions.push_back(pos);
+        positions.push_back(pos+Vec3(0.09572, 0, 0));
+        positions.push_back(pos+Vec3(-0.02399, 0.09266, 0));
+        positions.push_back(Vec3());
+    }
+    for (int i = 0; i < 2; i++) {
+        system->addParticle(23.0);
+        nonbonded->addParticle(i == 0 ? 1.0 : -1.0, 0.3, 0.5);
+        positions.push_back(Vec3(0.2+0.4*i, 0.2, 0.2));
+    }
+    return system;
+}
+
+/**
+ * Simulate a box of four site water molecules and ions, for which the Langevin integrator does the update,
+ * SETTLE, and virtual sites for each molecule in a single pass.  With no random forces, the result
+ * should match the Reference platform.
+ */
+void testFusedWaterUpdate() {
+    vector<Vec3> positions;
+    System* system = createWaterBox(positions);
+    LangevinIntegrator refIntegrator(0.0, 1.0, 0.001);
+    Context refContext(*system, refIntegrator, Platform::getPlatformByName("Reference"));
+    refContext.setPositions(positions);
+    refContext.computeVirtualSites();
+    refIntegrator.step(10);
+    State refState = refContext.getState(State::Positions | State::Velocities);
+    for (int numThreads = 1; numThreads <= 3; numThreads += 2) {
+        map<string, string> properties;
+        stringstream threads;
+        threads << numThreads;
+        properties[CpuPlatform::CpuThreads()] = threads.str();
+        LangevinIntegrator integrator(0.0, 1.0, 0.001);
+        Context context(*system, integrator, platform, properties);
+        context.setPositions(positions);
+        context.computeVirtualSites();
+        integrator.step(10);
+        State state = context.getState(State::Positions | State::Velocities);
+        for (int i = 0; i < system->getNumParticles(); i++) {
+            ASSERT_EQUAL_VEC(refState.getPositions()[i], state.getPositions()[i], 1e-4);
+            ASSERT_EQUAL_VEC(refState.getVelocities()[i], state.getVelocities()[i], 1e-3);
+        }
+        for (int i = 0; i < system->getNumConstraints(); i++) {
+            int p1, p2;
+            double distance;
+            system->getConstraintParameters(i, p1, p2, distance);
+            Vec3 delta = state.getPositions()[p1]-state.getPositions()[p2];
+            ASSERT_EQUAL_TOL(distance, sqrt(delta.dot(delta)), 1e-5);
+        }
+    }
+    delete system;
+}
+
+/**
+ * Integrate the same water box with two CpuLangevinDynamics objects.  One is given a CpuSETTLE and should
+ * take the fused path.  The other is given a ReferenceSETTLEAlgorithm, which forces it to fall back to
+ * separate passes.  Both should produce the same trajectory.  In single precision, the fused path constrains
+ * the water molecules four at a time with SIMD operations, so the results agree less closely.
+ */
+void testFusedUpdateMatchesSeparatePasses(bool useSinglePrecision) {
+    vector<Vec3> initialPositions;
+    System* system = createWaterBox(initialPositions);
+    int numParticles = system->getNumParticles();
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    vector<RealOpenMM> masses(numParticles);
+    vector<RealVec> forces(numParticles);
+    for (int i = 0; i < numParticles; i++) {
+        masses[i] = system->getParticleMass(i);
+        if (masses[i] != 0.0)
+            forces[i] = RealVec(genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5)*100.0;
+    }
+    ThreadPool threads(3);
+    CpuRandom random;
+    random.initialize(0, threads.getNumThreads());
+    CpuVirtualSites virtualSites(*system, threads);
+    ReferenceConstraints fusedConstraints(*system), separateConstraints(*system);
+    CpuSETTLE* settle = new CpuSETTLE(*system, *(ReferenceSETTLEAlgorithm*) fusedConstraints.settle, threads, useSinglePrecision);
+    delete fusedConstraints.settle;
+    fusedConstraints.settle = settle;
+    CpuLangevinDynamics fused(numParticles, 0.001, 1.0, 0.0, threads, random, &virtualSites);
+    CpuLangevinDynamics separate(numParticles, 0.001, 1.0, 0.0, threads, random, &virtualSites);
+    fused.setReferenceConstraintAlgorithm(&fusedConstraints);
+    separate.setReferenceConstraintAlgorithm(&separateConstraints);
+    vector<RealVec> fusedPos(numParticles), fusedVel(numParticles);
+    for (int i = 0; i < numParticles; i++)
+        fusedPos[i] = initialPositions[i];
+    virtualSites.computePositions(fusedPos);
+    vector<RealVec> separatePos = fusedPos, separateVel = fusedVel;
+    ASSERT(!fused.usesFusedUpdate());
+    for (int i = 0; i < 10; i++) {
+        fused.update(*system, fusedPos, fusedVel, forces, masses, 1e-5);
+        separate.update(*system, separatePos, separateVel, forces, masses, 1e-5);
+    }
+    ASSERT(fused.usesFusedUpdate());
+    ASSERT(!separate.usesFusedUpdate());
+    double posTol = (useSinglePrecision ? 1e-5 : 1e-10);
+    double velTol = (useSinglePrecision ? 1e-2 : 1e-10);
+    for (int i = 0; i < numParticles; i++) {
+        ASSERT_EQUAL_VEC(separatePos[i], fusedPos[i], posTol);
+        ASSERT_EQUAL_VEC(separateVel[i], fusedVel[i], velTol);
+    }
+    for (int i = 0; i < system->getNumConstraints(); i++) {
+        int p1, p2;
+        double distance;
+        system->getConstraintParameters(i, p1, p2, distance);
+        RealVec delta = fusedPos[p1]-fusedPos[p2];
+        ASSERT_EQUAL_TOL(distance, sqrt(delta.dot(delta)), 1e-5);
+    }
+    delete system;
+}
+
+/**
+ * Test the single precision SIMD version of SETTLE, using a number of water molecules that is not a multiple
+ * of four.  Positions and velocities are constrained, and the trajectory should agree with the Reference platform.
+ */
+void testSinglePrecisionSettle() {
+    const int numMolecules = 23;
+    System system;
+    vector<Vec3> positions;
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numMolecules; i++) {
+        Vec3 pos(0.4*(i%3), 0.4*((i/3)%3), 0.4*(i/9));
+        int first = system.getNumParticles();
+        system.addParticle(16.0);
+        system.addParticle(1.0);
+        system.addParticle(1.0);
+        system.addConstraint(first, first+1, 0.1);
+        system.addConstraint(first, first+2, 0.1);
+        system.addConstraint(first+1, first+2, 0.16330);
+        positions.push_back(pos);
+        positions.push_back(pos+Vec3(0.1, 0, 0));
+        positions.push_back(pos+Vec3(-0.03333, 0.09428, 0));
+    }
+    vector<Vec3> velocities(system.getNumParticles());
+    for (int i = 0; i < system.getNumParticles(); i++)
+        velocities[i] = Vec3(genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5);
+    VerletIntegrator refIntegrator(0.002);
+    Context refContext(system, refIntegrator, Platform::getPlatformByName("Reference"));
+    refContext.setPositions(positions);
+    refContext.setVelocities(velocities);
+    refContext.applyVelocityConstraints(1e-5);
+    refIntegrator.step(10);
+    State refState = refContext.getState(State::Positions | State::Velocities);
+    for (int numThreads = 1; numThreads <= 3; numThreads += 2) {
+        map<string, string> properties;
+        stringstream threads;
+        threads << numThreads;
+        properties[CpuPlatform::CpuThreads()] = threads.str();
+        properties[CpuPlatform::CpuPrecision()] = "single";
+        VerletIntegrator integrator(0.002);
+        Context context(system, integrator, platform, properties);
+        context.setPositions(positions);
+        context.setVelocities(velocities);
+        context.applyVelocityConstraints(1e-5);
+        vector<Vec3> constrainedVelocities = context.getState(State::Velocities).getVelocities();
+        for (int i = 0; i < system.getNumConstraints(); i++) {
+            int p1, p2;
+            double distance;
+            system.getConstraintParameters(i, p1, p2, distance);
+            Vec3 delta = positions[p1]-positions[p2];
+            Vec3 relativeVelocity = constrainedVelocities[p1]-constrainedVelocities[p2];
+            ASSERT_EQUAL_TOL(0.0, relativeVelocity.dot(delta)/distance, 1e-5);
+        }
+        integrator.step(10);
+        State state = context.getState(State::Positions | State::Velocities);
+        for (int i = 0; i < system.getNumParticles(); i++) {
+            ASSERT_EQUAL_VEC(refState.getPositions()[i], state.getPositions()[i], 1e-4);
+            ASSERT_EQUAL_VEC(refState.getVelocities()[i], state.getVelocities()[i], 1e-3);
+        }
+        for (int i = 0; i < system.getNumConstraints(); i++) {
+            int p1, p2;
+            double distance;
+            system.getConstraintParameters(i, p1, p2, distance);
+            Vec3 delta = state.getPositions()[p1]-state.getPositions()[p2];
+            ASSERT_EQUAL_TOL(distance, sqrt(delta.dot(delta)), 1e-5);
+        }
+    }
+}
 
 void runPlatformTests() {
+    testFusedWaterUpdate();
+    testFusedUpdateMatchesSeparatePasses(false);
+    testFusedUpdateMatchesSeparatePasses(true);
+    testSinglePrecisionSettle();
 }
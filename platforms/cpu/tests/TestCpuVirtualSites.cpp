@@ -0,0 +1,133 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2016 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "CpuTests.h"
+#include "TestVirtualSites.h"
+#include <sstream>
+
+/**
+ * Build a System containing many molecules with every type of virtual site, so the work gets divided
+ * between multiple threads.
+ */
+System* createManySitesSystem(vector<Vec3>& positions) {
+    System* system = new System();
+    NonbondedForce* nonbonded = new NonbondedForce();
+    system->addForce(nonbonded);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    positions.clear();
+    for (int i = 0; i < 40; i++) {
+        Vec3 center(2.0*(i%4), 2.0*((i/4)%4), 2.0*(i/16));
+        int first = system->getNumParticles();
+        for (int j = 0; j < 3; j++) {
+            system->addParticle(1.0);
+            nonbonded->addParticle(j == 0 ? -0.8 : 0.4, 0.3, 0.5);
+            positions.push_back(center+Vec3(genrand_real2(sfmt), genrand_real2(sfmt), genrand_real2(sfmt))*0.3);
+        }
+        int site = system->addParticle(0.0);
+        nonbonded->addParticle(0.5, 0.3, 0.0);
+        positions.push_back(Vec3());
+        switch (i%4) {
+            case 0:
+                system->setVirtualSite(site, new TwoParticleAverageSite(first, first+1, 0.4, 0.6));
+                break;
+            case 1:
+                system->setVirtualSite(site, new ThreeParticleAverageSite(first, first+1, first+2, 0.3, 0.5, 0.2));
+                break;
+            case 2:
+                system->setVirtualSite(site, new OutOfPlaneSite(first, first+1, first+2, 0.3, 0.5, 0.2));
+                break;
+            case 3:
+                system->setVirtualSite(site, new LocalCoordinatesSite(first, first+1, first+2, Vec3(0.3, 0.3, 0.4), Vec3(1.0, -0.5, -0.5), Vec3(0, -1.0, 1.0), Vec3(0.2, 0.2, 1.0)));
+                break;
+        }
+        for (int j = first; j < site; j++)
+            for (int k = j+1; k <= site; k++)
+                nonbonded->addException(j, k, 0, 1, 0);
+    }
+    return system;
+}
+
+/**
+ * Compare the positions of virtual sites and the redistributed forces to the Reference platform
+ * when using multiple threads.
+ */
+void testParallelSites() {
+    vector<Vec3> positions;
+    System* system = createManySitesSystem(positions);
+    VerletIntegrator refIntegrator(0.001);
+    Context refContext(*system, refIntegrator, Platform::getPlatformByName("Reference"));
+    refContext.setPositions(positions);
+    refContext.computeVirtualSites();
+    State refState = refContext.getState(State::Positions | State::Forces);
+    vector<Vec3> singleThreadForces;
+    for (int numThreads = 1; numThreads <= 3; numThreads++) {
+        map<string, string> properties;
+        stringstream threads;
+        threads << numThreads;
+        properties[CpuPlatform::CpuThreads()] = threads.str();
+        properties[CpuPlatform::CpuDeterministicForces()] = "true";
+        LangevinIntegrator integrator(300.0, 1.0, 0.001);
+        Context context(*system, integrator, platform, properties);
+        context.setPositions(positions);
+        context.computeVirtualSites();
+        State state = context.getState(State::Positions | State::Forces);
+        for (int i = 0; i < system->getNumParticles(); i++) {
+            ASSERT_EQUAL_VEC(refState.getPositions()[i], state.getPositions()[i], 1e-5);
+            ASSERT_EQUAL_VEC(refState.getForces()[i], state.getForces()[i], 1e-4);
+        }
+
+        // The nonbonded forces are deterministic, so distributing the forces from the sites must give
+        // exactly the same result for any number of threads.
+
+        if (numThreads == 1)
+            singleThreadForces = state.getForces();
+        else
+            for (int i = 0; i < system->getNumParticles(); i++)
+                for (int j = 0; j < 3; j++)
+                    ASSERT_EQUAL(singleThreadForces[i][j], state.getForces()[i][j]);
+
+        // Take a few steps and make sure the integrator kept the sites in the right places.
+
+        integrator.step(10);
+        state = context.getState(State::Positions);
+        refContext.setPositions(state.getPositions());
+        refContext.computeVirtualSites();
+        State refStepState = refContext.getState(State::Positions);
+        for (int i = 0; i < system->getNumParticles(); i++)
+            ASSERT_EQUAL_VEC(refStepState.getPositions()[i], state.getPositions()[i], 1e-5);
+    }
+    delete system;
+}
+
+void runPlatformTests() {
+    testParallelSites();
+}
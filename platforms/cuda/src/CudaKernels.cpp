@@ -147,6 +147,10 @@ void CudaUpdateStateDataKernel::setTime(ContextImpl& context, double time) {
         contexts[i]->setTime(time);
 }
 
+int CudaUpdateStateDataKernel::getStepCount(const ContextImpl& context) const {
+    return cu.getStepCount();
+}
+
 class CudaUpdateStateDataKernel::GetPositionsTask : public ThreadPool::Task {
 public:
     GetPositionsTask(CudaContext& cu, vector<Vec3>& positions, vector<float4>& posCorrection) : cu(cu), positions(positions), posCorrection(posCorrection) {
@@ -7390,6 +7394,7 @@ void CudaIntegrateCustomStepKernel::execute(ContextImpl& context, CustomIntegrat
                 // We can just restore the forces we saved earlier.
                 
                 savedForces[forceGroupFlags[step]]->copyTo(cu.getForce());
+                context.incrementStateVersion(); // The ContextImpl's cached forces no longer match the buffer.
             }
             else {
                 recordChangedParameters(context);
@@ -7489,8 +7494,10 @@ void CudaIntegrateCustomStepKernel::execute(ContextImpl& context, CustomIntegrat
             if (blockEnd[step] != -1)
                 nextStep = blockEnd[step]; // Return to the start of a while block.
         }
-        if (invalidatesForces[step])
+        if (invalidatesForces[step]) {
             forcesAreValid = false;
+            context.incrementStateVersion();
+        }
         step = nextStep;
     }
     recordChangedParameters(context);
@@ -7503,6 +7510,7 @@ void CudaIntegrateCustomStepKernel::execute(ContextImpl& context, CustomIntegrat
     if (cu.getAtomsWereReordered()) {
         forcesAreValid = false;
         validSavedForces.clear();
+        context.incrementStateVersion();
     }
 }
 
@@ -111,6 +111,12 @@ public:
      * @param context    the context in which to execute this kernel
      */
     void setTime(ContextImpl& context, double time);
+    /**
+     * Get the number of integration steps that have been taken.
+     *
+     * @param context    the context in which to execute this kernel
+     */
+    int getStepCount(const ContextImpl& context) const;
     /**
      * Get the positions of all particles.
      *
@@ -171,6 +171,10 @@ void OpenCLUpdateStateDataKernel::setTime(ContextImpl& context, double time) {
         contexts[i]->setTime(time);
 }
 
+int OpenCLUpdateStateDataKernel::getStepCount(const ContextImpl& context) const {
+    return cl.getStepCount();
+}
+
 class OpenCLUpdateStateDataKernel::GetPositionsTask : public ThreadPool::Task {
 public:
     GetPositionsTask(OpenCLContext& cl, vector<Vec3>& positions, vector<mm_float4>& posCorrection) : cl(cl), positions(positions), posCorrection(posCorrection) {
@@ -7676,6 +7680,7 @@ void OpenCLIntegrateCustomStepKernel::execute(ContextImpl& context, CustomIntegr
                 // We can just restore the forces we saved earlier.
                 
                 savedForces[forceGroupFlags[step]]->copyTo(cl.getForce());
+                context.incrementStateVersion(); // The ContextImpl's cached forces no longer match the buffer.
             }
             else {
                 recordChangedParameters(context);
@@ -7777,8 +7782,10 @@ void OpenCLIntegrateCustomStepKernel::execute(ContextImpl& context, CustomIntegr
             if (blockEnd[step] != -1)
                 nextStep = blockEnd[step]; // Return to the start of a while block.
         }
-        if (invalidatesForces[step])
+        if (invalidatesForces[step]) {
             forcesAreValid = false;
+            context.incrementStateVersion();
+        }
         step = nextStep;
     }
     recordChangedParameters(context);
@@ -7791,6 +7798,7 @@ void OpenCLIntegrateCustomStepKernel::execute(ContextImpl& context, CustomIntegr
     if (cl.getAtomsWereReordered()) {
         forcesAreValid = false;
         validSavedForces.clear();
+        context.incrementStateVersion();
     }
     
     // Reduce UI lag.
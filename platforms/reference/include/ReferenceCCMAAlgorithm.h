@@ -26,6 +26,7 @@
 #define __ReferenceCCMAAlgorithm_H__
 
 #include "ReferenceConstraintAlgorithm.h"
+#include <string>
 #include <utility>
 #include <vector>
 #include <set>
@@ -54,6 +55,15 @@ private:
 
     void applyConstraints(std::vector<OpenMM::RealVec>& atomCoordinates,
                        std::vector<OpenMM::RealVec>& atomCoordinatesP, std::vector<RealOpenMM>& inverseMasses, bool constrainingVelocities, RealOpenMM tolerance);
+    /**
+     * Serialize the inverse constraint matrix so it can be stored in the cache.
+     */
+    std::string saveMatrix() const;
+    /**
+     * Restore the inverse constraint matrix from data created by saveMatrix().  Returns false
+     * (and leaves the matrix unchanged) if the data is not valid for this set of constraints.
+     */
+    bool loadMatrix(const std::string& data);
           
 public:
     class AngleInfo;
@@ -116,6 +126,13 @@ public:
      */
     const std::vector<std::vector<std::pair<int, RealOpenMM> > >& getMatrix() const;
 
+    /**
+     * Get the key under which the inverse constraint matrix is stored in the ReferenceDataCache.  It
+     * contains every input the matrix depends on.
+     */
+    static std::string getCacheKey(int numberOfAtoms, const std::vector<std::pair<int, int> >& atomIndices, const std::vector<RealOpenMM>& distance,
+                                   const std::vector<RealOpenMM>& masses, const std::vector<AngleInfo>& angles, RealOpenMM elementCutoff);
+
 };
 
 class ReferenceCCMAAlgorithm::AngleInfo
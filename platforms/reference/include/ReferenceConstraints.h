@@ -37,6 +37,8 @@
 
 namespace OpenMM {
 
+class Profiler;
+
 /**
  * This class uses multiple algorithms to apply constraints as efficiently as possible.  It identifies clusters
  * of three atoms that can be handled by SETTLE, and creates a ReferenceSETTLEAlgorithm object to handle them.
@@ -47,6 +49,11 @@ public:
     ReferenceConstraints(const System& system);
     virtual ~ReferenceConstraints();
 
+    /**
+     * Set the Profiler in which to record the time spent applying constraints.  This may be NULL.
+     */
+    void setProfiler(Profiler* profiler);
+
     /**
      * Apply the constraint algorithm.
      * 
@@ -68,6 +75,7 @@ public:
     void applyToVelocities(std::vector<OpenMM::RealVec>& atomCoordinates, std::vector<OpenMM::RealVec>& velocities, std::vector<RealOpenMM>& inverseMasses, RealOpenMM tolerance);
     ReferenceConstraintAlgorithm* ccma;
     ReferenceConstraintAlgorithm* settle;
+    Profiler* profiler;
 };
 
 } // namespace OpenMM
@@ -47,7 +47,8 @@ private:
     std::vector<OpenMM::RealVec> sumBuffer, oldPos;
     std::vector<OpenMM::CustomIntegrator::ComputationType> stepType;
     std::vector<std::string> stepVariable;
-    std::vector<std::vector<Lepton::CompiledExpression> > stepExpressions;
+    // Each step's expressions are compiled together, so a condition's two sides are evaluated by one call.
+    std::vector<Lepton::CompiledExpression*> stepExpressions;
     std::vector<CustomIntegratorUtilities::Comparison> comparisons;
     std::vector<bool> invalidatesForces, needsForces, needsEnergy, computeBothForceAndEnergy;
     std::vector<int> forceGroupFlags, blockEnd;
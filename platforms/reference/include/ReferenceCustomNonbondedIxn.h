@@ -42,6 +42,7 @@ class ReferenceCustomNonbondedIxn {
       bool cutoff;
       bool useSwitch;
       bool periodic;
+      int threadIndex, numThreads;
       const OpenMM::NeighborList* neighborList;
       OpenMM::RealVec periodicBoxVectors[3];
       RealOpenMM cutoffDistance, switchingDistance;
@@ -123,6 +124,18 @@ class ReferenceCustomNonbondedIxn {
       
       void setUseSwitchingFunction(RealOpenMM distance);
 
+      /**---------------------------------------------------------------------------------------
+      
+         Compute only a subset of the interactions, so that the work can be divided between
+         several threads, each with its own ReferenceCustomNonbondedIxn.
+      
+         @param threadIndex         the index of the subset to compute
+         @param numThreads          the total number of subsets
+      
+         --------------------------------------------------------------------------------------- */
+      
+      void setThreadSubset(int threadIndex, int numThreads);
+
       /**---------------------------------------------------------------------------------------
 
          Set the force to use periodic boundary conditions.  This requires that a cutoff has
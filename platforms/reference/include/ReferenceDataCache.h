@@ -0,0 +1,110 @@
+#ifndef OPENMM_REFERENCEDATACACHE_H_
+#define OPENMM_REFERENCEDATACACHE_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2016 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "openmm/internal/windowsExport.h"
+#include <string>
+
+namespace OpenMM {
+
+/**
+ * This class provides an optional on-disk cache for data that is expensive to compute when a Context
+ * is created, such as the inverse constraint matrix used by CCMA.  Each entry is identified by a key
+ * string, which should contain every input the data depends on.  The file name is derived from a SHA1
+ * hash of the key, so Contexts built from identical Systems share entries, while any change to the
+ * System produces a different name.
+ *
+ * Caching is disabled unless the OPENMM_DATA_CACHE_DIR environment variable is set to a non-empty
+ * value giving the directory where cache files should be stored.  This is separate from OPENMM_CACHE_DIR,
+ * which the CUDA platform uses for its kernel cache, so setting that one does not enable this cache.
+ * Failures to read or write the cache are never fatal; the data is simply recomputed.
+ */
+
+class OPENMM_EXPORT ReferenceDataCache {
+public:
+    /**
+     * Get whether the cache is enabled.
+     */
+    static bool isEnabled();
+    /**
+     * Get the directory where cache files are stored, including a trailing separator.  This returns
+     * an empty string if the cache is disabled.
+     */
+    static std::string getCacheDirectory();
+    /**
+     * Get the full path of the cache file corresponding to a key.
+     *
+     * @param type   a short name identifying what kind of data is stored.  It is used as a prefix for the file name.
+     * @param key    a string containing all the inputs the data depends on
+     */
+    static std::string getCacheFile(const std::string& type, const std::string& key);
+    /**
+     * Try to load an entry from the cache.
+     *
+     * @param type   a short name identifying what kind of data is stored
+     * @param key    a string containing all the inputs the data depends on
+     * @param data   on exit, the cached data if it was found
+     * @return true if the entry was found, false otherwise
+     */
+    static bool load(const std::string& type, const std::string& key, std::string& data);
+    /**
+     * Store an entry in the cache.  The file is first written under a temporary name, then renamed,
+     * so processes running at the same time never see a partially written entry.
+     *
+     * @param type   a short name identifying what kind of data is stored
+     * @param key    a string containing all the inputs the data depends on
+     * @param data   the data to store
+     */
+    static void save(const std::string& type, const std::string& key, const std::string& data);
+    /**
+     * Read the contents of a file.  This is used by load(), and may also be used for files that are
+     * stored outside the cache directory.
+     *
+     * @param path   the full path of the file
+     * @param data   on exit, the contents of the file if it could be read
+     * @return true if the file was read, false otherwise
+     */
+    static bool loadFile(const std::string& path, std::string& data);
+    /**
+     * Write a file, first under a temporary name and then renaming it, in the same way as save().
+     * Failures are silently ignored.  This does not depend on whether the cache is enabled.
+     *
+     * @param path   the full path of the file
+     * @param data   the data to store
+     */
+    static void saveFile(const std::string& path, const std::string& data);
+};
+
+} // namespace OpenMM
+
+#endif /*OPENMM_REFERENCEDATACACHE_H_*/
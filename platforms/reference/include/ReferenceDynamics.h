@@ -170,6 +170,18 @@ class OPENMM_EXPORT ReferenceDynamics {
          --------------------------------------------------------------------------------------- */
       
       void setReferenceConstraintAlgorithm(ReferenceConstraintAlgorithm* referenceConstraint);
+
+      /**---------------------------------------------------------------------------------------
+      
+         Compute the positions of virtual sites.  Subclasses may override this to use a faster
+         implementation.
+      
+         @param system              the System being integrated
+         @param atomCoordinates     atom coordinates
+      
+         --------------------------------------------------------------------------------------- */
+      
+      virtual void computeVirtualSites(const OpenMM::System& system, std::vector<OpenMM::RealVec>& atomCoordinates);
 };
 
 } // namespace OpenMM
@@ -34,6 +34,7 @@
 
 #include "ReferencePlatform.h"
 #include "openmm/kernels.h"
+#include "openmm/internal/CustomNonbondedForceImpl.h"
 #include "SimTKOpenMMRealType.h"
 #include "ReferenceNeighborList.h"
 #include "lepton/CompiledExpression.h"
@@ -47,6 +48,7 @@ class ReferenceCustomCentroidBondIxn;
 class ReferenceCustomCompoundBondIxn;
 class ReferenceCustomHbondIxn;
 class ReferenceCustomManyParticleIxn;
+class ReferenceCustomNonbondedIxn;
 class ReferenceGayBerneForce;
 class ReferenceBrownianDynamics;
 class ReferenceStochasticDynamics;
@@ -64,7 +66,7 @@ class ReferenceCustomDynamics;
  */
 class ReferenceCalcForcesAndEnergyKernel : public CalcForcesAndEnergyKernel {
 public:
-    ReferenceCalcForcesAndEnergyKernel(std::string name, const Platform& platform) : CalcForcesAndEnergyKernel(name, platform) {
+    ReferenceCalcForcesAndEnergyKernel(std::string name, const Platform& platform) : CalcForcesAndEnergyKernel(name, platform), distributeVirtualSiteForces(true) {
     }
     /**
      * Initialize the kernel.
@@ -97,8 +99,16 @@ public:
      * energy directly, <i>or</i> add it to an internal buffer so that it will be included here.
      */
     double finishComputation(ContextImpl& context, bool includeForce, bool includeEnergy, int groups, bool& valid);
+    /**
+     * Set whether finishComputation() should distribute the forces on virtual sites to the particles
+     * they are computed from.  A platform that does this itself can disable it.
+     */
+    void setDistributeVirtualSiteForces(bool distribute) {
+        distributeVirtualSiteForces = distribute;
+    }
 private:
     std::vector<RealVec> savedForces;
+    bool distributeVirtualSiteForces;
 };
 
 /**
@@ -127,6 +137,12 @@ public:
      * @param context    the context in which to execute this kernel
      */
     void setTime(ContextImpl& context, double time);
+    /**
+     * Get the number of integration steps that have been taken.
+     *
+     * @param context    the context in which to execute this kernel
+     */
+    int getStepCount(const ContextImpl& context) const;
     /**
      * Get the positions of all particles.
      *
@@ -621,7 +637,8 @@ private:
  */
 class ReferenceCalcCustomNonbondedForceKernel : public CalcCustomNonbondedForceKernel {
 public:
-    ReferenceCalcCustomNonbondedForceKernel(std::string name, const Platform& platform) : CalcCustomNonbondedForceKernel(name, platform), forceCopy(NULL) {
+    ReferenceCalcCustomNonbondedForceKernel(std::string name, const Platform& platform, ReferencePlatform::PlatformData& data) : CalcCustomNonbondedForceKernel(name, platform),
+            data(data), longRangeCorrection(NULL) {
     }
     ~ReferenceCalcCustomNonbondedForceKernel();
     /**
@@ -648,11 +665,15 @@ public:
      */
     void copyParametersToContext(ContextImpl& context, const CustomNonbondedForce& force);
 private:
+    class PairLoop;
+    void createInteractions();
+    ReferencePlatform::PlatformData& data;
+    std::vector<ReferenceCustomNonbondedIxn*> ixns;
     int numParticles;
     RealOpenMM **particleParamArray;
     RealOpenMM nonbondedCutoff, switchingDistance, periodicBoxSize[3], longRangeCoefficient;
     bool useSwitchingFunction, hasInitializedLongRangeCorrection;
-    CustomNonbondedForce* forceCopy;
+    CustomNonbondedForceImpl::LongRangeCorrectionData* longRangeCorrection;
     std::map<std::string, double> globalParamValues;
     std::vector<std::set<int> > exclusions;
     Lepton::CompiledExpression energyExpression, forceExpression;
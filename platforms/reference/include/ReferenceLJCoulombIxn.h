@@ -30,9 +30,12 @@
 
 namespace OpenMM {
 
+class ReferenceThreadedForces;
+
 class ReferenceLJCoulombIxn {
 
    private:
+      class DirectLoop;
        
       bool cutoff;
       bool useSwitch;
@@ -46,6 +49,7 @@ class ReferenceLJCoulombIxn {
       RealOpenMM alphaEwald;
       int numRx, numRy, numRz;
       int meshDim[3];
+      ReferenceThreadedForces* threads;
 
       // parameter indices
 
@@ -111,6 +115,17 @@ class ReferenceLJCoulombIxn {
          --------------------------------------------------------------------------------------- */
       
       void setUseSwitchingFunction(RealOpenMM distance);
+
+      /**---------------------------------------------------------------------------------------
+      
+         Divide the direct space interactions between multiple threads.
+      
+         @param threads             the object used to run them, or NULL to compute them on the
+                                    calling thread
+      
+         --------------------------------------------------------------------------------------- */
+      
+      void setThreadedForces(ReferenceThreadedForces* threads);
       
       /**---------------------------------------------------------------------------------------
       
@@ -195,6 +210,45 @@ private:
                             RealOpenMM** atomParameters, std::vector<std::set<int> >& exclusions,
                             RealOpenMM* fixedParameters, std::vector<OpenMM::RealVec>& forces,
                             RealOpenMM* energyByAtom, RealOpenMM* totalEnergy, bool includeDirect, bool includeReciprocal) const;
+
+      /**---------------------------------------------------------------------------------------
+      
+         Calculate the direct space part of the Ewald or PME interaction for the subset of the
+         neighbor list assigned to one thread
+      
+         @param threadIndex      the index of the thread
+         @param numThreads       the total number of threads
+         @param atomCoordinates  atom coordinates
+         @param atomParameters   atom parameters (charges, c6, c12, ...)     atomParameters[atomIndex][paramterIndex]
+         @param forces           force array (forces added)
+         @param energyByAtom     atom energy
+         @param totalEnergy      total energy
+      
+         --------------------------------------------------------------------------------------- */
+          
+      void calculateEwaldDirectIxn(int threadIndex, int numThreads, std::vector<OpenMM::RealVec>& atomCoordinates,
+                            RealOpenMM** atomParameters, std::vector<OpenMM::RealVec>& forces,
+                            RealOpenMM* energyByAtom, RealOpenMM* totalEnergy) const;
+
+      /**---------------------------------------------------------------------------------------
+      
+         Calculate the LJ Coulomb interactions assigned to one thread when not using Ewald or PME
+      
+         @param threadIndex      the index of the thread
+         @param numThreads       the total number of threads
+         @param numberOfAtoms    number of atoms
+         @param atomCoordinates  atom coordinates
+         @param atomParameters   atom parameters (charges, c6, c12, ...)     atomParameters[atomIndex][paramterIndex]
+         @param exclusions       atom exclusion indices
+         @param forces           force array (forces added)
+         @param energyByAtom     atom energy
+         @param totalEnergy      total energy
+      
+         --------------------------------------------------------------------------------------- */
+          
+      void calculateDirectIxn(int threadIndex, int numThreads, int numberOfAtoms, std::vector<OpenMM::RealVec>& atomCoordinates,
+                            RealOpenMM** atomParameters, std::vector<std::set<int> >& exclusions, std::vector<OpenMM::RealVec>& forces,
+                            RealOpenMM* energyByAtom, RealOpenMM* totalEnergy) const;
 };
 
 } // namespace OpenMM
@@ -35,11 +35,20 @@
 #include "openmm/Platform.h"
 #include "openmm/System.h"
 #include "openmm/internal/windowsExport.h"
+#include <map>
+#include <string>
 
 namespace OpenMM {
 
+class ReferenceThreadedForces;
+
 /**
  * This Platform subclass uses the reference implementations of all the OpenMM kernels.
+ *
+ * By default all calculations are done on a single thread.  Set the Threads property to a larger value to
+ * divide the most expensive kernels (nonbonded interactions and the long range correction for custom
+ * nonbonded interactions) between multiple threads.  Results are still reproducible from run to run for
+ * a fixed number of threads.
  */
 
 class OPENMM_EXPORT ReferencePlatform : public Platform {
@@ -52,16 +61,26 @@ public:
     }
     double getSpeed() const;
     bool supportsDoublePrecision() const;
+    const std::string& getPropertyValue(const Context& context, const std::string& property) const;
     void contextCreated(ContextImpl& context, const std::map<std::string, std::string>& properties) const;
     void contextDestroyed(ContextImpl& context) const;
+    /**
+     * This is the name of the parameter for selecting the number of threads to use.
+     */
+    static const std::string& ReferenceThreads() {
+        static const std::string key = "Threads";
+        return key;
+    }
 };
 
 class ReferencePlatform::PlatformData {
 public:
-    PlatformData(const System& system);
+    PlatformData(const System& system, int numThreads=1);
     ~PlatformData();
-    int numParticles, stepCount;
     double time;
+    int stepCount, numParticles;
+    ReferenceThreadedForces* threadedForces;
+    std::map<std::string, std::string> propertyValues;
     void* positions;
     void* velocities;
     void* forces;
@@ -71,6 +71,15 @@ public:
      */
     void apply(std::vector<OpenMM::RealVec>& atomCoordinates, std::vector<OpenMM::RealVec>& atomCoordinatesP, std::vector<RealOpenMM>& inverseMasses, RealOpenMM tolerance);
 
+    /**
+     * Apply the constraint algorithm to a single cluster.
+     * 
+     * @param index            the index of the cluster to constrain
+     * @param atomCoordinates  the original atom coordinates
+     * @param atomCoordinatesP the new atom coordinates
+     */
+    void applyToCluster(int index, std::vector<OpenMM::RealVec>& atomCoordinates, std::vector<OpenMM::RealVec>& atomCoordinatesP);
+
     /**
      * Apply the constraint algorithm to velocities.
      * 
@@ -45,20 +45,16 @@ namespace OpenMM {
 extern "C" OPENMM_EXPORT Lepton::CustomFunction* createReferenceTabulatedFunction(const TabulatedFunction& function);
 
 /**
- * This class adapts a Continuous1DFunction into a Lepton::CustomFunction.
+ * This class adapts a Continuous1DFunction into a Lepton::CustomFunction.  The spline is stored as a table
+ * of polynomial coefficients for the intervals of the uniform grid, which lets it be evaluated without searching
+ * for the interval, and lets CompiledExpression evaluate it inline.
  */
-class OPENMM_EXPORT ReferenceContinuous1DFunction : public Lepton::CustomFunction {
+class OPENMM_EXPORT ReferenceContinuous1DFunction : public Lepton::UniformSplineFunction {
 public:
     ReferenceContinuous1DFunction(const Continuous1DFunction& function);
-    int getNumArguments() const;
-    double evaluate(const double* arguments) const;
-    double evaluateDerivative(const double* arguments, const int* derivOrder) const;
     CustomFunction* clone() const;
 private:
-    ReferenceContinuous1DFunction(const ReferenceContinuous1DFunction& other);
     const Continuous1DFunction& function;
-    double min, max;
-    std::vector<double> x, values, derivs;
 };
 
 /**
@@ -75,9 +71,8 @@ private:
     ReferenceContinuous2DFunction(const ReferenceContinuous2DFunction& other);
     const Continuous2DFunction& function;
     int xsize, ysize;
-    double xmin, xmax, ymin, ymax;
-    std::vector<double> x, y, values;
-    std::vector<std::vector<double> > c;
+    double xmin, xmax, ymin, ymax, xscale, yscale;
+    std::vector<double> c;
 };
 
 /**
@@ -94,9 +89,8 @@ private:
     ReferenceContinuous3DFunction(const ReferenceContinuous3DFunction& other);
     const Continuous3DFunction& function;
     int xsize, ysize, zsize;
-    double xmin, xmax, ymin, ymax, zmin, zmax;
-    std::vector<double> x, y, z, values;
-    std::vector<std::vector<double> > c;
+    double xmin, xmax, ymin, ymax, zmin, zmax, xscale, yscale, zscale;
+    std::vector<double> c;
 };
 
 /**
@@ -0,0 +1,113 @@
+#ifndef OPENMM_REFERENCETHREADEDFORCES_H_
+#define OPENMM_REFERENCETHREADEDFORCES_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2016 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "RealVec.h"
+#include "openmm/internal/ThreadPool.h"
+#include "openmm/internal/windowsExport.h"
+#include <string>
+#include <vector>
+
+namespace OpenMM {
+
+/**
+ * This class lets Reference platform kernels divide their interactions between the threads of a ThreadPool.
+ * It is only used when a Context is created with the Threads property set to more than one.
+ *
+ * Each thread accumulates forces and energy into its own buffers.  When all threads have finished, the
+ * buffers are added to the output in order of thread index.  The assignment of interactions to threads
+ * depends only on the number of threads, so the result is reproducible from run to run, although it may
+ * differ in the last bits from a serial calculation.  The buffers are kept between calls to avoid
+ * reallocating them on every step.
+ */
+
+class OPENMM_EXPORT ReferenceThreadedForces {
+public:
+    class Loop;
+    /**
+     * Create a ReferenceThreadedForces.
+     *
+     * @param numThreads  the number of threads to use
+     */
+    ReferenceThreadedForces(int numThreads);
+    /**
+     * Get the number of threads.
+     */
+    int getNumThreads() const {
+        return threads.getNumThreads();
+    }
+    /**
+     * Get the ThreadPool used to execute loops.
+     */
+    ThreadPool& getThreadPool() {
+        return threads;
+    }
+    /**
+     * Execute a Loop on every thread, then add the forces and energies computed by all threads.
+     *
+     * @param loop         the Loop to execute
+     * @param numAtoms     the number of atoms
+     * @param forces       the forces computed by all threads are added to this
+     * @param totalEnergy  if not NULL, the energies computed by all threads are added to this
+     */
+    void execute(Loop& loop, int numAtoms, std::vector<RealVec>& forces, RealOpenMM* totalEnergy);
+private:
+    class LoopTask;
+    class SumTask;
+    ThreadPool threads;
+    std::vector<std::vector<RealVec> > threadForces;
+    std::vector<RealOpenMM> threadEnergy;
+    std::vector<std::string> threadErrors;
+};
+
+/**
+ * A Loop computes the subset of interactions assigned to one thread.
+ */
+class ReferenceThreadedForces::Loop {
+public:
+    virtual ~Loop() {
+    }
+    /**
+     * Compute the interactions assigned to one thread.
+     *
+     * @param threadIndex  the index of the thread
+     * @param numThreads   the total number of threads
+     * @param forces       forces should be added to this.  It is zero on entry.
+     * @param energy       if not NULL, the energy should be added to this.  It is zero on entry.
+     */
+    virtual void execute(int threadIndex, int numThreads, std::vector<RealVec>& forces, RealOpenMM* energy) = 0;
+};
+
+} // namespace OpenMM
+
+#endif /*OPENMM_REFERENCETHREADEDFORCES_H_*/
@@ -0,0 +1,129 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2016 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "ReferenceDataCache.h"
+#include "SHA1.h"
+#include "openmm/internal/gmx_atomic.h"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#ifdef WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace OpenMM;
+using namespace std;
+
+static gmx_atomic_t tempFileCounter;
+
+bool ReferenceDataCache::isEnabled() {
+    char* cacheVariable = getenv("OPENMM_DATA_CACHE_DIR");
+    return (cacheVariable != NULL && cacheVariable[0] != 0);
+}
+
+string ReferenceDataCache::getCacheDirectory() {
+    char* cacheVariable = getenv("OPENMM_DATA_CACHE_DIR");
+    if (cacheVariable == NULL || cacheVariable[0] == 0)
+        return "";
+#ifdef WIN32
+    return string(cacheVariable)+"\\";
+#else
+    return string(cacheVariable)+"/";
+#endif
+}
+
+string ReferenceDataCache::getCacheFile(const string& type, const string& key) {
+    CSHA1 sha1;
+    sha1.Update((const UINT_8*) key.c_str(), key.size());
+    sha1.Final();
+    UINT_8 hash[20];
+    sha1.GetHash(hash);
+    stringstream cacheFile;
+    cacheFile << getCacheDirectory() << type << '_';
+    cacheFile.flags(ios::hex);
+    for (int i = 0; i < 20; i++)
+        cacheFile << setw(2) << setfill('0') << (int) hash[i];
+    return cacheFile.str();
+}
+
+bool ReferenceDataCache::load(const string& type, const string& key, string& data) {
+    if (!isEnabled())
+        return false;
+    return loadFile(getCacheFile(type, key), data);
+}
+
+void ReferenceDataCache::save(const string& type, const string& key, const string& data) {
+    if (!isEnabled())
+        return;
+    saveFile(getCacheFile(type, key), data);
+}
+
+bool ReferenceDataCache::loadFile(const string& path, string& data) {
+    ifstream file(path.c_str(), ios::in | ios::binary);
+    if (!file.is_open())
+        return false;
+    stringstream contents;
+    contents << file.rdbuf();
+    if (file.bad())
+        return false;
+    data = contents.str();
+    return true;
+}
+
+void ReferenceDataCache::saveFile(const string& path, const string& data) {
+    stringstream tempFile;
+    // The process ID and a counter make the name unique across processes and threads.
+
+    tempFile << path << ".tmp";
+#ifdef WIN32
+    tempFile << _getpid();
+#else
+    tempFile << getpid();
+#endif
+    tempFile << "_" << gmx_atomic_fetch_add(&tempFileCounter, 1);
+    {
+        ofstream file(tempFile.str().c_str(), ios::out | ios::binary);
+        if (!file.is_open())
+            return;
+        file.write(data.c_str(), data.size());
+        if (!file.good()) {
+            file.close();
+            remove(tempFile.str().c_str());
+            return;
+        }
+    }
+    if (rename(tempFile.str().c_str(), path.c_str()) != 0)
+        remove(tempFile.str().c_str());
+}
@@ -58,6 +58,7 @@
 #include "ReferenceRbDihedralBond.h"
 #include "ReferenceStochasticDynamics.h"
 #include "ReferenceTabulatedFunction.h"
+#include "ReferenceThreadedForces.h"
 #include "ReferenceVariableStochasticDynamics.h"
 #include "ReferenceVariableVerletDynamics.h"
 #include "ReferenceVerletDynamics.h"
@@ -152,6 +153,11 @@ static map<string, double>& extractEnergyParameterDerivatives(ContextImpl& conte
     return *((map<string, double>*) data->energyParameterDerivatives);
 }
 
+static ReferenceThreadedForces* extractThreadedForces(ContextImpl& context) {
+    ReferencePlatform::PlatformData* data = reinterpret_cast<ReferencePlatform::PlatformData*>(context.getPlatformData());
+    return data->threadedForces;
+}
+
 /**
  * Make sure an expression doesn't use any undefined variables.
  */
@@ -221,7 +227,7 @@ void ReferenceCalcForcesAndEnergyKernel::beginComputation(ContextImpl& context,
 double ReferenceCalcForcesAndEnergyKernel::finishComputation(ContextImpl& context, bool includeForces, bool includeEnergy, int groups, bool& valid) {
     if (!includeForces)
         extractForces(context) = savedForces; // Restore the forces so computing the energy doesn't overwrite the forces with incorrect values.
-    else
+    else if (distributeVirtualSiteForces)
         ReferenceVirtualSites::distributeForces(context.getSystem(), extractPositions(context), extractForces(context));
     return 0.0;
 }
@@ -237,6 +243,10 @@ void ReferenceUpdateStateDataKernel::setTime(ContextImpl& context, double time)
     data.time = time;
 }
 
+int ReferenceUpdateStateDataKernel::getStepCount(const ContextImpl& context) const {
+    return data.stepCount;
+}
+
 void ReferenceUpdateStateDataKernel::getPositions(ContextImpl& context, std::vector<Vec3>& positions) {
     int numParticles = context.getSystem().getNumParticles();
     vector<RealVec>& posData = extractPositions(context);
@@ -304,9 +314,10 @@ void ReferenceUpdateStateDataKernel::setPeriodicBoxVectors(ContextImpl& context,
 }
 
 void ReferenceUpdateStateDataKernel::createCheckpoint(ContextImpl& context, ostream& stream) {
-    int version = 2;
+    int version = 3;
     stream.write((char*) &version, sizeof(int));
     stream.write((char*) &data.time, sizeof(data.time));
+    stream.write((char*) &data.stepCount, sizeof(data.stepCount));
     vector<RealVec>& posData = extractPositions(context);
     stream.write((char*) &posData[0], sizeof(RealVec)*posData.size());
     vector<RealVec>& velData = extractVelocities(context);
@@ -319,9 +330,11 @@ void ReferenceUpdateStateDataKernel::createCheckpoint(ContextImpl& context, ostr
 void ReferenceUpdateStateDataKernel::loadCheckpoint(ContextImpl& context, istream& stream) {
     int version;
     stream.read((char*) &version, sizeof(int));
-    if (version != 2)
+    if (version != 2 && version != 3)
         throw OpenMMException("Checkpoint was created with a different version of OpenMM");
     stream.read((char*) &data.time, sizeof(data.time));
+    if (version > 2)
+        stream.read((char*) &data.stepCount, sizeof(data.stepCount));
     vector<RealVec>& posData = extractPositions(context);
     stream.read((char*) &posData[0], sizeof(RealVec)*posData.size());
     vector<RealVec>& velData = extractVelocities(context);
@@ -1004,6 +1017,7 @@ double ReferenceCalcNonbondedForceKernel::execute(ContextImpl& context, bool inc
         clj.setUsePME(ewaldAlpha, gridSize);
     if (useSwitchingFunction)
         clj.setUseSwitchingFunction(switchingDistance);
+    clj.setThreadedForces(extractThreadedForces(context));
     clj.calculatePairIxn(numParticles, posData, particleParamArray, exclusions, 0, forceData, 0, includeEnergy ? &energy : NULL, includeDirect, includeReciprocal);
     if (includeDirect) {
         ReferenceBondForce refBondForce;
@@ -1071,8 +1085,10 @@ ReferenceCalcCustomNonbondedForceKernel::~ReferenceCalcCustomNonbondedForceKerne
     disposeRealArray(particleParamArray, numParticles);
     if (neighborList != NULL)
         delete neighborList;
-    if (forceCopy != NULL)
-        delete forceCopy;
+    if (longRangeCorrection != NULL)
+        delete longRangeCorrection;
+    for (int i = 0; i < (int) ixns.size(); i++)
+        delete ixns[i];
 }
 
 void ReferenceCalcCustomNonbondedForceKernel::initialize(const System& system, const CustomNonbondedForce& force) {
@@ -1149,7 +1165,7 @@ void ReferenceCalcCustomNonbondedForceKernel::initialize(const System& system, c
     // Record information for the long range correction.
     
     if (force.getNonbondedMethod() == CustomNonbondedForce::CutoffPeriodic && force.getUseLongRangeCorrection()) {
-        forceCopy = new CustomNonbondedForce(force);
+        longRangeCorrection = new CustomNonbondedForceImpl::LongRangeCorrectionData(force);
         hasInitializedLongRangeCorrection = false;
     }
     else {
@@ -1164,27 +1180,68 @@ void ReferenceCalcCustomNonbondedForceKernel::initialize(const System& system, c
         force.getInteractionGroupParameters(i, set1, set2);
         interactionGroups.push_back(make_pair(set1, set2));
     }
+    createInteractions();
 }
 
+void ReferenceCalcCustomNonbondedForceKernel::createInteractions() {
+    
+    // Create an object to compute the interactions for each thread.
+    
+    for (int i = 0; i < (int) ixns.size(); i++)
+        delete ixns[i];
+    int numThreads = (data.threadedForces == NULL ? 1 : data.threadedForces->getNumThreads());
+    ixns.resize(numThreads);
+    for (int i = 0; i < numThreads; i++) {
+        ReferenceCustomNonbondedIxn* ixn = new ReferenceCustomNonbondedIxn(energyExpression, forceExpression, parameterNames, energyParamDerivExpressions);
+        ixns[i] = ixn;
+        if (nonbondedMethod != NoCutoff)
+            ixn->setUseCutoff(nonbondedCutoff, *neighborList);
+        if (interactionGroups.size() > 0)
+            ixn->setInteractionGroups(interactionGroups);
+        if (useSwitchingFunction)
+            ixn->setUseSwitchingFunction(switchingDistance);
+        ixn->setThreadSubset(i, numThreads);
+    }
+}
+
+/**
+ * This computes the interactions for a CustomNonbondedForce that are assigned to one thread.  Every
+ * thread needs its own ReferenceCustomNonbondedIxn, since they store intermediate values while
+ * evaluating expressions.
+ */
+class ReferenceCalcCustomNonbondedForceKernel::PairLoop : public ReferenceThreadedForces::Loop {
+public:
+    PairLoop(vector<ReferenceCustomNonbondedIxn*>& ixns, int numParticles, vector<RealVec>& posData, RealOpenMM** particleParamArray,
+            vector<set<int> >& exclusions, const map<string, double>& globalParamValues, int numDerivs) : ixns(ixns), numParticles(numParticles),
+            posData(posData), particleParamArray(particleParamArray), exclusions(exclusions), globalParamValues(globalParamValues),
+            threadDerivs(ixns.size(), vector<double>(numDerivs+1, 0.0)) {
+    }
+    void execute(int threadIndex, int numThreads, vector<RealVec>& forces, RealOpenMM* energy) {
+        ixns[threadIndex]->calculatePairIxn(numParticles, posData, particleParamArray, exclusions, 0, globalParamValues, forces, 0, energy, &threadDerivs[threadIndex][0]);
+    }
+    vector<ReferenceCustomNonbondedIxn*>& ixns;
+    int numParticles;
+    vector<RealVec>& posData;
+    RealOpenMM** particleParamArray;
+    vector<set<int> >& exclusions;
+    const map<string, double>& globalParamValues;
+    vector<vector<double> > threadDerivs;
+};
+
 double ReferenceCalcCustomNonbondedForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy) {
     vector<RealVec>& posData = extractPositions(context);
     vector<RealVec>& forceData = extractForces(context);
     RealVec* boxVectors = extractBoxVectors(context);
+    ReferenceThreadedForces* threads = extractThreadedForces(context);
     RealOpenMM energy = 0;
-    ReferenceCustomNonbondedIxn ixn(energyExpression, forceExpression, parameterNames, energyParamDerivExpressions);
     bool periodic = (nonbondedMethod == CutoffPeriodic);
-    if (nonbondedMethod != NoCutoff) {
+    if (nonbondedMethod != NoCutoff)
         computeNeighborListVoxelHash(*neighborList, numParticles, posData, exclusions, extractBoxVectors(context), periodic, nonbondedCutoff, 0.0);
-        ixn.setUseCutoff(nonbondedCutoff, *neighborList);
-    }
     if (periodic) {
         double minAllowedSize = 2*nonbondedCutoff;
         if (boxVectors[0][0] < minAllowedSize || boxVectors[1][1] < minAllowedSize || boxVectors[2][2] < minAllowedSize)
             throw OpenMMException("The periodic box size has decreased to less than twice the nonbonded cutoff.");
-        ixn.setPeriodic(boxVectors);
     }
-    if (interactionGroups.size() > 0)
-        ixn.setInteractionGroups(interactionGroups);
     bool globalParamsChanged = false;
     for (int i = 0; i < (int) globalParameterNames.size(); i++) {
         double value = context.getParameter(globalParameterNames[i]);
@@ -1192,18 +1249,28 @@ double ReferenceCalcCustomNonbondedForceKernel::execute(ContextImpl& context, bo
             globalParamsChanged = true;
         globalParamValues[globalParameterNames[i]] = value;
     }
-    if (useSwitchingFunction)
-        ixn.setUseSwitchingFunction(switchingDistance);
+    int numThreads = ixns.size();
+    if (periodic)
+        for (int i = 0; i < numThreads; i++)
+            ixns[i]->setPeriodic(boxVectors);
     vector<double> energyParamDerivValues(energyParamDerivNames.size()+1, 0.0);
-    ixn.calculatePairIxn(numParticles, posData, particleParamArray, exclusions, 0, globalParamValues, forceData, 0, includeEnergy ? &energy : NULL, &energyParamDerivValues[0]);
+    if (threads == NULL)
+        ixns[0]->calculatePairIxn(numParticles, posData, particleParamArray, exclusions, 0, globalParamValues, forceData, 0, includeEnergy ? &energy : NULL, &energyParamDerivValues[0]);
+    else {
+        PairLoop loop(ixns, numParticles, posData, particleParamArray, exclusions, globalParamValues, energyParamDerivNames.size());
+        threads->execute(loop, numParticles, forceData, includeEnergy ? &energy : NULL);
+        for (int i = 0; i < numThreads; i++)
+            for (int j = 0; j < (int) energyParamDerivNames.size(); j++)
+                energyParamDerivValues[j] += loop.threadDerivs[i][j];
+    }
     map<string, double>& energyParamDerivs = extractEnergyParameterDerivatives(context);
     for (int i = 0; i < energyParamDerivNames.size(); i++)
         energyParamDerivs[energyParamDerivNames[i]] += energyParamDerivValues[i];
     
     // Add in the long range correction.
     
-    if (!hasInitializedLongRangeCorrection || (globalParamsChanged && forceCopy != NULL)) {
-        CustomNonbondedForceImpl::calcLongRangeCorrection(*forceCopy, context.getOwner(), longRangeCoefficient, longRangeCoefficientDerivs);
+    if (!hasInitializedLongRangeCorrection || (globalParamsChanged && longRangeCorrection != NULL)) {
+        longRangeCorrection->calcCorrection(globalParamValues, longRangeCoefficient, longRangeCoefficientDerivs, threads == NULL ? NULL : &threads->getThreadPool());
         hasInitializedLongRangeCorrection = true;
     }
     double volume = boxVectors[0][0]*boxVectors[1][1]*boxVectors[2][2];
@@ -1227,13 +1294,14 @@ void ReferenceCalcCustomNonbondedForceKernel::copyParametersToContext(ContextImp
         for (int j = 0; j < numParameters; j++)
             particleParamArray[i][j] = static_cast<RealOpenMM>(parameters[j]);
     }
+    createInteractions();
     
     // If necessary, recompute the long range correction.
     
-    if (forceCopy != NULL) {
-        CustomNonbondedForceImpl::calcLongRangeCorrection(force, context.getOwner(), longRangeCoefficient, longRangeCoefficientDerivs);
-        hasInitializedLongRangeCorrection = true;
-        *forceCopy = force;
+    if (longRangeCorrection != NULL) {
+        delete longRangeCorrection;
+        longRangeCorrection = new CustomNonbondedForceImpl::LongRangeCorrectionData(force);
+        hasInitializedLongRangeCorrection = false;
     }
 }
 
@@ -33,10 +33,14 @@
 #include "ReferenceConstraints.h"
 #include "ReferenceKernelFactory.h"
 #include "ReferenceKernels.h"
+#include "ReferenceThreadedForces.h"
+#include "openmm/OpenMMException.h"
 #include "openmm/internal/ContextImpl.h"
 #include "SimTKOpenMMRealType.h"
 #include "RealVec.h"
+#include <cstdlib>
 #include <map>
+#include <sstream>
 #include <vector>
 
 using namespace OpenMM;
@@ -75,6 +79,21 @@ ReferencePlatform::ReferencePlatform() {
     registerKernelFactory(ApplyAndersenThermostatKernel::Name(), factory);
     registerKernelFactory(ApplyMonteCarloBarostatKernel::Name(), factory);
     registerKernelFactory(RemoveCMMotionKernel::Name(), factory);
+    platformProperties.push_back(ReferenceThreads());
+    string threads = "1";
+    char* threadsEnv = getenv("OPENMM_REFERENCE_THREADS");
+    if (threadsEnv != NULL)
+        threads = threadsEnv;
+    setPropertyDefaultValue(ReferenceThreads(), threads);
+}
+
+const string& ReferencePlatform::getPropertyValue(const Context& context, const string& property) const {
+    const ContextImpl& impl = getContextImpl(context);
+    const PlatformData* data = reinterpret_cast<const PlatformData*>(impl.getPlatformData());
+    map<string, string>::const_iterator value = data->propertyValues.find(property);
+    if (value != data->propertyValues.end())
+        return value->second;
+    return Platform::getPropertyValue(context, property);
 }
 
 double ReferencePlatform::getSpeed() const {
@@ -86,7 +105,15 @@ bool ReferencePlatform::supportsDoublePrecision() const {
 }
 
 void ReferencePlatform::contextCreated(ContextImpl& context, const map<string, string>& properties) const {
-    context.setPlatformData(new PlatformData(context.getSystem()));
+    const string& threadsPropValue = (properties.find(ReferenceThreads()) == properties.end() ?
+            getPropertyDefaultValue(ReferenceThreads()) : properties.find(ReferenceThreads())->second);
+    int numThreads = 0;
+    stringstream(threadsPropValue) >> numThreads;
+    if (numThreads < 1)
+        throw OpenMMException("Illegal value for Threads: "+threadsPropValue);
+    PlatformData* data = new PlatformData(context.getSystem(), numThreads);
+    ((ReferenceConstraints*) data->constraints)->setProfiler(&context.getProfiler());
+    context.setPlatformData(data);
 }
 
 void ReferencePlatform::contextDestroyed(ContextImpl& context) const {
@@ -94,7 +121,13 @@ void ReferencePlatform::contextDestroyed(ContextImpl& context) const {
     delete data;
 }
 
-ReferencePlatform::PlatformData::PlatformData(const System& system) : time(0.0), stepCount(0), numParticles(system.getNumParticles()) {
+ReferencePlatform::PlatformData::PlatformData(const System& system, int numThreads) : time(0.0), stepCount(0), numParticles(system.getNumParticles()),
+        threadedForces(NULL) {
+    if (numThreads > 1)
+        threadedForces = new ReferenceThreadedForces(numThreads);
+    stringstream threads;
+    threads << numThreads;
+    propertyValues[ReferenceThreads()] = threads.str();
     positions = new vector<RealVec>(numParticles);
     velocities = new vector<RealVec>(numParticles);
     forces = new vector<RealVec>(numParticles);
@@ -112,4 +145,6 @@ ReferencePlatform::PlatformData::~PlatformData() {
     delete[] (RealVec*) periodicBoxVectors;
     delete (ReferenceConstraints*) constraints;
     delete (map<string, double>*) energyParameterDerivatives;
+    if (threadedForces != NULL)
+        delete threadedForces;
 }
@@ -32,6 +32,7 @@
 #include "ReferenceTabulatedFunction.h"
 #include "openmm/OpenMMException.h"
 #include "openmm/internal/SplineFitter.h"
+#include <algorithm>
 
 #ifdef _MSC_VER
 
@@ -72,59 +73,69 @@ extern "C" OPENMM_EXPORT CustomFunction* createReferenceTabulatedFunction(const
 }
 
 ReferenceContinuous1DFunction::ReferenceContinuous1DFunction(const Continuous1DFunction& function) : function(function) {
+    vector<double> values, derivs;
+    double min, max;
     function.getFunctionParameters(values, min, max);
     int numValues = values.size();
-    x.resize(numValues);
+    vector<double> x(numValues);
     for (int i = 0; i < numValues; i++)
         x[i] = min+i*(max-min)/(numValues-1);
     SplineFitter::createNaturalSpline(x, values, derivs);
-}
-
-ReferenceContinuous1DFunction::ReferenceContinuous1DFunction(const ReferenceContinuous1DFunction& other) : function(other.function) {
-    function.getFunctionParameters(values, min, max);
-    x = other.x;
-    values = other.values;
-    derivs = other.derivs;
-}
 
-int ReferenceContinuous1DFunction::getNumArguments() const {
-    return 1;
-}
-
-double ReferenceContinuous1DFunction::evaluate(const double* arguments) const {
-    double t = arguments[0];
-    if (t < min || t > max)
-        return 0.0;
-    return SplineFitter::evaluateSpline(x, values, derivs, t);
-}
+    // Convert the spline to polynomial coefficients on each interval.
 
-double ReferenceContinuous1DFunction::evaluateDerivative(const double* arguments, const int* derivOrder) const {
-    double t = arguments[0];
-    if (t < min || t > max)
-        return 0.0;
-    return SplineFitter::evaluateSplineDerivative(x, values, derivs, t);
+    vector<double> coeff(4*(numValues-1));
+    for (int i = 0; i < numValues-1; i++) {
+        double h = (x[i+1]-x[i])*(x[i+1]-x[i])/6.0;
+        coeff[4*i] = values[i];
+        coeff[4*i+1] = values[i+1]-values[i]-h*(2.0*derivs[i]+derivs[i+1]);
+        coeff[4*i+2] = 3.0*h*derivs[i];
+        coeff[4*i+3] = h*(derivs[i+1]-derivs[i]);
+    }
+    setCoefficients(min, max, coeff);
 }
 
 CustomFunction* ReferenceContinuous1DFunction::clone() const {
     return new ReferenceContinuous1DFunction(*this);
 }
 
+/**
+ * Find the grid cell containing a point along one axis, and the position within it scaled to go from 0 to 1.
+ */
+static int findCell(double t, double start, double scale, int size, double& position) {
+    double scaled = (t-start)*scale;
+    int index = min(max((int) scaled, 0), size-2);
+    position = scaled-index;
+    return index;
+}
+
 ReferenceContinuous2DFunction::ReferenceContinuous2DFunction(const Continuous2DFunction& function) : function(function) {
+    vector<double> values;
     function.getFunctionParameters(xsize, ysize, values, xmin, xmax, ymin, ymax);
-    x.resize(xsize);
-    y.resize(ysize);
+    vector<double> x(xsize), y(ysize);
     for (int i = 0; i < xsize; i++)
         x[i] = xmin+i*(xmax-xmin)/(xsize-1);
     for (int i = 0; i < ysize; i++)
         y[i] = ymin+i*(ymax-ymin)/(ysize-1);
-    SplineFitter::create2DNaturalSpline(x, y, values, c);
+    xscale = (xsize-1)/(xmax-xmin);
+    yscale = (ysize-1)/(ymax-ymin);
+    vector<vector<double> > cellCoeff;
+    SplineFitter::create2DNaturalSpline(x, y, values, cellCoeff);
+    c.resize(16*cellCoeff.size());
+    for (int i = 0; i < (int) cellCoeff.size(); i++)
+        for (int j = 0; j < 16; j++)
+            c[16*i+j] = cellCoeff[i][j];
 }
 
 ReferenceContinuous2DFunction::ReferenceContinuous2DFunction(const ReferenceContinuous2DFunction& other) : function(other.function) {
-    function.getFunctionParameters(xsize, ysize, values, xmin, xmax, ymin, ymax);
-    x = other.x;
-    y = other.y;
-    values = other.values;
+    xsize = other.xsize;
+    ysize = other.ysize;
+    xmin = other.xmin;
+    xmax = other.xmax;
+    ymin = other.ymin;
+    ymax = other.ymax;
+    xscale = other.xscale;
+    yscale = other.yscale;
     c = other.c;
 }
 
@@ -139,7 +150,14 @@ double ReferenceContinuous2DFunction::evaluate(const double* arguments) const {
     double v = arguments[1];
     if (v < ymin || v > ymax)
         return 0.0;
-    return SplineFitter::evaluate2DSpline(x, y, values, c, u, v);
+    double da, db;
+    int cellx = findCell(u, xmin, xscale, xsize, da);
+    int celly = findCell(v, ymin, yscale, ysize, db);
+    const double* coeff = &c[16*(cellx+(xsize-1)*celly)];
+    double value = 0;
+    for (int i = 3; i >= 0; i--)
+        value = da*value + ((coeff[i*4+3]*db + coeff[i*4+2])*db + coeff[i*4+1])*db + coeff[i*4+0];
+    return value;
 }
 
 double ReferenceContinuous2DFunction::evaluateDerivative(const double* arguments, const int* derivOrder) const {
@@ -149,12 +167,22 @@ double ReferenceContinuous2DFunction::evaluateDerivative(const double* arguments
     double v = arguments[1];
     if (v < ymin || v > ymax)
         return 0.0;
-    double dx, dy;
-    SplineFitter::evaluate2DSplineDerivatives(x, y, values, c, u, v, dx, dy);
-    if (derivOrder[0] == 1 && derivOrder[1] == 0)
-        return dx;
-    if (derivOrder[0] == 0 && derivOrder[1] == 1)
-        return dy;
+    double da, db;
+    int cellx = findCell(u, xmin, xscale, xsize, da);
+    int celly = findCell(v, ymin, yscale, ysize, db);
+    const double* coeff = &c[16*(cellx+(xsize-1)*celly)];
+    if (derivOrder[0] == 1 && derivOrder[1] == 0) {
+        double dx = 0;
+        for (int i = 3; i >= 0; i--)
+            dx = db*dx + (3.0*coeff[i+3*4]*da + 2.0*coeff[i+2*4])*da + coeff[i+1*4];
+        return dx*xscale;
+    }
+    if (derivOrder[0] == 0 && derivOrder[1] == 1) {
+        double dy = 0;
+        for (int i = 3; i >= 0; i--)
+            dy = da*dy + (3.0*coeff[i*4+3]*db + 2.0*coeff[i*4+2])*db + coeff[i*4+1];
+        return dy*yscale;
+    }
     throw OpenMMException("ReferenceContinuous2DFunction: Unsupported derivative order");
 }
 
@@ -163,25 +191,39 @@ CustomFunction* ReferenceContinuous2DFunction::clone() const {
 }
 
 ReferenceContinuous3DFunction::ReferenceContinuous3DFunction(const Continuous3DFunction& function) : function(function) {
+    vector<double> values;
     function.getFunctionParameters(xsize, ysize, zsize, values, xmin, xmax, ymin, ymax, zmin, zmax);
-    x.resize(xsize);
-    y.resize(ysize);
-    z.resize(zsize);
+    vector<double> x(xsize), y(ysize), z(zsize);
     for (int i = 0; i < xsize; i++)
         x[i] = xmin+i*(xmax-xmin)/(xsize-1);
     for (int i = 0; i < ysize; i++)
         y[i] = ymin+i*(ymax-ymin)/(ysize-1);
     for (int i = 0; i < zsize; i++)
         z[i] = zmin+i*(zmax-zmin)/(zsize-1);
-    SplineFitter::create3DNaturalSpline(x, y, z, values, c);
+    xscale = (xsize-1)/(xmax-xmin);
+    yscale = (ysize-1)/(ymax-ymin);
+    zscale = (zsize-1)/(zmax-zmin);
+    vector<vector<double> > cellCoeff;
+    SplineFitter::create3DNaturalSpline(x, y, z, values, cellCoeff);
+    c.resize(64*cellCoeff.size());
+    for (int i = 0; i < (int) cellCoeff.size(); i++)
+        for (int j = 0; j < 64; j++)
+            c[64*i+j] = cellCoeff[i][j];
 }
 
 ReferenceContinuous3DFunction::ReferenceContinuous3DFunction(const ReferenceContinuous3DFunction& other) : function(other.function) {
-    function.getFunctionParameters(xsize, ysize, zsize, values, xmin, xmax, ymin, ymax, zmin, zmax);
-    x = other.x;
-    y = other.y;
-    z = other.z;
-    values = other.values;
+    xsize = other.xsize;
+    ysize = other.ysize;
+    zsize = other.zsize;
+    xmin = other.xmin;
+    xmax = other.xmax;
+    ymin = other.ymin;
+    ymax = other.ymax;
+    zmin = other.zmin;
+    zmax = other.zmax;
+    xscale = other.xscale;
+    yscale = other.yscale;
+    zscale = other.zscale;
     c = other.c;
 }
 
@@ -199,7 +241,19 @@ double ReferenceContinuous3DFunction::evaluate(const double* arguments) const {
     double w = arguments[2];
     if (w < zmin || w > zmax)
         return 0.0;
-    return SplineFitter::evaluate3DSpline(x, y, z, values, c, u, v, w);
+    double da, db, dc;
+    int cellx = findCell(u, xmin, xscale, xsize, da);
+    int celly = findCell(v, ymin, yscale, ysize, db);
+    int cellz = findCell(w, zmin, zscale, zsize, dc);
+    const double* coeff = &c[64*(cellx+(xsize-1)*celly+(xsize-1)*(ysize-1)*cellz)];
+    double value[] = {0, 0, 0, 0};
+    for (int i = 3; i >= 0; i--) {
+        for (int j = 0; j < 4; j++) {
+            int base = 4*i + 16*j;
+            value[j] = db*value[j] + ((coeff[base+3]*da + coeff[base+2])*da + coeff[base+1])*da + coeff[base];
+        }
+    }
+    return value[0] + dc*(value[1] + dc*(value[2] + dc*value[3]));
 }
 
 double ReferenceContinuous3DFunction::evaluateDerivative(const double* arguments, const int* derivOrder) const {
@@ -212,14 +266,36 @@ double ReferenceContinuous3DFunction::evaluateDerivative(const double* arguments
     double w = arguments[2];
     if (w < zmin || w > zmax)
         return 0.0;
-    double dx, dy, dz;
-    SplineFitter::evaluate3DSplineDerivatives(x, y, z, values, c, u, v, w, dx, dy, dz);
-    if (derivOrder[0] == 1 && derivOrder[1] == 0 && derivOrder[2] == 0)
-        return dx;
-    if (derivOrder[0] == 0 && derivOrder[1] == 1 && derivOrder[2] == 0)
-        return dy;
-    if (derivOrder[0] == 0 && derivOrder[1] == 0 && derivOrder[2] == 1)
-        return dz;
+    double da, db, dc;
+    int cellx = findCell(u, xmin, xscale, xsize, da);
+    int celly = findCell(v, ymin, yscale, ysize, db);
+    int cellz = findCell(w, zmin, zscale, zsize, dc);
+    const double* coeff = &c[64*(cellx+(xsize-1)*celly+(xsize-1)*(ysize-1)*cellz)];
+    double deriv[] = {0, 0, 0, 0};
+    if (derivOrder[0] == 1 && derivOrder[1] == 0 && derivOrder[2] == 0) {
+        for (int i = 3; i >= 0; i--)
+            for (int j = 0; j < 4; j++) {
+                int base = 4*i + 16*j;
+                deriv[j] = db*deriv[j] + (3.0*coeff[base+3]*da + 2.0*coeff[base+2])*da + coeff[base+1];
+            }
+        return (deriv[0] + dc*(deriv[1] + dc*(deriv[2] + dc*deriv[3])))*xscale;
+    }
+    if (derivOrder[0] == 0 && derivOrder[1] == 1 && derivOrder[2] == 0) {
+        for (int i = 3; i >= 0; i--)
+            for (int j = 0; j < 4; j++) {
+                int base = i + 16*j;
+                deriv[j] = da*deriv[j] + (3.0*coeff[base+12]*db + 2.0*coeff[base+8])*db + coeff[base+4];
+            }
+        return (deriv[0] + dc*(deriv[1] + dc*(deriv[2] + dc*deriv[3])))*yscale;
+    }
+    if (derivOrder[0] == 0 && derivOrder[1] == 0 && derivOrder[2] == 1) {
+        for (int i = 3; i >= 0; i--)
+            for (int j = 0; j < 4; j++) {
+                int base = 4*i + 16*j;
+                deriv[j] = db*deriv[j] + ((coeff[base+3]*da + coeff[base+2])*da + coeff[base+1])*da + coeff[base];
+            }
+        return (deriv[1] + dc*(2.0*deriv[2] + 3.0*dc*deriv[3]))*zscale;
+    }
     throw OpenMMException("ReferenceContinuous3DFunction: Unsupported derivative order");
 }
 
@@ -0,0 +1,101 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2016 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "ReferenceThreadedForces.h"
+#include "openmm/OpenMMException.h"
+#include <exception>
+
+using namespace OpenMM;
+using namespace std;
+
+class ReferenceThreadedForces::LoopTask : public ThreadPool::Task {
+public:
+    LoopTask(ReferenceThreadedForces& owner, Loop& loop, int numAtoms, bool includeEnergy) : owner(owner), loop(loop),
+            numAtoms(numAtoms), includeEnergy(includeEnergy) {
+    }
+    void execute(ThreadPool& threads, int threadIndex) {
+        vector<RealVec>& forces = owner.threadForces[threadIndex];
+        forces.assign(numAtoms, RealVec());
+        owner.threadEnergy[threadIndex] = 0;
+        owner.threadErrors[threadIndex].clear();
+        try {
+            loop.execute(threadIndex, threads.getNumThreads(), forces, includeEnergy ? &owner.threadEnergy[threadIndex] : NULL);
+        }
+        catch (exception& ex) {
+            owner.threadErrors[threadIndex] = ex.what();
+        }
+    }
+    ReferenceThreadedForces& owner;
+    Loop& loop;
+    int numAtoms;
+    bool includeEnergy;
+};
+
+class ReferenceThreadedForces::SumTask : public ThreadPool::Task {
+public:
+    SumTask(ReferenceThreadedForces& owner, int numAtoms, vector<RealVec>& forces) : owner(owner), numAtoms(numAtoms), forces(forces) {
+    }
+    void execute(ThreadPool& threads, int threadIndex) {
+        // Each thread sums a contiguous block of atoms.  Every atom's contributions are added in order
+        // of thread index, which keeps the result deterministic.
+
+        int numThreads = threads.getNumThreads();
+        int start = (int) ((long long) numAtoms*threadIndex/numThreads);
+        int end = (int) ((long long) numAtoms*(threadIndex+1)/numThreads);
+        for (int i = start; i < end; i++)
+            for (int j = 0; j < numThreads; j++)
+                forces[i] += owner.threadForces[j][i];
+    }
+    ReferenceThreadedForces& owner;
+    int numAtoms;
+    vector<RealVec>& forces;
+};
+
+ReferenceThreadedForces::ReferenceThreadedForces(int numThreads) : threads(numThreads) {
+    threadForces.resize(threads.getNumThreads());
+    threadEnergy.resize(threads.getNumThreads());
+    threadErrors.resize(threads.getNumThreads());
+}
+
+void ReferenceThreadedForces::execute(Loop& loop, int numAtoms, vector<RealVec>& forces, RealOpenMM* totalEnergy) {
+    LoopTask task(*this, loop, numAtoms, totalEnergy != NULL);
+    threads.execute(task);
+    threads.waitForThreads();
+    for (int i = 0; i < (int) threadErrors.size(); i++)
+        if (!threadErrors[i].empty())
+            throw OpenMMException(threadErrors[i]);
+    SumTask sumTask(*this, numAtoms, forces);
+    threads.execute(sumTask);
+    threads.waitForThreads();
+    if (totalEnergy != NULL)
+        for (int i = 0; i < (int) threadEnergy.size(); i++)
+            *totalEnergy += threadEnergy[i];
+}
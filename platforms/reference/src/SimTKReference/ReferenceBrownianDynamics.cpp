@@ -27,7 +27,6 @@
 
 #include "SimTKOpenMMUtilities.h"
 #include "ReferenceBrownianDynamics.h"
-#include "ReferenceVirtualSites.h"
 #include "openmm/OpenMMException.h"
 
 #include <cstdio>
@@ -159,6 +158,6 @@ void ReferenceBrownianDynamics::update(const OpenMM::System& system, vector<Real
                atomCoordinates[i][j] = xPrime[i][j];
            }
    }
-   ReferenceVirtualSites::computePositions(system, atomCoordinates);
+   computeVirtualSites(system, atomCoordinates);
    incrementTimeStep();
 }
@@ -27,17 +27,126 @@
 
 #include "SimTKOpenMMUtilities.h"
 #include "ReferenceCCMAAlgorithm.h"
+#include "ReferenceDataCache.h"
 #include "ReferenceDynamics.h"
 #include "quern.h"
 #include "openmm/OpenMMException.h"
 #include "openmm/Vec3.h"
 #include "openmm/internal/ThreadPool.h"
+#include <algorithm>
 #include <map>
 #include <utility>
 
 using namespace OpenMM;
 using namespace std;
 
+// This class computes rows of the constraint coupling matrix.  It is done in parallel, since
+// this can be slow for large numbers of constraints.
+
+class ComputeCouplingTask : public ThreadPool::Task {
+public:
+    ComputeCouplingTask(const vector<pair<int, int> >& atomIndices, const vector<RealOpenMM>& distance, const vector<RealOpenMM>& masses,
+                        const vector<ReferenceCCMAAlgorithm::AngleInfo>& angles, const vector<vector<int> >& atomConstraints,
+                        const vector<vector<int> >& atomAngles, vector<vector<pair<int, double> > >& matrix) :
+                atomIndices(atomIndices), distance(distance), masses(masses), angles(angles), atomConstraints(atomConstraints),
+                atomAngles(atomAngles), matrix(matrix) {
+    }
+
+    void execute(ThreadPool& pool, int threadIndex) {
+        int numConstraints = atomIndices.size();
+        vector<int> coupled;
+        for (int j = threadIndex; j < numConstraints; j += pool.getNumThreads()) {
+            // Find every other constraint that shares an atom with this one, in the same order
+            // as a search over all constraints would find them.
+
+            int atomj0 = atomIndices[j].first;
+            int atomj1 = atomIndices[j].second;
+            coupled.clear();
+            coupled.insert(coupled.end(), atomConstraints[atomj0].begin(), atomConstraints[atomj0].end());
+            coupled.insert(coupled.end(), atomConstraints[atomj1].begin(), atomConstraints[atomj1].end());
+            sort(coupled.begin(), coupled.end());
+            coupled.erase(unique(coupled.begin(), coupled.end()), coupled.end());
+            for (int index = 0; index < (int) coupled.size(); index++) {
+                int k = coupled[index];
+                if (j == k) {
+                    matrix[j].push_back(pair<int, double>(j, 1.0));
+                    continue;
+                }
+                double scale;
+                int atomk0 = atomIndices[k].first;
+                int atomk1 = atomIndices[k].second;
+                RealOpenMM invMass0 = 1/masses[atomj0];
+                RealOpenMM invMass1 = 1/masses[atomj1];
+                int atoma, atomb, atomc;
+                if (atomj0 == atomk0) {
+                    atoma = atomj1;
+                    atomb = atomj0;
+                    atomc = atomk1;
+                    scale = invMass0/(invMass0+invMass1);
+                }
+                else if (atomj1 == atomk1) {
+                    atoma = atomj0;
+                    atomb = atomj1;
+                    atomc = atomk0;
+                    scale = invMass1/(invMass0+invMass1);
+                }
+                else if (atomj0 == atomk1) {
+                    atoma = atomj1;
+                    atomb = atomj0;
+                    atomc = atomk0;
+                    scale = invMass0/(invMass0+invMass1);
+                }
+                else {
+                    atoma = atomj0;
+                    atomb = atomj1;
+                    atomc = atomk1;
+                    scale = invMass1/(invMass0+invMass1);
+                }
+
+                // Look for a third constraint forming a triangle with these two.  It must involve atoma,
+                // so we only need to check the constraints that involve that atom.
+
+                bool foundConstraint = false;
+                const vector<int>& candidates = atomConstraints[atoma];
+                int other = -1;
+                for (int m = 0; m < (int) candidates.size(); m++) {
+                    int c = candidates[m];
+                    if ((atomIndices[c].first == atoma && atomIndices[c].second == atomc) || (atomIndices[c].first == atomc && atomIndices[c].second == atoma))
+                        if (other == -1 || c < other)
+                            other = c;
+                }
+                if (other != -1) {
+                    double d1 = distance[j];
+                    double d2 = distance[k];
+                    double d3 = distance[other];
+                    matrix[j].push_back(pair<int, double>(k, scale*(d1*d1+d2*d2-d3*d3)/(2.0*d1*d2)));
+                    foundConstraint = true;
+                }
+                if (!foundConstraint) {
+                    // We didn't find one, so look for an angle force field term.
+
+                    const vector<int>& angleCandidates = atomAngles[atomb];
+                    for (vector<int>::const_iterator iter = angleCandidates.begin(); iter != angleCandidates.end(); iter++) {
+                        const ReferenceCCMAAlgorithm::AngleInfo& angle = angles[*iter];
+                        if ((angle.atom1 == atoma && angle.atom3 == atomc) || (angle.atom3 == atoma && angle.atom1 == atomc)) {
+                            matrix[j].push_back(pair<int, double>(k, scale*cos(angle.angle)));
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+    }
+private:
+    const vector<pair<int, int> >& atomIndices;
+    const vector<RealOpenMM>& distance;
+    const vector<RealOpenMM>& masses;
+    const vector<ReferenceCCMAAlgorithm::AngleInfo>& angles;
+    const vector<vector<int> >& atomConstraints;
+    const vector<vector<int> >& atomAngles;
+    vector<vector<pair<int, double> > >& matrix;
+};
+
 // This class extracts columns from the inverse matrix one at a time.  It is done in parallel,
 // since this can be very slow.
 
@@ -97,82 +206,33 @@ ReferenceCCMAAlgorithm::ReferenceCCMAAlgorithm(int numberOfAtoms,
         _distanceTolerance = SimTKOpenMMUtilities::allocateOneDRealOpenMMArray(numberOfConstraints, NULL, 1, 0.0, "distanceTolerance");
         _reducedMasses = SimTKOpenMMUtilities::allocateOneDRealOpenMMArray(numberOfConstraints, NULL, 1, 0.0, "reducedMasses");
     }
-    if (numberOfConstraints > 0)
-    {
-        // Compute the constraint coupling matrix
+    if (numberOfConstraints > 0) {
+        // See whether the inverse matrix has already been computed for an identical set of constraints.
+
+        string key;
+        if (ReferenceDataCache::isEnabled()) {
+            key = getCacheKey(numberOfAtoms, _atomIndices, _distance, masses, angles, elementCutoff);
+            string cached;
+            if (ReferenceDataCache::load("ccma", key, cached) && loadMatrix(cached))
+                return;
+        }
 
+        // Compute the constraint coupling matrix.  Only constraints that share an atom are coupled,
+        // so first record which constraints involve each atom.
+
+        vector<vector<int> > atomConstraints(numberOfAtoms);
+        for (int i = 0; i < numberOfConstraints; i++) {
+            atomConstraints[_atomIndices[i].first].push_back(i);
+            atomConstraints[_atomIndices[i].second].push_back(i);
+        }
         vector<vector<int> > atomAngles(numberOfAtoms);
         for (int i = 0; i < (int) angles.size(); i++)
             atomAngles[angles[i].atom2].push_back(i);
         vector<vector<pair<int, double> > > matrix(numberOfConstraints);
-        for (int j = 0; j < numberOfConstraints; j++) {
-            for (int k = 0; k < numberOfConstraints; k++) {
-                if (j == k) {
-                    matrix[j].push_back(pair<int, double>(j, 1.0));
-                    continue;
-                }
-                double scale;
-                int atomj0 = _atomIndices[j].first;
-                int atomj1 = _atomIndices[j].second;
-                int atomk0 = _atomIndices[k].first;
-                int atomk1 = _atomIndices[k].second;
-                RealOpenMM invMass0 = 1/masses[atomj0];
-                RealOpenMM invMass1 = 1/masses[atomj1];
-                int atoma, atomb, atomc;
-                if (atomj0 == atomk0) {
-                    atoma = atomj1;
-                    atomb = atomj0;
-                    atomc = atomk1;
-                    scale = invMass0/(invMass0+invMass1);
-                }
-                else if (atomj1 == atomk1) {
-                    atoma = atomj0;
-                    atomb = atomj1;
-                    atomc = atomk0;
-                    scale = invMass1/(invMass0+invMass1);
-                }
-                else if (atomj0 == atomk1) {
-                    atoma = atomj1;
-                    atomb = atomj0;
-                    atomc = atomk0;
-                    scale = invMass0/(invMass0+invMass1);
-                }
-                else if (atomj1 == atomk0) {
-                    atoma = atomj0;
-                    atomb = atomj1;
-                    atomc = atomk1;
-                    scale = invMass1/(invMass0+invMass1);
-                }
-                else
-                    continue; // These constraints are not connected.
-
-                // Look for a third constraint forming a triangle with these two.
-
-                bool foundConstraint = false;
-                for (int other = 0; other < numberOfConstraints; other++) {
-                    if ((_atomIndices[other].first == atoma && _atomIndices[other].second == atomc) || (_atomIndices[other].first == atomc && _atomIndices[other].second == atoma)) {
-                        double d1 = _distance[j];
-                        double d2 = _distance[k];
-                        double d3 = _distance[other];
-                        matrix[j].push_back(pair<int, double>(k, scale*(d1*d1+d2*d2-d3*d3)/(2.0*d1*d2)));
-                        foundConstraint = true;
-                        break;
-                    }
-                }
-                if (!foundConstraint) {
-                    // We didn't find one, so look for an angle force field term.
-
-                    const vector<int>& angleCandidates = atomAngles[atomb];
-                    for (vector<int>::const_iterator iter = angleCandidates.begin(); iter != angleCandidates.end(); iter++) {
-                        const AngleInfo& angle = angles[*iter];
-                        if ((angle.atom1 == atoma && angle.atom3 == atomc) || (angle.atom3 == atoma && angle.atom1 == atomc)) {
-                            matrix[j].push_back(pair<int, double>(k, scale*cos(angle.angle)));
-                            break;
-                        }
-                    }
-                }
-            }
-        }
+        ThreadPool threads;
+        ComputeCouplingTask couplingTask(_atomIndices, _distance, masses, angles, atomConstraints, atomAngles, matrix);
+        threads.execute(couplingTask);
+        threads.waitForThreads();
 
         // Invert it using QR.
 
@@ -194,7 +254,6 @@ ReferenceCCMAAlgorithm::ReferenceCCMAAlgorithm(int numberOfAtoms,
                 &qRowStart, &qColIndex, &qValue, &rRowStart, &rColIndex, &rValue);
         vector<vector<pair<int, RealOpenMM> > > transposedMatrix(numberOfConstraints);
         _matrix.resize(numberOfConstraints);
-        ThreadPool threads;
         ExtractMatrixTask task(numberOfConstraints, transposedMatrix, _distance, _elementCutoff, qRowStart, qColIndex, rRowStart, rColIndex, qValue, rValue);
         threads.execute(task);
         threads.waitForThreads();
@@ -209,7 +268,71 @@ ReferenceCCMAAlgorithm::ReferenceCCMAAlgorithm(int numberOfAtoms,
         }
         QUERN_free_result(qRowStart, qColIndex, qValue);
         QUERN_free_result(rRowStart, rColIndex, rValue);
+        if (ReferenceDataCache::isEnabled())
+            ReferenceDataCache::save("ccma", key, saveMatrix());
+    }
+}
+
+string ReferenceCCMAAlgorithm::getCacheKey(int numberOfAtoms, const vector<pair<int, int> >& atomIndices, const vector<RealOpenMM>& distance,
+                                           const vector<RealOpenMM>& masses, const vector<AngleInfo>& angles, RealOpenMM elementCutoff) {
+    int numberOfConstraints = atomIndices.size();
+    stringstream key;
+    key << sizeof(RealOpenMM) << ' ' << numberOfAtoms << ' ' << numberOfConstraints << ' ';
+    key.write((const char*) &elementCutoff, sizeof(RealOpenMM));
+    for (int i = 0; i < numberOfConstraints; i++) {
+        key.write((const char*) &atomIndices[i].first, sizeof(int));
+        key.write((const char*) &atomIndices[i].second, sizeof(int));
+        key.write((const char*) &distance[i], sizeof(RealOpenMM));
+        key.write((const char*) &masses[atomIndices[i].first], sizeof(RealOpenMM));
+        key.write((const char*) &masses[atomIndices[i].second], sizeof(RealOpenMM));
+    }
+    for (int i = 0; i < (int) angles.size(); i++) {
+        key.write((const char*) &angles[i].atom1, sizeof(int));
+        key.write((const char*) &angles[i].atom2, sizeof(int));
+        key.write((const char*) &angles[i].atom3, sizeof(int));
+        key.write((const char*) &angles[i].angle, sizeof(RealOpenMM));
+    }
+    return key.str();
+}
+
+string ReferenceCCMAAlgorithm::saveMatrix() const {
+    stringstream data;
+    for (int i = 0; i < (int) _matrix.size(); i++) {
+        int size = _matrix[i].size();
+        data.write((const char*) &size, sizeof(int));
+        for (int j = 0; j < size; j++) {
+            data.write((const char*) &_matrix[i][j].first, sizeof(int));
+            data.write((const char*) &_matrix[i][j].second, sizeof(RealOpenMM));
+        }
+    }
+    return data.str();
+}
+
+bool ReferenceCCMAAlgorithm::loadMatrix(const string& data) {
+    vector<vector<pair<int, RealOpenMM> > > matrix(_numberOfConstraints);
+    const size_t entrySize = sizeof(int)+sizeof(RealOpenMM);
+    size_t offset = 0;
+    for (int i = 0; i < _numberOfConstraints; i++) {
+        int size;
+        if (offset+sizeof(int) > data.size())
+            return false;
+        memcpy(&size, &data[offset], sizeof(int));
+        offset += sizeof(int);
+        if (size < 0 || offset+size*entrySize > data.size())
+            return false;
+        matrix[i].resize(size);
+        for (int j = 0; j < size; j++) {
+            memcpy(&matrix[i][j].first, &data[offset], sizeof(int));
+            memcpy(&matrix[i][j].second, &data[offset+sizeof(int)], sizeof(RealOpenMM));
+            offset += entrySize;
+            if (matrix[i][j].first < 0 || matrix[i][j].first >= _numberOfConstraints)
+                return false;
+        }
     }
+    if (offset != data.size())
+        return false;
+    _matrix.swap(matrix);
+    return true;
 }
 
 ReferenceCCMAAlgorithm::~ReferenceCCMAAlgorithm() {
@@ -34,6 +34,8 @@
 #include "ReferenceSETTLEAlgorithm.h"
 #include "openmm/HarmonicAngleForce.h"
 #include "openmm/OpenMMException.h"
+#include "openmm/internal/Profiler.h"
+#include "openmm/internal/timer.h"
 #include <map>
 #include <utility>
 #include <vector>
@@ -41,7 +43,7 @@
 using namespace OpenMM;
 using namespace std;
 
-ReferenceConstraints::ReferenceConstraints(const System& system) : ccma(NULL), settle(NULL) {
+ReferenceConstraints::ReferenceConstraints(const System& system) : ccma(NULL), settle(NULL), profiler(NULL) {
     int numParticles = system.getNumParticles();
     vector<RealOpenMM> masses(numParticles);
     for (int i = 0; i < numParticles; ++i)
@@ -191,16 +193,28 @@ ReferenceConstraints::~ReferenceConstraints() {
         delete settle;
 }
 
+void ReferenceConstraints::setProfiler(Profiler* profiler) {
+    this->profiler = profiler;
+}
+
 void ReferenceConstraints::apply(vector<OpenMM::RealVec>& atomCoordinates, vector<OpenMM::RealVec>& atomCoordinatesP, vector<RealOpenMM>& inverseMasses, RealOpenMM tolerance) {
+    bool profile = (profiler != NULL && profiler->isEnabled());
+    double startTime = (profile ? getCurrentTime() : 0.0);
     if (ccma != NULL)
         ccma->apply(atomCoordinates, atomCoordinatesP, inverseMasses, tolerance);
     if (settle != NULL)
         settle->apply(atomCoordinates, atomCoordinatesP, inverseMasses, tolerance);
+    if (profile)
+        profiler->addTime("Constraints", getCurrentTime()-startTime);
 }
 
 void ReferenceConstraints::applyToVelocities(vector<OpenMM::RealVec>& atomCoordinates, vector<OpenMM::RealVec>& velocities, vector<RealOpenMM>& inverseMasses, RealOpenMM tolerance) {
+    bool profile = (profiler != NULL && profiler->isEnabled());
+    double startTime = (profile ? getCurrentTime() : 0.0);
     if (ccma != NULL)
         ccma->applyToVelocities(atomCoordinates, velocities, inverseMasses, tolerance);
     if (settle != NULL)
         settle->applyToVelocities(atomCoordinates, velocities, inverseMasses, tolerance);
+    if (profile)
+        profiler->addTime("Velocity constraints", getCurrentTime()-startTime);
 }
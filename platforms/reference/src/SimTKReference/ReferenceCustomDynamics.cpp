@@ -23,7 +23,6 @@
  */
 
 #include "SimTKOpenMMUtilities.h"
-#include "ReferenceVirtualSites.h"
 #include "ReferenceCustomDynamics.h"
 #include "openmm/OpenMMException.h"
 #include "openmm/internal/ContextImpl.h"
@@ -119,13 +118,13 @@ void ReferenceCustomDynamics::initialize(ContextImpl& context, vector<RealOpenMM
     vector<int> forceGroup;
     vector<vector<ParsedExpression> > expressions;
     CustomIntegratorUtilities::analyzeComputations(context, integrator, expressions, comparisons, blockEnd, invalidatesForces, needsForces, needsEnergy, computeBothForceAndEnergy, forceGroup);
-    stepExpressions.resize(expressions.size());
+    stepExpressions.resize(expressions.size(), NULL);
     for (int i = 0; i < numSteps; i++) {
-        stepExpressions[i].resize(expressions[i].size());
-        for (int j = 0; j < (int) expressions[i].size(); j++) {
-            stepExpressions[i][j] = ParsedExpression(replaceDerivFunctions(expressions[i][j].getRootNode(), context)).createCompiledExpression();
-            stepExpressions[i][j].setVariableLocations(variableLocations);
-            expressionSet.registerExpression(stepExpressions[i][j]);
+        if (expressions[i].size() > 0) {
+            vector<ParsedExpression> stepExpression;
+            for (int j = 0; j < (int) expressions[i].size(); j++)
+                stepExpression.push_back(ParsedExpression(replaceDerivFunctions(expressions[i][j].getRootNode(), context)));
+            stepExpressions[i] = &expressionSet.registerExpressions(stepExpression, variableLocations);
         }
         if (stepType[i] == CustomIntegrator::WhileBlockStart)
             blockEnd[blockEnd[i]] = i; // Record where to branch back to.
@@ -232,7 +231,7 @@ void ReferenceCustomDynamics::update(ContextImpl& context, int numberOfAtoms, ve
             case CustomIntegrator::ComputeGlobal: {
                 uniform = SimTKOpenMMUtilities::getUniformlyDistributedRandomNumber();
                 gaussian = SimTKOpenMMUtilities::getNormallyDistributedRandomNumber();
-                RealOpenMM result = stepExpressions[step][0].evaluate();
+                RealOpenMM result = stepExpressions[step]->evaluate();
                 globals[stepVariable[step]] = result;
                 expressionSet.setVariable(stepVariableIndex[step], result);
                 break;
@@ -250,11 +249,11 @@ void ReferenceCustomDynamics::update(ContextImpl& context, int numberOfAtoms, ve
                 }
                 if (results == NULL)
                     throw OpenMMException("Illegal per-DOF output variable: "+stepVariable[step]);
-                computePerDof(numberOfAtoms, *results, atomCoordinates, velocities, forces, masses, perDof, stepExpressions[step][0]);
+                computePerDof(numberOfAtoms, *results, atomCoordinates, velocities, forces, masses, perDof, *stepExpressions[step]);
                 break;
             }
             case CustomIntegrator::ComputeSum: {
-                computePerDof(numberOfAtoms, sumBuffer, atomCoordinates, velocities, forces, masses, perDof, stepExpressions[step][0]);
+                computePerDof(numberOfAtoms, sumBuffer, atomCoordinates, velocities, forces, masses, perDof, *stepExpressions[step]);
                 RealOpenMM sum = 0.0;
                 for (int j = 0; j < numberOfAtoms; j++)
                     if (masses[j] != 0.0)
@@ -296,11 +295,14 @@ void ReferenceCustomDynamics::update(ContextImpl& context, int numberOfAtoms, ve
                 break;
             }
         }
-        if (invalidatesForces[step])
+        if (invalidatesForces[step]) {
             forcesAreValid = false;
+            context.incrementStateVersion();
+        }
         step = nextStep;
     }
-    ReferenceVirtualSites::computePositions(context.getSystem(), atomCoordinates);
+    computeVirtualSites(context.getSystem(), atomCoordinates);
+    context.incrementStateVersion();
     incrementTimeStep();
     recordChangedParameters(context, globals);
 }
@@ -332,8 +334,8 @@ void ReferenceCustomDynamics::computePerDof(int numberOfAtoms, vector<RealVec>&
 bool ReferenceCustomDynamics::evaluateCondition(int step) {
     uniform = SimTKOpenMMUtilities::getUniformlyDistributedRandomNumber();
     gaussian = SimTKOpenMMUtilities::getNormallyDistributedRandomNumber();
-    double lhs = stepExpressions[step][0].evaluate();
-    double rhs = stepExpressions[step][1].evaluate();
+    double lhs = stepExpressions[step]->evaluate();
+    double rhs = stepExpressions[step]->getOutput(1);
     switch (comparisons[step]) {
         case CustomIntegratorUtilities::EQUAL:
             return (lhs == rhs);
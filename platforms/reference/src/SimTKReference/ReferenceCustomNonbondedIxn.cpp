@@ -46,7 +46,7 @@ using namespace OpenMM;
 ReferenceCustomNonbondedIxn::ReferenceCustomNonbondedIxn(const Lepton::CompiledExpression& energyExpression,
         const Lepton::CompiledExpression& forceExpression, const vector<string>& parameterNames,
         const vector<Lepton::CompiledExpression> energyParamDerivExpressions) :
-            cutoff(false), useSwitch(false), periodic(false), energyExpression(energyExpression), forceExpression(forceExpression),
+            cutoff(false), useSwitch(false), periodic(false), threadIndex(0), numThreads(1), energyExpression(energyExpression), forceExpression(forceExpression),
             paramNames(parameterNames), energyParamDerivExpressions(energyParamDerivExpressions) {
     expressionSet.registerExpression(this->energyExpression);
     expressionSet.registerExpression(this->forceExpression);
@@ -120,6 +120,21 @@ void ReferenceCustomNonbondedIxn::setUseSwitchingFunction(RealOpenMM distance) {
     switchingDistance = distance;
 }
 
+/**---------------------------------------------------------------------------------------
+
+   Compute only a subset of the interactions.  With a cutoff, the neighbor list is divided into
+   contiguous blocks.  Otherwise, the first atom of each pair is assigned to subsets in turn.
+
+   @param threadIndex         the index of the subset to compute
+   @param numThreads          the total number of subsets
+
+   --------------------------------------------------------------------------------------- */
+
+void ReferenceCustomNonbondedIxn::setThreadSubset(int threadIndex, int numThreads) {
+    this->threadIndex = threadIndex;
+    this->numThreads = numThreads;
+}
+
   /**---------------------------------------------------------------------------------------
 
      Set the force to use periodic boundary conditions.  This requires that a cutoff has
@@ -171,10 +186,13 @@ void ReferenceCustomNonbondedIxn::calculatePairIxn(int numberOfAtoms, vector<Rea
     if (interactionGroups.size() > 0) {
         // The user has specified interaction groups, so compute only the requested interactions.
         
+        int index = 0;
         for (int group = 0; group < (int) interactionGroups.size(); group++) {
             const set<int>& set1 = interactionGroups[group].first;
             const set<int>& set2 = interactionGroups[group].second;
             for (set<int>::const_iterator atom1 = set1.begin(); atom1 != set1.end(); ++atom1) {
+                if (index++%numThreads != threadIndex)
+                    continue;
                 for (set<int>::const_iterator atom2 = set2.begin(); atom2 != set2.end(); ++atom2) {
                     if (*atom1 == *atom2 || exclusions[*atom1].find(*atom2) != exclusions[*atom1].end())
                         continue; // This is an excluded interaction.
@@ -192,7 +210,10 @@ void ReferenceCustomNonbondedIxn::calculatePairIxn(int numberOfAtoms, vector<Rea
     else if (cutoff) {
         // We are using a cutoff, so get the interactions from the neighbor list.
         
-        for (int i = 0; i < (int) neighborList->size(); i++) {
+        int numPairs = neighborList->size();
+        int start = (int) ((long long) numPairs*threadIndex/numThreads);
+        int end = (int) ((long long) numPairs*(threadIndex+1)/numThreads);
+        for (int i = start; i < end; i++) {
             OpenMM::AtomPair pair = (*neighborList)[i];
             for (int j = 0; j < (int) paramNames.size(); j++) {
                 expressionSet.setVariable(particleParamIndex[j*2], atomParameters[pair.first][j]);
@@ -204,7 +225,7 @@ void ReferenceCustomNonbondedIxn::calculatePairIxn(int numberOfAtoms, vector<Rea
     else {
         // Every particle interacts with every other one.
         
-        for (int ii = 0; ii < numberOfAtoms; ii++) {
+        for (int ii = threadIndex; ii < numberOfAtoms; ii += numThreads) {
             for (int jj = ii+1; jj < numberOfAtoms; jj++) {
                 if (exclusions[jj].find(ii) == exclusions[jj].end()) {
                     for (int j = 0; j < (int) paramNames.size(); j++) {
@@ -27,6 +27,7 @@
 
 #include "SimTKOpenMMUtilities.h"
 #include "ReferenceDynamics.h"
+#include "ReferenceVirtualSites.h"
 
 #include <cstdio>
 
@@ -263,3 +264,16 @@ void ReferenceDynamics::update(const OpenMM::System& system, vector<RealVec>& at
 
    // ---------------------------------------------------------------------------------------
 }
+
+/**---------------------------------------------------------------------------------------
+
+   Compute the positions of virtual sites
+
+   @param system              the System being integrated
+   @param atomCoordinates     atom coordinates
+
+   --------------------------------------------------------------------------------------- */
+
+void ReferenceDynamics::computeVirtualSites(const OpenMM::System& system, vector<RealVec>& atomCoordinates) {
+   ReferenceVirtualSites::computePositions(system, atomCoordinates);
+}
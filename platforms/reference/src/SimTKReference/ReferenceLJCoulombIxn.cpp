@@ -31,6 +31,7 @@
 #include "ReferenceLJCoulombIxn.h"
 #include "ReferenceForce.h"
 #include "ReferencePME.h"
+#include "ReferenceThreadedForces.h"
 #include "openmm/OpenMMException.h"
 
 // In case we're using some primitive version of Visual Studio this will
@@ -41,13 +42,33 @@ using std::set;
 using std::vector;
 using namespace OpenMM;
 
+class ReferenceLJCoulombIxn::DirectLoop : public ReferenceThreadedForces::Loop {
+public:
+    DirectLoop(const ReferenceLJCoulombIxn& owner, int numberOfAtoms, vector<RealVec>& atomCoordinates, RealOpenMM** atomParameters,
+            vector<set<int> >& exclusions) : owner(owner), numberOfAtoms(numberOfAtoms), atomCoordinates(atomCoordinates),
+            atomParameters(atomParameters), exclusions(exclusions) {
+    }
+    void execute(int threadIndex, int numThreads, vector<RealVec>& forces, RealOpenMM* energy) {
+        if (owner.ewald || owner.pme)
+            owner.calculateEwaldDirectIxn(threadIndex, numThreads, atomCoordinates, atomParameters, forces, NULL, energy);
+        else
+            owner.calculateDirectIxn(threadIndex, numThreads, numberOfAtoms, atomCoordinates, atomParameters, exclusions, forces, NULL, energy);
+    }
+private:
+    const ReferenceLJCoulombIxn& owner;
+    int numberOfAtoms;
+    vector<RealVec>& atomCoordinates;
+    RealOpenMM** atomParameters;
+    vector<set<int> >& exclusions;
+};
+
 /**---------------------------------------------------------------------------------------
 
    ReferenceLJCoulombIxn constructor
 
    --------------------------------------------------------------------------------------- */
 
-ReferenceLJCoulombIxn::ReferenceLJCoulombIxn() : cutoff(false), useSwitch(false), periodic(false), ewald(false), pme(false) {
+ReferenceLJCoulombIxn::ReferenceLJCoulombIxn() : cutoff(false), useSwitch(false), periodic(false), ewald(false), pme(false), threads(NULL) {
 
    // ---------------------------------------------------------------------------------------
 
@@ -92,6 +113,19 @@ ReferenceLJCoulombIxn::~ReferenceLJCoulombIxn() {
     crf = (1.0/cutoffDistance)*(3.0*solventDielectric)/(2.0*solventDielectric+1.0);
   }
 
+/**---------------------------------------------------------------------------------------
+
+   Divide the direct space interactions between multiple threads.
+
+   @param threads             the object used to run them, or NULL to compute them on the
+                              calling thread
+
+   --------------------------------------------------------------------------------------- */
+
+void ReferenceLJCoulombIxn::setThreadedForces(ReferenceThreadedForces* threads) {
+    this->threads = threads;
+}
+
 /**---------------------------------------------------------------------------------------
 
    Set the force to use a switching function on the Lennard-Jones interaction.
@@ -356,10 +390,84 @@ void ReferenceLJCoulombIxn::calculateEwaldIxn(int numberOfAtoms, vector<RealVec>
 
     if (!includeDirect)
         return;
+    if (threads != NULL && energyByAtom == NULL) {
+        DirectLoop loop(*this, numberOfAtoms, atomCoordinates, atomParameters, exclusions);
+        threads->execute(loop, numberOfAtoms, forces, totalEnergy);
+    }
+    else
+        calculateEwaldDirectIxn(0, 1, atomCoordinates, atomParameters, forces, energyByAtom, totalEnergy);
+
+    // Now subtract off the exclusions, since they were implicitly included in the reciprocal space sum.
+
+    RealOpenMM totalExclusionEnergy = 0.0f;
+    const double TWO_OVER_SQRT_PI = 2/sqrt(PI_M);
+    for (int i = 0; i < numberOfAtoms; i++)
+        for (set<int>::const_iterator iter = exclusions[i].begin(); iter != exclusions[i].end(); ++iter) {
+            if (*iter > i) {
+               int ii = i;
+               int jj = *iter;
+
+               RealOpenMM deltaR[2][ReferenceForce::LastDeltaRIndex];
+               ReferenceForce::getDeltaR(atomCoordinates[jj], atomCoordinates[ii], deltaR[0]);
+               RealOpenMM r         = deltaR[0][ReferenceForce::RIndex];
+               RealOpenMM inverseR  = one/(deltaR[0][ReferenceForce::RIndex]);
+               RealOpenMM alphaR    = alphaEwald * r;
+               if (erf(alphaR) > 1e-6) {
+                   RealOpenMM dEdR      = (RealOpenMM) (ONE_4PI_EPS0 * atomParameters[ii][QIndex] * atomParameters[jj][QIndex] * inverseR * inverseR * inverseR);
+                              dEdR      = (RealOpenMM) (dEdR * (erf(alphaR) - 2 * alphaR * exp (- alphaR * alphaR) / SQRT_PI));
+
+                   // accumulate forces
+
+                   for (int kk = 0; kk < 3; kk++) {
+                      RealOpenMM force  = dEdR*deltaR[0][kk];
+                      forces[ii][kk]   -= force;
+                      forces[jj][kk]   += force;
+                   }
+
+                   // accumulate energies
+
+                   realSpaceEwaldEnergy = (RealOpenMM) (ONE_4PI_EPS0*atomParameters[ii][QIndex]*atomParameters[jj][QIndex]*inverseR*erf(alphaR));
+               }
+               else {
+                   realSpaceEwaldEnergy = (RealOpenMM) (alphaEwald*TWO_OVER_SQRT_PI*ONE_4PI_EPS0*atomParameters[ii][QIndex]*atomParameters[jj][QIndex]);
+               }
+
+               totalExclusionEnergy += realSpaceEwaldEnergy;
+               if (energyByAtom) {
+                   energyByAtom[ii] -= realSpaceEwaldEnergy;
+                   energyByAtom[jj] -= realSpaceEwaldEnergy;
+               }
+            }
+        }
+
+    if (totalEnergy)
+        *totalEnergy -= totalExclusionEnergy;
+}
+
+
+/**---------------------------------------------------------------------------------------
+
+   Calculate the direct space part of the Ewald or PME interaction for a subset of the
+   neighbor list.  The list is divided into numThreads contiguous blocks, and only the block
+   for threadIndex is computed.
+
+   --------------------------------------------------------------------------------------- */
+
+void ReferenceLJCoulombIxn::calculateEwaldDirectIxn(int threadIndex, int numThreads, vector<RealVec>& atomCoordinates,
+                                             RealOpenMM** atomParameters, vector<RealVec>& forces,
+                                             RealOpenMM* energyByAtom, RealOpenMM* totalEnergy) const {
+    static const RealOpenMM one         =  1.0;
+    static const RealOpenMM six         =  6.0;
+    static const RealOpenMM twelve      = 12.0;
+    RealOpenMM SQRT_PI                  = sqrt(PI_M);
+
     RealOpenMM totalVdwEnergy            = 0.0f;
     RealOpenMM totalRealSpaceEwaldEnergy = 0.0f;
 
-    for (int i = 0; i < (int) neighborList->size(); i++) {
+    int numPairs = neighborList->size();
+    int start = (int) ((long long) numPairs*threadIndex/numThreads);
+    int end = (int) ((long long) numPairs*(threadIndex+1)/numThreads);
+    for (int i = start; i < end; i++) {
        OpenMM::AtomPair pair = (*neighborList)[i];
        int ii = pair.first;
        int jj = pair.second;
@@ -375,6 +483,7 @@ void ReferenceLJCoulombIxn::calculateEwaldIxn(int numberOfAtoms, vector<RealVec>
            switchDeriv = t*t*(-30+t*(60-t*30))/(cutoffDistance-switchingDistance);
        }
        RealOpenMM alphaR    = alphaEwald * r;
+       RealOpenMM realSpaceEwaldEnergy, vdwEnergy;
 
 
        RealOpenMM dEdR      = (RealOpenMM) (ONE_4PI_EPS0 * atomParameters[ii][QIndex] * atomParameters[jj][QIndex] * inverseR * inverseR * inverseR);
@@ -416,55 +525,8 @@ void ReferenceLJCoulombIxn::calculateEwaldIxn(int numberOfAtoms, vector<RealVec>
 
     if (totalEnergy)
         *totalEnergy += totalRealSpaceEwaldEnergy + totalVdwEnergy;
-
-    // Now subtract off the exclusions, since they were implicitly included in the reciprocal space sum.
-
-    RealOpenMM totalExclusionEnergy = 0.0f;
-    const double TWO_OVER_SQRT_PI = 2/sqrt(PI_M);
-    for (int i = 0; i < numberOfAtoms; i++)
-        for (set<int>::const_iterator iter = exclusions[i].begin(); iter != exclusions[i].end(); ++iter) {
-            if (*iter > i) {
-               int ii = i;
-               int jj = *iter;
-
-               RealOpenMM deltaR[2][ReferenceForce::LastDeltaRIndex];
-               ReferenceForce::getDeltaR(atomCoordinates[jj], atomCoordinates[ii], deltaR[0]);
-               RealOpenMM r         = deltaR[0][ReferenceForce::RIndex];
-               RealOpenMM inverseR  = one/(deltaR[0][ReferenceForce::RIndex]);
-               RealOpenMM alphaR    = alphaEwald * r;
-               if (erf(alphaR) > 1e-6) {
-                   RealOpenMM dEdR      = (RealOpenMM) (ONE_4PI_EPS0 * atomParameters[ii][QIndex] * atomParameters[jj][QIndex] * inverseR * inverseR * inverseR);
-                              dEdR      = (RealOpenMM) (dEdR * (erf(alphaR) - 2 * alphaR * exp (- alphaR * alphaR) / SQRT_PI));
-
-                   // accumulate forces
-
-                   for (int kk = 0; kk < 3; kk++) {
-                      RealOpenMM force  = dEdR*deltaR[0][kk];
-                      forces[ii][kk]   -= force;
-                      forces[jj][kk]   += force;
-                   }
-
-                   // accumulate energies
-
-                   realSpaceEwaldEnergy = (RealOpenMM) (ONE_4PI_EPS0*atomParameters[ii][QIndex]*atomParameters[jj][QIndex]*inverseR*erf(alphaR));
-               }
-               else {
-                   realSpaceEwaldEnergy = (RealOpenMM) (alphaEwald*TWO_OVER_SQRT_PI*ONE_4PI_EPS0*atomParameters[ii][QIndex]*atomParameters[jj][QIndex]);
-               }
-
-               totalExclusionEnergy += realSpaceEwaldEnergy;
-               if (energyByAtom) {
-                   energyByAtom[ii] -= realSpaceEwaldEnergy;
-                   energyByAtom[jj] -= realSpaceEwaldEnergy;
-               }
-            }
-        }
-
-    if (totalEnergy)
-        *totalEnergy -= totalExclusionEnergy;
 }
 
-
 /**---------------------------------------------------------------------------------------
 
    Calculate LJ Coulomb pair ixn
@@ -495,14 +557,36 @@ void ReferenceLJCoulombIxn::calculatePairIxn(int numberOfAtoms, vector<RealVec>&
    }
    if (!includeDirect)
        return;
+   if (threads != NULL && energyByAtom == NULL) {
+       DirectLoop loop(*this, numberOfAtoms, atomCoordinates, atomParameters, exclusions);
+       threads->execute(loop, numberOfAtoms, forces, totalEnergy);
+   }
+   else
+       calculateDirectIxn(0, 1, numberOfAtoms, atomCoordinates, atomParameters, exclusions, forces, energyByAtom, totalEnergy);
+}
+
+/**---------------------------------------------------------------------------------------
+
+   Calculate the LJ Coulomb interactions assigned to one thread.  With a cutoff, the neighbor
+   list is divided into numThreads contiguous blocks.  Without one, rows of the pair matrix are
+   assigned to threads in turn to balance the work.
+
+   --------------------------------------------------------------------------------------- */
+
+void ReferenceLJCoulombIxn::calculateDirectIxn(int threadIndex, int numThreads, int numberOfAtoms, vector<RealVec>& atomCoordinates,
+                                             RealOpenMM** atomParameters, vector<set<int> >& exclusions, vector<RealVec>& forces,
+                                             RealOpenMM* energyByAtom, RealOpenMM* totalEnergy) const {
    if (cutoff) {
-       for (int i = 0; i < (int) neighborList->size(); i++) {
+       int numPairs = neighborList->size();
+       int start = (int) ((long long) numPairs*threadIndex/numThreads);
+       int end = (int) ((long long) numPairs*(threadIndex+1)/numThreads);
+       for (int i = start; i < end; i++) {
            OpenMM::AtomPair pair = (*neighborList)[i];
            calculateOneIxn(pair.first, pair.second, atomCoordinates, atomParameters, forces, energyByAtom, totalEnergy);
        }
    }
    else {
-       for (int ii = 0; ii < numberOfAtoms; ii++) {
+       for (int ii = threadIndex; ii < numberOfAtoms; ii += numThreads) {
           // loop over atom pairs
 
           for (int jj = ii+1; jj < numberOfAtoms; jj++)
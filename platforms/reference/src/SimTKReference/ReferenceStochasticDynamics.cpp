@@ -27,7 +27,6 @@
 
 #include "SimTKOpenMMUtilities.h"
 #include "ReferenceStochasticDynamics.h"
-#include "ReferenceVirtualSites.h"
 #include "openmm/OpenMMException.h"
 
 #include <cstdio>
@@ -233,6 +232,6 @@ void ReferenceStochasticDynamics::update(const OpenMM::System& system, vector<Re
 
    updatePart3(numberOfAtoms, atomCoordinates, velocities, inverseMasses, xPrime);
 
-   ReferenceVirtualSites::computePositions(system, atomCoordinates);
+   computeVirtualSites(system, atomCoordinates);
    incrementTimeStep();
 }
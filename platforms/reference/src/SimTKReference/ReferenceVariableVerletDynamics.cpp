@@ -28,7 +28,6 @@
 
 #include "SimTKOpenMMUtilities.h"
 #include "ReferenceVariableVerletDynamics.h"
-#include "ReferenceVirtualSites.h"
 
 using std::vector;
 using namespace OpenMM;
@@ -166,7 +165,7 @@ void ReferenceVariableVerletDynamics::update(const OpenMM::System& system, vecto
                atomCoordinates[i][j] = xPrime[i][j];
            }
    }
-   ReferenceVirtualSites::computePositions(system, atomCoordinates);
+   computeVirtualSites(system, atomCoordinates);
    incrementTimeStep();
 }
 
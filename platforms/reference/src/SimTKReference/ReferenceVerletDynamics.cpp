@@ -27,7 +27,6 @@
 
 #include "SimTKOpenMMUtilities.h"
 #include "ReferenceVerletDynamics.h"
-#include "ReferenceVirtualSites.h"
 
 #include <cstdio>
 
@@ -141,6 +140,6 @@ void ReferenceVerletDynamics::update(const OpenMM::System& system, vector<RealVe
            }
    }
 
-   ReferenceVirtualSites::computePositions(system, atomCoordinates);
+   computeVirtualSites(system, atomCoordinates);
    incrementTimeStep();
 }
@@ -0,0 +1,205 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2016 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "openmm/internal/AssertionUtilities.h"
+#include "ReferenceCCMAAlgorithm.h"
+#include "ReferenceDataCache.h"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+using namespace OpenMM;
+using namespace std;
+
+void setVariable(const char* name, const char* value) {
+#ifdef WIN32
+    _putenv_s(name, value == NULL ? "" : value);
+#else
+    if (value == NULL)
+        unsetenv(name);
+    else
+        setenv(name, value, 1);
+#endif
+}
+
+void setCacheDirectory(const char* dir) {
+    setVariable("OPENMM_DATA_CACHE_DIR", dir[0] == 0 ? NULL : dir);
+}
+
+string readFile(const string& filename) {
+    ifstream file(filename.c_str(), ios::in | ios::binary);
+    ASSERT(file.is_open());
+    stringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+}
+
+void assertMatricesEqual(const ReferenceCCMAAlgorithm& expected, const ReferenceCCMAAlgorithm& found) {
+    const vector<vector<pair<int, RealOpenMM> > >& matrix1 = expected.getMatrix();
+    const vector<vector<pair<int, RealOpenMM> > >& matrix2 = found.getMatrix();
+    ASSERT_EQUAL(matrix1.size(), matrix2.size());
+    for (int i = 0; i < (int) matrix1.size(); i++) {
+        ASSERT_EQUAL(matrix1[i].size(), matrix2[i].size());
+        for (int j = 0; j < (int) matrix1[i].size(); j++) {
+            ASSERT_EQUAL(matrix1[i][j].first, matrix2[i][j].first);
+            ASSERT_EQUAL(matrix1[i][j].second, matrix2[i][j].second);
+        }
+    }
+}
+
+bool matricesDiffer(const ReferenceCCMAAlgorithm& ccma1, const ReferenceCCMAAlgorithm& ccma2) {
+    const vector<vector<pair<int, RealOpenMM> > >& matrix1 = ccma1.getMatrix();
+    const vector<vector<pair<int, RealOpenMM> > >& matrix2 = ccma2.getMatrix();
+    for (int i = 0; i < (int) matrix1.size(); i++)
+        for (int j = 0; j < (int) matrix1[i].size(); j++)
+            if (matrix1[i][j].second != matrix2[i][j].second)
+                return true;
+    return false;
+}
+
+void testCachedConstraintMatrix() {
+    // Build a branched chain of constraints with angles between them.
+
+    const int numAtoms = 30;
+    vector<pair<int, int> > atoms;
+    vector<RealOpenMM> distances;
+    vector<RealOpenMM> masses;
+    vector<ReferenceCCMAAlgorithm::AngleInfo> angles;
+    for (int i = 0; i < numAtoms; i++)
+        masses.push_back(i%3 == 0 ? 12.0 : 1.0+i%2);
+    for (int i = 1; i < numAtoms; i++) {
+        int parent = (i%4 == 0 ? i-2 : i-1);
+        atoms.push_back(make_pair(parent, i));
+        distances.push_back(0.1+0.01*(i%5));
+        if (parent > 0)
+            angles.push_back(ReferenceCCMAAlgorithm::AngleInfo(parent-1, parent, i, 1.9));
+    }
+    vector<RealOpenMM> changedDistances = distances;
+    changedDistances[3] *= 1.5;
+    int numConstraints = atoms.size();
+    setCacheDirectory("");
+    ReferenceCCMAAlgorithm uncached(numAtoms, numConstraints, atoms, distances, masses, angles, 0.02);
+    ReferenceCCMAAlgorithm changedUncached(numAtoms, numConstraints, atoms, changedDistances, masses, angles, 0.02);
+    ASSERT(matricesDiffer(uncached, changedUncached));
+
+    // Each object computes its matrix and stores it in the cache.  Changing a distance must produce a
+    // different entry rather than reusing the first one.
+
+    setCacheDirectory(".");
+    ASSERT(ReferenceDataCache::isEnabled());
+    string cacheFile = ReferenceDataCache::getCacheFile("ccma", ReferenceCCMAAlgorithm::getCacheKey(numAtoms, atoms, distances, masses, angles, 0.02));
+    string changedCacheFile = ReferenceDataCache::getCacheFile("ccma", ReferenceCCMAAlgorithm::getCacheKey(numAtoms, atoms, changedDistances, masses, angles, 0.02));
+    ASSERT(cacheFile != changedCacheFile);
+    remove(cacheFile.c_str());
+    remove(changedCacheFile.c_str());
+    ReferenceCCMAAlgorithm first(numAtoms, numConstraints, atoms, distances, masses, angles, 0.02);
+    assertMatricesEqual(uncached, first);
+    ASSERT(ifstream(cacheFile.c_str()).is_open());
+    ReferenceCCMAAlgorithm changed(numAtoms, numConstraints, atoms, changedDistances, masses, angles, 0.02);
+    assertMatricesEqual(changedUncached, changed);
+    ASSERT(ifstream(changedCacheFile.c_str()).is_open());
+
+    // Overwrite the first entry with the contents of the second one.  If the next object really loads
+    // its matrix from the cache rather than recomputing it, it will get the matrix for the changed distances.
+
+    string changedData = readFile(changedCacheFile);
+    {
+        ofstream file(cacheFile.c_str(), ios::out | ios::binary);
+        file.write(changedData.c_str(), changedData.size());
+    }
+    ReferenceCCMAAlgorithm second(numAtoms, numConstraints, atoms, distances, masses, angles, 0.02);
+    assertMatricesEqual(changedUncached, second);
+
+    // A corrupted entry must be ignored, and the matrix recomputed.
+
+    {
+        ofstream file(cacheFile.c_str(), ios::out | ios::binary);
+        file.write(changedData.c_str(), changedData.size()/2);
+    }
+    ReferenceCCMAAlgorithm third(numAtoms, numConstraints, atoms, distances, masses, angles, 0.02);
+    assertMatricesEqual(uncached, third);
+
+    // Clean up the files that were created.
+
+    remove(cacheFile.c_str());
+    remove(changedCacheFile.c_str());
+    setCacheDirectory("");
+}
+
+void testEnabled() {
+    // The kernel cache directory used by the CUDA platform must not enable this cache, and neither
+    // may an empty value.
+
+    setVariable("OPENMM_DATA_CACHE_DIR", NULL);
+    setVariable("OPENMM_CACHE_DIR", ".");
+    ASSERT(!ReferenceDataCache::isEnabled());
+    setVariable("OPENMM_CACHE_DIR", NULL);
+    setVariable("OPENMM_DATA_CACHE_DIR", "");
+    ASSERT(!ReferenceDataCache::isEnabled());
+    ASSERT_EQUAL("", ReferenceDataCache::getCacheDirectory());
+    setVariable("OPENMM_DATA_CACHE_DIR", ".");
+    ASSERT(ReferenceDataCache::isEnabled());
+    setVariable("OPENMM_DATA_CACHE_DIR", NULL);
+}
+
+void testExplicitFile() {
+    // Files outside the cache directory can be read and written even when the cache is disabled.
+
+    setVariable("OPENMM_DATA_CACHE_DIR", NULL);
+    string filename = "TestReferenceDataCacheFile";
+    remove(filename.c_str());
+    string data;
+    ASSERT(!ReferenceDataCache::loadFile(filename, data));
+    ReferenceDataCache::saveFile(filename, "first");
+    ASSERT(ReferenceDataCache::loadFile(filename, data));
+    ASSERT_EQUAL("first", data);
+    ReferenceDataCache::saveFile(filename, "second");
+    ASSERT(ReferenceDataCache::loadFile(filename, data));
+    ASSERT_EQUAL("second", data);
+    remove(filename.c_str());
+}
+
+int main() {
+    try {
+        testEnabled();
+        testExplicitFile();
+        testCachedConstraintMatrix();
+    }
+    catch(const exception& e) {
+        cout << "exception: " << e.what() << endl;
+        return 1;
+    }
+    cout << "Done" << endl;
+    return 0;
+}
@@ -32,5 +32,53 @@
 #include "ReferenceTests.h"
 #include "TestNonbondedForce.h"
 
+void testParallelComputation(NonbondedForce::NonbondedMethod method) {
+    System system;
+    const int numParticles = 200;
+    for (int i = 0; i < numParticles; i++)
+        system.addParticle(1.0);
+    NonbondedForce* force = new NonbondedForce();
+    for (int i = 0; i < numParticles; i++)
+        force->addParticle(i%2-0.5, 0.5, 1.0);
+    force->setNonbondedMethod(method);
+    system.addForce(force);
+    system.setDefaultPeriodicBoxVectors(Vec3(5,0,0), Vec3(0,5,0), Vec3(0,0,5));
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    vector<Vec3> positions(numParticles);
+    for (int i = 0; i < numParticles; i++)
+        positions[i] = Vec3(5*genrand_real2(sfmt), 5*genrand_real2(sfmt), 5*genrand_real2(sfmt));
+    for (int i = 0; i < numParticles; ++i)
+        for (int j = 0; j < i; ++j) {
+            Vec3 d = positions[i]-positions[j];
+            if (d.dot(d) < 0.1)
+                force->addException(i, j, 0, 1, 0);
+        }
+    VerletIntegrator integrator1(0.01);
+    Context context1(system, integrator1, platform);
+    context1.setPositions(positions);
+    State state1 = context1.getState(State::Forces | State::Energy);
+    VerletIntegrator integrator2(0.01);
+    map<string, string> props;
+    props[ReferencePlatform::ReferenceThreads()] = "3";
+    Context context2(system, integrator2, platform, props);
+    ASSERT_EQUAL(3, atoi(platform.getPropertyValue(context2, ReferencePlatform::ReferenceThreads()).c_str()));
+    context2.setPositions(positions);
+    State state2 = context2.getState(State::Forces | State::Energy);
+    ASSERT_EQUAL_TOL(state1.getPotentialEnergy(), state2.getPotentialEnergy(), 1e-5);
+    for (int i = 0; i < numParticles; i++)
+        ASSERT_EQUAL_VEC(state1.getForces()[i], state2.getForces()[i], 1e-5);
+
+    // Repeating the calculation with the same number of threads should give bitwise identical results.
+
+    State state3 = context2.getState(State::Forces | State::Energy);
+    ASSERT(state2.getPotentialEnergy() == state3.getPotentialEnergy());
+    for (int i = 0; i < numParticles; i++)
+        ASSERT(state2.getForces()[i] == state3.getForces()[i]);
+}
+
 void runPlatformTests() {
+    testParallelComputation(NonbondedForce::NoCutoff);
+    testParallelComputation(NonbondedForce::CutoffPeriodic);
+    testParallelComputation(NonbondedForce::PME);
 }
@@ -33,12 +33,16 @@
   #define _USE_MATH_DEFINES // Needed to get M_PI
 #endif
 #include "CpuPmeKernels.h"
+#include "ReferenceDataCache.h"
 #include "SimTKOpenMMRealType.h"
 #include "openmm/internal/hardware.h"
+#include "openmm/internal/Profiler.h"
+#include "openmm/internal/timer.h"
 #include "openmm/internal/vectorize.h"
 #include <cmath>
 #include <algorithm>
 #include <cstring>
+#include <map>
 #include <sstream>
 #include <cstdlib>
 
@@ -48,7 +52,68 @@ using namespace std;
 static const int PME_ORDER = 5;
 
 bool CpuCalcPmeReciprocalForceKernel::hasInitializedThreads = false;
-int CpuCalcPmeReciprocalForceKernel::numThreads = 0;
+int CpuCalcPmeReciprocalForceKernel::defaultNumThreads = 0;
+
+/**
+ * A pair of FFTW plans that may be shared by any number of kernels.  They are only ever
+ * executed with the new-array execute functions, so each kernel can use its own grids.
+ */
+struct SharedPlans {
+    fftwf_plan forward, backward;
+    int refCount;
+};
+
+// The FFTW planner is not thread safe, so planLock must be held while creating or destroying
+// plans, as well as while accessing the table of shared plans.
+
+static pthread_mutex_t planLock = PTHREAD_MUTEX_INITIALIZER;
+static map<vector<int>, SharedPlans> sharedPlans;
+
+static vector<int> getPlanKey(int gridx, int gridy, int gridz, int numThreads) {
+    vector<int> key(4);
+    key[0] = gridx;
+    key[1] = gridy;
+    key[2] = gridz;
+    key[3] = numThreads;
+    return key;
+}
+
+static string getWisdomKey() {
+    stringstream key;
+    key << "FFTW wisdom " << fftwf_version;
+    return key.str();
+}
+
+/**
+ * Get the file FFTW wisdom should be stored in.  This is the value of OPENMM_FFTW_WISDOM_FILE if it is
+ * set, or else a file in the data cache directory.  An empty string means wisdom should not be stored.
+ */
+static string getWisdomFile() {
+    char* wisdomFile = getenv("OPENMM_FFTW_WISDOM_FILE");
+    if (wisdomFile != NULL && wisdomFile[0] != 0)
+        return wisdomFile;
+    if (ReferenceDataCache::isEnabled())
+        return ReferenceDataCache::getCacheFile("fftwf", getWisdomKey());
+    return "";
+}
+
+static void loadWisdom() {
+    string wisdomFile = getWisdomFile();
+    string wisdom;
+    if (wisdomFile != "" && ReferenceDataCache::loadFile(wisdomFile, wisdom))
+        fftwf_import_wisdom_from_string(wisdom.c_str());
+}
+
+static void saveWisdom() {
+    string wisdomFile = getWisdomFile();
+    if (wisdomFile == "")
+        return;
+    char* wisdom = fftwf_export_wisdom_to_string();
+    if (wisdom != NULL) {
+        ReferenceDataCache::saveFile(wisdomFile, wisdom);
+        free(wisdom);
+    }
+}
 
 static void spreadCharge(float* posq, float* grid, int gridx, int gridy, int gridz, int numParticles, Vec3* periodicBoxVectors, Vec3* recipBoxVectors, gmx_atomic_t& atomicCounter) {
     float temp[4];
@@ -350,15 +415,24 @@ static void* threadBody(void* args) {
     return 0;
 }
 
+void CpuCalcPmeReciprocalForceKernel::setNumThreads(int numThreads) {
+    this->numThreads = numThreads;
+}
+
 void CpuCalcPmeReciprocalForceKernel::initialize(int xsize, int ysize, int zsize, int numParticles, double alpha) {
+    pthread_mutex_lock(&planLock);
     if (!hasInitializedThreads) {
-        numThreads = getNumProcessors();
+        defaultNumThreads = getNumProcessors();
         char* threadsEnv = getenv("OPENMM_CPU_THREADS");
         if (threadsEnv != NULL)
-            stringstream(threadsEnv) >> numThreads;
+            stringstream(threadsEnv) >> defaultNumThreads;
         fftwf_init_threads();
+        loadWisdom();
         hasInitializedThreads = true;
     }
+    pthread_mutex_unlock(&planLock);
+    if (numThreads < 1)
+        numThreads = defaultNumThreads;
     threadEnergy.resize(numThreads);
     gridx = findFFTDimension(xsize, false);
     gridy = findFFTDimension(ysize, false);
@@ -389,10 +463,9 @@ void CpuCalcPmeReciprocalForceKernel::initialize(int xsize, int ysize, int zsize
         tempGrid.push_back((float*) fftwf_malloc(sizeof(float)*(gridx*gridy*gridz+3)));
     realGrid = tempGrid[0];
     complexGrid = (fftwf_complex*) fftwf_malloc(sizeof(fftwf_complex)*gridx*gridy*(gridz/2+1));
-    fftwf_plan_with_nthreads(numThreads);
-    forwardFFT = fftwf_plan_dft_r2c_3d(gridx, gridy, gridz, realGrid, complexGrid, FFTW_MEASURE);
-    backwardFFT = fftwf_plan_dft_c2r_3d(gridx, gridy, gridz, complexGrid, realGrid, FFTW_MEASURE);
-    hasCreatedPlan = true;
+    pthread_mutex_lock(&planLock);
+    acquirePlans();
+    pthread_mutex_unlock(&planLock);
     
     // Initialize the b-spline moduli.
 
@@ -463,9 +536,44 @@ CpuCalcPmeReciprocalForceKernel::~CpuCalcPmeReciprocalForceKernel() {
         fftwf_free(tempGrid[i]);
     if (complexGrid != NULL)
         fftwf_free(complexGrid);
+    pthread_mutex_lock(&planLock);
+    releasePlans();
+    pthread_mutex_unlock(&planLock);
+}
+
+void CpuCalcPmeReciprocalForceKernel::acquirePlans() {
+    vector<int> key = getPlanKey(gridx, gridy, gridz, numThreads);
+    map<vector<int>, SharedPlans>::iterator existing = sharedPlans.find(key);
+    if (existing != sharedPlans.end()) {
+        existing->second.refCount++;
+        forwardFFT = existing->second.forward;
+        backwardFFT = existing->second.backward;
+    }
+    else {
+        // FFTW_MEASURE overwrites the arrays, but nothing has been stored in them yet.
+
+        fftwf_plan_with_nthreads(numThreads);
+        forwardFFT = fftwf_plan_dft_r2c_3d(gridx, gridy, gridz, realGrid, complexGrid, FFTW_MEASURE);
+        backwardFFT = fftwf_plan_dft_c2r_3d(gridx, gridy, gridz, complexGrid, realGrid, FFTW_MEASURE);
+        SharedPlans& plans = sharedPlans[key];
+        plans.forward = forwardFFT;
+        plans.backward = backwardFFT;
+        plans.refCount = 1;
+        saveWisdom();
+    }
+    hasCreatedPlan = true;
+}
+
+void CpuCalcPmeReciprocalForceKernel::releasePlans() {
     if (hasCreatedPlan) {
-        fftwf_destroy_plan(forwardFFT);
-        fftwf_destroy_plan(backwardFFT);
+        vector<int> key = getPlanKey(gridx, gridy, gridz, numThreads);
+        SharedPlans& plans = sharedPlans[key];
+        if (--plans.refCount == 0) {
+            fftwf_destroy_plan(plans.forward);
+            fftwf_destroy_plan(plans.backward);
+            sharedPlans.erase(key);
+        }
+        hasCreatedPlan = false;
     }
 }
 
@@ -485,11 +593,14 @@ void CpuCalcPmeReciprocalForceKernel::runMainThread() {
         posq = io->getPosq();
         ComputeTask task(*this);
         gmx_atomic_set(&atomicCounter, 0);
+        double time1 = (recordTimes ? getCurrentTime() : 0.0);
         threads.execute(task); // Signal threads to perform charge spreading.
         threads.waitForThreads();
         threads.resumeThreads(); // Signal threads to sum the charge grids.
         threads.waitForThreads();
+        double time2 = (recordTimes ? getCurrentTime() : 0.0);
         fftwf_execute_dft_r2c(forwardFFT, realGrid, complexGrid);
+        double time3 = (recordTimes ? getCurrentTime() : 0.0);
         if (lastBoxVectors[0] != periodicBoxVectors[0] || lastBoxVectors[1] != periodicBoxVectors[1] || lastBoxVectors[2] != periodicBoxVectors[2]) {
             threads.resumeThreads(); // Signal threads to compute the reciprocal scale factors.
             threads.waitForThreads();
@@ -502,10 +613,19 @@ void CpuCalcPmeReciprocalForceKernel::runMainThread() {
         }
         threads.resumeThreads(); // Signal threads to perform reciprocal convolution.
         threads.waitForThreads();
+        double time4 = (recordTimes ? getCurrentTime() : 0.0);
         fftwf_execute_dft_c2r(backwardFFT, complexGrid, realGrid);
+        double time5 = (recordTimes ? getCurrentTime() : 0.0);
         gmx_atomic_set(&atomicCounter, 0);
         threads.resumeThreads(); // Signal threads to interpolate forces.
         threads.waitForThreads();
+        if (recordTimes) {
+            spreadTime = time2-time1;
+            forwardFFTTime = time3-time2;
+            convolutionTime = time4-time3;
+            backwardFFTTime = time5-time4;
+            interpolateTime = getCurrentTime()-time5;
+        }
         isFinished = true;
         lastBoxVectors[0] = periodicBoxVectors[0];
         lastBoxVectors[1] = periodicBoxVectors[1];
@@ -553,6 +673,7 @@ void CpuCalcPmeReciprocalForceKernel::beginComputation(IO& io, const Vec3* perio
     this->periodicBoxVectors[1] = periodicBoxVectors[1];
     this->periodicBoxVectors[2] = periodicBoxVectors[2];
     this->includeEnergy = includeEnergy;
+    recordTimes = (io.getProfiler() != NULL);
     energy = 0.0;
 
     // Invert the box vectors.
@@ -578,6 +699,14 @@ double CpuCalcPmeReciprocalForceKernel::finishComputation(IO& io) {
     }
     pthread_mutex_unlock(&lock);
     io.setForce(&force[0]);
+    if (recordTimes) {
+        Profiler& profiler = *io.getProfiler();
+        profiler.addTime("PME charge spreading", spreadTime);
+        profiler.addTime("PME forward FFT", forwardFFTTime);
+        profiler.addTime("PME convolution", convolutionTime);
+        profiler.addTime("PME backward FFT", backwardFFTTime);
+        profiler.addTime("PME force interpolation", interpolateTime);
+    }
     return energy;
 }
 
@@ -47,13 +47,26 @@ namespace OpenMM {
 /**
  * This is an optimized CPU implementation of CalcPmeReciprocalForceKernel.  It is both
  * vectorized (requiring SSE 4.1) and multithreaded.  It uses FFTW to perform the FFTs.
+ *
+ * FFTW plans are shared by all kernels with the same grid size, but each kernel has its own
+ * worker threads, so kernels belonging to different Contexts can run at the same time.  FFTW
+ * wisdom is saved so that later processes can create plans quickly.  It is stored in the file
+ * given by the OPENMM_FFTW_WISDOM_FILE environment variable, or if that is not set, in the
+ * directory given by OPENMM_DATA_CACHE_DIR.  If neither is set, wisdom is not saved.
  */
 
 class OPENMM_EXPORT_PME CpuCalcPmeReciprocalForceKernel : public CalcPmeReciprocalForceKernel {
 public:
     CpuCalcPmeReciprocalForceKernel(std::string name, const Platform& platform) : CalcPmeReciprocalForceKernel(name, platform),
-            hasCreatedPlan(false), isDeleted(false), realGrid(NULL), complexGrid(NULL) {
+            numThreads(0), hasCreatedPlan(false), isDeleted(false), realGrid(NULL), complexGrid(NULL) {
     }
+    /**
+     * Set the number of threads the kernel should use.  This must be called before initialize().
+     * By default, it uses the value of OPENMM_CPU_THREADS, or one thread per core if that is not set.
+     *
+     * @param numThreads   the number of threads to use
+     */
+    void setNumThreads(int numThreads);
     /**
      * Initialize the kernel.
      * 
@@ -107,9 +120,18 @@ private:
      * Select a size for one grid dimension that FFTW can handle efficiently.
      */
     int findFFTDimension(int minimum, bool isZ);
+    /**
+     * Get the FFTW plans for this kernel's grid size, creating them if no other kernel is
+     * using them already.  This must be called with planLock held.
+     */
+    void acquirePlans();
+    /**
+     * Release the FFTW plans.  This must be called with planLock held.
+     */
+    void releasePlans();
     static bool hasInitializedThreads;
-    static int numThreads;
-    int gridx, gridy, gridz, numParticles;
+    static int defaultNumThreads;
+    int numThreads, gridx, gridy, gridz, numParticles;
     double alpha;
     bool hasCreatedPlan, isFinished, isDeleted;
     std::vector<float> force;
@@ -130,7 +152,8 @@ private:
     float energy;
     float* posq;
     Vec3 periodicBoxVectors[3], recipBoxVectors[3];
-    bool includeEnergy;
+    bool includeEnergy, recordTimes;
+    double spreadTime, forwardFFTTime, convolutionTime, backwardFFTTime, interpolateTime;
     gmx_atomic_t atomicCounter;
 };
 
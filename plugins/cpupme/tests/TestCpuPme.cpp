@@ -133,6 +133,66 @@ void testPME(bool triclinic) {
         ASSERT_EQUAL_VEC(refState.getForces()[i], Vec3(io.force[4*i], io.force[4*i+1], io.force[4*i+2]), 1e-3);
 }
 
+void testSharedPlans() {
+    // Create two kernels with the same grid size, so they share FFTW plans.
+
+    const int numParticles = 40;
+    const double boxWidth = 3.0;
+    const double alpha = 3.0;
+    const int gridSize = 24;
+    Vec3 boxVectors[3];
+    boxVectors[0] = Vec3(boxWidth, 0, 0);
+    boxVectors[1] = Vec3(0, boxWidth, 0);
+    boxVectors[2] = Vec3(0, 0, boxWidth);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    IO io1, io2;
+    for (int i = 0; i < numParticles; i++) {
+        io1.posq.push_back(boxWidth*genrand_real2(sfmt));
+        io1.posq.push_back(boxWidth*genrand_real2(sfmt));
+        io1.posq.push_back(boxWidth*genrand_real2(sfmt));
+        io1.posq.push_back(i%2 == 0 ? 1.0 : -1.0);
+    }
+    io2.posq = io1.posq;
+    Platform& platform = Platform::getPlatformByName("Reference");
+    CpuCalcPmeReciprocalForceKernel pme1(CalcPmeReciprocalForceKernel::Name(), platform);
+    pme1.initialize(gridSize, gridSize, gridSize, numParticles, alpha);
+    pme1.beginComputation(io1, boxVectors, true);
+    double energy1 = pme1.finishComputation(io1);
+    vector<float> force1(io1.force, io1.force+4*numParticles);
+    {
+        // Both kernels should get the same results, even when they run at the same time.
+
+        CpuCalcPmeReciprocalForceKernel pme2(CalcPmeReciprocalForceKernel::Name(), platform);
+        pme2.initialize(gridSize, gridSize, gridSize, numParticles, alpha);
+        pme1.beginComputation(io1, boxVectors, true);
+        pme2.beginComputation(io2, boxVectors, true);
+        ASSERT_EQUAL_TOL(energy1, pme2.finishComputation(io2), 1e-5);
+        ASSERT_EQUAL_TOL(energy1, pme1.finishComputation(io1), 1e-5);
+        for (int i = 0; i < 4*numParticles; i++) {
+            ASSERT_EQUAL_TOL(force1[i], io1.force[i], 1e-4);
+            ASSERT_EQUAL_TOL(force1[i], io2.force[i], 1e-4);
+        }
+    }
+
+    // Deleting the second kernel should not affect the first one.
+
+    pme1.beginComputation(io1, boxVectors, true);
+    ASSERT_EQUAL_TOL(energy1, pme1.finishComputation(io1), 1e-5);
+    for (int i = 0; i < 4*numParticles; i++)
+        ASSERT_EQUAL_TOL(force1[i], io1.force[i], 1e-4);
+
+    // A kernel with a different number of threads should also get the same results.
+
+    CpuCalcPmeReciprocalForceKernel pme3(CalcPmeReciprocalForceKernel::Name(), platform);
+    pme3.setNumThreads(2);
+    pme3.initialize(gridSize, gridSize, gridSize, numParticles, alpha);
+    pme3.beginComputation(io2, boxVectors, true);
+    ASSERT_EQUAL_TOL(energy1, pme3.finishComputation(io2), 1e-5);
+    for (int i = 0; i < 4*numParticles; i++)
+        ASSERT_EQUAL_TOL(force1[i], io2.force[i], 1e-4);
+}
+
 int main(int argc, char* argv[]) {
     try {
         if (!CpuCalcPmeReciprocalForceKernel::isProcessorSupported()) {
@@ -141,6 +201,7 @@ int main(int argc, char* argv[]) {
         }
         testPME(false);
         testPME(true);
+        testSharedPlans();
     }
     catch(const exception& e) {
         cout << "exception: " << e.what() << endl;
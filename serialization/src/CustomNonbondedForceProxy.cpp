@@ -51,6 +51,16 @@ void CustomNonbondedForceProxy::serialize(const void* object, SerializationNode&
     node.setBoolProperty("useSwitchingFunction", force.getUseSwitchingFunction());
     node.setDoubleProperty("switchingDistance", force.getSwitchingDistance());
     node.setBoolProperty("useLongRangeCorrection", force.getUseLongRangeCorrection());
+    string tableParameter;
+    double tableMin, tableMax;
+    int tablePoints;
+    force.getLongRangeCorrectionTable(tableParameter, tableMin, tableMax, tablePoints);
+    if (!tableParameter.empty()) {
+        node.setStringProperty("longRangeTableParameter", tableParameter);
+        node.setDoubleProperty("longRangeTableMin", tableMin);
+        node.setDoubleProperty("longRangeTableMax", tableMax);
+        node.setIntProperty("longRangeTablePoints", tablePoints);
+    }
     SerializationNode& perParticleParams = node.createChildNode("PerParticleParameters");
     for (int i = 0; i < force.getNumPerParticleParameters(); i++) {
         perParticleParams.createChildNode("Parameter").setStringProperty("name", force.getPerParticleParameterName(i));
@@ -113,6 +123,9 @@ void* CustomNonbondedForceProxy::deserialize(const SerializationNode& node) cons
         force->setUseSwitchingFunction(node.getBoolProperty("useSwitchingFunction", false));
         force->setSwitchingDistance(node.getDoubleProperty("switchingDistance", -1.0));
         force->setUseLongRangeCorrection(node.getBoolProperty("useLongRangeCorrection", false));
+        if (node.hasProperty("longRangeTableParameter"))
+            force->setLongRangeCorrectionTable(node.getStringProperty("longRangeTableParameter"), node.getDoubleProperty("longRangeTableMin"),
+                    node.getDoubleProperty("longRangeTableMax"), node.getIntProperty("longRangeTablePoints"));
         const SerializationNode& perParticleParams = node.getChildNode("PerParticleParameters");
         for (int i = 0; i < (int) perParticleParams.getChildren().size(); i++) {
             const SerializationNode& parameter = perParticleParams.getChildren()[i];
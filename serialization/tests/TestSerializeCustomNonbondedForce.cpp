@@ -46,6 +46,7 @@ void testSerialization() {
     force.setNonbondedMethod(CustomNonbondedForce::CutoffPeriodic);
     force.setUseSwitchingFunction(true);
     force.setUseLongRangeCorrection(true);
+    force.setLongRangeCorrectionTable("y", 0.5, 2.5, 11);
     force.setSwitchingDistance(2.0);
     force.setCutoffDistance(2.1);
     force.addGlobalParameter("x", 1.3);
@@ -87,6 +88,15 @@ void testSerialization() {
     ASSERT_EQUAL(force.getSwitchingDistance(), force2.getSwitchingDistance());
     ASSERT_EQUAL(force.getUseSwitchingFunction(), force2.getUseSwitchingFunction());
     ASSERT_EQUAL(force.getUseLongRangeCorrection(), force2.getUseLongRangeCorrection());
+    string tableParam1, tableParam2;
+    double tableMin1, tableMin2, tableMax1, tableMax2;
+    int tablePoints1, tablePoints2;
+    force.getLongRangeCorrectionTable(tableParam1, tableMin1, tableMax1, tablePoints1);
+    force2.getLongRangeCorrectionTable(tableParam2, tableMin2, tableMax2, tablePoints2);
+    ASSERT_EQUAL(tableParam1, tableParam2);
+    ASSERT_EQUAL(tableMin1, tableMin2);
+    ASSERT_EQUAL(tableMax1, tableMax2);
+    ASSERT_EQUAL(tablePoints1, tablePoints2);
     ASSERT_EQUAL(force.getNumPerParticleParameters(), force2.getNumPerParticleParameters());
     for (int i = 0; i < force.getNumPerParticleParameters(); i++)
         ASSERT_EQUAL(force.getPerParticleParameterName(i), force2.getPerParticleParameterName(i));
@@ -33,6 +33,7 @@
 #include "openmm/AndersenThermostat.h"
 #include "openmm/Context.h"
 #include "openmm/NonbondedForce.h"
+#include "openmm/OpenMMException.h"
 #include "openmm/System.h"
 #include "openmm/VerletIntegrator.h"
 #include "sfmt/SFMT.h"
@@ -116,12 +117,96 @@ void testSetState() {
     }
 }
 
+void testAsyncCheckpoint() {
+    const int numParticles = 100;
+    const double boxSize = 5.0;
+    System system;
+    system.addForce(new AndersenThermostat(300.0, 100.0));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    system.addForce(nonbonded);
+    nonbonded->setNonbondedMethod(NonbondedForce::CutoffPeriodic);
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    vector<Vec3> positions(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        nonbonded->addParticle(i%2 == 0 ? 0.1 : -0.1, 0.2, 0.1);
+        positions[i] = Vec3(boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt));
+    }
+    VerletIntegrator integrator(0.001);
+    Context context(system, integrator, platform);
+    context.setPositions(positions);
+    integrator.step(10);
+    
+    // Write an uncompressed and a compressed full checkpoint, then continue the simulation
+    // and write a delta checkpoint relative to the second one.
+    
+    State s1 = context.getState(State::Positions | State::Velocities | State::Parameters);
+    stringstream full, compressed, delta;
+    ASSERT(!context.createCheckpointAsync(full));
+    ASSERT(!context.createCheckpointAsync(compressed, Context::CompressCheckpoint));
+    integrator.step(10);
+    State s2 = context.getState(State::Positions | State::Velocities | State::Parameters);
+    ASSERT(context.createCheckpointAsync(delta, Context::DeltaCheckpoint));
+    context.waitForCheckpoint();
+    ASSERT(delta.str().size() < full.str().size());
+    
+    // Load each of them and see if the state is restored correctly.
+    
+    context.loadCheckpoint(full);
+    State s3 = context.getState(State::Positions | State::Velocities | State::Parameters);
+    compareStates(s1, s3);
+    context.loadCheckpoint(compressed);
+    State s4 = context.getState(State::Positions | State::Velocities | State::Parameters);
+    compareStates(s1, s4);
+    compressed.seekg(0, compressed.beg);
+    context.loadCheckpoint(delta, compressed);
+    State s5 = context.getState(State::Positions | State::Velocities | State::Parameters);
+    compareStates(s2, s5);
+    
+    // A delta checkpoint cannot be loaded by itself, or relative to the wrong full checkpoint.
+    
+    delta.seekg(0, delta.beg);
+    bool threwException = false;
+    try {
+        context.loadCheckpoint(delta);
+    }
+    catch (OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+    delta.seekg(0, delta.beg);
+    stringstream other;
+    context.createCheckpoint(other);
+    threwException = false;
+    try {
+        context.loadCheckpoint(delta, other);
+    }
+    catch (OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+    
+    // If there is no earlier full checkpoint, requesting a delta checkpoint writes a full one
+    // that can be loaded by itself.
+    
+    VerletIntegrator integrator2(0.001);
+    Context context2(system, integrator2, platform);
+    context2.setPositions(positions);
+    stringstream first;
+    ASSERT(!context2.createCheckpointAsync(first, Context::DeltaCheckpoint));
+    context2.waitForCheckpoint();
+    context2.loadCheckpoint(first);
+}
+
 void runPlatformTests();
 
 int main(int argc, char* argv[]) {
     try {
         initializeTests(argc, argv);
         testSetState();
+        testAsyncCheckpoint();
         runPlatformTests();
     }
     catch(const exception& e) {
@@ -0,0 +1,139 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2016 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "openmm/internal/AssertionUtilities.h"
+#include "openmm/Context.h"
+#include "openmm/ContextGroup.h"
+#include "openmm/NonbondedForce.h"
+#include "openmm/System.h"
+#include "openmm/VerletIntegrator.h"
+#include "sfmt/SFMT.h"
+#include <iostream>
+#include <vector>
+
+using namespace OpenMM;
+using namespace std;
+
+void testContextGroup() {
+    const int numParticles = 50;
+    const int numReplicas = 3;
+    const double boxSize = 3.0;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    system.addForce(nonbonded);
+    nonbonded->setNonbondedMethod(NonbondedForce::CutoffPeriodic);
+    nonbonded->setCutoffDistance(1.0);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        nonbonded->addParticle(i%2 == 0 ? 0.1 : -0.1, 0.2, 0.2);
+        if (i > 0)
+            nonbonded->addException(i-1, i, 0.0, 1.0, 0.0);
+    }
+    vector<vector<Vec3> > positions(numReplicas, vector<Vec3>(numParticles));
+    for (int i = 0; i < numReplicas; i++)
+        for (int j = 0; j < numParticles; j++)
+            positions[i][j] = Vec3(boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt));
+    
+    // Create a group of Contexts, each starting from different positions.
+    
+    ContextGroup group(system, platform);
+    vector<VerletIntegrator*> integrators;
+    for (int i = 0; i < numReplicas; i++) {
+        integrators.push_back(new VerletIntegrator(0.001));
+        Context& context = group.addContext(*integrators[i]);
+        context.setPositions(positions[i]);
+    }
+    ASSERT_EQUAL(numReplicas, group.getNumContexts());
+    ASSERT_EQUAL(10, group.getStepsPerTurn());
+    group.setStepsPerTurn(4);
+    
+    // Each one should give the same results as an independent Context.
+    
+    for (int i = 0; i < numReplicas; i++) {
+        VerletIntegrator integrator(0.001);
+        Context context(system, integrator, platform);
+        context.setPositions(positions[i]);
+        State s1 = context.getState(State::Energy | State::Forces);
+        State s2 = group.getContext(i).getState(State::Energy | State::Forces);
+        ASSERT_EQUAL_TOL(s1.getPotentialEnergy(), s2.getPotentialEnergy(), 1e-5);
+        for (int j = 0; j < numParticles; j++)
+            ASSERT_EQUAL_VEC(s1.getForces()[j], s2.getForces()[j], 1e-5);
+    }
+    
+    // Advance all of them, and see if each one matches a Context that was simulated separately.
+    
+    group.step(10);
+    for (int i = 0; i < numReplicas; i++) {
+        VerletIntegrator integrator(0.001);
+        Context context(system, integrator, platform);
+        context.setPositions(positions[i]);
+        integrator.step(10);
+        State s1 = context.getState(State::Positions | State::Velocities);
+        State s2 = group.getContext(i).getState(State::Positions | State::Velocities);
+        ASSERT_EQUAL_TOL(0.01, s2.getTime(), 1e-10);
+        for (int j = 0; j < numParticles; j++) {
+            ASSERT_EQUAL_VEC(s1.getPositions()[j], s2.getPositions()[j], 1e-5);
+            ASSERT_EQUAL_VEC(s1.getVelocities()[j], s2.getVelocities()[j], 1e-5);
+        }
+    }
+    
+    // Reinitializing one Context should not affect the others.
+    
+    group.getContext(0).reinitialize();
+    group.getContext(0).setPositions(positions[0]);
+    State s1 = group.getContext(1).getState(State::Positions);
+    group.step(1);
+    State s2 = group.getContext(1).getState(State::Positions);
+    ASSERT_EQUAL_TOL(0.001, group.getContext(0).getState(0).getTime(), 1e-10);
+    ASSERT_EQUAL_TOL(0.011, s2.getTime(), 1e-10);
+    ASSERT(s1.getPositions()[0] != s2.getPositions()[0]);
+    for (int i = 0; i < numReplicas; i++)
+        delete integrators[i];
+}
+
+void runPlatformTests();
+
+int main(int argc, char* argv[]) {
+    try {
+        initializeTests(argc, argv);
+        testContextGroup();
+        runPlatformTests();
+    }
+    catch(const exception& e) {
+        cout << "exception: " << e.what() << endl;
+        return 1;
+    }
+    cout << "Done" << endl;
+    return 0;
+}
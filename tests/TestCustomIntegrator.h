@@ -635,6 +635,78 @@ void testForceGroups() {
     ASSERT_EQUAL_TOL(s2.getPotentialEnergy(), integrator.getGlobalVariable(2), 1e-5);
 }
 
+/**
+ * Test that forces and energies are recomputed whenever they change, even when
+ * the same force groups are requested repeatedly within a step.
+ */
+void testRepeatedForceGroups() {
+    System system;
+    system.addParticle(2.0);
+    system.addParticle(2.0);
+    CustomIntegrator integrator(0.01);
+    integrator.addPerDofVariable("dx", 0);
+    integrator.addPerDofVariable("x0", 0);
+    integrator.addPerDofVariable("outf1", 0);
+    integrator.addGlobalVariable("oute", 0);
+    integrator.addGlobalVariable("oute1", 0);
+    integrator.addGlobalVariable("oute2", 0);
+    integrator.addGlobalVariable("moved1", 0);
+    integrator.addGlobalVariable("moved", 0);
+    integrator.addGlobalVariable("restored", 0);
+    integrator.addComputePerDof("x0", "x");
+    integrator.addComputeGlobal("oute", "energy");
+    integrator.addComputeGlobal("oute1", "energy1");
+    integrator.addComputePerDof("outf1", "f1");
+    integrator.addComputeGlobal("oute2", "energy2");
+    integrator.addComputePerDof("x", "x+dx");
+    integrator.addComputeGlobal("moved1", "energy1");
+    integrator.addComputeGlobal("moved", "energy");
+    integrator.addComputePerDof("x", "x0");
+    integrator.addComputeGlobal("restored", "energy");
+    HarmonicBondForce* bonds = new HarmonicBondForce();
+    bonds->addBond(0, 1, 1.5, 1.1);
+    bonds->setForceGroup(1);
+    system.addForce(bonds);
+    NonbondedForce* nb = new NonbondedForce();
+    nb->addParticle(0.2, 1, 0);
+    nb->addParticle(0.2, 1, 0);
+    nb->setForceGroup(2);
+    system.addForce(nb);
+    Context context(system, integrator, platform);
+    vector<Vec3> positions(2);
+    positions[0] = Vec3(-1, 0, 0);
+    positions[1] = Vec3(1, 0, 0);
+    context.setPositions(positions);
+    vector<Vec3> dx(2);
+    dx[1] = Vec3(0.5, 0, 0);
+    integrator.setPerDofVariable(0, dx);
+    integrator.step(1);
+    double e1 = 0.5*1.1*0.5*0.5;
+    double e2 = 138.935456*0.2*0.2/2.0;
+    double movedE1 = 0.5*1.1*1.0*1.0;
+    double movedE2 = 138.935456*0.2*0.2/2.5;
+    ASSERT_EQUAL_TOL(e1+e2, integrator.getGlobalVariable(0), 1e-5);
+    ASSERT_EQUAL_TOL(e1, integrator.getGlobalVariable(1), 1e-5);
+    ASSERT_EQUAL_TOL(e2, integrator.getGlobalVariable(2), 1e-5);
+    ASSERT_EQUAL_TOL(movedE1, integrator.getGlobalVariable(3), 1e-5);
+    ASSERT_EQUAL_TOL(movedE1+movedE2, integrator.getGlobalVariable(4), 1e-5);
+    ASSERT_EQUAL_TOL(e1+e2, integrator.getGlobalVariable(5), 1e-5);
+    vector<Vec3> f1;
+    integrator.getPerDofVariable(2, f1);
+    ASSERT_EQUAL_VEC(Vec3(1.1*0.5, 0, 0), f1[0], 1e-5);
+    ASSERT_EQUAL_VEC(Vec3(-1.1*0.5, 0, 0), f1[1], 1e-5);
+    
+    // Changing the positions between steps must also invalidate the results.
+    
+    positions[1] = Vec3(1.5, 0, 0);
+    context.setPositions(positions);
+    integrator.step(1);
+    ASSERT_EQUAL_TOL(movedE1+movedE2, integrator.getGlobalVariable(0), 1e-5);
+    ASSERT_EQUAL_TOL(movedE1, integrator.getGlobalVariable(1), 1e-5);
+    ASSERT_EQUAL_TOL(movedE2, integrator.getGlobalVariable(2), 1e-5);
+    ASSERT_EQUAL_TOL(movedE1+movedE2, context.getState(State::Energy).getPotentialEnergy(), 1e-5);
+}
+
 /**
  * Test a multiple time step r-RESPA integrator.
  */
@@ -874,6 +946,7 @@ int main(int argc, char* argv[]) {
         testRandomDistributions();
         testPerDofVariables();
         testForceGroups();
+        testRepeatedForceGroups();
         testRespa();
         testIfBlock();
         testWhileBlock();
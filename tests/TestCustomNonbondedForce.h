@@ -1129,6 +1129,123 @@ void testEnergyParameterDerivatives2() {
     ASSERT_EQUAL_TOL((energy1-energy2)/(2*delta), derivs["a"], 1e-4);
 }
 
+void testLongRangeCorrectionTable() {
+    // Create two identical forces, one of which interpolates the long range correction from a table.
+    
+    const int numParticles = 40;
+    const double boxSize = 3.0;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    CustomNonbondedForce* direct = new CustomNonbondedForce("eps1*eps2*(r+lambda)^-6 + b*(r+1)^-4");
+    direct->addGlobalParameter("lambda", 0.5);
+    direct->addGlobalParameter("b", 1.0);
+    direct->addPerParticleParameter("eps");
+    direct->addEnergyParameterDerivative("lambda");
+    direct->addEnergyParameterDerivative("b");
+    direct->setNonbondedMethod(CustomNonbondedForce::CutoffPeriodic);
+    direct->setCutoffDistance(1.0);
+    direct->setSwitchingDistance(0.8);
+    direct->setUseSwitchingFunction(true);
+    direct->setUseLongRangeCorrection(true);
+    vector<Vec3> positions;
+    vector<double> parameters(1);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        parameters[0] = (i%3 == 0 ? 1.0 : 1.5);
+        direct->addParticle(parameters);
+        positions.push_back(Vec3(genrand_real2(sfmt), genrand_real2(sfmt), genrand_real2(sfmt))*boxSize);
+    }
+    CustomNonbondedForce* tabulated = new CustomNonbondedForce(*direct);
+    tabulated->setLongRangeCorrectionTable("lambda", 0.0, 1.0, 21);
+    direct->setForceGroup(1);
+    tabulated->setForceGroup(2);
+    system.addForce(direct);
+    system.addForce(tabulated);
+    VerletIntegrator integrator(0.01);
+    Context context(system, integrator, platform);
+    context.setPositions(positions);
+    
+    // Compare them for values of lambda inside and outside the range of the table, and after changing
+    // other parameters that should cause the table to be rebuilt.
+    
+    double lambda[] = {0.5, 0.13, 0.87, 0.87, 0.0, 1.0, 1.3, 0.6, 0.4};
+    for (int i = 0; i < 9; i++) {
+        if (i == 3)
+            context.setParameter("b", 2.0);
+        if (i == 7)
+            context.setParameter("b", 0.5);
+        if (i == 8) {
+            parameters[0] = 3.0;
+            direct->setParticleParameters(0, parameters);
+            tabulated->setParticleParameters(0, parameters);
+            direct->updateParametersInContext(context);
+            tabulated->updateParametersInContext(context);
+        }
+        context.setParameter("lambda", lambda[i]);
+        State state1 = context.getState(State::Energy | State::ParameterDerivatives, false, 1<<1);
+        State state2 = context.getState(State::Energy | State::ParameterDerivatives, false, 1<<2);
+        ASSERT_EQUAL_TOL(state1.getPotentialEnergy(), state2.getPotentialEnergy(), 1e-5);
+        map<string, double> derivs1 = state1.getEnergyParameterDerivatives();
+        map<string, double> derivs2 = state2.getEnergyParameterDerivatives();
+        ASSERT_EQUAL_TOL(derivs1["lambda"], derivs2["lambda"], 1e-5);
+        ASSERT_EQUAL_TOL(derivs1["b"], derivs2["b"], 1e-5);
+    }
+}
+
+void testChangingParameterSubset() {
+    const int numParticles = 200;
+    const double boxSize = 3.0;
+    System system;
+    CustomNonbondedForce* force = new CustomNonbondedForce("4*eps*((sigma/r)^12-(sigma/r)^6); sigma=0.5*(sigma1+sigma2); eps=sqrt(eps1*eps2)");
+    force->addPerParticleParameter("sigma");
+    force->addPerParticleParameter("eps");
+    force->setNonbondedMethod(CustomNonbondedForce::CutoffPeriodic);
+    force->setCutoffDistance(1.0);
+    force->setUseLongRangeCorrection(true);
+    vector<Vec3> positions(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    vector<double> params(2);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        params[0] = (i%2 == 0 ? 0.2 : 0.3);
+        params[1] = (i%2 == 0 ? 0.5 : 1.0);
+        force->addParticle(params);
+        positions[i] = Vec3(boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt));
+    }
+    system.addForce(force);
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    VerletIntegrator integrator1(0.001);
+    VerletIntegrator integrator2(0.001);
+    Context context1(system, integrator1, platform);
+    Context context2(system, integrator2, platform);
+    context1.setPositions(positions);
+    context2.setPositions(positions);
+    
+    // Repeatedly modify a few particles.  Update one Context with only the changes, and the other one with
+    // all parameters, and see if they agree.
+    
+    for (int iteration = 0; iteration < 3; iteration++) {
+        vector<int> particles;
+        for (int i = 0; i < 4; i++) {
+            int index = (int) (numParticles*genrand_real2(sfmt));
+            params[0] = 0.2+0.1*iteration;
+            params[1] = 0.5+0.2*i;
+            force->setParticleParameters(index, params);
+            particles.push_back(index);
+        }
+        force->updateParameterSubsetInContext(context1, particles);
+        force->updateParametersInContext(context2);
+        State state1 = context1.getState(State::Forces | State::Energy);
+        State state2 = context2.getState(State::Forces | State::Energy);
+        for (int i = 0; i < numParticles; i++)
+            ASSERT_EQUAL_VEC(state2.getForces()[i], state1.getForces()[i], 1e-5);
+        ASSERT_EQUAL_TOL(state2.getPotentialEnergy(), state1.getPotentialEnergy(), 1e-5);
+    }
+}
+
 void runPlatformTests();
 
 int main(int argc, char* argv[]) {
@@ -1157,6 +1274,8 @@ int main(int argc, char* argv[]) {
         testIllegalVariable();
         testEnergyParameterDerivatives();
         testEnergyParameterDerivatives2();
+        testLongRangeCorrectionTable();
+        testChangingParameterSubset();
         runPlatformTests();
     }
     catch(const exception& e) {
@@ -34,6 +34,7 @@
 #include "ReferencePlatform.h"
 #include "openmm/HarmonicBondForce.h"
 #include "openmm/NonbondedForce.h"
+#include "openmm/OpenMMException.h"
 #include "openmm/System.h"
 #include "openmm/VerletIntegrator.h"
 #include "SimTKOpenMMRealType.h"
@@ -629,6 +630,79 @@ void testChangingParameters() {
     ASSERT_EQUAL_TOL(state.getPotentialEnergy(), referenceState.getPotentialEnergy(), tol);
 }
 
+void testChangingParameterSubset() {
+    const int numMolecules = 300;
+    const int numParticles = numMolecules*3;
+    const double cutoff = 1.0;
+    const double boxSize = 5.0;
+    System system;
+    for (int i = 0; i < numParticles; i++)
+        system.addParticle(1.0);
+    NonbondedForce* nonbonded = new NonbondedForce();
+    vector<Vec3> positions(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numMolecules; i++) {
+        nonbonded->addParticle(-0.8, 0.3, 0.6);
+        nonbonded->addParticle(0.4, 0.2, 0.1);
+        nonbonded->addParticle(0.4, 0.2, 0.1);
+        positions[3*i] = Vec3(boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt));
+        positions[3*i+1] = positions[3*i]+Vec3(0.1, 0, 0);
+        positions[3*i+2] = positions[3*i]+Vec3(0, 0.1, 0);
+        nonbonded->addException(3*i, 3*i+1, 0.0, 1.0, 0.0);
+        nonbonded->addException(3*i, 3*i+2, 0.0, 1.0, 0.0);
+        nonbonded->addException(3*i+1, 3*i+2, 0.1, 0.2, 0.05);
+    }
+    nonbonded->setNonbondedMethod(NonbondedForce::PME);
+    nonbonded->setCutoffDistance(cutoff);
+    nonbonded->setUseDispersionCorrection(true);
+    system.addForce(nonbonded);
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    VerletIntegrator integrator1(0.001);
+    VerletIntegrator integrator2(0.001);
+    Context context1(system, integrator1, platform);
+    Context context2(system, integrator2, platform);
+    context1.setPositions(positions);
+    context2.setPositions(positions);
+    
+    // Repeatedly modify a few particles and exceptions.  Update one Context with only the changes, and the
+    // other one with all parameters, and see if they agree.
+    
+    for (int iteration = 0; iteration < 4; iteration++) {
+        vector<int> particles, exceptions;
+        for (int i = 0; i < 5; i++) {
+            int molecule = (int) (numMolecules*genrand_real2(sfmt));
+            double scale = (iteration == 3 ? 1.0 : 1.0+0.5*genrand_real2(sfmt));
+            nonbonded->setParticleParameters(3*molecule, -0.8*scale, 0.3*scale, 0.6);
+            nonbonded->setParticleParameters(3*molecule+1, 0.4*scale, 0.2, 0.1*scale);
+            nonbonded->setExceptionParameters(3*molecule+2, 3*molecule+1, 3*molecule+2, 0.1*scale, 0.2, 0.05*scale);
+            particles.push_back(3*molecule);
+            particles.push_back(3*molecule+1);
+            exceptions.push_back(3*molecule+2);
+        }
+        nonbonded->updateParameterSubsetInContext(context1, particles, exceptions);
+        nonbonded->updateParametersInContext(context2);
+        State state1 = context1.getState(State::Forces | State::Energy);
+        State state2 = context2.getState(State::Forces | State::Energy);
+        for (int i = 0; i < numParticles; i++)
+            ASSERT_EQUAL_VEC(state2.getForces()[i], state1.getForces()[i], 1e-5);
+        ASSERT_EQUAL_TOL(state2.getPotentialEnergy(), state1.getPotentialEnergy(), 1e-5);
+    }
+    
+    // Turning on an exception that was previously excluded is not allowed.
+    
+    nonbonded->setExceptionParameters(0, 0, 1, 0.5, 1.0, 0.0);
+    vector<int> particles, exceptions(1, 0);
+    bool threwException = false;
+    try {
+        nonbonded->updateParameterSubsetInContext(context1, particles, exceptions);
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+}
+
 void testSwitchingFunction(NonbondedForce::NonbondedMethod method) {
     System system;
     system.setDefaultPeriodicBoxVectors(Vec3(6, 0, 0), Vec3(0, 6, 0), Vec3(0, 0, 6));
@@ -699,6 +773,7 @@ int main(int argc, char* argv[]) {
         testLargeSystem();
         testDispersionCorrection();
         testChangingParameters();
+        testChangingParameterSubset();
         testSwitchingFunction(NonbondedForce::CutoffNonPeriodic);
         testSwitchingFunction(NonbondedForce::PME);
         runPlatformTests();
@@ -222,6 +222,101 @@ void testCustomFunction(const string& expression, const string& equivalent) {
     verifySameValue(deriv3, deriv4, 2.0, -3.0);
 }
 
+/**
+ * This is a UniformSplineFunction equal to x^3-2*x on the interval [-1, 2].  Since it is a cubic, the spline
+ * reproduces it exactly.
+ */
+
+class ExampleSplineFunction : public UniformSplineFunction {
+public:
+    ExampleSplineFunction() {
+        int numIntervals = 7;
+        double min = -1.0, max = 2.0;
+        double h = (max-min)/numIntervals;
+        vector<double> coeff(4*numIntervals);
+        for (int i = 0; i < numIntervals; i++) {
+            double a = min+i*h;
+            coeff[4*i] = a*a*a-2*a;
+            coeff[4*i+1] = 3*a*a*h-2*h;
+            coeff[4*i+2] = 3*a*h*h;
+            coeff[4*i+3] = h*h*h;
+        }
+        setCoefficients(min, max, coeff);
+    }
+    CustomFunction* clone() const {
+        return new ExampleSplineFunction(*this);
+    }
+};
+
+/**
+ * Test evaluating a UniformSplineFunction, both with CompiledExpression and ExpressionProgram.
+ */
+
+void testUniformSplineFunction() {
+    map<string, CustomFunction*> functions;
+    ExampleSplineFunction spline;
+    functions["spline"] = &spline;
+    ParsedExpression exp = Parser::parse("spline(x)", functions);
+    ParsedExpression deriv = exp.differentiate("x").optimize();
+    CompiledExpression compiledExp = exp.createCompiledExpression();
+    CompiledExpression compiledDeriv = deriv.createCompiledExpression();
+    ExpressionProgram programExp = exp.createProgram();
+    ExpressionProgram programDeriv = deriv.createProgram();
+    map<string, double> variables;
+    for (int i = -5; i <= 35; i++) {
+        double x = -1.0+0.1*i;
+        double expectedValue = 0.0, expectedDeriv = 0.0;
+        if (i >= 0 && i <= 30) {
+            expectedValue = x*x*x-2*x;
+            expectedDeriv = 3*x*x-2;
+        }
+        variables["x"] = x;
+        compiledExp.getVariableReference("x") = x;
+        compiledDeriv.getVariableReference("x") = x;
+        ASSERT_EQUAL_TOL(expectedValue, compiledExp.evaluate(), 1e-10);
+        ASSERT_EQUAL_TOL(expectedDeriv, compiledDeriv.evaluate(), 1e-10);
+        ASSERT_EQUAL_TOL(expectedValue, programExp.evaluate(variables), 1e-10);
+        ASSERT_EQUAL_TOL(expectedDeriv, programDeriv.evaluate(variables), 1e-10);
+    }
+}
+
+/**
+ * Test a CompiledExpression that evaluates several expressions at once.
+ */
+
+void testMultipleOutputs() {
+    map<string, CustomFunction*> functions;
+    ParsedExpression energy = Parser::parse("x^2*exp(y)+sin(x*y)", functions).optimize();
+    vector<ParsedExpression> expressions;
+    expressions.push_back(energy);
+    expressions.push_back(energy.differentiate("x").optimize());
+    expressions.push_back(energy.differentiate("y").optimize());
+    expressions.push_back(Parser::parse("y", functions));
+    CompiledExpression compiled(expressions);
+    ASSERT_EQUAL(4, compiled.getNumOutputs());
+    double x = 0.0, y = 0.0;
+    map<string, double*> locations;
+    locations["x"] = &x;
+    locations["y"] = &y;
+    compiled.setVariableLocations(locations);
+    CompiledExpression copy = compiled;
+    for (int i = 0; i < 5; i++) {
+        x = 0.3*i-0.5;
+        y = 1.1-0.2*i;
+        double value = compiled.evaluate();
+        ASSERT_EQUAL_TOL(x*x*exp(y)+sin(x*y), value, 1e-10);
+        ASSERT_EQUAL_TOL(value, compiled.getOutput(0), 1e-10);
+        ASSERT_EQUAL_TOL(2*x*exp(y)+y*cos(x*y), compiled.getOutput(1), 1e-10);
+        ASSERT_EQUAL_TOL(x*x*exp(y)+x*cos(x*y), compiled.getOutput(2), 1e-10);
+        ASSERT_EQUAL_TOL(y, compiled.getOutput(3), 1e-10);
+        copy.getVariableReference("x") = x;
+        copy.getVariableReference("y") = y;
+        copy.evaluate();
+        for (int j = 0; j < 4; j++)
+            ASSERT_EQUAL_TOL(compiled.getOutput(j), copy.getOutput(j), 1e-10);
+    }
+}
+
 int main() {
     try {
         verifyEvaluation("5", 5.0);
@@ -301,6 +396,8 @@ int main() {
         verifyDerivative("select(x, x^2, 3*x)", "select(x, 2*x, 3)");
         testCustomFunction("custom(x, y)/2", "x*y");
         testCustomFunction("custom(x^2, 1)+custom(2, y-1)", "2*x^2+4*(y-1)");
+        testUniformSplineFunction();
+        testMultipleOutputs();
         cout << Parser::parse("x*x").optimize() << endl;
         cout << Parser::parse("x*(x*x)").optimize() << endl;
         cout << Parser::parse("(x*x)*x").optimize() << endl;
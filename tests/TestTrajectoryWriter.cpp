@@ -0,0 +1,246 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2016 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "openmm/internal/AssertionUtilities.h"
+#include "openmm/Context.h"
+#include "openmm/HarmonicBondForce.h"
+#include "openmm/OpenMMException.h"
+#include "openmm/Platform.h"
+#include "openmm/TrajectoryWriter.h"
+#include "openmm/VerletIntegrator.h"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+using namespace OpenMM;
+using namespace std;
+
+/**
+ * Create a System of bonded pairs in a periodic box.
+ */
+System* createSystem(vector<Vec3>& positions) {
+    System* system = new System();
+    system->setDefaultPeriodicBoxVectors(Vec3(3, 0, 0), Vec3(0.5, 3, 0), Vec3(0, 0.2, 3));
+    HarmonicBondForce* bonds = new HarmonicBondForce();
+    bonds->setUsesPeriodicBoundaryConditions(true);
+    system->addForce(bonds);
+    positions.clear();
+    for (int i = 0; i < 20; i++) {
+        system->addParticle(1.0);
+        system->addParticle(1.0);
+        bonds->addBond(2*i, 2*i+1, 0.1, 1000.0);
+        Vec3 pos(0.37*i, 1.0-0.21*i, 0.13*i-0.5);
+        positions.push_back(pos);
+        positions.push_back(pos+Vec3(0.1, 0.02, 0));
+    }
+    return system;
+}
+
+int readInt(ifstream& file) {
+    int value;
+    file.read((char*) &value, 4);
+    return value;
+}
+
+void testDCD() {
+    const string filename = "TestTrajectoryWriter.dcd";
+    vector<Vec3> positions;
+    System* system = createSystem(positions);
+    VerletIntegrator integrator(0.002);
+    Context context(*system, integrator, Platform::getPlatformByName("Reference"));
+    context.setPositions(positions);
+    context.setTime(100.0);
+    vector<State> states;
+    {
+        TrajectoryWriter writer(filename, TrajectoryWriter::DCD, 5, false, 2);
+        for (int i = 0; i < 6; i++) {
+            integrator.step(5);
+            writer.writeFrame(context);
+            states.push_back(context.getState(State::Positions));
+        }
+        writer.flush();
+        ASSERT_EQUAL(6, writer.getNumFrames());
+    }
+
+    // Read the file and check its contents.
+
+    ifstream file(filename.c_str(), ios::in | ios::binary);
+    ASSERT_EQUAL(84, readInt(file));
+    char magic[4];
+    file.read(magic, 4);
+    ASSERT(strncmp(magic, "CORD", 4) == 0);
+    ASSERT_EQUAL(6, readInt(file));
+    ASSERT_EQUAL(5, readInt(file)); // The first step comes from the step count, not the time.
+    ASSERT_EQUAL(5, readInt(file));
+    ASSERT_EQUAL(35, readInt(file)); // DCDFile records the first step plus the number of frames times the interval.
+    file.seekg(48, ios::beg);
+    ASSERT_EQUAL(1, readInt(file));
+    file.seekg(268, ios::beg);
+    ASSERT_EQUAL(system->getNumParticles(), readInt(file));
+    ASSERT_EQUAL(4, readInt(file));
+    for (int frame = 0; frame < 6; frame++) {
+        ASSERT_EQUAL(48, readInt(file));
+        double box[6];
+        file.read((char*) box, sizeof(box));
+        ASSERT_EQUAL(48, readInt(file));
+        ASSERT_EQUAL_TOL(30.0, box[0], 1e-6);
+        ASSERT_EQUAL_TOL(sqrt(3.0*3.0+0.5*0.5)*10, box[2], 1e-6);
+        ASSERT_EQUAL_TOL(0.5/sqrt(3.0*3.0+0.5*0.5), box[1], 1e-6);
+        for (int i = 0; i < 3; i++) {
+            ASSERT_EQUAL(4*system->getNumParticles(), readInt(file));
+            vector<float> coords(system->getNumParticles());
+            file.read((char*) &coords[0], 4*coords.size());
+            for (int j = 0; j < system->getNumParticles(); j++)
+                ASSERT_EQUAL_TOL(10*states[frame].getPositions()[j][i], coords[j], 1e-6);
+            ASSERT_EQUAL(4*system->getNumParticles(), readInt(file));
+        }
+    }
+    file.get();
+    ASSERT(file.eof());
+    file.close();
+    remove(filename.c_str());
+    delete system;
+}
+
+void testCompressed() {
+    const string filename = "TestTrajectoryWriter.trj";
+    const double precision = 1000.0;
+    vector<Vec3> positions;
+    System* system = createSystem(positions);
+    VerletIntegrator integrator(0.002);
+    Context context(*system, integrator, Platform::getPlatformByName("Reference"));
+    context.setPositions(positions);
+    vector<State> states;
+    {
+        TrajectoryWriter writer(filename, TrajectoryWriter::Compressed, 1, false, 3, precision);
+        for (int i = 0; i < 10; i++) {
+            integrator.step(3);
+            writer.writeFrame(context);
+            states.push_back(context.getState(State::Positions));
+        }
+    }
+
+    // Read the frames back in.
+
+    ifstream file(filename.c_str(), ios::in | ios::binary);
+    vector<Vec3> framePositions;
+    Vec3 a, b, c;
+    double time;
+    for (int frame = 0; frame < 10; frame++) {
+        ASSERT(TrajectoryWriter::readCompressedFrame(file, framePositions, a, b, c, time));
+        ASSERT_EQUAL_TOL(states[frame].getTime(), time, 1e-10);
+        ASSERT_EQUAL_VEC(Vec3(3, 0, 0), a, 0);
+        ASSERT_EQUAL_VEC(Vec3(0.5, 3, 0), b, 0);
+        ASSERT_EQUAL_VEC(Vec3(0, 0.2, 3), c, 0);
+        ASSERT_EQUAL(system->getNumParticles(), framePositions.size());
+        for (int i = 0; i < system->getNumParticles(); i++)
+            for (int j = 0; j < 3; j++)
+                ASSERT(fabs(states[frame].getPositions()[i][j]-framePositions[i][j]) <= 0.5/precision+1e-10);
+    }
+    ASSERT(!TrajectoryWriter::readCompressedFrame(file, framePositions, a, b, c, time));
+
+    // The compressed file should be much smaller than the coordinates stored as floats.
+
+    file.clear();
+    file.seekg(0, ios::end);
+    ASSERT(file.tellg() < 10*12*system->getNumParticles());
+    file.close();
+    remove(filename.c_str());
+    delete system;
+}
+
+void testEnforcePeriodicBox() {
+    const string filename = "TestTrajectoryWriterPeriodic.trj";
+    vector<Vec3> positions;
+    System* system = createSystem(positions);
+    VerletIntegrator integrator(0.002);
+    Context context(*system, integrator, Platform::getPlatformByName("Reference"));
+    context.setPositions(positions);
+    {
+        TrajectoryWriter writer(filename, TrajectoryWriter::Compressed, 1, true, 1, 1e6);
+        writer.writeFrame(context);
+    }
+    State state = context.getState(State::Positions, true);
+    ifstream file(filename.c_str(), ios::in | ios::binary);
+    vector<Vec3> framePositions;
+    Vec3 a, b, c;
+    double time;
+    ASSERT(TrajectoryWriter::readCompressedFrame(file, framePositions, a, b, c, time));
+    for (int i = 0; i < system->getNumParticles(); i++)
+        ASSERT_EQUAL_VEC(state.getPositions()[i], framePositions[i], 1e-6);
+    file.close();
+    remove(filename.c_str());
+    delete system;
+}
+
+void testInvalidPositions() {
+    const string filename = "TestTrajectoryWriterInvalid.dcd";
+    vector<Vec3> positions;
+    System* system = createSystem(positions);
+    VerletIntegrator integrator(0.002);
+    Context context(*system, integrator, Platform::getPlatformByName("Reference"));
+    double invalidValues[] = {numeric_limits<double>::quiet_NaN(), numeric_limits<double>::infinity(), -numeric_limits<double>::infinity()};
+    for (int i = 0; i < 3; i++) {
+        positions[3][1] = invalidValues[i];
+        context.setPositions(positions);
+        TrajectoryWriter writer(filename, TrajectoryWriter::DCD);
+        writer.writeFrame(context);
+        bool threwException = false;
+        try {
+            writer.flush();
+        }
+        catch (OpenMMException& ex) {
+            threwException = true;
+        }
+        ASSERT(threwException);
+    }
+    remove(filename.c_str());
+    delete system;
+}
+
+int main() {
+    try {
+        testDCD();
+        testCompressed();
+        testEnforcePeriodicBox();
+        testInvalidPositions();
+    }
+    catch(const exception& e) {
+        cout << "exception: " << e.what() << endl;
+        return 1;
+    }
+    cout << "Done" << endl;
+    return 0;
+}
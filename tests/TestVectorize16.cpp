@@ -0,0 +1,273 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2014-2016 Stanford University and the Authors.      *
+ * Authors: Robert T. McGibbon                                                *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+/**
+ * This tests vectorized operations.
+ */
+
+#include "openmm/internal/AssertionUtilities.h"
+#include "openmm/internal/hardware.h"
+#include <iostream>
+
+#ifndef __AVX512F__
+bool isVec16Supported() {
+    return false;
+}
+#else
+#include "openmm/internal/vectorize16.h"
+
+/**
+ * Check whether 16 component vectors are supported with the current CPU.
+ */
+bool isVec16Supported() {
+    // Make sure the CPU and operating system support AVX-512F.
+
+    int cpuInfo[4];
+    cpuid(cpuInfo, 0);
+    if (cpuInfo[0] < 7)
+        return false;
+    cpuidex(cpuInfo, 7, 0);
+    if ((cpuInfo[1] & ((int) 1 << 16)) == 0)
+        return false;
+    cpuid(cpuInfo, 1);
+    if ((cpuInfo[2] & ((int) 1 << 27)) == 0)
+        return false;
+    return ((xgetbv(0) & 0xE6) == 0xE6);
+}
+#endif
+
+using namespace OpenMM;
+using namespace std;
+
+#ifdef __AVX512F__
+
+#define ASSERT_VEC4_EQUAL(found, expected0, expected1, expected2, expected3) {if (std::abs((found)[0]-(expected0))>1e-6 || std::abs((found)[1]-(expected1))>1e-6 || std::abs((found)[2]-(expected2))>1e-6 || std::abs((found)[3]-(expected3))>1e-6) {std::stringstream details; details << " Expected ("<<(expected0)<<","<<(expected1)<<","<<(expected2)<<","<<(expected3)<<"), found ("<<(found)[0]<<","<<(found)[1]<<","<<(found)[2]<<","<<(found)[3]<<")"; throwException(__FILE__, __LINE__, details.str());}};
+
+/**
+ * Compare every element of an fvec16 to the expected values.
+ */
+void assertVec16Equal(const fvec16& found, const float* expected, int line) {
+    float values[16];
+    found.store(values);
+    for (int i = 0; i < 16; i++)
+        if (!(std::abs(values[i]-expected[i]) <= 1e-6)) {
+            std::stringstream details;
+            details << " Element " << i << ": expected " << expected[i] << ", found " << values[i];
+            throwException(__FILE__, line, details.str());
+        }
+}
+
+/**
+ * Compare every element of an ivec16 to the expected values.
+ */
+void assertVec16EqualInt(const ivec16& found, const int* expected, int line) {
+    int values[16];
+    found.store(values);
+    for (int i = 0; i < 16; i++)
+        if (values[i] != expected[i]) {
+            std::stringstream details;
+            details << " Element " << i << ": expected " << expected[i] << ", found " << values[i];
+            throwException(__FILE__, line, details.str());
+        }
+}
+
+#define ASSERT_VEC16_EQUAL(found, ...) {float expected[] = {__VA_ARGS__}; assertVec16Equal(found, expected, __LINE__);}
+#define ASSERT_VEC16_EQUAL_INT(found, ...) {int expected[] = {__VA_ARGS__}; assertVec16EqualInt(found, expected, __LINE__);}
+
+void testLoadStore() {
+    fvec16 f1(2.0f);
+    ivec16 i1(3);
+    ASSERT_VEC16_EQUAL(f1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2);
+    ASSERT_VEC16_EQUAL_INT(i1, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3);
+    fvec16 f2(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    ivec16 i2(2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17);
+    ASSERT_VEC16_EQUAL(f2, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    ASSERT_VEC16_EQUAL_INT(i2, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17);
+    float farray[16];
+    int iarray[16];
+    f2.store(farray);
+    i2.store(iarray);
+    fvec16 f3(farray);
+    ivec16 i3(iarray);
+    ASSERT_VEC16_EQUAL(f3, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    ASSERT_VEC16_EQUAL_INT(i3, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17);
+    ASSERT_EQUAL(f3.lowerVec().lowerVec()[1], 1.0);
+    ASSERT_EQUAL(f3.lowerVec().upperVec()[2], 6.0);
+    ASSERT_EQUAL(f3.upperVec().lowerVec()[0], 8.0);
+    ASSERT_EQUAL(f3.upperVec().upperVec()[3], 15.0);
+    ASSERT_EQUAL(i3.lowerVec().lowerVec()[1], 3);
+    ASSERT_EQUAL(i3.upperVec().upperVec()[3], 17);
+}
+
+void testArithmetic() {
+    fvec16 f1(0.5, 1.0, 1.5, 2.0, 2.5, 3.0, 3.5, 4.0, 4.5, 5.0, 5.5, 6.0, 6.5, 7.0, 7.5, 8.0);
+    fvec16 f2(1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16);
+    ASSERT_VEC16_EQUAL(f1+f2, 1.5, 3, 4.5, 6, 7.5, 9, 10.5, 12, 13.5, 15, 16.5, 18, 19.5, 21, 22.5, 24);
+    ASSERT_VEC16_EQUAL(f1-f2, -0.5, -1, -1.5, -2, -2.5, -3, -3.5, -4, -4.5, -5, -5.5, -6, -6.5, -7, -7.5, -8);
+    ASSERT_VEC16_EQUAL(f1*f2, 0.5, 2, 4.5, 8, 12.5, 18, 24.5, 32, 40.5, 50, 60.5, 72, 84.5, 98, 112.5, 128);
+    ASSERT_VEC16_EQUAL(f1/f2, 0.5, 0.5, 0.5, 0.5, 0.5, 0.5, 0.5, 0.5, 0.5, 0.5, 0.5, 0.5, 0.5, 0.5, 0.5, 0.5);
+    ASSERT_VEC16_EQUAL(-f1, -0.5, -1.0, -1.5, -2.0, -2.5, -3.0, -3.5, -4.0, -4.5, -5.0, -5.5, -6.0, -6.5, -7.0, -7.5, -8.0);
+    fvec16 f3 = f1;
+    f3 += f2;
+    ASSERT_VEC16_EQUAL(f3, 1.5, 3, 4.5, 6, 7.5, 9, 10.5, 12, 13.5, 15, 16.5, 18, 19.5, 21, 22.5, 24);
+    f3 = f1;
+    f3 -= f2;
+    ASSERT_VEC16_EQUAL(f3, -0.5, -1, -1.5, -2, -2.5, -3, -3.5, -4, -4.5, -5, -5.5, -6, -6.5, -7, -7.5, -8);
+    f3 = f1;
+    f3 *= f2;
+    ASSERT_VEC16_EQUAL(f3, 0.5, 2, 4.5, 8, 12.5, 18, 24.5, 32, 40.5, 50, 60.5, 72, 84.5, 98, 112.5, 128);
+    f3 = f1;
+    f3 /= f2;
+    ASSERT_VEC16_EQUAL(f3, 0.5, 0.5, 0.5, 0.5, 0.5, 0.5, 0.5, 0.5, 0.5, 0.5, 0.5, 0.5, 0.5, 0.5, 0.5, 0.5);
+    ASSERT_VEC16_EQUAL(2.0f*f1, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16);
+    ASSERT_VEC16_EQUAL_INT(ivec16(f1*4.0f)+ivec16(1), 3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 29, 31, 33);
+}
+
+void testLogic() {
+    int allBits = -1;
+    ivec16 mask = ivec16::fromBitMask(0x6666);
+    ASSERT_VEC16_EQUAL_INT(mask, 0, allBits, allBits, 0, 0, allBits, allBits, 0, 0, allBits, allBits, 0, 0, allBits, allBits, 0);
+    fvec16 f1(0.5, 1.0, 1.5, 2.0, 2.5, 3.0, 3.5, 4.0, 4.5, 5.0, 5.5, 6.0, 6.5, 7.0, 7.5, 8.0);
+    ivec16 i1(1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16);
+    fvec16 fmask = _mm512_castsi512_ps(mask);
+    ASSERT_VEC16_EQUAL(f1&fmask, 0, 1.0, 1.5, 0, 0, 3.0, 3.5, 0, 0, 5.0, 5.5, 0, 0, 7.0, 7.5, 0);
+    float temp[16];
+    (f1|fmask).store(temp);
+    for (int i = 0; i < 16; i++) {
+        if (i%4 == 1 || i%4 == 2) {
+            ASSERT(temp[i] != temp[i]); // All bits set, which is nan
+        }
+        else {
+            ASSERT_EQUAL(0.5*(i+1), temp[i]);
+        }
+    }
+    ASSERT_VEC16_EQUAL_INT(i1&mask, 0, 2, 3, 0, 0, 6, 7, 0, 0, 10, 11, 0, 0, 14, 15, 0);
+    ASSERT_VEC16_EQUAL_INT(i1|mask, 1, allBits, allBits, 4, 5, allBits, allBits, 8, 9, allBits, allBits, 12, 13, allBits, allBits, 16);
+}
+
+void testComparisons() {
+    fvec16 v1(0.0f);
+    fvec16 v2(1.5f);
+    fvec16 a(1.0, 1.5, 3.0, 2.2, 10.0, 10.5, 13.0, 12.2, 1.0, 1.5, 3.0, 2.2, 10.0, 10.5, 13.0, 12.2);
+    fvec16 b(1.1, 1.5, 3.0, 2.1, 10.1, 10.5, 13.0, 12.1, 1.1, 1.5, 3.0, 2.1, 10.1, 10.5, 13.0, 12.1);
+    ASSERT_VEC16_EQUAL(blend(v1, v2, a==b), 0.0, 1.5, 1.5, 0.0, 0.0, 1.5, 1.5, 0.0, 0.0, 1.5, 1.5, 0.0, 0.0, 1.5, 1.5, 0.0);
+    ASSERT_VEC16_EQUAL(blend(v1, v2, a!=b), 1.5, 0.0, 0.0, 1.5, 1.5, 0.0, 0.0, 1.5, 1.5, 0.0, 0.0, 1.5, 1.5, 0.0, 0.0, 1.5);
+    ASSERT_VEC16_EQUAL(blend(v1, v2, a<b), 1.5, 0.0, 0.0, 0.0, 1.5, 0.0, 0.0, 0.0, 1.5, 0.0, 0.0, 0.0, 1.5, 0.0, 0.0, 0.0);
+    ASSERT_VEC16_EQUAL(blend(v1, v2, a>b), 0.0, 0.0, 0.0, 1.5, 0.0, 0.0, 0.0, 1.5, 0.0, 0.0, 0.0, 1.5, 0.0, 0.0, 0.0, 1.5);
+    ASSERT_VEC16_EQUAL(blend(v1, v2, a<=b), 1.5, 1.5, 1.5, 0.0, 1.5, 1.5, 1.5, 0.0, 1.5, 1.5, 1.5, 0.0, 1.5, 1.5, 1.5, 0.0);
+    ASSERT_VEC16_EQUAL(blend(v1, v2, a>=b), 0.0, 1.5, 1.5, 1.5, 0.0, 1.5, 1.5, 1.5, 0.0, 1.5, 1.5, 1.5, 0.0, 1.5, 1.5, 1.5);
+
+    // Combining an exclusion mask with a comparison, as is done in the nonbonded kernel.
+
+    ivec16 include = ivec16::fromBitMask(~0x00F0) & (a < b);
+    ASSERT_VEC16_EQUAL(blend(v1, v2, include), 1.5, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 1.5, 0.0, 0.0, 0.0, 1.5, 0.0, 0.0, 0.0);
+    ASSERT(any(include));
+    ASSERT(!any(ivec16::fromBitMask(~0x1111) & (a < b)));
+}
+
+void testMathFunctions() {
+    fvec16 f1(0.4, 1.9, -1.2, -3.8, 0.4, 1.9, -1.2, -3.8, 0.4, 1.9, -1.2, -3.8, 0.4, 1.9, -1.2, -3.8);
+    fvec16 f2(1.1, 1.2, 1.3, -5.0, 1.1, 1.2, 1.3, -5.0, 1.1, 1.2, 1.3, -5.0, 1.1, 1.2, 1.3, -5.0);
+    ASSERT_VEC16_EQUAL(floor(f1), 0.0, 1.0, -2.0, -4.0, 0.0, 1.0, -2.0, -4.0, 0.0, 1.0, -2.0, -4.0, 0.0, 1.0, -2.0, -4.0);
+    ASSERT_VEC16_EQUAL(ceil(f1), 1.0, 2.0, -1.0, -3.0, 1.0, 2.0, -1.0, -3.0, 1.0, 2.0, -1.0, -3.0, 1.0, 2.0, -1.0, -3.0);
+    ASSERT_VEC16_EQUAL(round(f1), 0.0, 2.0, -1.0, -4.0, 0.0, 2.0, -1.0, -4.0, 0.0, 2.0, -1.0, -4.0, 0.0, 2.0, -1.0, -4.0);
+    ASSERT_VEC16_EQUAL(abs(f1), 0.4, 1.9, 1.2, 3.8, 0.4, 1.9, 1.2, 3.8, 0.4, 1.9, 1.2, 3.8, 0.4, 1.9, 1.2, 3.8);
+    ASSERT_VEC16_EQUAL(min(f1, f2), 0.4, 1.2, -1.2, -5.0, 0.4, 1.2, -1.2, -5.0, 0.4, 1.2, -1.2, -5.0, 0.4, 1.2, -1.2, -5.0);
+    ASSERT_VEC16_EQUAL(max(f1, f2), 1.1, 1.9, 1.3, -3.8, 1.1, 1.9, 1.3, -3.8, 1.1, 1.9, 1.3, -3.8, 1.1, 1.9, 1.3, -3.8);
+    fvec16 f3(1.5, 3.1, 4.0, 15.0, 1.5, 3.1, 4.0, 15.0, 1.5, 3.1, 4.0, 15.0, 1.5, 3.1, 4.0, 15.0);
+    float s[] = {sqrtf(1.5f), sqrtf(3.1f), sqrtf(4.0f), sqrtf(15.0f)};
+    ASSERT_VEC16_EQUAL(sqrt(f3), s[0], s[1], s[2], s[3], s[0], s[1], s[2], s[3], s[0], s[1], s[2], s[3], s[0], s[1], s[2], s[3]);
+    ASSERT_VEC16_EQUAL(rsqrt(f3), 1/s[0], 1/s[1], 1/s[2], 1/s[3], 1/s[0], 1/s[1], 1/s[2], 1/s[3], 1/s[0], 1/s[1], 1/s[2], 1/s[3], 1/s[0], 1/s[1], 1/s[2], 1/s[3]);
+    float v1[16], v2[16];
+    f1.store(v1);
+    f2.store(v2);
+    float expectedDot = 0;
+    for (int i = 0; i < 16; i++)
+        expectedDot += v1[i]*v2[i];
+    ASSERT_EQUAL_TOL(expectedDot, dot16(f1, f2), 1e-6);
+    ASSERT(any(f1 > 0.5f));
+    ASSERT(!any(f1 > 2.0f));
+    ASSERT_VEC16_EQUAL(blend(f1, f2, ivec16::fromBitMask(0x5555)), 1.1, 1.9, 1.3, -3.8, 1.1, 1.9, 1.3, -3.8, 1.1, 1.9, 1.3, -3.8, 1.1, 1.9, 1.3, -3.8);
+    ASSERT_VEC16_EQUAL_INT(min(ivec16(f2), ivec16(1)), 1, 1, 1, -5, 1, 1, 1, -5, 1, 1, 1, -5, 1, 1, 1, -5);
+    ASSERT_VEC16_EQUAL_INT(max(ivec16(f1), ivec16(0)), 0, 1, 0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0, 1, 0, 0);
+}
+
+void testGather() {
+    float table[41];
+    for (int i = 0; i < 41; i++)
+        table[i] = 0.5f*i;
+    ivec16 index(0, 3, 39, 7, 12, 12, 1, 20, 33, 2, 5, 8, 13, 21, 34, 38);
+    ASSERT_VEC16_EQUAL(gather(table, index), 0.0, 1.5, 19.5, 3.5, 6.0, 6.0, 0.5, 10.0, 16.5, 1.0, 2.5, 4.0, 6.5, 10.5, 17.0, 19.0);
+    ASSERT_VEC16_EQUAL(gather(&table[1], index), 0.5, 2.0, 20.0, 4.0, 6.5, 6.5, 1.0, 10.5, 17.0, 1.5, 3.0, 4.5, 7.0, 11.0, 17.5, 19.5);
+}
+
+void testTranspose() {
+    fvec4 in[16];
+    for (int i = 0; i < 16; i++)
+        in[i] = fvec4(10.0f*i, 10.0f*i+1, 10.0f*i+2, 10.0f*i+3);
+    fvec16 o1, o2, o3, o4;
+    transpose(in, o1, o2, o3, o4);
+    ASSERT_VEC16_EQUAL(o1, 0, 10, 20, 30, 40, 50, 60, 70, 80, 90, 100, 110, 120, 130, 140, 150);
+    ASSERT_VEC16_EQUAL(o2, 1, 11, 21, 31, 41, 51, 61, 71, 81, 91, 101, 111, 121, 131, 141, 151);
+    ASSERT_VEC16_EQUAL(o3, 2, 12, 22, 32, 42, 52, 62, 72, 82, 92, 102, 112, 122, 132, 142, 152);
+    ASSERT_VEC16_EQUAL(o4, 3, 13, 23, 33, 43, 53, 63, 73, 83, 93, 103, 113, 123, 133, 143, 153);
+
+    fvec4 out[16];
+    transpose(o1, o2, o3, o4, out);
+    for (int i = 0; i < 16; i++)
+        ASSERT_VEC4_EQUAL(out[i], 10.0f*i, 10.0f*i+1, 10.0f*i+2, 10.0f*i+3);
+}
+
+#endif
+
+int main(int argc, char* argv[]) {
+    try {
+        if (!isVec16Supported()) {
+            cout << "CPU is not supported.  Exiting." << endl;
+            return 0;
+        }
+#ifdef __AVX512F__
+        testLoadStore();
+        testArithmetic();
+        testLogic();
+        testComparisons();
+        testMathFunctions();
+        testGather();
+        testTranspose();
+#endif
+    }
+    catch(const exception& e) {
+        cout << "exception: " << e.what() << endl;
+        return 1;
+    }
+    cout << "Done" << endl;
+    return 0;
+}
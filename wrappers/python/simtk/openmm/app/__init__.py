@@ -29,6 +29,8 @@ from .statedatareporter import StateDataReporter
 from .element import Element
 from .desmonddmsfile import DesmondDMSFile
 from .checkpointreporter import CheckpointReporter
+from .trajectoryreporter import TrajectoryReporter
+from .compressedtrajectoryfile import CompressedTrajectoryFile
 from .charmmcrdfiles import CharmmCrdFile, CharmmRstFile
 from .charmmparameterset import CharmmParameterSet
 from .charmmpsffile import CharmmPsfFile, CharmmPSFWarning
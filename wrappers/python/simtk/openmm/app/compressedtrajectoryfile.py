@@ -0,0 +1,127 @@
+"""
+compressedtrajectoryfile.py: Used for reading compressed trajectory files.
+
+This is part of the OpenMM molecular simulation toolkit originating from
+Simbios, the NIH National Center for Physics-Based Simulation of
+Biological Structures at Stanford, funded under the NIH Roadmap for
+Medical Research, grant U54 GM072970. See https://simtk.org.
+
+Portions copyright (c) 2026 Stanford University and the Authors.
+Authors: Peter Eastman
+Contributors:
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+USE OR OTHER DEALINGS IN THE SOFTWARE.
+"""
+from __future__ import absolute_import
+__author__ = "Peter Eastman"
+__version__ = "1.0"
+
+import struct
+from simtk.unit import picoseconds, nanometers
+from simtk.openmm import Vec3
+
+class CompressedTrajectoryFile(object):
+    """CompressedTrajectoryFile reads trajectories written by TrajectoryWriter (or TrajectoryReporter)
+    in the compressed format.
+
+    Each frame stores the particle positions rounded to a fixed precision, the periodic box vectors, and
+    the simulation time.  To use this class, create a CompressedTrajectoryFile object, then call readFrame()
+    repeatedly until it returns None, or simply iterate over the object."""
+
+    def __init__(self, file):
+        """Open a compressed trajectory file for reading.
+
+        Parameters
+        ----------
+        file : string or file
+            The name of the file to read, or a file object opened in binary mode
+        """
+        if isinstance(file, str):
+            self._file = open(file, 'rb')
+            self._ownsFile = True
+        else:
+            self._file = file
+            self._ownsFile = False
+
+    def readFrame(self):
+        """Read the next frame from the file.
+
+        Returns
+        -------
+        tuple
+            A three element tuple containing the positions, the periodic box vectors, and the simulation time.
+            If the end of the file has been reached, this returns None instead.
+        """
+        header = self._file.read(100)
+        if len(header) == 0:
+            return None
+        if len(header) < 4 or header[:4] != b'OMMZ':
+            raise ValueError('The file does not contain a compressed trajectory frame')
+        if len(header) != 100:
+            raise ValueError('Trajectory data is corrupted')
+        numParticles, precision, time = struct.unpack('<idd', header[4:24])
+        box = struct.unpack('<9d', header[24:96])
+        size = struct.unpack('<i', header[96:100])[0]
+        if numParticles < 0 or size < 0 or not precision > 0:
+            raise ValueError('Trajectory data is corrupted')
+        data = bytearray(self._file.read(size))
+        if len(data) != size:
+            raise ValueError('Trajectory data is corrupted')
+
+        # Decode the coordinates.  Each one is a variable length, zigzag encoded difference from the same
+        # coordinate of the previous particle.
+
+        scale = 1.0/precision
+        last = [0, 0, 0]
+        positions = []
+        pos = 0
+        for i in range(numParticles):
+            coords = [0.0, 0.0, 0.0]
+            for j in range(3):
+                code = 0
+                shift = 0
+                while True:
+                    if pos == size:
+                        raise ValueError('Trajectory data is corrupted')
+                    byte = data[pos]
+                    pos += 1
+                    code |= (byte&0x7F)<<shift
+                    shift += 7
+                    if byte&0x80 == 0:
+                        break
+                delta = -(code>>1)-1 if code&1 else code>>1
+                last[j] += delta
+                coords[j] = last[j]*scale
+            positions.append(Vec3(*coords))
+        if pos != size:
+            raise ValueError('Trajectory data is corrupted')
+        boxVectors = (Vec3(*box[0:3]), Vec3(*box[3:6]), Vec3(*box[6:9]))*nanometers
+        return (positions*nanometers, boxVectors, time*picoseconds)
+
+    def __iter__(self):
+        while True:
+            frame = self.readFrame()
+            if frame is None:
+                break
+            yield frame
+
+    def close(self):
+        """Close the file, if it was opened by this object."""
+        if self._ownsFile:
+            self._file.close()
@@ -0,0 +1,126 @@
+"""
+trajectoryreporter.py: Outputs simulation trajectories using a background writer thread
+
+This is part of the OpenMM molecular simulation toolkit originating from
+Simbios, the NIH National Center for Physics-Based Simulation of
+Biological Structures at Stanford, funded under the NIH Roadmap for
+Medical Research, grant U54 GM072970. See https://simtk.org.
+
+Portions copyright (c) 2016 Stanford University and the Authors.
+Authors: Peter Eastman
+Contributors:
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+USE OR OTHER DEALINGS IN THE SOFTWARE.
+"""
+from __future__ import absolute_import
+__author__ = "Peter Eastman"
+__version__ = "1.0"
+
+import simtk.openmm as mm
+__all__ = ['TrajectoryReporter']
+
+
+class TrajectoryReporter(object):
+    """TrajectoryReporter outputs a series of frames from a Simulation to a DCD
+    or compressed trajectory file.
+
+    Unlike DCDReporter, this does not retrieve a State for each frame.  Positions
+    are copied directly out of the Context into a buffer, and a background thread
+    formats them and writes them to disk while the simulation continues.  Files
+    in the compressed format can be read with CompressedTrajectoryFile.
+
+    To use it, create a TrajectoryReporter, then add it to the Simulation's list
+    of reporters.
+    """
+
+    def __init__(self, file, reportInterval, format='dcd', enforcePeriodicBox=None, bufferSize=4):
+        """Create a TrajectoryReporter.
+
+        Parameters
+        ----------
+        file : string
+            The file to write to
+        reportInterval : int
+            The interval (in time steps) at which to write frames
+        format : string='dcd'
+            The file format to write, either 'dcd' or 'compressed'
+        enforcePeriodicBox : bool
+            Specifies whether particle positions should be translated so the
+            center of every molecule lies in the same periodic box.  If None
+            (the default), it will automatically decide whether to translate
+            molecules based on whether the system being simulated uses periodic
+            boundary conditions.
+        bufferSize : int=4
+            The number of frames that may be waiting to be written before
+            writing a new frame blocks the simulation
+        """
+        formats = {'dcd': mm.TrajectoryWriter.DCD, 'compressed': mm.TrajectoryWriter.Compressed}
+        if format.lower() not in formats:
+            raise ValueError('Unknown trajectory format: %s' % format)
+        self._file = file
+        self._reportInterval = reportInterval
+        self._format = formats[format.lower()]
+        self._enforcePeriodicBox = enforcePeriodicBox
+        self._bufferSize = bufferSize
+        self._writer = None
+
+    def describeNextReport(self, simulation):
+        """Get information about the next report this object will generate.
+
+        Parameters
+        ----------
+        simulation : Simulation
+            The Simulation to generate a report for
+
+        Returns
+        -------
+        tuple
+            A five element tuple. The first element is the number of steps
+            until the next report. The remaining elements specify whether
+            that report will require positions, velocities, forces, and
+            energies respectively.
+        """
+        steps = self._reportInterval - simulation.currentStep%self._reportInterval
+        return (steps, False, False, False, False)
+
+    def report(self, simulation, state):
+        """Generate a report.
+
+        Parameters
+        ----------
+        simulation : Simulation
+            The Simulation to generate a report for
+        state : State
+            The current state of the simulation
+        """
+        if self._writer is None:
+            if self._enforcePeriodicBox is None:
+                enforcePeriodicBox = simulation._usesPBC
+            else:
+                enforcePeriodicBox = self._enforcePeriodicBox
+            self._writer = mm.TrajectoryWriter(self._file, self._format, self._reportInterval, enforcePeriodicBox, self._bufferSize)
+        self._writer.writeFrame(simulation.context)
+
+    def flush(self):
+        """Block until every frame that has been reported so far has been written to disk."""
+        if self._writer is not None:
+            self._writer.flush()
+
+    def __del__(self):
+        self._writer = None
@@ -50,6 +50,7 @@ SKIP_METHODS = [('State',),
                 ('CalcPeriodicTorsionForceKernel',),
                 ('CalcRBTorsionForceKernel',),
                 ('ComputationInfo',),
+                ('ContextGroup',),
                 ('ConstraintInfo',),
                 ('CudaKernelFactory',),
                 ('CudaStreamFactory',),
@@ -91,6 +92,8 @@ SKIP_METHODS = [('State',),
                 ('Context',  'setState'),
                 ('Context',  'createCheckpoint'),
                 ('Context',  'loadCheckpoint'),
+                ('Context',  'createCheckpointAsync'),
+                ('TrajectoryWriter',  'readCompressedFrame'),
                 ('CudaPlatform',),
                 ('Force',    'Force'),
                 ('ParticleParameterInfo',),
@@ -113,6 +116,7 @@ SKIP_METHODS = [('State',),
 # The build script assumes method args that are non-const references are
 # used to output values. This list gives excpetions to this rule.
 NO_OUTPUT_ARGS = [('LocalEnergyMinimizer', 'minimize', 'context'),
+                  ('TrajectoryWriter', 'writeFrame', 'context'),
                   ('System', 'getDefaultPeriodicBoxVectors', 'a'),
                   ('System', 'getDefaultPeriodicBoxVectors', 'b'),
                   ('System', 'getDefaultPeriodicBoxVectors', 'c'),
@@ -374,6 +378,7 @@ UNITS = {
 ("CustomNonbondedForce", "getExceptionParameters") : (None, ()),
 ("CustomNonbondedForce", "getExclusionParticles") : (None, ()),
 ("CustomNonbondedForce", "getFunctionParameters") : (None, ()),
+("CustomNonbondedForce", "getLongRangeCorrectionTable") : (None, ()),
 ("CustomNonbondedForce", "getGlobalParameterName") : (None, ()),
 ("CustomNonbondedForce", "getNumExclusions") : (None, ()),
 ("CustomNonbondedForce", "getNumFunctions") : (None, ()),
@@ -0,0 +1,75 @@
+import os
+import struct
+import unittest
+import tempfile
+from simtk.openmm import app
+import simtk.openmm as mm
+from simtk import unit
+
+
+class TestTrajectoryReporter(unittest.TestCase):
+    def setUp(self):
+        with open('systems/alanine-dipeptide-implicit.pdb') as f:
+            pdb = app.PDBFile(f)
+        forcefield = app.ForceField('amber99sbildn.xml')
+        system = forcefield.createSystem(pdb.topology,
+            nonbondedMethod=app.CutoffNonPeriodic, nonbondedCutoff=1.0*unit.nanometers,
+            constraints=app.HBonds)
+        self.simulation = app.Simulation(pdb.topology, system, mm.VerletIntegrator(0.002*unit.picoseconds))
+        self.simulation.context.setPositions(pdb.positions)
+
+    def test_dcd(self):
+        file = tempfile.NamedTemporaryFile(suffix='.dcd', delete=False)
+        file.close()
+        reporter = app.TrajectoryReporter(file.name, 2)
+        self.simulation.reporters.append(reporter)
+        self.simulation.step(10)
+        reporter.flush()
+
+        # There is no DCD reader, so just check the header and the file size.
+
+        self.simulation.reporters = []
+        del reporter
+        with open(file.name, 'rb') as f:
+            data = f.read()
+        os.unlink(file.name)
+        self.assertEqual(b'CORD', data[4:8])
+        self.assertEqual((5, 2, 2, 12), struct.unpack('<4i', data[8:24]))
+        numAtoms = self.simulation.topology.getNumAtoms()
+        self.assertEqual(276+5*(3*(4*numAtoms+8)), len(data))
+
+    def test_compressed(self):
+        file = tempfile.NamedTemporaryFile(suffix='.trj', delete=False)
+        file.close()
+        reporter = app.TrajectoryReporter(file.name, 2, format='compressed')
+        self.simulation.reporters.append(reporter)
+        states = []
+        for i in range(5):
+            self.simulation.step(2)
+            states.append(self.simulation.context.getState(getPositions=True))
+        reporter.flush()
+        self.simulation.reporters = []
+        del reporter
+
+        # Read the frames back in and compare them to the States.
+
+        trajectory = app.CompressedTrajectoryFile(file.name)
+        frames = list(trajectory)
+        trajectory.close()
+        os.unlink(file.name)
+        self.assertEqual(5, len(frames))
+        for state, (positions, boxVectors, time) in zip(states, frames):
+            self.assertAlmostEqual(state.getTime().value_in_unit(unit.picoseconds), time.value_in_unit(unit.picoseconds))
+            expected = state.getPositions().value_in_unit(unit.nanometers)
+            actual = positions.value_in_unit(unit.nanometers)
+            self.assertEqual(len(expected), len(actual))
+            for p1, p2 in zip(expected, actual):
+                for j in range(3):
+                    self.assertTrue(abs(p1[j]-p2[j]) <= 0.0005+1e-10)
+
+    def test_invalidFormat(self):
+        with self.assertRaises(ValueError):
+            app.TrajectoryReporter('test.xyz', 1, format='xyz')
+
+if __name__ == '__main__':
+    unittest.main()